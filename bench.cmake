@@ -0,0 +1,152 @@
+#~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+# bench.cmake - the bench target (see CMakeLists.txt).
+# Generates the inputs in WORK_DIR and times grep on them. BENCH
+# is a list of the benchmarks to run, or "all":
+#	wildcard	-W: patterns made to backtrack (*a*a*a*b) on long
+#				lines, and thousands of patterns in one set
+#	prefetch	-R over thousands of small files, read ahead
+#				(--async) and one after the other (--async=0)
+#	lib			grep_compiled in process (grep_libbench, given as
+#				LIBBENCH) against a grep run for each search
+# Each search is run REPEAT times and the best time is reported.
+#~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+# string(TIMESTAMP) has microseconds (%f) from 3.23 on
+cmake_minimum_required(VERSION 3.23)
+
+if(NOT GREP OR NOT EXISTS "${GREP}")
+	message(FATAL_ERROR "GREP is not the grep binary: '${GREP}'")
+endif()
+if(NOT BENCH OR BENCH STREQUAL "all")
+	set(BENCH wildcard prefetch lib)
+endif()
+if(NOT REPEAT)
+	set(REPEAT 3)
+endif()
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+# bench_time(name command...): runs the command REPEAT times and
+# reports the best wall time. A search finding nothing is fine.
+function(bench_time sName)
+	set(nBest -1)
+	foreach(i RANGE 1 ${REPEAT})
+		string(TIMESTAMP t0 "%s%f")
+		execute_process(COMMAND ${ARGN} OUTPUT_QUIET ERROR_QUIET)
+		string(TIMESTAMP t1 "%s%f")
+		math(EXPR nTime "(${t1} - ${t0}) / 1000")
+		if(nBest EQUAL -1 OR nTime LESS nBest)
+			set(nBest ${nTime})
+		endif()
+	endforeach()
+	message(STATUS "${sName}: ${nBest} ms")
+endfunction()
+
+# bench_words(var count): count random lowercase words, 3 to 9
+# chars, the same ones each run
+function(bench_words var nCount)
+	set(words "")
+	foreach(i RANGE 1 ${nCount})
+		math(EXPR nLen "3 + ${i} % 7")
+		string(RANDOM LENGTH ${nLen} ALPHABET "abcdefghijklmnopqrstuvwxyz"
+			   RANDOM_SEED ${i} sWord)
+		list(APPEND words "${sWord}")
+	endforeach()
+	set(${var} "${words}" PARENT_SCOPE)
+endfunction()
+
+#-----------------------------------------------------------------
+# wildcard: a line of a's has a match of every segment of *a*a*a*b
+# but the last everywhere; a backtracking matcher tries each way to
+# place them. 64 lines of 64K, then 3,000 two-word patterns over
+# 1M of words, where most lines match no pattern.
+#-----------------------------------------------------------------
+if("wildcard" IN_LIST BENCH)
+	message(STATUS "wildcard")
+	string(REPEAT "a" 65536 sLine)
+	string(REPEAT "${sLine}\n" 64 sText)
+	file(WRITE "${WORK_DIR}/wild_a.txt" "${sText}")
+	bench_time("  *a*a*a*b, 4M of a's" "${GREP}" -W -c "*a*a*a*b" "${WORK_DIR}/wild_a.txt")
+	bench_time("  *a*a*a*a*a*a*a*a*b -i, 4M of a's"
+			   "${GREP}" -W -c -i "*a*a*a*a*a*a*a*a*b" "${WORK_DIR}/wild_a.txt")
+	bench_time("  *a*a*a*b -x, 4M of a's" "${GREP}" -W -c -x "*a*a*a*b" "${WORK_DIR}/wild_a.txt")
+
+	bench_words(words 2000)
+	set(sPatterns "")
+	foreach(i RANGE 1 3000)
+		math(EXPR i1 "(${i} * 7919) % 2000")
+		math(EXPR i2 "(${i} * 104729 + 13) % 2000")
+		list(GET words ${i1} w1)
+		list(GET words ${i2} w2)
+		string(APPEND sPatterns "${w1}*${w2}?\n")
+	endforeach()
+	file(WRITE "${WORK_DIR}/wild_pats.txt" "${sPatterns}")
+	set(sLines "")
+	foreach(i RANGE 0 1999 16)
+		list(SUBLIST words ${i} 16 line)
+		list(JOIN line " " sLine)
+		string(APPEND sLines "${sLine}\n")
+	endforeach()
+	string(REPEAT "${sLines}" 80 sText)
+	file(WRITE "${WORK_DIR}/wild_words.txt" "${sText}")
+	bench_time("  3000 patterns, 1M of words"
+			   "${GREP}" -W -c -f "${WORK_DIR}/wild_pats.txt" "${WORK_DIR}/wild_words.txt")
+endif()
+
+#-----------------------------------------------------------------
+# prefetch: 4,000 files of 1 to 12K in 40 directories, searched
+# with the files read ahead and without. The first run reads them
+# into the file cache; with a cold cache the reads ahead gain more.
+#-----------------------------------------------------------------
+if("prefetch" IN_LIST BENCH)
+	message(STATUS "prefetch")
+	bench_words(words 200)
+	list(JOIN words " " sWords)
+	set(sWords "${sWords}\n")
+	if(NOT EXISTS "${WORK_DIR}/files/d39/f99.txt")
+		foreach(i RANGE 0 7)
+			math(EXPR nCopies "${i} + 1")
+			string(REPEAT "${sWords}" ${nCopies} sText${i})
+		endforeach()
+		foreach(d RANGE 0 39)
+			foreach(f RANGE 0 99)
+				math(EXPR i "(${d} * 100 + ${f}) % 8")
+				file(WRITE "${WORK_DIR}/files/d${d}/f${f}.txt" "${sText${i}}")
+			endforeach()
+		endforeach()
+	endif()
+	bench_time("  -R, --async=0" "${GREP}" --async=0 -R -c zzzz "${WORK_DIR}/files/*")
+	bench_time("  -R, --async=32" "${GREP}" --async=32 -R -c zzzz "${WORK_DIR}/files/*")
+	bench_time("  -R, --async=256" "${GREP}" --async=256 -R -c zzzz "${WORK_DIR}/files/*")
+endif()
+
+#-----------------------------------------------------------------
+# lib: 500 searches of a 64K file for a word, by one grep_compiled
+# and by a grep each. The difference is the process start and the
+# compile of each grep.
+#-----------------------------------------------------------------
+if("lib" IN_LIST BENCH)
+	message(STATUS "lib")
+	if(NOT LIBBENCH OR NOT EXISTS "${LIBBENCH}")
+		message(FATAL_ERROR "LIBBENCH is not the grep_libbench binary: '${LIBBENCH}'")
+	endif()
+	bench_words(words 2000)
+	set(sLines "")
+	foreach(i RANGE 0 1999 16)
+		list(SUBLIST words ${i} 16 line)
+		list(JOIN line " " sLine)
+		string(APPEND sLines "${sLine}\n")
+	endforeach()
+	string(REPEAT "${sLines}" 4 sText)
+	file(WRITE "${WORK_DIR}/lib_words.txt" "${sText}")
+	list(GET words 1000 sWord)
+	execute_process(COMMAND "${LIBBENCH}" "${GREP}" 500 "${sWord}" "${WORK_DIR}/lib_words.txt"
+					OUTPUT_VARIABLE sOut RESULT_VARIABLE nRtn)
+	if(NOT nRtn EQUAL 0)
+		message(FATAL_ERROR "grep_libbench failed")
+	endif()
+	string(REGEX REPLACE "\n$" "" sOut "${sOut}")
+	string(REPLACE "\n" ";" sOut "${sOut}")
+	foreach(sLine IN LISTS sOut)
+		message(STATUS "  ${sLine}")
+	endforeach()
+endif()
@@ -6,11 +6,49 @@
 #include "grep.h"
 #include "grep_options.h"
 #include "grep_search.h"
+#include "grep_input.h"
+#include "grep_reader.h"
+#include "grep_prefetch.h"
+#include "grep_utf8.h"
+#include "grep_output.h"
+#include "grep_dirlist.h"
+#include "grep_server.h"
+#include "grep_cache.h"
+#include "grep_stats.h"
+#include "grep_archive.h"
+#include "grep_budget.h"
+#include "grep_parallel.h"
+#include "grep_aggregate.h"
+#include "grep_snapshot.h"
 
 //----------------------------------------------------------------
 // Forward declarations
 //----------------------------------------------------------------
-void DoGrepOnFile(_win32_file_& file);
+int  GrepMain(int argc, char* argv[]);
+void CompilePatterns();
+void GrepFoundFile(LPCTSTR pszFileName, grep_parallel& pool, bool bPrefetch, grep_prefetcher& prefetcher,
+				   grep_file_context& ctx);
+void GrepPooledFile(LPCTSTR pszFileName, grep_file_context& ctx);
+void GrepFile(LPCTSTR pszFileName, grep_file_context& ctx);
+void GrepPrefetched(grep_prefetcher& prefetcher, grep_file_context& ctx);
+void GrepArchive(LPCTSTR pszFileName, grep_archive_type type, grep_file_context& ctx);
+void DoGrepOnFile(grep_file_context& ctx);
+void DoGrepInverted(grep_file_context& ctx);
+void DoGrepMultiline(grep_file_context& ctx);
+bool WriteInvertedSpan(grep_file_context& ctx, LPCSTR pSpan, long nLen,
+					   ulong* pnCurLine, ulong* pnMatchedLines);
+void WriteMatchedLine(grep_file_context& ctx, ulong nLine, LPCSTR pLine, long nLineLen,
+					  long nPattern, long nMatchStart, long nMatchLength);
+void WriteMatchedRange(grep_file_context& ctx, ulong nLine, LPCSTR pText, long nLen,
+					   long nPattern, long nMatchStart, long nMatchLength);
+void WriteJsonMatch(grep_file_context& ctx, ulong nLine, ulong nEndLine, LPCSTR pText, long nLen,
+					long nPattern, long nMatchStart, long nMatchLength);
+void WriteFileName(grep_file_context& ctx);
+void FinishFile(grep_file_context& ctx, ulong nLines, ulong nMatchedLines);
+void WriteJsonFile(grep_file_context& ctx);
+void WriteMemoryStats();
+void WriteAggregates();
+void WriteDisplayLine(grep_output& out, LPCSTR pLine, long nLineLen);
 void GrepUsage(bool bVerbose);
 
 //----------------------------------------------------------------
@@ -21,6 +59,7 @@ void GrepUsage(bool bVerbose);
 grep_options g_options;
 // The searcher
 grep_search  g_searcher;
+grep_search* g_pSearcher = &g_searcher;
 
 // File and line counts
 ulong  g_uAllFileCount		= 0;
@@ -33,20 +72,84 @@ PSTRCMP	pfncmp;
 // String searching function; set in parseOptions depending on case-sensitivity
 PSTRSTR	pfnstr;
 
+// Set when the search can stop early
+bool g_bQuitSearch = false;
+
 // stdout
-_win32_file_	g_stdout(_win32_file_::ft_stdout);
+grep_output		g_stdout;
+
+// --stats
+grep_pattern_stats	g_stats;
+
+// --memory
+grep_memory_budget	g_budget;
+
+// --top, --by-pattern, --sample
+grep_aggregate		g_aggregate;
+
+// What the main thread searches with; the reader keeps its buffers
+// from file to file
+grep_file_context	g_context;
+
+// Guards the file and line counts when files are searched in parallel
+grep_mutex		g_countMutex;
+
+// --archives: zip members up to this size are inflated ahead of the
+// search, by up to this many threads at a time
+static const long ARCHIVE_MEMBER_BUFFER	= 4 * 1024 * 1024;
+static const long MAX_ARCHIVE_AHEAD		= 16;
 
 
 //----------------------------------------------------------------
 //							main()
 //----------------------------------------------------------------
 int main(int argc, char* argv[])
+{
+	int nRtn;
+
+	// resident server and its client
+	if( argc > 1 && !_tcsncmp(argv[1], _T("--server="), 9) )
+		nRtn = GrepServe(argv[1] + 9);
+	else if( argc > 1 && !_tcsncmp(argv[1], _T("--client="), 9) )
+		nRtn = GrepClient(argv[1] + 9, argc - 2, argv + 2);
+	else
+		nRtn = GrepMain(argc, argv);
+
+	g_stdout.flush();
+	return nRtn;
+}
+
+void grep_outOfMemory()
+{
+	g_stdout.writeString( "grep: Out of memory\r\n" );
+	g_stdout.flush();
+	exit( RTN_ERROR );
+}
+
+//----------------------------------------------------------------
+// One grep command line; the server runs one per client request
+//----------------------------------------------------------------
+int GrepMain(int argc, char* argv[])
 {
 	_file_finder_ ff;
-	_win32_file_ w32f;
+	_string_array_ files;	// the listing of a filespec, if not from ff
+	grep_dir_snapshot snapshot;	// -R with --cache: the directories walked before
+	grep_parallel pool;			// searches files in parallel (--threads)
+	grep_prefetcher prefetcher;	// reads files ahead when there are many
 	TCHAR curfile[MAX_PATH*2];
 	bool bGoodFileSpec;		// is the current filespec good?
-	int i;
+	bool bParallel;			// are they searched in parallel?
+	bool bPrefetch;			// are the files of this filespec prefetched?
+	bool bListed;			// are they listed in files, rather than found by ff?
+	bool bSnapshot;			// is the listing checked against the snapshot?
+	int i, j;
+
+	g_uAllFileCount		= 0;
+	g_uMatchedFileCount	= 0;
+	g_uAllLineCount		= 0;
+	g_uMatchedLineCount	= 0;
+	g_bQuitSearch		= false;
+	g_options.reset();
 
 	if( argc == 1 )
 		return GrepUsage(false), RTN_ERROR;
@@ -56,57 +159,360 @@ int main(int argc, char* argv[])
 	if( !g_options.parseOptions(argc, argv) )
 		return GrepUsage(false), RTN_ERROR;
 
-	if( g_options.fileSpecCount() == 0 )
+	// seed the search object with the patterns, search type, and options
+	if( g_pServer )
+	{
+		g_pSearcher = g_pServer->searcher( g_options );
+		if( g_pSearcher == NULL )
+		{
+			g_stdout.writeString( "grep: The server is out of memory\r\n" );
+			return RTN_ERROR;
+		}
+	}
+	else
+	{
+		CompilePatterns();
+		g_pSearcher = &g_searcher;
+	}
+	if( g_options.bStats )
+		g_stats.init( g_pSearcher->patternCount(), g_pSearcher->engineCount(), g_options.bStatsAll );
+	if( g_options.aggregates() )
+		g_aggregate.init( g_options.nTopFiles, g_pSearcher->patternCount(),
+						  g_options.bByPattern, g_options.nSample );
+
+	// the reader and the output come out of the budget first; the
+	// options made sure they fit
+	g_budget.setLimit( g_options.uMemoryBudget );
+	g_budget.reserve( grep_reader::footprint(g_options.nReadSize) + grep_output::bufferSize() );
+	g_context.reader.setBudget( g_budget.isLimited() ? &g_budget : NULL );
+	g_context.pOut = &g_stdout;
+
+	if( g_options.fileSpecCount() == 0 && g_pServer )
+	{
+		g_stdout.writeString( "grep: The server can't read the client's input; name the files to search\r\n" );
+		return RTN_ERROR;
+	}
+	else if( g_options.fileSpecCount() == 0 )
 	{
 		// no file specs - use stdin
-		w32f.reset( _win32_file_::ft_stdin );
-		DoGrepOnFile(w32f);
+		g_context.input.openStdin();
+		DoGrepOnFile(g_context);
 	}
 	else
 	{
+		// the directories earlier -R runs walked
+		bSnapshot = ( !g_pServer && g_options.bSearchSubDirs && g_options.szCacheDir[0] );
+		if( bSnapshot )
+			snapshot.load( g_options.szCacheDir );
+		bListed = ( g_pServer || bSnapshot );
+
 		// go through file specifications, open each file and search it
-		for(i=0; i<g_options.fileSpecCount(); i++)
+		for(i=0; i<g_options.fileSpecCount() && !g_bQuitSearch; i++)
 		{
-			// Init the file finder with specification
-			ff.initPattern( g_options.getFileSpec(i), g_options.bSearchSubDirs );
-			if( ff.fileCount() == -1 )  // file count unknown, but likely more than one
-				g_options.bOneFile = false;
+			// the server keeps directory listings from request to request
+			files.clear();
+			if( g_pServer && !g_pServer->listFiles( g_options.getFileSpec(i), g_options.bSearchSubDirs, &files ) )
+				files.clear();
+			// only the directories that changed since the snapshot are read
+			else if( bSnapshot )
+				grep_dir_list::list( g_options.getFileSpec(i), true, &files, NULL, &snapshot );
+			// otherwise init the file finder with specification
+			else if( !g_pServer )
+				ff.initPattern( g_options.getFileSpec(i), g_options.bSearchSubDirs );
+
+			if( (bListed ? files.length() > 1 : ff.fileCount() == -1) )
+				g_options.bOneFile = false;  // file count unknown, but likely more than one
+
+			// with many files, search several at once, or at least keep
+			// several opens and reads in flight
+			bParallel = ( !g_options.bOneFile && g_options.nThreads > 1 );
+			if( bParallel && !pool.isStarted() )
+				bParallel = pool.start( g_options.nThreads, !g_options.bUnordered, GrepPooledFile,
+										&g_stdout, g_options.nReadSize,
+										g_budget.isLimited() ? &g_budget : NULL );
+			bPrefetch = ( !bParallel && !g_options.bOneFile && g_options.nAsyncReads > 0 &&
+						  !g_options.bDirectIO );
+			if( bPrefetch && !prefetcher.isStarted() )
+				bPrefetch = prefetcher.start( g_options.nAsyncReads, g_options.nReadSize, false,
+											  g_budget.isLimited() ? &g_budget : NULL );
+
 			bGoodFileSpec = false;
-			while( ff.getNextFile(curfile) )
+			if( bListed )
 			{
-				bGoodFileSpec = true;
-				w32f.reset(curfile);
-				if( !w32f.open(access_read, share_read | share_write, open_existing) )
+				for(j=0; j<files.length() && !g_bQuitSearch; j++)
 				{
-					if( !g_options.bSuppressBadFiles && !g_options.bQuiet )
-						g_stdout.writeFormatted( "grep: Cannot open file \'%s\'\r\n", curfile );
-					continue;
+					bGoodFileSpec = true;
+					GrepFoundFile(files[j], pool, bPrefetch, prefetcher, g_context);
 				}
-				DoGrepOnFile(w32f);
 			}
+			else
+			{
+				while( !g_bQuitSearch && ff.getNextFile(curfile) )
+				{
+					bGoodFileSpec = true;
+					GrepFoundFile(curfile, pool, bPrefetch, prefetcher, g_context);
+				}
+			}
+			while( bPrefetch && !prefetcher.isEmpty() )
+			{
+				if( g_bQuitSearch )
+					prefetcher.release( prefetcher.next() );
+				else
+					GrepPrefetched(prefetcher, g_context);
+			}
+			if( bParallel )
+				pool.wait();
+
 			if( !bGoodFileSpec && !g_options.bSuppressBadFiles && !g_options.bQuiet )
 				g_stdout.writeFormatted( "grep: Can\'t find file(s) \'%s\'\r\n", g_options.getFileSpec(i) );
 		}
+
+		if( bSnapshot && !snapshot.save(g_options.szCacheDir) &&
+			!g_options.bSuppressBadFiles && !g_options.bQuiet )
+			g_stdout.writeFormatted( "grep: Can\'t write to the cache directory \'%s\'\r\n",
+									 g_options.szCacheDir );
 	}
 
-	if( g_options.bShowSummary && !g_options.bQuiet )
+	if( g_aggregate.isActive() )
+		WriteAggregates();
+
+	if( g_options.bShowSummary && !g_options.bQuiet && g_options.bJson )
+	{
+		g_stdout.writeFormatted( "{\"type\":\"summary\",\"files\":%lu,\"lines\":%lu,"
+								 "\"matched_files\":%lu,\"matched_lines\":%lu,\"patterns\":%d}\r\n",
+								 g_uAllFileCount, g_uAllLineCount,
+								 g_uMatchedFileCount, g_uMatchedLineCount,
+								 g_pSearcher->patternCount() );
+	}
+	else if( g_options.bShowSummary && !g_options.bQuiet )
+	{
 		g_stdout.writeFormatted( "\r\nSearched %lu line(s) in %lu file(s)."
 								 "\r\nMatched %lu line(s) in %lu file(s)\r\n",
 								 g_uAllLineCount, g_uAllFileCount,
 								 g_uMatchedLineCount, g_uMatchedFileCount );
+	}
+	if( g_options.bStats && !g_options.bQuiet )
+	{
+		g_stats.write( g_options.patterns(), g_options.bJson );
+		WriteMemoryStats();
+	}
+	if( g_pSearcher->regexGiveUps() && !g_options.bQuiet )
+		g_stdout.writeFormatted( "grep: %ld line(s) needed more backtracking than allowed"
+								 " and were taken as not matching\r\n",
+								 g_pSearcher->regexGiveUps() );
+	g_stats.release();
+	g_aggregate.release();
 	
 	return (g_uMatchedFileCount? RTN_MATCH : RTN_NOMATCH);
 }
 
 
+//----------------------------------------------------------------
+// Compiles the patterns into g_searcher, or with --cache takes the
+// compiled set from the cache directory, saving it there if it
+// wasn't
+//----------------------------------------------------------------
+void CompilePatterns()
+{
+	ulonglong uKey;
+	bool bCached = ( g_options.szCacheDir[0] && grep_search::canSave(g_options.searchType()) );
+
+	if( bCached )
+	{
+		uKey = grep_compile_cache::keyOf( g_options.searchType(), g_options.patterns(),
+										  !g_options.bNoCase, g_options.bTreatAsWord,
+										  g_options.bMatchEntireLine );
+		if( grep_compile_cache::load(g_options.szCacheDir, uKey, &g_searcher) )
+			return;
+	}
+
+	g_searcher.init( g_options.searchType(), g_options.patterns(),
+					 !g_options.bNoCase, g_options.bTreatAsWord, g_options.bMatchEntireLine,
+					 g_options.nFuzzyEdits );
+
+	if( bCached && !grep_compile_cache::save(g_options.szCacheDir, uKey, &g_searcher) &&
+		!g_options.bSuppressBadFiles && !g_options.bQuiet )
+		g_stdout.writeFormatted( "grep: Can\'t write to the cache directory \'%s\'\r\n",
+								 g_options.szCacheDir );
+}
+
+//----------------------------------------------------------------
+// Searches a file the file specification named, right away, through
+// the prefetcher, or on the pool's threads
+//----------------------------------------------------------------
+void GrepFoundFile(LPCTSTR pszFileName, grep_parallel& pool, bool bPrefetch, grep_prefetcher& prefetcher,
+				   grep_file_context& ctx)
+{
+	grep_archive_type type;
+
+	if( pool.isStarted() )
+		pool.submit(pszFileName);
+	else if( g_options.bArchives && (type = grep_archive::typeOf(pszFileName)) != archive_none )
+	{
+		// the files before it come out first
+		while( bPrefetch && !prefetcher.isEmpty() && !g_bQuitSearch )
+			GrepPrefetched(prefetcher, ctx);
+		if( !g_bQuitSearch )
+			GrepArchive(pszFileName, type, ctx);
+	}
+	else if( bPrefetch )
+	{
+		if( prefetcher.isFull() )
+			GrepPrefetched(prefetcher, ctx);
+		prefetcher.submit(pszFileName);
+	}
+	else
+		GrepFile(pszFileName, ctx);
+}
+
+//----------------------------------------------------------------
+// Searches a file on one of the pool's threads
+//----------------------------------------------------------------
+void GrepPooledFile(LPCTSTR pszFileName, grep_file_context& ctx)
+{
+	grep_archive_type type;
+
+	if( g_bQuitSearch )
+		return;
+	if( g_options.bArchives && (type = grep_archive::typeOf(pszFileName)) != archive_none )
+		GrepArchive(pszFileName, type, ctx);
+	else
+		GrepFile(pszFileName, ctx);
+}
+
+//----------------------------------------------------------------
+// Opens the file and searches it
+//----------------------------------------------------------------
+void GrepFile(LPCTSTR pszFileName, grep_file_context& ctx)
+{
+	if( !ctx.input.open(pszFileName, g_options.bDirectIO, g_options.nReadSize) )
+	{
+		if( !g_options.bSuppressBadFiles && !g_options.bQuiet )
+			ctx.pOut->writeFormatted( "grep: Cannot open file \'%s\'\r\n", pszFileName );
+		return;
+	}
+	DoGrepOnFile(ctx);
+	ctx.input.close();
+}
+
+//----------------------------------------------------------------
+// Searches the oldest file submitted to the prefetcher
+//----------------------------------------------------------------
+void GrepPrefetched(grep_prefetcher& prefetcher, grep_file_context& ctx)
+{
+	grep_prefetched* pFile = prefetcher.next();
+
+	switch(pFile->nStatus)
+	{
+	case pf_ok:
+		ctx.input.openMemory(pFile->szName, pFile->pData, pFile->nLen);
+		DoGrepOnFile(ctx);
+		ctx.input.close();
+		break;
+	case pf_too_big:
+		GrepFile(pFile->szName, ctx);
+		break;
+	default:
+		if( !g_options.bSuppressBadFiles && !g_options.bQuiet )
+			ctx.pOut->writeFormatted( "grep: Cannot open file \'%s\'\r\n", pFile->szName );
+		break;
+	}
+	prefetcher.release(pFile);
+}
+
+//----------------------------------------------------------------
+// --archives: searches each member of the archive as a file named
+// archive:member. Deflated zip members that fit in a buffer are
+// inflated ahead of the search on the prefetcher's threads, in the
+// order of the directory; the others are inflated as they are read.
+//----------------------------------------------------------------
+void GrepArchive(LPCTSTR pszFileName, grep_archive_type type, grep_file_context& ctx)
+{
+	grep_archive archive;
+	grep_archive_member ahead[MAX_ARCHIVE_AHEAD];	// members in the prefetcher
+	grep_archive_member member;
+	grep_prefetcher inflater;	// declared last: stops before the members go
+	grep_archive_member* pMember;
+	grep_prefetched* pItem;
+	long nAhead, nFirst, nSlots;
+	bool bHeld, bEnd;
+
+	if( !archive.open(pszFileName, type) )
+	{
+		if( !g_options.bSuppressBadFiles && !g_options.bQuiet )
+			ctx.pOut->writeFormatted( "grep: Cannot open file \'%s\'\r\n", pszFileName );
+		return;
+	}
+	if( g_options.bOneFile )
+		g_options.bOneFile = false;		// the members are named in the output
+
+	nSlots = 2 * grep_thread::cpuCount();
+	if( nSlots > MAX_ARCHIVE_AHEAD )
+		nSlots = MAX_ARCHIVE_AHEAD;
+	if( type == archive_zip && nSlots >= 2 &&
+		inflater.start(nSlots, ARCHIVE_MEMBER_BUFFER, true, g_budget.isLimited() ? &g_budget : NULL) )
+		nSlots = inflater.slotCount();
+	else
+		nSlots = 0;
+
+	nAhead = nFirst = 0;
+	bHeld = bEnd = false;
+	while( !g_bQuitSearch )
+	{
+		// keep the prefetcher busy with the deflated members coming up;
+		// a member it can't take is held until those before it are done
+		while( !bHeld && !bEnd && (nSlots == 0 || nAhead < nSlots) )
+		{
+			if( !archive.next(&member) )
+				bEnd = true;
+			else if( nSlots && member.bDeflated && member.nSize <= ARCHIVE_MEMBER_BUFFER )
+			{
+				pMember = &ahead[(nFirst + nAhead++) % nSlots];
+				*pMember = member;
+				inflater.submit(pMember->szName, grep_archive::loadMember, pMember);
+			}
+			else
+				bHeld = true;
+		}
+
+		if( nAhead )
+		{
+			pItem = inflater.next();
+			if( pItem->nStatus == pf_ok )
+				ctx.input.openMemory(pItem->szName, pItem->pData, pItem->nLen);
+			else
+				archive.openMember(&ahead[nFirst], ctx.input);	// inflate it as it is read
+			DoGrepOnFile(ctx);
+			ctx.input.close();
+			inflater.release(pItem);
+			nFirst = (nFirst + 1) % nSlots;
+			nAhead--;
+		}
+		else if( bHeld )
+		{
+			archive.openMember(&member, ctx.input);
+			DoGrepOnFile(ctx);
+			ctx.input.close();
+			bHeld = false;
+		}
+		else
+			break;
+	}
+	while( !inflater.isEmpty() )
+		inflater.release( inflater.next() );
+
+	if( archive.isDamaged() && !g_options.bSuppressBadFiles && !g_options.bQuiet )
+		ctx.pOut->writeFormatted( "grep: Damaged archive \'%s\'\r\n", pszFileName );
+}
+
 //----------------------------------------------------------------
 // The main grep logic. Called for each file.
 // Checks the file against all the available patterns.
 // Returns on the first match w/o checking the remaining patterns.
 //----------------------------------------------------------------
-void DoGrepOnFile(_win32_file_& file)
+void DoGrepOnFile(grep_file_context& ctx)
 {
-	char  curLine[8192];	// 8K line length limit
+	LPSTR curLine;			// points into the reader's buffer
 	long  nLineLen;
 	ulong nCurLine;
 	ulong nMatchedLines;
@@ -114,8 +520,19 @@ void DoGrepOnFile(_win32_file_& file)
 	long  nMatchStart;		// the beginning of the match in the line
 	long  nMatchLength;		// the length of the matching substring in the line (chars)
 	bool  bMatched;
-	char* pc;
 
+	if( g_options.nMultiline )
+	{
+		DoGrepMultiline(ctx);
+		return;
+	}
+
+	// -v with a search that can skip over many lines at once
+	if( g_options.bShowNoMatch && !g_options.bStats && g_pSearcher->canSearchBlocks() )
+	{
+		DoGrepInverted(ctx);
+		return;
+	}
 	
 	////////////////////////////////////////////////////
 	// Process the file:
@@ -126,14 +543,20 @@ void DoGrepOnFile(_win32_file_& file)
 	nMatchingPat	= -1;
 	nMatchStart		= -1;
 	nMatchLength	= -1;
-	while( (nLineLen = file.readLine(curLine, sizeof(curLine))) != -1 )
+	ctx.reader.attach(&ctx.input, g_options.nReadSize, g_options.uRangeStart, g_options.uRangeEnd);
+	while( (nLineLen = ctx.reader.nextLine(&curLine)) != -1 )
 	{
 		nCurLine++;
-		bMatched = g_searcher.match( curLine,
-									 nLineLen,
-									 &nMatchingPat,
-									 &nMatchStart,
-									 &nMatchLength );
+		if( g_options.bStats )
+			bMatched = g_pSearcher->matchStats( curLine, nLineLen, g_options.bStatsAll, &g_stats,
+												&nMatchingPat, &nMatchStart, &nMatchLength, &ctx.scratch );
+		else
+			bMatched = g_pSearcher->match( curLine,
+										   nLineLen,
+										   &nMatchingPat,
+										   &nMatchStart,
+										   &nMatchLength,
+										   &ctx.scratch );
 
 		if( (bMatched && !g_options.bShowNoMatch) || (!bMatched && g_options.bShowNoMatch) )
 		{
@@ -141,68 +564,377 @@ void DoGrepOnFile(_win32_file_& file)
 			// output according to the options
 			if(g_options.bQuiet)
 			{
-				file.close();
-				exit(RTN_MATCH);  // exit on first match
+				g_bQuitSearch = true;  // stop on first match
+				break;
 			}
 			else if(g_options.bFileNameOnly)
 			{
 				if(nMatchedLines == 1)
 				{
-					g_stdout.writeLine( file.getFileName() );
+					WriteFileName(ctx);
 					if(!g_options.bShowSummary)
 						return;
 				}
 			}
 			else if(g_options.bJustCount)
-				;
-			else if(g_options.bOneFile || g_options.bNoFileAppend)
 			{
-				if( g_options.bLineNumber &&
-					(file.getFileType() != _win32_file_::ft_stdin) )
-					g_stdout.writeFormatted( "%lu: ", nCurLine );
-				pc = curLine;
-				// while( (pc+=printf("%1s", pc)) < &curLine[nLineLen] )
-				while(pc < &curLine[nLineLen])
-				{
-					// g_stdout.write( isprint(*pc)? pc : "?", 1 );
-					g_stdout.write( ((*pc<32 && *pc!=9) || *pc>128) ?
-									&NON_DISPLAYABLE_CHAR : pc, 1 );
-					pc++;
-				}
-				g_stdout.writeString( "\r\n" );
+				if(g_aggregate.wantsLines())
+					g_aggregate.addLine( ctx.input.getFileName(), nCurLine, curLine, nLineLen,
+										 bMatched ? nMatchingPat : -1 );
 			}
+			else if(bMatched)
+				WriteMatchedLine( ctx, nCurLine, curLine, nLineLen,
+								  nMatchingPat, nMatchStart, nMatchLength );
+			else
+				WriteMatchedLine( ctx, nCurLine, curLine, nLineLen, -1, -1, -1 );
+
+			// --max-count: the rest of the file is not read
+			if( nMatchedLines == (ulong)g_options.nMaxCount )
+				break;
+		}
+		
+	}
+
+	FinishFile(ctx, nCurLine, nMatchedLines);
+}
+
+//----------------------------------------------------------------
+// -v over blocks of lines: the searcher finds the next matching
+// line anywhere in the block, and every line before it is output
+// (or counted) without being matched at all.
+//----------------------------------------------------------------
+void DoGrepInverted(grep_file_context& ctx)
+{
+	LPSTR  pBlock;
+	LPCSTR pc;
+	long   nBlockLen;
+	long   nFrom;			// where the unsearched part of the block starts
+	long   nMatch;			// first match at or after nFrom
+	long   nSpanEnd;		// start of the line with the match
+	long   nNext;			// start of the line after it
+	ulong  nCurLine = 0;
+	ulong  nMatchedLines = 0;
+
+	ctx.reader.attach(&ctx.input, g_options.nReadSize, g_options.uRangeStart, g_options.uRangeEnd);
+	while( (nBlockLen = ctx.reader.nextBlock(&pBlock)) != -1 )
+	{
+		for(nFrom = 0; nFrom < nBlockLen; nFrom = nNext)
+		{
+			nMatch = g_pSearcher->findInBlock( pBlock, nBlockLen, nFrom, &ctx.scratch );
+			if(nMatch == -1)
+				nSpanEnd = nNext = nBlockLen;
 			else
 			{
-				if( file.getFileType() != _win32_file_::ft_stdin )
-					g_stdout.writeFormatted( "%s: ", file.getFileName() );
-				if( g_options.bLineNumber &&
-					(file.getFileType() != _win32_file_::ft_stdin) )
-					g_stdout.writeFormatted( "%lu: ", nCurLine );
-				pc = curLine;
-				// while( (pc+=printf("%1s", pc)) < &curLine[nLineLen] )
-				while(pc < &curLine[nLineLen])
-				{
-					g_stdout.write( ((*pc<32 && *pc!=9) || *pc>128) ?
-									&NON_DISPLAYABLE_CHAR : pc, 1 );
-					pc++;
-				}
-				g_stdout.writeString( "\r\n" );
+				for(nSpanEnd = nMatch; nSpanEnd > nFrom && pBlock[nSpanEnd-1] != '\n'; nSpanEnd--)
+					;
+				pc = (LPCSTR)memchr( pBlock + nMatch, '\n', nBlockLen - nMatch );
+				nNext = (pc ? (long)(pc - pBlock) + 1 : nBlockLen);
+			}
+
+			if( nSpanEnd > nFrom &&
+				!WriteInvertedSpan(ctx, pBlock + nFrom, nSpanEnd - nFrom, &nCurLine, &nMatchedLines) )
+			{
+				if(g_options.bFileNameOnly)
+					return;		// as in DoGrepOnFile
+				nBlockLen = -1;
+				break;
 			}
+			if(nMatch != -1)
+				nCurLine++;		// the matching line, left out
 		}
-		
+		if(nBlockLen == -1)
+			break;
+	}
+
+	FinishFile(ctx, nCurLine, nMatchedLines);
+}
+
+//----------------------------------------------------------------
+// --multiline: the patterns are matched against blocks of lines
+// instead of single lines, so that a match can span line breaks.
+// The tail of each block that had no match is searched again at
+// the start of the next one, up to the lookback, so a match that
+// crosses into the next block is found if it starts that close to
+// the end. Each match is written as the lines it covers.
+//----------------------------------------------------------------
+void DoGrepMultiline(grep_file_context& ctx)
+{
+	LPSTR  pBlock;
+	LPCSTR pc;
+	long   nBlockLen;
+	long   nKeep = 0;		// bytes of the last block to search again
+	long   nLookback;
+	long   nFrom;			// the first line not searched or written yet
+	long   nFirst;			// the start of the first line of a match
+	long   nLast;			// the end of the last one
+	long   nPos;			// how far the lines were counted
+	ulong  nLine;			// the line number at nPos
+	ulong  nBlockLine = 1;	// the line number at the start of the block
+	ulong  nLines;
+	ulong  nMatchedLines = 0;
+	bool   bOpenLine = false;	// the last block ended without a line break
+	long   nPat, nStart, nLength;
+
+	nLookback = (g_options.nMultiline < g_options.nReadSize ?
+				 g_options.nMultiline : g_options.nReadSize);
+	nLine = 1;
+	ctx.reader.attach(&ctx.input, g_options.nReadSize, g_options.uRangeStart, g_options.uRangeEnd);
+	while( (nBlockLen = ctx.reader.nextBlock(&pBlock, nKeep)) != -1 )
+	{
+		nPos = 0;
+		nLine = nBlockLine;
+		bOpenLine = (pBlock[nBlockLen-1] != '\n');
+		for(nFrom = 0; nFrom < nBlockLen; nFrom = nLast)
+		{
+			if( !g_pSearcher->matchInBlock(pBlock, nBlockLen, nFrom, &nPat, &nStart, &nLength, &ctx.scratch) )
+				break;
+
+			// from the start of the first line to the break after the last char
+			for(nFirst = nStart; nFirst > nFrom && pBlock[nFirst-1] != '\n'; nFirst--)
+				;
+			nLast = nStart + (nLength > 0 ? nLength - 1 : 0);
+			pc = (LPCSTR)memchr( pBlock + nLast, '\n', nBlockLen - nLast );
+			nLast = (pc ? (long)(pc - pBlock) + 1 : nBlockLen);
+
+			nLine += grep_reader::countNewlines(pBlock + nPos, nFirst - nPos);
+			nPos = nFirst;
+			nLines = grep_reader::countNewlines(pBlock + nFirst, nLast - nFirst) +
+					 (pBlock[nLast-1] != '\n' ? 1 : 0);
+			if( g_options.nMaxCount && nMatchedLines + nLines > (ulong)g_options.nMaxCount )
+				nLines = g_options.nMaxCount - nMatchedLines;
+			nMatchedLines += nLines;
+
+			if(g_options.bQuiet)
+			{
+				g_bQuitSearch = true;
+				break;
+			}
+			else if(g_options.bFileNameOnly)
+			{
+				WriteFileName(ctx);
+				if(!g_options.bShowSummary)
+					return;
+				break;
+			}
+			else if(!g_options.bJustCount)
+				WriteMatchedRange( ctx, nLine, pBlock + nFirst, nLast - nFirst,
+								   nPat, nStart - nFirst, nLength );
+			if( nMatchedLines == (ulong)g_options.nMaxCount )
+				break;
+		}
+		nLine += grep_reader::countNewlines(pBlock + nPos, nBlockLen - nPos);
+		if( g_bQuitSearch || (g_options.bFileNameOnly && nMatchedLines) ||
+			(g_options.nMaxCount && nMatchedLines == (ulong)g_options.nMaxCount) )
+			break;		// stopped early
+
+		// keep the whole lines within the lookback that have not been
+		// written, for the next block
+		nKeep = nBlockLen - nFrom;
+		if(nKeep > nLookback)
+		{
+			pc = (LPCSTR)memchr( pBlock + nBlockLen - nLookback - 1, '\n', nLookback );
+			nKeep = (pc ? nBlockLen - (long)(pc - pBlock) - 1 : 0);
+		}
+		nBlockLine = nLine - grep_reader::countNewlines(pBlock + nBlockLen - nKeep, nKeep);
 	}
+	FinishFile(ctx, nLine - (bOpenLine ? 0 : 1), nMatchedLines);
+}
 
-	if(g_options.bJustCount)
+//----------------------------------------------------------------
+// Handles a run of lines that -v selects. Returns false when the
+// rest of the file need not be looked at.
+//----------------------------------------------------------------
+bool WriteInvertedSpan(grep_file_context& ctx, LPCSTR pSpan, long nLen,
+					   ulong* pnCurLine, ulong* pnMatchedLines)
+{
+	LPCSTR pEnd = pSpan + nLen;
+	LPCSTR pc;
+	long   nLineLen;
+	ulong  nLines;
+	bool   bMore = true;	// false when --max-count is reached
+
+	if(g_options.bQuiet)
+	{
+		(*pnMatchedLines)++;
+		g_bQuitSearch = true;
+		return false;
+	}
+	if(g_options.bFileNameOnly)
+	{
+		if(*pnMatchedLines == 0)
+			WriteFileName(ctx);
+		if(!g_options.bShowSummary)
+			return false;
+	}
+
+	if(g_options.bFileNameOnly || (g_options.bJustCount && !g_aggregate.wantsLines()))
+	{
+		// only the number of lines matters
+		nLines = grep_reader::countNewlines(pSpan, nLen) + (pEnd[-1] != '\n' ? 1 : 0);
+		if( g_options.nMaxCount && *pnMatchedLines + nLines >= (ulong)g_options.nMaxCount )
+		{
+			nLines = g_options.nMaxCount - *pnMatchedLines;
+			bMore = false;
+		}
+		*pnCurLine += nLines;
+		*pnMatchedLines += nLines;
+		return bMore;
+	}
+
+	for(; pSpan < pEnd && bMore; pSpan = pc + 1)
+	{
+		pc = (LPCSTR)memchr(pSpan, '\n', pEnd - pSpan);
+		if(pc == NULL)
+			pc = pEnd;
+		nLineLen = (long)(pc - pSpan);
+		if(nLineLen > 0 && pSpan[nLineLen-1] == '\r')
+			nLineLen--;
+		(*pnCurLine)++;
+		(*pnMatchedLines)++;
+		if(g_options.bJustCount)
+			g_aggregate.addLine( ctx.input.getFileName(), *pnCurLine, pSpan, nLineLen, -1 );
+		else
+			WriteMatchedLine( ctx, *pnCurLine, pSpan, nLineLen, -1, -1, -1 );
+		bMore = ( *pnMatchedLines != (ulong)g_options.nMaxCount );
+	}
+	return bMore;
+}
+
+//----------------------------------------------------------------
+// Writes a selected line with the file name and line number the
+// options ask for. pLine must point into ctx.reader's buffer; the
+// match is given for --json, nPattern is -1 for lines -v selects.
+//----------------------------------------------------------------
+void WriteMatchedLine(grep_file_context& ctx, ulong nLine, LPCSTR pLine, long nLineLen,
+					  long nPattern, long nMatchStart, long nMatchLength)
+{
+	if( g_options.bJson )
+	{
+		WriteJsonMatch(ctx, nLine, 0, pLine, nLineLen, nPattern, nMatchStart, nMatchLength);
+		return;
+	}
+
+	if( !(g_options.bOneFile || g_options.bNoFileAppend) && !ctx.input.isStdin() )
+		ctx.pOut->writeFormatted( "%s: ", ctx.input.getFileName() );
+	if( g_options.bLineNumber && !ctx.input.isStdin() )
+		ctx.pOut->writeFormatted( "%lu: ", nLine );
+	WriteDisplayLine( *ctx.pOut, pLine, nLineLen );
+}
+
+//----------------------------------------------------------------
+// Writes the lines a --multiline match covers; nLine is the number
+// of the first. The text has the line breaks.
+//----------------------------------------------------------------
+void WriteMatchedRange(grep_file_context& ctx, ulong nLine, LPCSTR pText, long nLen,
+					   long nPattern, long nMatchStart, long nMatchLength)
+{
+	LPCSTR pEnd = pText + nLen;
+	LPCSTR pc;
+	long   nLineLen;
+
+	if( g_options.bJson )
+	{
+		// one record, with the line breaks in the text
+		nLineLen = nLen;
+		if(nLineLen > 0 && pText[nLineLen-1] == '\n')
+			nLineLen--;
+		if(nLineLen > 0 && pText[nLineLen-1] == '\r')
+			nLineLen--;
+		WriteJsonMatch( ctx, nLine, nLine + grep_reader::countNewlines(pText, nLineLen),
+						pText, nLineLen, nPattern, nMatchStart, nMatchLength );
+		return;
+	}
+
+	for(; pText < pEnd; pText = pc + 1, nLine++)
+	{
+		pc = (LPCSTR)memchr(pText, '\n', pEnd - pText);
+		if(pc == NULL)
+			pc = pEnd;
+		nLineLen = (long)(pc - pText);
+		if(nLineLen > 0 && pText[nLineLen-1] == '\r')
+			nLineLen--;
+		WriteMatchedLine( ctx, nLine, pText, nLineLen, nPattern, -1, -1 );
+	}
+}
+
+//----------------------------------------------------------------
+// A --json record of a selected line, or with nEndLine, of the
+// lines of a --multiline match. nPattern is -1 for lines that -v
+// selects.
+//----------------------------------------------------------------
+void WriteJsonMatch(grep_file_context& ctx, ulong nLine, ulong nEndLine, LPCSTR pText, long nLen,
+					long nPattern, long nMatchStart, long nMatchLength)
+{
+	ctx.pOut->writeString( nPattern == -1 ? "{\"type\":\"line\"," : "{\"type\":\"match\"," );
+	WriteJsonFile(ctx);
+	ctx.pOut->writeString( ",\"line\":" );
+	ctx.pOut->writeNumber( nLine );
+	if( nEndLine )
+	{
+		ctx.pOut->writeString( ",\"end_line\":" );
+		ctx.pOut->writeNumber( nEndLine );
+	}
+	ctx.pOut->writeString( ",\"offset\":" );
+	ctx.pOut->writeNumber( ctx.reader.offsetOf(pText) );
+	if( nPattern != -1 )
+	{
+		ctx.pOut->writeString( ",\"pattern\":" );
+		ctx.pOut->writeNumber( nPattern );
+	}
+	if( nPattern != -1 && nMatchStart >= 0 )
+	{
+		ctx.pOut->writeString( ",\"start\":" );
+		ctx.pOut->writeNumber( nMatchStart );
+		ctx.pOut->writeString( ",\"length\":" );
+		ctx.pOut->writeNumber( nMatchLength );
+	}
+	ctx.pOut->writeString( ",\"text\":" );
+	ctx.pOut->writeJsonString( pText, nLen );
+	ctx.pOut->writeString( "}\r\n" );
+}
+
+//----------------------------------------------------------------
+// The -l output
+//----------------------------------------------------------------
+void WriteFileName(grep_file_context& ctx)
+{
+	if( g_options.bJson )
+	{
+		ctx.pOut->writeString( "{\"type\":\"file\"," );
+		WriteJsonFile(ctx);
+		ctx.pOut->writeString( "}\r\n" );
+	}
+	else
+		ctx.pOut->writeLine( ctx.input.getFileName() );
+}
+
+//----------------------------------------------------------------
+// The -c output and the totals, at the end of each file
+//----------------------------------------------------------------
+void FinishFile(grep_file_context& ctx, ulong nLines, ulong nMatchedLines)
+{
+	if(g_aggregate.isActive())
+		;	// the counts go to --top
+	else if(g_options.bJustCount && g_options.bJson)
 	{
-		if( !(g_options.bOneFile || g_options.bNoFileAppend) &&
-			(file.getFileType() != _win32_file_::ft_stdin) )
-			g_stdout.writeFormatted( "%s: ", file.getFileName() );
-		g_stdout.writeFormatted( "%lu\r\n", nMatchedLines );
+		ctx.pOut->writeString( "{\"type\":\"count\"," );
+		WriteJsonFile(ctx);
+		ctx.pOut->writeString( ",\"count\":" );
+		ctx.pOut->writeNumber( nMatchedLines );
+		ctx.pOut->writeString( "}\r\n" );
+	}
+	else if(g_options.bJustCount)
+	{
+		if( !(g_options.bOneFile || g_options.bNoFileAppend) && !ctx.input.isStdin() )
+			ctx.pOut->writeFormatted( "%s: ", ctx.input.getFileName() );
+		ctx.pOut->writeFormatted( "%lu\r\n", nMatchedLines );
 	}
 
 	// finish up
+	grep_lock lock(g_countMutex);
+	g_aggregate.addFile( ctx.input.getFileName(), nMatchedLines );
 	g_uAllFileCount++;
-	g_uAllLineCount += nCurLine;
+	g_uAllLineCount += nLines;
 	if(nMatchedLines)
 	{
 		g_uMatchedFileCount++;
@@ -210,6 +942,205 @@ void DoGrepOnFile(_win32_file_& file)
 	}
 }
 
+//----------------------------------------------------------------
+// The "file" member of a JSON record; null for stdin
+//----------------------------------------------------------------
+void WriteJsonFile(grep_file_context& ctx)
+{
+	ctx.pOut->writeString( "\"file\":" );
+	if( ctx.input.isStdin() )
+		ctx.pOut->writeString( "null" );
+	else
+		ctx.pOut->writeJsonString( ctx.input.getFileName(), lstrlen(ctx.input.getFileName()) );
+}
+
+//----------------------------------------------------------------
+// --stats: the most memory the process had, and with --memory the
+// most of the budget the buffers took
+//----------------------------------------------------------------
+void WriteMemoryStats()
+{
+	grep_alloc_stats allocs;
+
+	// what loading and compiling the patterns cost
+	allocs.uAllocs = allocs.uHeapBlocks = 0;
+	g_options.patterns()->addStats(&allocs);
+	g_pSearcher->addStats(&allocs);
+
+	if( g_options.bJson )
+	{
+		g_stdout.writeString( "{\"type\":\"memory\",\"peak_resident\":" );
+		g_stdout.writeNumber( grep_peakResident() );
+		if( g_budget.isLimited() )
+		{
+			g_stdout.writeString( ",\"budget\":" );
+			g_stdout.writeNumber( g_budget.limit() );
+			g_stdout.writeString( ",\"budget_peak\":" );
+			g_stdout.writeNumber( g_budget.peak() );
+		}
+		g_stdout.writeFormatted( ",\"pattern_allocs\":%lu,\"pattern_heap_blocks\":%lu}\r\n",
+								 allocs.uAllocs, allocs.uHeapBlocks );
+		return;
+	}
+
+	g_stdout.writeString( "\r\nPeak resident memory: " );
+	g_stdout.writeNumber( grep_peakResident() / 1024 );
+	g_stdout.writeString( "K" );
+	if( g_budget.isLimited() )
+	{
+		g_stdout.writeString( ", buffers at most " );
+		g_stdout.writeNumber( g_budget.peak() / 1024 );
+		g_stdout.writeString( "K of the " );
+		g_stdout.writeNumber( g_budget.limit() / 1024 );
+		g_stdout.writeString( "K budget" );
+	}
+	g_stdout.writeFormatted( "\r\nPatterns: %d, %lu allocation(s) from %lu heap block(s)\r\n",
+							 g_pSearcher->patternCount(), allocs.uAllocs, allocs.uHeapBlocks );
+}
+
+
+//----------------------------------------------------------------
+// --top, --by-pattern and --sample, in that order. The sampled
+// lines are written as the search would have written them.
+//----------------------------------------------------------------
+void WriteAggregates()
+{
+	const grep_top_file* pFile;
+	const grep_sampled_line* pLine;
+	const grep_pattern_list* pPatterns = g_options.patterns();
+	bool bStdin = ( g_options.fileSpecCount() == 0 );
+	long i, p;
+
+	g_aggregate.finish();
+	if( g_options.bJson )
+	{
+		for(i=0; i<g_aggregate.topCount(); i++)
+		{
+			pFile = g_aggregate.topFile(i);
+			g_stdout.writeString( "{\"type\":\"top_file\",\"file\":" );
+			if( bStdin )
+				g_stdout.writeString( "null" );
+			else
+				g_stdout.writeJsonString( pFile->pszName, lstrlen(pFile->pszName) );
+			g_stdout.writeString( ",\"count\":" );
+			g_stdout.writeNumber( pFile->nLines );
+			g_stdout.writeString( "}\r\n" );
+		}
+		for(i=0; i<g_aggregate.patternCount(); i++)
+		{
+			p = g_aggregate.patternAt(i);
+			g_stdout.writeFormatted( "{\"type\":\"pattern_count\",\"index\":%ld,\"pattern\":", p );
+			g_stdout.writeJsonString( pPatterns->get(p), pPatterns->lengthOf(p) );
+			g_stdout.writeString( ",\"count\":" );
+			g_stdout.writeNumber( g_aggregate.patternHits(p) );
+			g_stdout.writeString( "}\r\n" );
+		}
+		for(i=0; i<g_aggregate.sampleCount(); i++)
+		{
+			pLine = g_aggregate.sampleLine(i);
+			g_stdout.writeString( "{\"type\":\"sample\",\"file\":" );
+			if( bStdin )
+				g_stdout.writeString( "null" );
+			else
+				g_stdout.writeJsonString( pLine->pBuf, lstrlen(pLine->pBuf) );
+			g_stdout.writeString( ",\"line\":" );
+			g_stdout.writeNumber( pLine->nLine );
+			if( pLine->nPattern != -1 )
+			{
+				g_stdout.writeString( ",\"pattern\":" );
+				g_stdout.writeNumber( pLine->nPattern );
+			}
+			g_stdout.writeString( ",\"text\":" );
+			g_stdout.writeJsonString( pLine->pBuf + lstrlen(pLine->pBuf) + 1, pLine->nTextLen );
+			g_stdout.writeString( "}\r\n" );
+		}
+		return;
+	}
+
+	if( g_aggregate.topCount() )
+	{
+		g_stdout.writeString( "Files with the most matching lines:\r\n" );
+		for(i=0; i<g_aggregate.topCount(); i++)
+		{
+			pFile = g_aggregate.topFile(i);
+			g_stdout.writeFormatted( "%12lu  ", pFile->nLines );
+			g_stdout.writeLine( pFile->pszName );
+		}
+	}
+	if( g_aggregate.patternCount() )
+	{
+		g_stdout.writeString( "Lines matched, counting the first pattern that matched:\r\n" );
+		for(i=0; i<g_aggregate.patternCount(); i++)
+		{
+			p = g_aggregate.patternAt(i);
+			g_stdout.writeFormatted( "%12lu  ", g_aggregate.patternHits(p) );
+			g_stdout.write( pPatterns->get(p), pPatterns->lengthOf(p) );
+			g_stdout.writeString( "\r\n" );
+		}
+	}
+	if( g_aggregate.sampleCount() )
+	{
+		g_stdout.writeFormatted( "%ld of the ", g_aggregate.sampleCount() );
+		g_stdout.writeNumber( g_aggregate.sampledFrom() );
+		g_stdout.writeString( " matching line(s), picked at random:\r\n" );
+		for(i=0; i<g_aggregate.sampleCount(); i++)
+		{
+			pLine = g_aggregate.sampleLine(i);
+			if( !(g_options.bOneFile || g_options.bNoFileAppend) && !bStdin )
+				g_stdout.writeFormatted( "%s: ", pLine->pBuf );
+			if( g_options.bLineNumber && !bStdin )
+				g_stdout.writeFormatted( "%lu: ", pLine->nLine );
+			WriteDisplayLine( g_stdout, pLine->pBuf + lstrlen(pLine->pBuf) + 1, pLine->nTextLen );
+		}
+	}
+}
+
+
+//----------------------------------------------------------------
+// Writes the line followed by CR/LF. Control characters other
+// than tab, and bytes that are not part of a valid UTF-8 sequence,
+// are replaced with NON_DISPLAYABLE_CHAR; everything else goes out
+// in as few writes as possible.
+//----------------------------------------------------------------
+void WriteDisplayLine(grep_output& out, LPCSTR pLine, long nLineLen)
+{
+	LPCSTR pc   = pLine;
+	LPCSTR pRun = pLine;	// start of the current run of displayable chars
+	LPCSTR pEnd = pLine + nLineLen;
+	long   nSeq;
+
+	while(pc < pEnd)
+	{
+		if((unsigned char)*pc >= 32)
+		{
+			if((unsigned char)*pc < 0x80)
+			{
+				pc++;
+				continue;
+			}
+			if( (nSeq = utf8_seqLength(pc, (long)(pEnd - pc))) != 0 )
+			{
+				pc += nSeq;
+				continue;
+			}
+		}
+		else if(*pc == 9)
+		{
+			pc++;
+			continue;
+		}
+
+		// not displayable: flush the run and substitute
+		if(pc > pRun)
+			out.write( pRun, (long)(pc - pRun) );
+		out.write( &NON_DISPLAYABLE_CHAR, 1 );
+		pRun = ++pc;
+	}
+	if(pc > pRun)
+		out.write( pRun, (long)(pc - pRun) );
+	out.writeString( "\r\n" );
+}
+
 
 //----------------------------------------------------------------
 // GrepUsage() - Displays usage syntax. What a surprise!
@@ -246,8 +1177,9 @@ void GrepUsage(bool bVerbose)
 				"\twildcards  include  * (matches  zero or more\n"
 				"\tcharacters),  and ? (exactly one character).\n"
 				"\tAll other characters  are matched literally.\n"
-				"\tThe -w and -x options are not valid with the\n"
-				"\twildcard search.  This option is NT only.\n\n"
+				"\tThe -w option is not valid with the wildcard\n"
+				"\tsearch;  with  -x  the pattern has to match\n"
+				"\tthe entire line.  This option is NT only.\n\n"
 
 			"  -P\tMatch  using  phonetic  search.  If an input\n"
 				"\tline contains any  words that sound like any\n"
@@ -264,8 +1196,9 @@ void GrepUsage(bool bVerbose)
 
 				"\tEach pattern will be interpreted  as  a full\n"
 				"\tregular expression, which includes the basic\n"
-				"\tregular expression syntax, except for \\( and\n"
-				"\t\\), and including:\n\n" // except \{m,n\} also?
+				"\tregular expression syntax, where ( ) and {m,n}\n"
+				"\tare written without the backslash,  and\n"
+				"\tincluding:\n\n"
 
 				"\t 1. A full regular expression  followed by +\n"
 				"\t    that matches  one or more occurrences of\n"
@@ -281,6 +1214,12 @@ void GrepUsage(bool bVerbose)
 
 				"\t 4. A full  regular expression that  may  be\n"
 				"\t    enclosed in parentheses () for grouping.\n\n"
+				"\t 5. A full regular expression followed by\n"
+				"\t    {m}, {m,}, or {m,n} that matches m, at\n"
+				"\t    least m, or m to n occurrences of it.\n\n"
+
+				"\t 6. \\1 to \\9, which match the text the first\n"
+				"\t    to ninth parenthesized group matched.\n\n"
 
 				"\tThe order of precedence of  operators is [],\n"
 				"\tthen  *?+,  then  concatenation,  then | and\n"
@@ -330,6 +1269,145 @@ void GrepUsage(bool bVerbose)
 				"\tof lines  matched  at the end of the search.\n"
 				"\tThis option is NT only.\n\n"
 
+			"  --fuzzy[=K]\n"
+				"\tMatch using approximate search.  A line is\n"
+				"\tmatched if some text in it is  within K\n"
+				"\tedits of a pattern:  bytes inserted, left\n"
+				"\tout or replaced. K is 0 to 32, 1 if left\n"
+				"\tout.  With -w the text must be whole words,\n"
+				"\twith -x the entire line.  Patterns of up\n"
+				"\tto 64 bytes are the fastest.\n\n"
+
+			"  --io=buffered|direct\n"
+				"\tHow the files are read.  buffered (the de-\n"
+				"\tfault) reads through the system file cache\n"
+				"\twith read-ahead. direct bypasses the cache,\n"
+				"\tfor huge files that  won\'t be read again\n"
+				"\tsoon, if the file system allows it.\n\n"
+
+			"  --read-size=N[K|M]\n"
+				"\tSize of each read from a file, 4K  to 64M.\n"
+				"\tThe default is 256K.\n\n"
+
+			"  --async=N\n"
+				"\tWhen searching many files, read up to N of\n"
+				"\tthem ahead of the search,  each one up to\n"
+				"\tthe read size.  0 turns it off. The default\n"
+				"\tis 32.\n\n"
+
+			"  --threads=N\n"
+				"\tSearch up to N files at once. The output\n"
+				"\tis in the order the files were found, as\n"
+				"\twith one thread;  output of files ahead\n"
+				"\tof their turn is kept until it comes. Not\n"
+				"\twith --stats. The default is 1.\n\n"
+
+			"  --unordered\n"
+				"\tWith --threads, write each file's output\n"
+				"\tas soon as it can go,  in whatever order\n"
+				"\tthe files are done. A file's lines still\n"
+				"\tcome out together.\n\n"
+
+			"  --memory=N[K|M|G]\n"
+				"\tKeep the buffers of the search within N\n"
+				"\tbytes: fewer files are read ahead,  and a\n"
+				"\tline too long for what is left is split.\n"
+				"\tOutput is never held back, so a slow con-\n"
+				"\tsumer of it slows the search down instead.\n"
+				"\t--stats reports the peak memory used.\n\n"
+
+			"  --cache=dir\n"
+				"\tKeep  compiled  wildcard  (-W) and phonetic\n"
+				"\t(-P) pattern sets in dir,  and use them in\n"
+				"\tlater runs with the same patterns and op-\n"
+				"\ttions instead of compiling again.  With -R,\n"
+				"\talso keep the names in the directories\n"
+				"\twalked; later runs read again only those\n"
+				"\tthat changed.  The tree is then listed be-\n"
+				"\tfore the search starts.\n\n"
+
+			"  --max-count=N\n"
+				"\tStop reading a file after N selected lines.\n\n"
+
+			"  --range=START:END\n"
+				"\tSearch only the lines that start at byte\n"
+				"\toffsets START to END-1 of each file; the\n"
+				"\tfile is read from there, not from the\n"
+				"\tstart. Either one can be left out.  K, M\n"
+				"\tand G multiply by 1024s. Line numbers are\n"
+				"\tcounted from START.\n\n"
+
+			"  --multiline[=N[K|M]]\n"
+				"\tLet the patterns  (not with -W  or -P)\n"
+				"\tmatch across line breaks, and write the\n"
+				"\tlines each match covers.  The file is\n"
+				"\tsearched in blocks;  a match that runs\n"
+				"\tinto the next block is found if it starts\n"
+				"\twithin N bytes of its end (64K by default,\n"
+				"\tat most the read size).  Not with -v, -x.\n\n"
+
+			"  --archives\n"
+				"\tSearch the files in .zip, .jar, .tar, .tgz\n"
+				"\tand .tar.gz files, as archive:member, in-\n"
+				"\tstead of the archives themselves.  Nothing\n"
+				"\tis extracted to disk.  Encrypted and zip64\n"
+				"\tmembers are passed over.\n\n"
+
+			"  --json\n"
+				"\tWrite each output line as a JSON object:\n"
+				"\tthe file (null for stdin),  line number,\n"
+				"\tbyte offset of the line,  and for a match\n"
+				"\tthe index of the pattern, and the start\n"
+				"\tand length of the match in the line. -n\n"
+				"\tand -h don't apply.  Offsets  in UTF-16\n"
+				"\tfiles are in the text converted to UTF-8.\n\n"
+
+			"  --stats[=first|all]\n"
+				"\tAt the end, list for each pattern the lines\n"
+				"\tit matched,  and the bytes and time its\n"
+				"\tsearch took, the costliest first. first\n"
+				"\t(the default) counts only the first pat-\n"
+				"\ttern matching a line, the others are not\n"
+				"\ttried; all tries and counts every one.\n"
+				"\t-W and -P match all the patterns in one\n"
+				"\tpass: their time is given for the set.\n"
+				"\tLast come the peak memory use, and the\n"
+				"\tallocations the patterns took.\n\n"
+
+			"  --top[=K]\n"
+				"\tInstead of the lines, list the K files (10\n"
+				"\tif left out) with the most matching lines,\n"
+				"\tthe most first.\n\n"
+
+			"  --by-pattern\n"
+				"\tInstead of the lines, list how many lines\n"
+				"\teach pattern was the first to match,  the\n"
+				"\tmost first. Not with -v.\n\n"
+
+			"  --sample=N\n"
+				"\tInstead of the lines, write N of them\n"
+				"\tpicked at random, each matching line as\n"
+				"\tlikely as any other, in the order found.\n"
+				"\tOnly N lines are kept however many match.\n\n"
+
+				"\t--top, --by-pattern and --sample can be\n"
+				"\tgiven together;  not with -l, -q.  The\n"
+				"\tlast two search one file at a time and\n"
+				"\tdon't take --multiline.\n\n"
+
+			"  --server=socket\n"
+				"\tMust be the first option. Stay up and run\n"
+				"\tthe searches  sent to the local socket by\n"
+				"\t--client,  keeping  the compiled patterns\n"
+				"\tand the directory listings between them.\n"
+				"\tNot available on Windows.\n\n"
+
+			"  --client=socket\n"
+				"\tMust be the first option.  Have the server\n"
+				"\ton socket run  the rest  of  the  command\n"
+				"\tline.  Files must be named; the server\n"
+				"\tcan\'t read the client\'s stdin.\n\n"
+
 			"  -e pattern\n"
 				"\tSpecify one or more patterns to be used dur-\n"
 				"\ting the search for input.  Each pattern must\n"
@@ -351,7 +1429,8 @@ void GrepUsage(bool bVerbose)
 				"\tby an empty line in pattern_file. Unless the\n"
 				"\t-E, -F, -W, or -P  option is also specified,\n"
 				"\teach  pattern  will be  treated as  a  basic\n"
-				"\tregular expression.\n\n"
+				"\tregular expression.  Repeated patterns are\n"
+				"\tsearched for only once.\n\n"
 			
 			"  pattern\n"
 				"\tThe string/regular expression to search for.\n\n"
@@ -374,6 +1453,11 @@ void GrepUsage(bool bVerbose)
 			"     backslash (\\). Double quotes that don\'t enclose\n"
 			"     a pattern and  are not escaped with a backslash\n"
 			"     are not passed by the shell and will be ignored.\n"
+			"  4. Input may be ASCII, UTF-8, or UTF-16. UTF-16 is\n"
+			"     recognized by its byte order mark or content,\n"
+			"     and is converted to UTF-8 for matching and out-\n"
+			"     put. With -i, accented Latin, Greek and Cyril-\n"
+			"     lic letters are matched regardless of case.\n"
 
 /*
 			"Where:\r\n"
@@ -49,8 +49,8 @@ BSC32=bscmake.exe
 # ADD BASE BSC32 /nologo
 # ADD BSC32 /nologo
 LINK32=link.exe
-# ADD BASE LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /subsystem:console /machine:I386
-# ADD LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /subsystem:console /machine:I386
+# ADD BASE LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib psapi.lib /nologo /subsystem:console /machine:I386
+# ADD LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib psapi.lib /nologo /subsystem:console /machine:I386
 
 !ELSEIF  "$(CFG)" == "grep - Win32 Debug"
 
@@ -74,8 +74,8 @@ BSC32=bscmake.exe
 # ADD BASE BSC32 /nologo
 # ADD BSC32 /nologo
 LINK32=link.exe
-# ADD BASE LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /subsystem:console /debug /machine:I386 /pdbtype:sept
-# ADD LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /subsystem:console /debug /machine:I386 /pdbtype:sept
+# ADD BASE LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib psapi.lib /nologo /subsystem:console /debug /machine:I386 /pdbtype:sept
+# ADD LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib psapi.lib /nologo /subsystem:console /debug /machine:I386 /pdbtype:sept
 
 !ENDIF 
 
@@ -92,14 +92,106 @@ SOURCE=.\grep.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\grep_aggregate.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_archive.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_arena.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_budget.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_cache.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_dirlist.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_fuzzy.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_inflate.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_input.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_lib.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\grep_options.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\grep_output.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_parallel.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_patterns.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_prefetch.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_reader.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_regex.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\grep_search.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\grep_server.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_snapshot.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_soundex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_stats.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_thread.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_utf8.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_wildcard.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\incl_files.cpp
 # End Source File
 # End Group
@@ -112,12 +204,108 @@ SOURCE=.\grep.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\grep_aggregate.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_archive.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_arena.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_budget.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_cache.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_dirlist.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_fuzzy.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_inflate.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_input.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_lib.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\grep_options.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\grep_output.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_parallel.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_patterns.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_prefetch.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_reader.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_regex.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_scratch.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\grep_search.h
 # End Source File
+# Begin Source File
+
+SOURCE=.\grep_server.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_snapshot.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_soundex.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_stats.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_thread.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_utf8.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\grep_wildcard.h
+# End Source File
 # End Group
 # Begin Group "Resource Files"
 
@@ -7,7 +7,23 @@
 #define _grep_h_inc_
 
 #include <stdlib.h>
+#ifdef _WIN32
 #include <conio.h>
+#endif
+
+// SSE2 is used by the scanning kernels when the target has it
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GREP_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// The scanning kernels are also built for AVX2 when the build asks
+// for it (CMakeLists.txt); the loader picks the version to run
+#if defined(GREP_MULTIVERSION) && defined(__GNUC__) && defined(__x86_64__)
+#define GREP_TARGET_CLONES	__attribute__((target_clones("avx2", "default")))
+#else
+#define GREP_TARGET_CLONES
+#endif
 
 #include <_strfuncs_.h>
 #include <_string_array_.h>
@@ -16,7 +32,6 @@
 #include <_boyer_moore_.h>
 #include <_wildcard_search_.h>
 #include <_soundex_.h>
-#include <_regex_.h>
 
 using namespace soige;  // my util classes namespace
 
@@ -33,6 +48,15 @@ using namespace soige;  // my util classes namespace
 const char NON_DISPLAYABLE_CHAR = '?';
 
 typedef unsigned long ulong;
+#ifdef _MSC_VER
+typedef unsigned __int64	ulonglong;
+typedef __int64				longlong;
+#define ULL(n)	n##ui64
+#else
+typedef unsigned long long	ulonglong;
+typedef long long			longlong;
+#define ULL(n)	n##ULL
+#endif
 
 // Typedef for string comparison func (depends on case)
 typedef int   (*PSTRCMP)(const void*, const void*, size_t);
@@ -49,7 +73,8 @@ enum grep_search_type
 	search_phonetic,	//  -P: phonetic search - soundex
 	search_regex,		// def: basic regular expression search - regex
 	search_full_regex,	//  -E: full (extended) regular expression search - full regex
-	search_wildcard		//  -W: simple wildcard (* and ?) search - wildcard
+	search_wildcard,	//  -W: simple wildcard (* and ?) search - wildcard
+	search_fuzzy		//  --fuzzy: approximate search, within k edits - bit-parallel
 };
 
 
@@ -61,6 +86,8 @@ class  grep_options;
 extern grep_options g_options;
 class  grep_search;
 extern grep_search  g_searcher;
+// The searcher in use: g_searcher, or one the server has kept compiled
+extern grep_search* g_pSearcher;
 
 // File and line counts
 extern ulong g_uAllFileCount;
@@ -73,8 +100,16 @@ extern PSTRCMP pfncmp;
 // String searching function; set in g_options.parseOptions depending on case-sensitivity
 extern PSTRSTR pfnstr;
 
-// stdout
-extern _win32_file_  g_stdout;
+// Set when the search can stop early (-q matched)
+extern bool g_bQuitSearch;
+
+// stdout, buffered
+class  grep_output;
+extern grep_output  g_stdout;
+
+// Reports that the heap is exhausted and exits, for the allocations
+// there is no way on without (grep_arena); the program defines it
+void grep_outOfMemory();
 
 #endif	// _grep_h_inc_
 
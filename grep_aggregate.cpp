@@ -0,0 +1,235 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_aggregate.cpp - implementation of grep_aggregate
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_aggregate.h"
+#include "grep_stats.h"
+
+// The results being sorted; qsort gives the compare function no context
+static const grep_aggregate* s_pSorting = NULL;
+
+grep_aggregate::grep_aggregate()
+{
+	_top		= NULL;
+	_nTop		= 0;
+	_nTopMax	= 0;
+	_nFiles		= 0;
+	_hits		= NULL;
+	_order		= NULL;
+	_nPatterns	= 0;
+	_sample		= NULL;
+	_nSample	= 0;
+	_nSampleMax	= 0;
+	_uSeen		= 0;
+	_uRandom	= 0;
+}
+
+grep_aggregate::~grep_aggregate()
+{
+	release();
+}
+
+void grep_aggregate::init(long nTopFiles, long nPatterns, bool bByPattern, long nSample)
+{
+	long i;
+
+	release();
+	if(nTopFiles)
+	{
+		_top = new grep_top_file[nTopFiles];
+		_nTopMax = nTopFiles;
+	}
+	if(bByPattern)
+	{
+		_nPatterns = nPatterns;
+		_hits = new ulong[nPatterns + 1];
+		_order = new long[nPatterns + 1];
+		memset(_hits, 0, (nPatterns + 1) * sizeof(ulong));
+		for(i=0; i<nPatterns; i++)
+			_order[i] = i;
+	}
+	if(nSample)
+	{
+		_sample = new grep_sampled_line[nSample];
+		memset(_sample, 0, nSample * sizeof(grep_sampled_line));
+		_nSampleMax = nSample;
+		// any odd seed will do; a different sample each run
+		_uRandom = (grep_ticks() << 1) | 1;
+	}
+}
+
+void grep_aggregate::release()
+{
+	long i;
+
+	for(i=0; i<_nTop; i++)
+		delete[] _top[i].pszName;
+	for(i=0; i<_nSampleMax; i++)
+		free(_sample[i].pBuf);
+	delete[] _top;
+	delete[] _hits;
+	delete[] _order;
+	delete[] _sample;
+	_top		= NULL;
+	_hits		= NULL;
+	_order		= NULL;
+	_sample		= NULL;
+	_nTop = _nTopMax = _nPatterns = _nSample = _nSampleMax = 0;
+	_nFiles		= 0;
+	_uSeen		= 0;
+}
+
+//----------------------------------------------------------------
+// --top: the file's count goes in the heap if it is not full yet,
+// or in place of the root if it has more lines. Of files with as
+// many lines, the ones searched first are kept.
+//----------------------------------------------------------------
+void grep_aggregate::addFile(LPCTSTR pszFileName, ulong nMatchedLines)
+{
+	grep_top_file file;
+	long i, nParent;
+
+	file.nSeq = _nFiles++;
+	if(!_nTopMax || !nMatchedLines)
+		return;
+	file.nLines = nMatchedLines;
+	if(_nTop == _nTopMax && !_less(_top[0], file))
+		return;
+
+	file.pszName = new TCHAR[lstrlen(pszFileName) + 1];
+	lstrcpy(file.pszName, pszFileName);
+	if(_nTop == _nTopMax)
+	{
+		delete[] _top[0].pszName;
+		_top[0] = file;
+		_siftDown(0);
+		return;
+	}
+
+	// up from the bottom
+	for(i = _nTop++; i > 0; i = nParent)
+	{
+		nParent = (i - 1) / 2;
+		if(!_less(file, _top[nParent]))
+			break;
+		_top[i] = _top[nParent];
+	}
+	_top[i] = file;
+}
+
+// Fewer lines, or as many and searched later
+bool grep_aggregate::_less(const grep_top_file& f1, const grep_top_file& f2)
+{
+	if(f1.nLines != f2.nLines)
+		return (f1.nLines < f2.nLines);
+	return (f1.nSeq > f2.nSeq);
+}
+
+void grep_aggregate::_siftDown(long i)
+{
+	grep_top_file file = _top[i];
+	long nChild;
+
+	while((nChild = 2 * i + 1) < _nTop)
+	{
+		if(nChild + 1 < _nTop && _less(_top[nChild + 1], _top[nChild]))
+			nChild++;
+		if(!_less(_top[nChild], file))
+			break;
+		_top[i] = _top[nChild];
+		i = nChild;
+	}
+	_top[i] = file;
+}
+
+//----------------------------------------------------------------
+// A matching line, for --by-pattern and --sample. nPattern is the
+// index grep_search::match gave, -1 for lines -v selects.
+//----------------------------------------------------------------
+void grep_aggregate::addLine(LPCTSTR pszFileName, ulong nLine, LPCSTR pLine, long nLineLen, long nPattern)
+{
+	ulonglong uSlot;
+
+	if(_hits && nPattern >= 0 && nPattern < _nPatterns)
+		_hits[nPattern]++;
+	if(!_nSampleMax)
+		return;
+
+	// the first N lines fill the sample; the k-th after that takes a
+	// random place in it with probability N/k
+	_uSeen++;
+	if(_nSample < _nSampleMax)
+		_keepLine(&_sample[_nSample++], pszFileName, nLine, pLine, nLineLen, nPattern);
+	else if((uSlot = _random() % _uSeen) < (ulonglong)_nSampleMax)
+		_keepLine(&_sample[uSlot], pszFileName, nLine, pLine, nLineLen, nPattern);
+}
+
+void grep_aggregate::_keepLine( grep_sampled_line* pSlot, LPCTSTR pszFileName, ulong nLine,
+								LPCSTR pLine, long nLineLen, long nPattern )
+{
+	long nNameLen = lstrlen(pszFileName);
+	long nSize = nNameLen + 1 + nLineLen;
+
+	// the buffers only grow: after a while, lines are copied without
+	// an allocation
+	if(nSize > pSlot->nBufSize)
+	{
+		if(nSize < 2 * pSlot->nBufSize)
+			nSize = 2 * pSlot->nBufSize;
+		free(pSlot->pBuf);
+		pSlot->pBuf = (char*)malloc(nSize);
+		pSlot->nBufSize = nSize;
+	}
+	memcpy(pSlot->pBuf, pszFileName, nNameLen + 1);
+	memcpy(pSlot->pBuf + nNameLen + 1, pLine, nLineLen);
+	pSlot->nTextLen	= nLineLen;
+	pSlot->nLine	= nLine;
+	pSlot->nPattern	= nPattern;
+	pSlot->uSeq		= _uSeen;
+}
+
+ulonglong grep_aggregate::_random()
+{
+	_uRandom ^= _uRandom << 13;
+	_uRandom ^= _uRandom >> 7;
+	_uRandom ^= _uRandom << 17;
+	return _uRandom;
+}
+
+//----------------------------------------------------------------
+// Orders the results for writing them out
+//----------------------------------------------------------------
+void grep_aggregate::finish()
+{
+	s_pSorting = this;
+	if(_nTop)
+		qsort(_top, _nTop, sizeof(grep_top_file), _compareTop);
+	if(_hits)
+		qsort(_order, _nPatterns, sizeof(long), _comparePatterns);
+	if(_nSample)
+		qsort(_sample, _nSample, sizeof(grep_sampled_line), _compareSample);
+	s_pSorting = NULL;
+}
+
+// The most lines first, then the order searched
+int grep_aggregate::_compareTop(const void* p1, const void* p2)
+{
+	return (_less(*(const grep_top_file*)p2, *(const grep_top_file*)p1) ? -1 : 1);
+}
+
+// The most hits first, then the pattern order
+int grep_aggregate::_comparePatterns(const void* p1, const void* p2)
+{
+	const grep_aggregate* pThis = s_pSorting;
+	long i1 = *(const long*)p1;
+	long i2 = *(const long*)p2;
+
+	if(pThis->_hits[i1] != pThis->_hits[i2])
+		return (pThis->_hits[i1] > pThis->_hits[i2] ? -1 : 1);
+	return (i1 < i2 ? -1 : 1);
+}
+
+int grep_aggregate::_compareSample(const void* p1, const void* p2)
+{
+	return (((const grep_sampled_line*)p1)->uSeq < ((const grep_sampled_line*)p2)->uSeq ? -1 : 1);
+}
@@ -0,0 +1,99 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_aggregate.h - summaries of the matches instead of the lines
+// (--top, --by-pattern, --sample).
+//
+// --top keeps the K files with the most matching lines in a heap
+// whose root is the least of them, so each file costs a compare
+// and at most log K moves. --by-pattern counts the lines each
+// pattern was the first to match. --sample keeps N matching lines
+// picked uniformly at random from all of them (reservoir sampling:
+// the k-th line replaces a random one of the N with probability
+// N/k), so the memory is N lines however many match.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_aggregate_inc_
+#define _grep_aggregate_inc_
+
+#include "grep.h"
+
+// A file --top keeps
+struct grep_top_file
+{
+	TCHAR*	pszName;
+	ulong	nLines;		// matching lines
+	ulong	nSeq;		// the order the file was searched in
+};
+
+// A line --sample keeps
+struct grep_sampled_line
+{
+	char*	pBuf;		// the file name, a 0, then the text
+	long	nBufSize;
+	long	nTextLen;
+	ulong	nLine;
+	long	nPattern;	// -1 for lines -v selects
+	ulonglong uSeq;		// the order the line was matched in
+};
+
+class grep_aggregate
+{
+public:
+	grep_aggregate();
+	~grep_aggregate();
+
+	// Zero of any of them turns that summary off
+	void init(long nTopFiles, long nPatterns, bool bByPattern, long nSample);
+	void release();
+	bool isActive() const		{ return _nTopMax || _hits || _nSampleMax; }
+	// whether addLine needs to be called for each matching line
+	bool wantsLines() const		{ return _hits || _nSampleMax; }
+
+	// The callers serialize these: addFile is called with the file
+	// counts lock held, addLine only where files are searched one at
+	// a time (see grep_options::_validate)
+	void addFile(LPCTSTR pszFileName, ulong nMatchedLines);
+	void addLine(LPCTSTR pszFileName, ulong nLine, LPCSTR pLine, long nLineLen, long nPattern);
+
+	// Sorts the results for reading: the files the most lines first,
+	// the patterns likewise, the sample in the order it was matched
+	void finish();
+
+	long topCount() const						{ return _nTop; }
+	const grep_top_file* topFile(long i) const	{ return &_top[i]; }
+	long patternCount() const					{ return _nPatterns; }
+	// the i-th pattern after finish(), and the lines it matched
+	long patternAt(long i) const				{ return _order[i]; }
+	ulong patternHits(long nPattern) const		{ return _hits[nPattern]; }
+	long sampleCount() const					{ return _nSample; }
+	const grep_sampled_line* sampleLine(long i) const	{ return &_sample[i]; }
+	// all the matching lines the sample was taken from
+	ulonglong sampledFrom() const				{ return _uSeen; }
+
+private:
+	grep_top_file*		_top;		// a heap, the fewest lines at the root
+	long				_nTop;
+	long				_nTopMax;
+	ulong				_nFiles;
+
+	ulong*				_hits;		// per pattern, NULL without --by-pattern
+	long*				_order;
+	long				_nPatterns;
+
+	grep_sampled_line*	_sample;
+	long				_nSample;
+	long				_nSampleMax;
+	ulonglong			_uSeen;
+	ulonglong			_uRandom;	// xorshift64 state
+
+private:
+	static bool _less(const grep_top_file& f1, const grep_top_file& f2);
+	void _siftDown(long i);
+	void _keepLine(grep_sampled_line* pSlot, LPCTSTR pszFileName, ulong nLine,
+				   LPCSTR pLine, long nLineLen, long nPattern);
+	ulonglong _random();
+	static int _compareTop(const void* p1, const void* p2);
+	static int _comparePatterns(const void* p1, const void* p2);
+	static int _compareSample(const void* p1, const void* p2);
+};
+
+#endif	// _grep_aggregate_inc_
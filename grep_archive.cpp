@@ -0,0 +1,507 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_archive.cpp - implementation of grep_archive
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_archive.h"
+
+// zip record signatures
+static const ulong ZIP_LOCAL_HEADER	= 0x04034B50;
+static const ulong ZIP_DIR_ENTRY	= 0x02014B50;
+static const ulong ZIP_END_OF_DIR	= 0x06054B50;
+// The end of directory record is 22 bytes and a comment of up to 64K
+static const long  ZIP_END_SEARCH	= 22 + 65535;
+
+static const long  TAR_BLOCK		= 512;
+
+// little-endian fields of the zip records
+inline ulong zip16(const char* p)
+{
+	return (ulong)(unsigned char)p[0] | ((ulong)(unsigned char)p[1] << 8);
+}
+inline ulong zip32(const char* p)
+{
+	return zip16(p) | (zip16(p + 2) << 16);
+}
+
+grep_archive::grep_archive()
+{
+	_type		= archive_none;
+	_pMap		= NULL;
+	_nMapLen	= 0;
+	_nPos		= 0;
+	_nEntries	= 0;
+	_bDamaged	= false;
+	_nLeft		= 0;
+	_nPadding	= 0;
+	_szArchive[0]	= _T('\0');
+	_szLongName[0]	= '\0';
+}
+
+grep_archive::~grep_archive()
+{
+	close();
+}
+
+grep_archive_type grep_archive::typeOf(LPCTSTR pszFileName)
+{
+	static const struct { LPCTSTR pszExt; grep_archive_type type; } s_exts[] =
+	{
+		{ _T(".zip"), archive_zip },
+		{ _T(".jar"), archive_zip },
+		{ _T(".tar"), archive_tar },
+		{ _T(".tgz"), archive_tgz },
+		{ _T(".tar.gz"), archive_tgz }
+	};
+	int nLen = lstrlen(pszFileName);
+	int i, j, nExt;
+
+	for(i=0; i<(int)(sizeof(s_exts)/sizeof(s_exts[0])); i++)
+	{
+		nExt = lstrlen(s_exts[i].pszExt);
+		if(nLen <= nExt)
+			continue;
+		for(j=0; j<nExt && _totlower(pszFileName[nLen - nExt + j]) == s_exts[i].pszExt[j]; j++)
+			;
+		if(j == nExt)
+			return s_exts[i].type;
+	}
+	return archive_none;
+}
+
+bool grep_archive::open(LPCTSTR pszFileName, grep_archive_type type)
+{
+	long i;
+
+	close();
+	if(!grep_input::mapFile(pszFileName, false, &_pMap, &_nMapLen))
+		return false;
+	lstrcpyn(_szArchive, pszFileName, sizeof(_szArchive)/sizeof(TCHAR));
+	_type = type;
+
+	switch(type)
+	{
+	case archive_zip:
+		// the end of directory record, from the end back
+		for(i = _nMapLen - 22; i >= 0 && i >= _nMapLen - ZIP_END_SEARCH; i--)
+		{
+			if(zip32(_pMap + i) == ZIP_END_OF_DIR)
+				break;
+		}
+		if(i < 0 || i < _nMapLen - ZIP_END_SEARCH)
+		{
+			// no directory; an empty file is an empty archive
+			_bDamaged = (_nMapLen != 0);
+			_nEntries = 0;
+			break;
+		}
+		_nEntries = (long)zip16(_pMap + i + 10);
+		_nPos = (long)zip32(_pMap + i + 16);
+		if(_nEntries == 0xFFFF || zip32(_pMap + i + 16) == 0xFFFFFFFF)
+		{
+			_bDamaged = true;	// zip64, not supported
+			_nEntries = 0;
+		}
+		break;
+	case archive_tgz:
+		if(!_inflater.initGzip((const unsigned char*)_pMap, _nMapLen))
+			_bDamaged = (_nMapLen != 0);
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
+void grep_archive::close()
+{
+	if(_pMap || _nMapLen)
+		grep_input::unmapFile(_pMap, _nMapLen);
+	_pMap		= NULL;
+	_nMapLen	= 0;
+	_nPos		= 0;
+	_nEntries	= 0;
+	_bDamaged	= false;
+	_nLeft		= 0;
+	_nPadding	= 0;
+	_szLongName[0] = '\0';
+	_type		= archive_none;
+}
+
+bool grep_archive::next(grep_archive_member* pMember)
+{
+	if(_bDamaged)
+		return false;
+	if(_type == archive_zip)
+		return _nextZip(pMember);
+	return _nextTar(pMember);
+}
+
+void grep_archive::openMember(grep_archive_member* pMember, grep_input& input)
+{
+	if(_type == archive_tgz)
+		input.openStream(pMember->szName, _readTgzMember, this);
+	else if(pMember->bDeflated)
+	{
+		_inflater.init((const unsigned char*)pMember->pData, pMember->nLen);
+		input.openStream(pMember->szName, _readInflated, this);
+	}
+	else
+		input.openMemory(pMember->szName, pMember->pData, pMember->nLen);
+}
+
+//----------------------------------------------------------------
+// Inflates a zip member into the buffer; runs on the prefetcher's
+// threads, so it has an inflater of its own
+//----------------------------------------------------------------
+grep_prefetch_status grep_archive::loadMember(void* pContext, char* pBuf, long nBufSize, long* pnLen)
+{
+	grep_archive_member* pMember = (grep_archive_member*)pContext;
+	grep_inflater* pInflater;
+	grep_prefetch_status nStatus;
+	long nLen = 0, n = 0;
+	char c;
+
+	*pnLen = 0;
+	if(pMember->nSize > nBufSize)
+		return pf_too_big;
+
+	pInflater = new grep_inflater;
+	pInflater->init((const unsigned char*)pMember->pData, pMember->nLen);
+	while( nLen < nBufSize && (n = pInflater->read(pBuf + nLen, nBufSize - nLen)) > 0 )
+		nLen += n;
+	if(n < 0)
+		nStatus = pf_read_failed;
+	else if(nLen == nBufSize && pInflater->read(&c, 1) != 0)
+		nStatus = pf_too_big;
+	else
+		nStatus = pf_ok;
+	delete pInflater;
+
+	*pnLen = nLen;
+	return nStatus;
+}
+
+//----------------------------------------------------------------
+// zip: the central directory lists the members; each one points
+// to its local header, which the data follows
+//----------------------------------------------------------------
+bool grep_archive::_nextZip(grep_archive_member* pMember)
+{
+	const char* e;
+	const char* pLocal;
+	ulong uFlags, uMethod, uCompressed, uSize, uOffset;
+	long  nNameLen, nData;
+
+	while(_nEntries > 0)
+	{
+		_nEntries--;
+		e = _pMap + _nPos;
+		if( _nPos < 0 || _nPos > _nMapLen - 46 || zip32(e) != ZIP_DIR_ENTRY )
+			break;
+		uFlags		= zip16(e + 8);
+		uMethod		= zip16(e + 10);
+		uCompressed	= zip32(e + 20);
+		uSize		= zip32(e + 24);
+		nNameLen	= (long)zip16(e + 28);
+		uOffset		= zip32(e + 42);
+		_nPos += 46 + nNameLen + (long)zip16(e + 30) + (long)zip16(e + 32);
+		if(_nPos > _nMapLen)
+			break;
+
+		// directories, encrypted members, methods other than stored
+		// and deflated, and zip64 sizes are passed over
+		if( (nNameLen > 0 && e[46 + nNameLen - 1] == '/') || (uFlags & 1) ||
+			(uMethod != 0 && uMethod != 8) ||
+			uCompressed == 0xFFFFFFFF || uSize == 0xFFFFFFFF || uOffset == 0xFFFFFFFF )
+			continue;
+
+		if( uOffset > (ulong)(_nMapLen - 30) || zip32(_pMap + uOffset) != ZIP_LOCAL_HEADER )
+			break;
+		pLocal = _pMap + uOffset;
+		nData = (long)uOffset + 30 + (long)zip16(pLocal + 26) + (long)zip16(pLocal + 28);
+		if( nData > _nMapLen || uCompressed > (ulong)(_nMapLen - nData) || uSize > 0x7FFFFFFF )
+			break;
+
+		_memberName(pMember, e + 46, nNameLen);
+		pMember->pData		= _pMap + nData;
+		pMember->nLen		= (long)uCompressed;
+		pMember->nSize		= (long)uSize;
+		pMember->bDeflated	= (uMethod == 8);
+		return true;
+	}
+
+	if(_nEntries > 0)
+		_bDamaged = true;
+	_nEntries = 0;
+	return false;
+}
+
+//----------------------------------------------------------------
+// tar: a 512-byte header before each member, its data padded to
+// 512 bytes, and zero blocks at the end. GNU long names ('L') and
+// pax paths ('x') name the member after them.
+//----------------------------------------------------------------
+bool grep_archive::_nextTar(grep_archive_member* pMember)
+{
+	unsigned char hdr[TAR_BLOCK];
+	char  szName[MAX_PATH*2];
+	char  extended[8192];
+	const char* pData = NULL;
+	long  nSize, nPad, n;
+	char  cType;
+	int   nResult;
+
+	for(;;)
+	{
+		if(_type == archive_tar)
+		{
+			if(_nPos > _nMapLen - TAR_BLOCK)
+				return false;
+			memcpy(hdr, _pMap + _nPos, TAR_BLOCK);
+		}
+		else
+		{
+			// what the search didn't read of the previous member
+			if(!_skipTgz(_nLeft + _nPadding))
+			{
+				_bDamaged = true;
+				return false;
+			}
+			_nLeft = _nPadding = 0;
+			n = _readTgz(hdr, TAR_BLOCK);
+			if(n < TAR_BLOCK)
+			{
+				_bDamaged = (n != 0);
+				return false;
+			}
+		}
+
+		nResult = _tarHeader(hdr, &nSize, &cType, szName, sizeof(szName));
+		if(nResult <= 0)
+		{
+			_bDamaged = (nResult < 0);
+			return false;
+		}
+		nPad = (TAR_BLOCK - nSize % TAR_BLOCK) % TAR_BLOCK;
+		if(_type == archive_tar)
+		{
+			if(nSize > _nMapLen - _nPos - TAR_BLOCK)
+			{
+				_bDamaged = true;
+				return false;
+			}
+			pData = _pMap + _nPos + TAR_BLOCK;
+			_nPos += TAR_BLOCK + nSize + nPad;
+			if(_nPos > _nMapLen)
+				_nPos = _nMapLen;
+		}
+		else
+		{
+			_nLeft = nSize;
+			_nPadding = nPad;
+		}
+
+		if(cType == 'L' || cType == 'x')
+		{
+			if(_type == archive_tgz)
+			{
+				n = (nSize < (long)sizeof(extended) ? nSize : (long)sizeof(extended));
+				if(_readTgz(extended, n) != n)
+				{
+					_bDamaged = true;
+					return false;
+				}
+				_nLeft -= n;
+				pData = extended;
+				nSize = n;
+			}
+			_tarLongName(pData, nSize, cType);
+			continue;
+		}
+		if(cType != '0' && cType != '\0' && cType != '7')
+		{
+			// directories, links, devices: nothing to search
+			_szLongName[0] = '\0';
+			continue;
+		}
+
+		if(_szLongName[0])
+			_memberName(pMember, _szLongName, lstrlen(_szLongName));
+		else
+			_memberName(pMember, szName, lstrlen(szName));
+		_szLongName[0] = '\0';
+		pMember->pData		= (_type == archive_tar ? pData : NULL);
+		pMember->nLen		= nSize;
+		pMember->nSize		= nSize;
+		pMember->bDeflated	= false;
+		return true;
+	}
+}
+
+//----------------------------------------------------------------
+// Reads a tar header. Returns 1 for a member, 0 for the zero
+// block at the end, -1 if the header is not valid.
+//----------------------------------------------------------------
+int grep_archive::_tarHeader(const unsigned char* h, long* pnSize, char* pcType, LPSTR pszName, long nNameSize)
+{
+	ulong uSum = 0, uChecksum = 0;
+	ulonglong uSize = 0;
+	long  i, nPrefix, nName;
+
+	for(i=0; i<TAR_BLOCK; i++)
+		uSum += (i >= 148 && i < 156 ? ' ' : h[i]);
+	if(uSum == 8 * ' ')
+		return 0;		// all zero
+
+	for(i=148; i<156 && h[i] == ' '; i++)
+		;
+	for(; i<156 && h[i] >= '0' && h[i] <= '7'; i++)
+		uChecksum = uChecksum * 8 + (h[i] - '0');
+	if(uChecksum != uSum)
+		return -1;
+
+	// the size: octal, or base-256 with the high bit set
+	if(h[124] & 0x80)
+	{
+		for(i=125; i<136; i++)
+			uSize = (uSize << 8) | h[i];
+	}
+	else
+	{
+		for(i=124; i<136 && h[i] == ' '; i++)
+			;
+		for(; i<136 && h[i] >= '0' && h[i] <= '7'; i++)
+			uSize = uSize * 8 + (h[i] - '0');
+	}
+	if(uSize > 0x7FFFFFFF)
+		return -1;
+	*pnSize = (long)uSize;
+	*pcType = (char)h[156];
+
+	// ustar: a prefix directory and the name
+	for(nName=0; nName<100 && h[nName]; nName++)
+		;
+	nPrefix = 0;
+	if(!memcmp(h + 257, "ustar", 5))
+	{
+		for(; nPrefix<155 && h[345 + nPrefix]; nPrefix++)
+			;
+	}
+	if(nPrefix + 1 + nName >= nNameSize)
+		return -1;
+	if(nPrefix)
+	{
+		memcpy(pszName, h + 345, nPrefix);
+		pszName[nPrefix++] = '/';
+	}
+	memcpy(pszName + nPrefix, h, nName);
+	pszName[nPrefix + nName] = '\0';
+	return 1;
+}
+
+// The name of the next member, from a GNU long name or pax records
+void grep_archive::_tarLongName(const char* pData, long nLen, char cType)
+{
+	const char* pEnd = pData + nLen;
+	const char* pRec;
+	const char* pc;
+	long nRecLen, n;
+
+	if(cType == 'L')
+	{
+		for(n=0; n<nLen && pData[n]; n++)
+			;
+		if(n >= (long)sizeof(_szLongName))
+			n = sizeof(_szLongName) - 1;
+		memcpy(_szLongName, pData, n);
+		_szLongName[n] = '\0';
+		return;
+	}
+
+	// pax: "<length> <key>=<value>\n" records
+	for(pRec = pData; pRec < pEnd; pRec += nRecLen)
+	{
+		for(nRecLen = 0, pc = pRec; pc < pEnd && *pc >= '0' && *pc <= '9'; pc++)
+			nRecLen = nRecLen * 10 + (*pc - '0');
+		if(nRecLen <= 0 || pRec + nRecLen > pEnd || pc >= pEnd || *pc != ' ')
+			return;
+		pc++;
+		if(pRec + nRecLen - pc > 5 && !memcmp(pc, "path=", 5))
+		{
+			pc += 5;
+			n = (long)(pRec + nRecLen - 1 - pc);	// without the '\n'
+			if(n >= (long)sizeof(_szLongName))
+				n = sizeof(_szLongName) - 1;
+			memcpy(_szLongName, pc, n);
+			_szLongName[n] = '\0';
+		}
+	}
+}
+
+bool grep_archive::_skipTgz(long nBytes)
+{
+	char buf[16384];
+	long n;
+
+	for(; nBytes > 0; nBytes -= n)
+	{
+		n = _readTgz(buf, (nBytes < (long)sizeof(buf) ? nBytes : (long)sizeof(buf)));
+		if(n <= 0)
+			return false;
+	}
+	return true;
+}
+
+// Reads up to nBytes from the gzip stream; fewer only at its end
+long grep_archive::_readTgz(void* pBuf, long nBytes)
+{
+	long nRead = 0, n;
+
+	while(nRead < nBytes)
+	{
+		n = _inflater.read((char*)pBuf + nRead, nBytes - nRead);
+		if(n < 0)
+			return -1;
+		if(n == 0)
+			break;
+		nRead += n;
+	}
+	return nRead;
+}
+
+void grep_archive::_memberName(grep_archive_member* pMember, LPCSTR pName, long nNameLen)
+{
+	long nLen = lstrlen(_szArchive);
+	long nMax = sizeof(pMember->szName)/sizeof(TCHAR) - 1;
+
+	lstrcpyn(pMember->szName, _szArchive, nMax + 1);
+	if(nLen < nMax)
+		pMember->szName[nLen++] = _T(':');
+	if(nNameLen > nMax - nLen)
+		nNameLen = nMax - nLen;
+	memcpy(pMember->szName + nLen, pName, nNameLen);
+	pMember->szName[nLen + nNameLen] = _T('\0');
+}
+
+// PREADPROCs of the members that are read through the inflater
+long grep_archive::_readInflated(void* pContext, LPVOID pBuf, long nBytes)
+{
+	return ((grep_archive*)pContext)->_inflater.read((char*)pBuf, nBytes);
+}
+
+long grep_archive::_readTgzMember(void* pContext, LPVOID pBuf, long nBytes)
+{
+	grep_archive* pThis = (grep_archive*)pContext;
+	long n;
+
+	if(pThis->_nLeft == 0)
+		return 0;
+	if(nBytes > pThis->_nLeft)
+		nBytes = pThis->_nLeft;
+	n = pThis->_inflater.read((char*)pBuf, nBytes);
+	if(n == 0)
+		return -1;		// the stream ended inside the member
+	if(n > 0)
+		pThis->_nLeft -= n;
+	return n;
+}
@@ -0,0 +1,91 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_archive.h - the members of zip and tar archives, searched
+// as files of their own named archive:member (--archives).
+//
+// The archive is mapped, nothing is extracted to disk. Members that
+// are stored as they are (all of a tar, stored zip members) are
+// searched in place; deflated zip members are inflated as they are
+// read, or ahead of the search on the prefetcher's threads. A .tgz
+// is one gzip stream, so its members can only be read in order.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_archive_inc_
+#define _grep_archive_inc_
+
+#include "grep.h"
+#include "grep_input.h"
+#include "grep_inflate.h"
+#include "grep_prefetch.h"
+
+enum grep_archive_type
+{
+	archive_none,
+	archive_zip,		// .zip, .jar
+	archive_tar,		// .tar
+	archive_tgz			// .tgz, .tar.gz
+};
+
+// A member that is a file
+struct grep_archive_member
+{
+	TCHAR		szName[MAX_PATH*2];	// archive:member
+	const char*	pData;		// in the mapping; NULL in a .tgz
+	long		nLen;		// bytes at pData
+	long		nSize;		// bytes once inflated
+	bool		bDeflated;
+};
+
+class grep_archive
+{
+public:
+	grep_archive();
+	~grep_archive();
+
+	// what the file name says the file is
+	static grep_archive_type typeOf(LPCTSTR pszFileName);
+
+	bool open(LPCTSTR pszFileName, grep_archive_type type);
+	void close();
+	// The next member that is a file, or false at the end. In a .tgz
+	// the previous member is skipped over, and only the member last
+	// returned can be opened.
+	bool next(grep_archive_member* pMember);
+	// true if next() stopped at something it could not read
+	bool isDamaged()	{ return _bDamaged; }
+
+	// Serves the member through input, in place or inflated as read
+	void openMember(grep_archive_member* pMember, grep_input& input);
+
+	// PPREFETCHPROC that inflates a zip member (pContext) into pBuf
+	static grep_prefetch_status loadMember(void* pContext, char* pBuf, long nBufSize, long* pnLen);
+
+private:
+	grep_archive_type _type;
+	TCHAR		_szArchive[MAX_PATH*2];
+	char*		_pMap;
+	long		_nMapLen;
+	long		_nPos;			// next header or directory entry
+	long		_nEntries;		// zip: directory entries left
+	bool		_bDamaged;
+	char		_szLongName[MAX_PATH*2];	// tar: GNU long name or pax path
+
+	// inflates the zip member being read, or the whole .tgz
+	grep_inflater _inflater;
+	// .tgz: what is left of the current member and its padding
+	long		_nLeft;
+	long		_nPadding;
+
+private:
+	bool _nextZip(grep_archive_member* pMember);
+	bool _nextTar(grep_archive_member* pMember);
+	int  _tarHeader(const unsigned char* h, long* pnSize, char* pcType, LPSTR pszName, long nNameSize);
+	void _tarLongName(const char* pData, long nLen, char cType);
+	bool _skipTgz(long nBytes);
+	long _readTgz(void* pBuf, long nBytes);
+	void _memberName(grep_archive_member* pMember, LPCSTR pName, long nNameLen);
+
+	static long _readInflated(void* pContext, LPVOID pBuf, long nBytes);
+	static long _readTgzMember(void* pContext, LPVOID pBuf, long nBytes);
+};
+
+#endif	// _grep_archive_inc_
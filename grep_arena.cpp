@@ -0,0 +1,102 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_arena.cpp - implementation of grep_arena
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_arena.h"
+
+// Block header size, rounded up so the data stays aligned
+static const long BLOCK_HEADER = 32;
+
+grep_arena::grep_arena()
+{
+	_pFirst		= NULL;
+	_pCur		= NULL;
+	_nNextSize	= ARENA_FIRST_BLOCK;
+	_uAllocs	= 0;
+	_uBlocks	= 0;
+}
+
+grep_arena::~grep_arena()
+{
+	release();
+}
+
+void* grep_arena::alloc(long nBytes)
+{
+	block* pBlock;
+	long   nSize;
+	void*  p;
+
+	nBytes = (nBytes + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+	_uAllocs++;
+
+	// go on to the next kept block if this one is full
+	while(_pCur && _pCur->nUsed + nBytes > _pCur->nSize && _pCur->pNext)
+	{
+		_pCur = _pCur->pNext;
+		_pCur->nUsed = 0;
+	}
+
+	if(!_pCur || _pCur->nUsed + nBytes > _pCur->nSize)
+	{
+		nSize = (nBytes > _nNextSize ? nBytes : _nNextSize);
+		pBlock = (block*)malloc(BLOCK_HEADER + nSize);
+		if(pBlock == NULL)
+			grep_outOfMemory();		// does not return
+		pBlock->nSize = nSize;
+		pBlock->nUsed = 0;
+		pBlock->pNext = NULL;
+		if(_pCur)
+			_pCur->pNext = pBlock;
+		else
+			_pFirst = pBlock;
+		_pCur = pBlock;
+		_uBlocks++;
+		if(_nNextSize < ARENA_MAX_BLOCK)
+			_nNextSize *= 2;
+	}
+
+	p = _data(_pCur) + _pCur->nUsed;
+	_pCur->nUsed += nBytes;
+	return p;
+}
+
+char* grep_arena::copy(LPCSTR p, long nLen)
+{
+	char* pCopy = (char*)alloc(nLen + 1);
+	memcpy(pCopy, p, nLen);
+	pCopy[nLen] = '\0';
+	return pCopy;
+}
+
+void grep_arena::reset()
+{
+	_pCur = _pFirst;
+	if(_pCur)
+		_pCur->nUsed = 0;
+}
+
+void grep_arena::release()
+{
+	block* pNext;
+
+	while(_pFirst)
+	{
+		pNext = _pFirst->pNext;
+		free(_pFirst);
+		_pFirst = pNext;
+	}
+	_pCur = NULL;
+	_nNextSize = ARENA_FIRST_BLOCK;
+}
+
+void grep_arena::addStats(grep_alloc_stats* pStats) const
+{
+	pStats->uAllocs		+= _uAllocs;
+	pStats->uHeapBlocks	+= _uBlocks;
+}
+
+char* grep_arena::_data(block* pBlock)
+{
+	return (char*)pBlock + BLOCK_HEADER;
+}
@@ -0,0 +1,65 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_arena.h - arena allocator.
+// Hands out memory from big blocks; nothing is freed on its own.
+// reset() makes all of it free again but keeps the blocks, so an
+// arena that is filled and reset over and over (patterns compiled
+// again and again by the server, for one) stops touching the heap
+// once it has grown to its working size.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_arena_inc_
+#define _grep_arena_inc_
+
+#include "grep.h"
+
+// Size of the first block; each new block is twice the last, up to the max
+const long ARENA_FIRST_BLOCK	= 16 * 1024;
+const long ARENA_MAX_BLOCK		= 1024 * 1024;
+// Alignment of every allocation (64-bit words)
+const long ARENA_ALIGNMENT		= 8;
+
+// Allocation counts, summed over the objects asked
+struct grep_alloc_stats
+{
+	ulong uAllocs;		// allocations served
+	ulong uHeapBlocks;	// of those, the ones that went to the heap
+};
+
+class grep_arena
+{
+public:
+	grep_arena();
+	~grep_arena();
+
+	// Memory for nBytes, ARENA_ALIGNMENT aligned; never NULL; if the
+	// heap has no block for it, grep_outOfMemory() ends the program
+	void* alloc(long nBytes);
+	// NUL-terminated copy of nLen chars
+	char* copy(LPCSTR p, long nLen);
+
+	// Frees all allocations, keeping the blocks for the next ones
+	void reset();
+	// Gives the blocks back to the heap
+	void release();
+
+	void addStats(grep_alloc_stats* pStats) const;
+
+private:
+	struct block
+	{
+		block*	pNext;
+		long	nSize;		// usable bytes
+		long	nUsed;
+	};
+
+	block*	_pFirst;
+	block*	_pCur;			// allocating from here
+	long	_nNextSize;		// size of the next block
+	ulong	_uAllocs;
+	ulong	_uBlocks;
+
+private:
+	static char* _data(block* pBlock);
+};
+
+#endif	// _grep_arena_inc_
@@ -0,0 +1,80 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_budget.cpp - implementation of grep_memory_budget
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_budget.h"
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+grep_memory_budget::grep_memory_budget()
+{
+	_uLimit	= 0;
+	_uUsed	= 0;
+	_uPeak	= 0;
+}
+
+void grep_memory_budget::setLimit(ulonglong uLimit)
+{
+	grep_lock lock(_mutex);
+
+	_uLimit	= uLimit;
+	_uUsed	= 0;
+	_uPeak	= 0;
+}
+
+bool grep_memory_budget::tryReserve(long nBytes)
+{
+	grep_lock lock(_mutex);
+
+	if(_uLimit && _uUsed + nBytes > _uLimit)
+		return false;
+	_uUsed += nBytes;
+	if(_uUsed > _uPeak)
+		_uPeak = _uUsed;
+	return true;
+}
+
+void grep_memory_budget::reserve(long nBytes)
+{
+	grep_lock lock(_mutex);
+
+	while(_uLimit && _uUsed && _uUsed + nBytes > _uLimit)
+		_released.wait(_mutex);
+	_uUsed += nBytes;
+	if(_uUsed > _uPeak)
+		_uPeak = _uUsed;
+}
+
+void grep_memory_budget::release(long nBytes)
+{
+	grep_lock lock(_mutex);
+
+	_uUsed -= (_uUsed < (ulonglong)nBytes ? _uUsed : (ulonglong)nBytes);
+	_released.broadcast();
+}
+
+ulonglong grep_peakResident()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+
+	pmc.cb = sizeof(pmc);
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+	return (ulonglong)pmc.PeakWorkingSetSize;
+#else
+	struct rusage ru;
+
+	if(getrusage(RUSAGE_SELF, &ru) != 0)
+		return 0;
+#ifdef __APPLE__
+	return (ulonglong)ru.ru_maxrss;			// bytes
+#else
+	return (ulonglong)ru.ru_maxrss * 1024;	// kilobytes
+#endif
+#endif
+}
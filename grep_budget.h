@@ -0,0 +1,48 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_budget.h - the memory budget of a search (--memory).
+//
+// Everything that can grow with the input or the number of files -
+// buffers read ahead, a line buffer grown for a long line, output
+// waiting to be written - is reserved here first. What doesn't fit
+// is not read ahead, or waits until the output stage has written
+// something and released it, so a slow reader of the output slows
+// down the readers of the input instead of growing the process.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_budget_inc_
+#define _grep_budget_inc_
+
+#include "grep.h"
+#include "grep_thread.h"
+
+class grep_memory_budget
+{
+public:
+	grep_memory_budget();
+
+	// Starts over with uLimit bytes; 0 is no limit
+	void setLimit(ulonglong uLimit);
+	bool isLimited()		{ return _uLimit != 0; }
+	ulonglong limit()		{ return _uLimit; }
+	ulonglong peak()		{ return _uPeak; }
+
+	// Takes nBytes if they fit, never waits
+	bool tryReserve(long nBytes);
+	// Takes nBytes, waiting for releases while they don't fit; it
+	// does not wait when nothing else is reserved, so that anything
+	// up to the whole budget goes through eventually
+	void reserve(long nBytes);
+	void release(long nBytes);
+
+private:
+	grep_mutex		_mutex;
+	grep_condition	_released;
+	ulonglong		_uLimit;
+	ulonglong		_uUsed;
+	ulonglong		_uPeak;
+};
+
+// Most memory the process has had resident so far, in bytes
+ulonglong grep_peakResident();
+
+#endif	// _grep_budget_inc_
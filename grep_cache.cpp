@@ -0,0 +1,176 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_cache.cpp - implementation of grep_compile_cache
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <stdio.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "grep_cache.h"
+#include "grep_search.h"
+#include "grep_input.h"
+
+// Bumped whenever a flat block changes
+static const long CACHE_VERSION = 2;
+static const char CACHE_MAGIC[8] = { 'G', 'R', 'E', 'P', 'C', 'C', '\r', '\n' };
+static const ulonglong CACHE_BYTE_ORDER = ULL(0x0102030405060708);
+
+struct cache_header
+{
+	char		szMagic[8];
+	long		nVersion;
+	long		nLongSize;		// sizeof(long) of the writer
+	ulonglong	uByteOrder;		// CACHE_BYTE_ORDER as the writer stored it
+	ulonglong	uKey;
+	long		nDataLen;		// bytes after the header
+	long		nReserved;
+};
+
+// FNV-1a, 64 bits
+static ulonglong _hash(ulonglong uHash, const void* pData, long nLen)
+{
+	const unsigned char* pc = (const unsigned char*)pData;
+
+	while(nLen-- > 0)
+		uHash = (uHash ^ *pc++) * ULL(0x100000001b3);
+	return uHash;
+}
+
+ulonglong grep_compile_cache::keyOf( grep_search_type searchType,
+									 const grep_pattern_list* patterns,
+									 bool caseSensitive,
+									 bool matchWholeWord,
+									 bool matchEntireLine )
+{
+	ulonglong uHash = ULL(0xcbf29ce484222325);
+	long nValues[5];
+	long nLen;
+	int  i;
+
+	nValues[0] = CACHE_VERSION;
+	nValues[1] = searchType;
+	nValues[2] = caseSensitive;
+	nValues[3] = matchWholeWord;
+	nValues[4] = matchEntireLine;
+	uHash = _hash(uHash, nValues, sizeof(nValues));
+
+	// each pattern with its length, so that the boundaries count
+	for(i=0; i<patterns->length(); i++)
+	{
+		nLen  = patterns->lengthOf(i);
+		uHash = _hash(uHash, &nLen, sizeof(nLen));
+		uHash = _hash(uHash, patterns->get(i), nLen);
+	}
+	return uHash;
+}
+
+bool grep_compile_cache::load(LPCTSTR pszDir, ulonglong uKey, grep_search* pSearch)
+{
+	TCHAR szFile[MAX_PATH*2];
+	const cache_header* pHeader;
+	char* pMap;
+	long  nMapLen;
+	long  nHeaderLen = cache_align(sizeof(cache_header));
+
+	_fileName(szFile, pszDir, uKey, _T(".cache"));
+	if(!grep_input::mapFile(szFile, false, &pMap, &nMapLen))
+		return false;
+
+	pHeader = (const cache_header*)pMap;
+	if( nMapLen < nHeaderLen ||
+		memcmp(pHeader->szMagic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) ||
+		pHeader->nVersion != CACHE_VERSION ||
+		pHeader->nLongSize != (long)sizeof(long) ||
+		pHeader->uByteOrder != CACHE_BYTE_ORDER ||
+		pHeader->uKey != uKey ||
+		pHeader->nDataLen != nMapLen - nHeaderLen ||
+		!pSearch->load(pMap + nHeaderLen, pHeader->nDataLen, pMap, nMapLen) )
+	{
+		grep_input::unmapFile(pMap, nMapLen);
+		return false;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------
+// Written to a temporary file first and renamed, so that another
+// run never maps a half-written file
+//----------------------------------------------------------------
+bool grep_compile_cache::save(LPCTSTR pszDir, ulonglong uKey, const grep_search* pSearch)
+{
+	TCHAR szFile[MAX_PATH*2];
+	TCHAR szTemp[MAX_PATH*2];
+	TCHAR szExt[32];
+	cache_header* pHeader;
+	char* pBuf;
+	long  nHeaderLen = cache_align(sizeof(cache_header));
+	long  nDataLen;
+	FILE* pFile;
+	bool  bOk;
+
+	if(!grep_search::canSave(pSearch->searchType()))
+		return false;
+
+	nDataLen = pSearch->saveSize();
+	pBuf = (char*)malloc(nHeaderLen + nDataLen);
+	if(pBuf == NULL)
+		return false;
+	memset(pBuf, 0, nHeaderLen);
+	pHeader = (cache_header*)pBuf;
+	memcpy(pHeader->szMagic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	pHeader->nVersion	= CACHE_VERSION;
+	pHeader->nLongSize	= sizeof(long);
+	pHeader->uByteOrder	= CACHE_BYTE_ORDER;
+	pHeader->uKey		= uKey;
+	pHeader->nDataLen	= nDataLen;
+	pSearch->save(pBuf + nHeaderLen);
+
+	_fileName(szFile, pszDir, uKey, _T(".cache"));
+#ifdef _WIN32
+	wsprintf(szExt, _T(".%lu.tmp"), GetCurrentProcessId());
+#else
+	sprintf(szExt, ".%lu.tmp", (ulong)getpid());
+#endif
+	_fileName(szTemp, pszDir, uKey, szExt);
+
+	pFile = fopen(szTemp, "wb");
+	bOk = (pFile != NULL);
+	if(bOk)
+	{
+		bOk = (fwrite(pBuf, 1, nHeaderLen + nDataLen, pFile) == (size_t)(nHeaderLen + nDataLen));
+		bOk = (fclose(pFile) == 0) && bOk;
+	}
+	free(pBuf);
+
+#ifdef _WIN32
+	bOk = bOk && MoveFileEx(szTemp, szFile, MOVEFILE_REPLACE_EXISTING);
+	if(!bOk)
+		DeleteFile(szTemp);
+#else
+	bOk = bOk && (rename(szTemp, szFile) == 0);
+	if(!bOk)
+		unlink(szTemp);
+#endif
+	return bOk;
+}
+
+void grep_compile_cache::_fileName(LPTSTR pszOut, LPCTSTR pszDir, ulonglong uKey, LPCTSTR pszExt)
+{
+	TCHAR szKey[17];
+	int   nLen = lstrlen(pszDir);
+	int   i;
+
+	for(i=15; i>=0; i--, uKey >>= 4)
+		szKey[i] = _T("0123456789abcdef")[(int)(uKey & 15)];
+	szKey[16] = 0;
+
+	if(nLen > MAX_PATH)
+		nLen = MAX_PATH;
+	lstrcpyn(pszOut, pszDir, nLen + 1);
+	if(nLen && pszDir[nLen-1] != _T('/') && pszDir[nLen-1] != _T('\\'))
+		pszOut[nLen++] = _T('/');
+	lstrcpyn(pszOut + nLen, _T("grep-"), 6);
+	lstrcpyn(pszOut + nLen + 5, szKey, 17);
+	lstrcpyn(pszOut + nLen + 21, pszExt, 32);
+}
@@ -0,0 +1,50 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_cache.h - on-disk cache of compiled pattern sets.
+// With --cache=DIR, a compiled searcher is written to DIR in one
+// flat block, in a file named after a hash of the patterns, the
+// search type and the options that change the compiled form. The
+// next run with the same set maps the file and matches straight
+// from it instead of compiling again.
+//
+// Only the engines of this program can be saved (wildcard and
+// phonetic sets); the others are compiled each time. The file is
+// for the machine that wrote it: the header records the format
+// version, the size of long and the byte order, and a file that
+// doesn't agree is ignored and rewritten.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_cache_inc_
+#define _grep_cache_inc_
+
+#include "grep.h"
+#include "grep_patterns.h"
+
+class grep_search;
+
+// Every array in a flat block starts on this boundary
+const long CACHE_ALIGNMENT = 8;
+
+inline long cache_align(long nSize)
+{
+	return (nSize + CACHE_ALIGNMENT - 1) & ~(CACHE_ALIGNMENT - 1);
+}
+
+class grep_compile_cache
+{
+public:
+	// Key of a compiled set
+	static ulonglong keyOf( grep_search_type searchType, const grep_pattern_list* patterns,
+							bool caseSensitive, bool matchWholeWord, bool matchEntireLine );
+
+	// Sets up the searcher from its cache file in pszDir. Returns
+	// false if there is no good one.
+	static bool load(LPCTSTR pszDir, ulonglong uKey, grep_search* pSearch);
+	// Writes the cache file of the searcher. Returns false if it
+	// can't be saved.
+	static bool save(LPCTSTR pszDir, ulonglong uKey, const grep_search* pSearch);
+
+private:
+	static void _fileName(LPTSTR pszOut, LPCTSTR pszDir, ulonglong uKey, LPCTSTR pszExt);
+};
+
+#endif	// _grep_cache_inc_
@@ -0,0 +1,329 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_dirlist.cpp - implementation of grep_dir_list
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "grep_dirlist.h"
+
+bool grep_dir_list::list(LPCTSTR pszSpec, bool bRecursive,
+						 _string_array_* pFiles, _string_array_* pDirs,
+						 grep_dir_snapshot* pSnapshot)
+{
+	TCHAR szDir[MAX_PATH*2];
+	LPCTSTR pszName;
+	LPCTSTR pc;
+	int nFiles = pFiles->length();
+	int nDirs  = (pDirs ? pDirs->length() : 0);
+
+	if(!*pszSpec)
+		return false;
+	if(pSnapshot)
+		pSnapshot->begin();
+
+	if(_isDirectory(pszSpec))
+	{
+		_walk(pszSpec, false, _T("*"), bRecursive, pFiles, pDirs, pSnapshot, NULL);
+	}
+	else
+	{
+		// split into the directory and the name pattern
+		pszName = pszSpec;
+		for(pc=pszSpec; *pc; pc++)
+		{
+			if(*pc == _T('/') || *pc == _T('\\'))
+				pszName = pc + 1;
+		}
+		if(!_tcschr(pszName, _T('*')) && !_tcschr(pszName, _T('?')) && !bRecursive)
+		{
+			// a plain file name; let the open tell whether it exists
+			pFiles->append(pszSpec);
+			return true;
+		}
+		if(pszName == pszSpec)
+			_walk(_T("."), true, pszName, bRecursive, pFiles, pDirs, pSnapshot, NULL);
+		else
+		{
+			lstrcpyn(szDir, pszSpec, (int)(pszName - pszSpec) + 1);
+			_walk(szDir, false, pszName, bRecursive, pFiles, pDirs, pSnapshot, NULL);
+		}
+	}
+	return ( pFiles->length() > nFiles || (pDirs && pDirs->length() > nDirs) );
+}
+
+bool grep_dir_list::nameMatch(LPCTSTR pszPattern, LPCTSTR pszName)
+{
+	LPCTSTR pStar = NULL;	// last * seen, and where its match ends
+	LPCTSTR pResume = NULL;
+
+	while(*pszName)
+	{
+		if(*pszPattern == _T('*'))
+		{
+			pStar = ++pszPattern;
+			pResume = pszName;
+		}
+		else if( *pszPattern == _T('?') ||
+#ifdef _WIN32
+				 _totlower(*pszPattern) == _totlower(*pszName) )
+#else
+				 *pszPattern == *pszName )
+#endif
+		{
+			pszPattern++;
+			pszName++;
+		}
+		else if(pStar)
+		{
+			// let the last * take one more char
+			pszPattern = pStar;
+			pszName = ++pResume;
+		}
+		else
+			return false;
+	}
+	while(*pszPattern == _T('*'))
+		pszPattern++;
+	return !*pszPattern;
+}
+
+//----------------------------------------------------------------
+// Lists one directory. Files are listed before the subdirectories
+// are entered, like the file finder does. A directory the walk is
+// already in, reached again through a link, is left out. With a
+// snapshot, the
+// entries it has for the directory are used if it hasn't changed;
+// the stamp is taken before reading, so a change made while it is
+// read shows the next time.
+//----------------------------------------------------------------
+void grep_dir_list::_walk(LPCTSTR pszDir, bool bImplicitDir, LPCTSTR pszPattern,
+						  bool bRecursive, _string_array_* pFiles, _string_array_* pDirs,
+						  grep_dir_snapshot* pSnapshot, const dir_id* pParent)
+{
+	_string_array_ subDirs;
+	dir_id id;
+	const dir_id* pId;
+	TCHAR szPath[MAX_PATH*2];
+	grep_dir_stamp stamp;
+	LPCTSTR pListing = NULL;
+	LPTSTR  pRead = NULL;	// the listing read, if not the snapshot's
+	LPCTSTR pc;
+	long nLen;
+	bool bStamped;
+	int i;
+
+	// a link back up the tree would be walked forever
+	if(_idOf(pszDir, &id))
+	{
+		for(pId = pParent; pId; pId = pId->pParent)
+		{
+			if(pId->uDevice == id.uDevice && pId->uIndex == id.uIndex)
+				return;
+		}
+		id.pParent = pParent;
+		pParent = &id;
+	}
+
+	bStamped = ( pSnapshot && pSnapshot->stampOf(pszDir, &stamp) );
+	if(bStamped)
+		pListing = pSnapshot->find(pszDir, stamp);
+	if(pListing == NULL)
+	{
+		if(!_read(pszDir, &pRead, &nLen))
+			return;
+		if(bStamped)
+			pSnapshot->store(pszDir, stamp, pRead, nLen);
+		pListing = pRead;
+	}
+	if(pDirs)
+		pDirs->append(pszDir);
+
+	for(pc = pListing; *pc; pc += lstrlen(pc) + 1)
+	{
+		if(*pc == DIR_ENTRY_DIR)
+		{
+			if(bRecursive)
+			{
+				_join(szPath, (bImplicitDir ? _T("") : pszDir), pc + 1);
+				subDirs.append(szPath);
+			}
+		}
+		else if(nameMatch(pszPattern, pc + 1))
+		{
+			_join(szPath, (bImplicitDir ? _T("") : pszDir), pc + 1);
+			pFiles->append(szPath);
+		}
+	}
+	free(pRead);
+
+	for(i=0; i<subDirs.length(); i++)
+		_walk(subDirs[i], false, pszPattern, bRecursive, pFiles, pDirs, pSnapshot, pParent);
+}
+
+//----------------------------------------------------------------
+// Reads the entries of a directory into a listing: the kind and
+// name of each, NUL-terminated, and an empty one at the end.
+// Links are listed as what they point to; broken ones are left
+// out.
+//----------------------------------------------------------------
+bool grep_dir_list::_read(LPCTSTR pszDir, LPTSTR* ppListing, long* pnLen)
+{
+	TCHAR szPath[MAX_PATH*2];
+	LPCTSTR pszName;
+	long nMax = 0;
+	bool bDir;
+	bool bOk = true;
+
+	*ppListing = NULL;
+	*pnLen = 0;
+
+#ifdef _WIN32
+	WIN32_FIND_DATA fd;
+	HANDLE hFind;
+
+	_join(szPath, pszDir, _T("*"));
+	hFind = FindFirstFile(szPath, &fd);
+	if(hFind == INVALID_HANDLE_VALUE)
+		return false;
+	do
+	{
+		pszName = fd.cFileName;
+		bDir = ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+#else
+	DIR* pDir = opendir(pszDir);
+	struct dirent* pEntry;
+	struct stat st;
+
+	if(!pDir)
+		return false;
+	while( (pEntry = readdir(pDir)) != NULL )
+	{
+		pszName = pEntry->d_name;
+#ifdef DT_DIR
+		if(pEntry->d_type == DT_DIR)
+			bDir = true;
+		else if(pEntry->d_type == DT_REG)
+			bDir = false;
+		else
+#endif
+		{
+			_join(szPath, pszDir, pszName);
+			if(stat(szPath, &st) != 0)
+				continue;
+			bDir = S_ISDIR(st.st_mode);
+		}
+#endif
+		if(pszName[0] == _T('.') && (!pszName[1] || (pszName[1] == _T('.') && !pszName[2])))
+			continue;
+		if(!_append(ppListing, pnLen, &nMax, (bDir ? DIR_ENTRY_DIR : DIR_ENTRY_FILE), pszName))
+		{
+			bOk = false;
+			break;
+		}
+#ifdef _WIN32
+	}
+	while(FindNextFile(hFind, &fd));
+	FindClose(hFind);
+#else
+	}
+	closedir(pDir);
+#endif
+
+	// out of memory: the directory is one that couldn't be read
+	if(!bOk || !_append(ppListing, pnLen, &nMax, 0, _T("")))
+	{
+		free(*ppListing);
+		*ppListing = NULL;
+		*pnLen = 0;
+		return false;
+	}
+	return true;
+}
+
+// Adds the kind and the name to the listing, growing it; false if
+// it couldn't grow
+bool grep_dir_list::_append(LPTSTR* ppListing, long* pnLen, long* pnMax, TCHAR cKind, LPCTSTR pszName)
+{
+	long nNameLen = (cKind ? lstrlen(pszName) + 2 : 1);
+	long nMax;
+	LPTSTR pGrown;
+
+	if(*pnLen + nNameLen > *pnMax)
+	{
+		nMax = (*pnMax ? 2 * *pnMax : 1024);
+		if(nMax < *pnLen + nNameLen)
+			nMax = *pnLen + nNameLen;
+		pGrown = (LPTSTR)realloc(*ppListing, nMax * sizeof(TCHAR));
+		if(pGrown == NULL)
+			return false;
+		*ppListing = pGrown;
+		*pnMax = nMax;
+	}
+	if(cKind)
+	{
+		(*ppListing)[(*pnLen)++] = cKind;
+		memcpy(*ppListing + *pnLen, pszName, (nNameLen - 1) * sizeof(TCHAR));
+		*pnLen += nNameLen - 1;
+	}
+	else
+		(*ppListing)[(*pnLen)++] = 0;
+	return true;
+}
+
+// The device and index that tell a directory from any other
+bool grep_dir_list::_idOf(LPCTSTR pszDir, dir_id* pId)
+{
+#ifdef _WIN32
+	BY_HANDLE_FILE_INFORMATION info;
+	HANDLE hDir;
+	BOOL bOk;
+
+	// a directory opens only with backup semantics
+	hDir = CreateFile( pszDir, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+					   NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL );
+	if(hDir == INVALID_HANDLE_VALUE)
+		return false;
+	bOk = GetFileInformationByHandle(hDir, &info);
+	CloseHandle(hDir);
+	if(!bOk)
+		return false;
+	pId->uDevice = info.dwVolumeSerialNumber;
+	pId->uIndex  = ((ulonglong)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+#else
+	struct stat st;
+
+	if(stat(pszDir, &st) != 0)
+		return false;
+	pId->uDevice = (ulonglong)st.st_dev;
+	pId->uIndex  = (ulonglong)st.st_ino;
+#endif
+	return true;
+}
+
+bool grep_dir_list::_isDirectory(LPCTSTR pszPath)
+{
+#ifdef _WIN32
+	DWORD dwAttr = GetFileAttributes(pszPath);
+	return (dwAttr != INVALID_FILE_ATTRIBUTES && (dwAttr & FILE_ATTRIBUTE_DIRECTORY));
+#else
+	struct stat st;
+	return (stat(pszPath, &st) == 0 && S_ISDIR(st.st_mode));
+#endif
+}
+
+void grep_dir_list::_join(LPTSTR pszOut, LPCTSTR pszDir, LPCTSTR pszName)
+{
+	int nLen = lstrlen(pszDir);
+
+	lstrcpyn(pszOut, pszDir, MAX_PATH*2);
+	if( nLen && pszDir[nLen-1] != _T('/') && pszDir[nLen-1] != _T('\\') &&
+		nLen < MAX_PATH*2 - 1 )
+	{
+		pszOut[nLen++] = GREP_PATH_SEP;
+		pszOut[nLen] = 0;
+	}
+	lstrcpyn(pszOut + nLen, pszName, MAX_PATH*2 - nLen);
+}
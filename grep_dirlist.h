@@ -0,0 +1,58 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_dirlist.h - directory listing.
+// Expands a file specification into the list of files it names,
+// and the list of directories that had to be read to get it, so
+// that the listing can be kept and checked for changes later.
+// Given a snapshot (grep_snapshot.h), directories that haven't
+// changed since it was taken are not read again. Links to
+// directories are followed like the file finder does, except into
+// a directory the walk is already in.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_dirlist_inc_
+#define _grep_dirlist_inc_
+
+#include "grep.h"
+#include "grep_snapshot.h"
+
+#ifdef _WIN32
+#define GREP_PATH_SEP		_T('\\')
+#else
+#define GREP_PATH_SEP		_T('/')
+#endif
+
+class grep_dir_list
+{
+public:
+	// The spec is a file, a directory (all its files), or a path
+	// whose last part has * and ? wildcards. With bRecursive the
+	// subdirectories are listed too, with the same name pattern.
+	// pDirs and pSnapshot may be NULL. Returns false if nothing
+	// could be read.
+	static bool list(LPCTSTR pszSpec, bool bRecursive,
+					 _string_array_* pFiles, _string_array_* pDirs,
+					 grep_dir_snapshot* pSnapshot = NULL);
+
+	// * and ? match of a file name; case-insensitive on Windows
+	static bool nameMatch(LPCTSTR pszPattern, LPCTSTR pszName);
+
+private:
+	// A directory the walk is in, and the one it was entered from
+	struct dir_id
+	{
+		ulonglong		uDevice;
+		ulonglong		uIndex;		// inode, or file index on Windows
+		const dir_id*	pParent;
+	};
+
+	static void _walk(LPCTSTR pszDir, bool bImplicitDir, LPCTSTR pszPattern,
+					  bool bRecursive, _string_array_* pFiles, _string_array_* pDirs,
+					  grep_dir_snapshot* pSnapshot, const dir_id* pParent);
+	static bool _idOf(LPCTSTR pszDir, dir_id* pId);
+	static bool _read(LPCTSTR pszDir, LPTSTR* ppListing, long* pnLen);
+	static bool _append(LPTSTR* ppListing, long* pnLen, long* pnMax, TCHAR cKind, LPCTSTR pszName);
+	static bool _isDirectory(LPCTSTR pszPath);
+	static void _join(LPTSTR pszOut, LPCTSTR pszDir, LPCTSTR pszName);
+};
+
+#endif	// _grep_dirlist_inc_
@@ -0,0 +1,308 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_fuzzy.cpp - implementation of grep_fuzzy
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_fuzzy.h"
+#include "grep_utf8.h"
+
+grep_fuzzy::grep_fuzzy()
+{
+	_pPattern		= NULL;
+	_nLen			= 0;
+	_nEdits			= 0;
+	_bNoCase		= false;
+	_bWholeWord		= false;
+	_bEntireLine	= false;
+	_pPeq			= NULL;
+}
+
+grep_fuzzy::~grep_fuzzy()
+{
+	reset();
+}
+
+void grep_fuzzy::reset()
+{
+	_mem.reset();
+	_pPattern	= NULL;
+	_pPeq		= NULL;
+	_nLen		= 0;
+	_nEdits		= 0;
+}
+
+void grep_fuzzy::init( LPCSTR pPattern, long nLen, long nEdits, bool caseSensitive,
+					   bool matchWholeWord, bool matchEntireLine )
+{
+	unsigned char c;
+	long i;
+
+	reset();
+	_nLen			= nLen;
+	_nEdits			= nEdits;
+	_bNoCase		= !caseSensitive;
+	_bWholeWord		= matchWholeWord;
+	_bEntireLine	= matchEntireLine;
+
+	_pPattern = _mem.copy(pPattern, nLen);
+	if(_bNoCase)
+	{
+		for(i=0; i<nLen; i++)
+			_pPattern[i] = (char)tolower((unsigned char)_pPattern[i]);
+	}
+
+	// Bit i of the forward mask of c is set if pattern char i is c,
+	// bit i of the backward one if pattern char nLen-1-i is
+	if(nLen > 0 && nLen <= FUZZY_WORD_BITS)
+	{
+		_pPeq = (ulonglong*)_mem.alloc(2 * 256 * sizeof(ulonglong));
+		memset(_pPeq, 0, 2 * 256 * sizeof(ulonglong));
+		for(i=0; i<nLen; i++)
+		{
+			c = (unsigned char)_pPattern[i];
+			_pPeq[c] |= (ulonglong)1 << i;
+			_pPeq[256 + c] |= (ulonglong)1 << (nLen - 1 - i);
+			if(_bNoCase && isalpha(c))
+			{
+				_pPeq[toupper(c)] |= (ulonglong)1 << i;
+				_pPeq[256 + toupper(c)] |= (ulonglong)1 << (nLen - 1 - i);
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------
+// Attempt to match the line. Params are the same as in
+// grep_search::match.
+//----------------------------------------------------------------
+bool grep_fuzzy::match( /* in */ LPCSTR pLine,
+						/* in */  long  nLineLen,
+						/* out */ long* pMatchStart,
+						/* out */ long* pMatchLength,
+						/* in */  grep_scratch* pScratch ) const
+{
+	long* pDist;	// edits from the pattern to the text, by its length
+	long* pCol;		// a column of the table, for long patterns
+	long nStart, nEnd, nAvail, nBest, i;
+
+	// the shortest text the pattern can match has nLen - nEdits bytes
+	if(nLineLen < _nLen - _nEdits)
+		return false;
+	pDist = (long*)pScratch->buffer( scratch_fuzzy,
+									 (nLineLen + 1 + _nLen + 1) * sizeof(long) );
+	pCol = pDist + nLineLen + 1;
+
+	if(_bEntireLine)
+	{
+		// the whole line, so its length is checked first
+		if(nLineLen > _nLen + _nEdits)
+			return false;
+		_distances(pLine, nLineLen, false, pDist, pCol);
+		if(pDist[nLineLen] > _nEdits)
+			return false;
+		nStart = 0;
+		nEnd = nLineLen;
+	}
+	else if(_bWholeWord)
+	{
+		// From each place a word can start, the text up to each word
+		// end is measured. Starts within a word are passed over.
+		nBest = -1;
+		for(nStart = 0; nStart <= nLineLen; )
+		{
+			if(nStart > 0 && utf8_isWordByte((unsigned char)pLine[nStart-1]))
+			{
+				nStart += utf8_wordLength(pLine + nStart, nLineLen - nStart) + 1;
+				continue;
+			}
+			nAvail = nLineLen - nStart;
+			if(nAvail > _nLen + _nEdits)
+				nAvail = _nLen + _nEdits;
+			_distances(pLine + nStart, nAvail, false, pDist, pCol);
+			for(i = (_nLen ? 1 : 0); i <= nAvail; i++)
+			{
+				nEnd = nStart + i;
+				if( pDist[i] <= _nEdits &&
+					(nEnd == nLineLen || !utf8_isWordByte((unsigned char)pLine[nEnd])) &&
+					(nBest == -1 || pDist[i] <= pDist[nBest]) )
+					nBest = i;
+			}
+			if(nBest != -1)
+				break;
+			nStart++;
+		}
+		if(nBest == -1)
+			return false;
+		nEnd = nStart + nBest;
+	}
+	else
+	{
+		nEnd = _findEnd(pLine, nLineLen, pCol);
+		if(nEnd == -1)
+			return false;
+
+		// back from the end with the pattern reversed: the start
+		// with the fewest edits, the furthest one if several
+		nAvail = (nEnd < _nLen + _nEdits ? nEnd : _nLen + _nEdits);
+		_distances(pLine + nEnd, nAvail, true, pDist, pCol);
+		nBest = 0;
+		for(i=1; i<=nAvail; i++)
+		{
+			if(pDist[i] <= pDist[nBest])
+				nBest = i;
+		}
+		nStart = nEnd - nBest;
+	}
+
+	if(pMatchStart)		*pMatchStart	= nStart;
+	if(pMatchLength)	*pMatchLength	= nEnd - nStart;
+	return true;
+}
+
+//----------------------------------------------------------------
+// Where the first text within the edits of the pattern ends, or -1.
+// The scan goes on for up to twice nEdits more bytes, for an end
+// with fewer edits or as few further on: a match is found while
+// still missing its last chars ("hel" for helo in "hello").
+//----------------------------------------------------------------
+long grep_fuzzy::_findEnd(LPCSTR pLine, long nLineLen, long* pCol) const
+{
+	const unsigned char* pc = (const unsigned char*)pLine;
+	ulonglong Pv, Mv, Ph, Mh, Xv, Xh, Eq, hb;
+	long nScore, nFirst = -1, nBest = -1, nBestScore = 0, nDiag, nUp, j, i;
+
+	nScore = _nLen;
+	if(nScore <= _nEdits)
+	{
+		nFirst = nBest = 0;
+		nBestScore = nScore;
+	}
+
+	if(_pPeq)
+	{
+		// The differences between the cells of the column, going
+		// down: +1 where a bit of Pv is set, -1 where one of Mv is.
+		// The top cell is always 0: a match can start anywhere.
+		Pv = ~(ulonglong)0;
+		Mv = 0;
+		hb = (ulonglong)1 << (_nLen - 1);
+		for(j=0; j<nLineLen; j++)
+		{
+			if(nFirst != -1 && (j - nFirst >= 2 * _nEdits || nBestScore == 0))
+				break;
+			Eq = _pPeq[pc[j]];
+			Xv = Eq | Mv;
+			Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+			Ph = Mv | ~(Xh | Pv);
+			Mh = Pv & Xh;
+			if(Ph & hb)
+				nScore++;
+			else if(Mh & hb)
+				nScore--;
+			Ph <<= 1;
+			Mh <<= 1;
+			Pv = Mh | ~(Xv | Ph);
+			Mv = Ph & Xv;
+			if(nScore <= _nEdits && (nBest == -1 || nScore <= nBestScore))
+			{
+				if(nFirst == -1)
+					nFirst = j + 1;
+				nBest = j + 1;
+				nBestScore = nScore;
+			}
+		}
+		return nBest;
+	}
+
+	// the table, a column at a time
+	for(i=0; i<=_nLen; i++)
+		pCol[i] = i;
+	for(j=0; j<nLineLen; j++)
+	{
+		if(nFirst != -1 && (j - nFirst >= 2 * _nEdits || nBestScore == 0))
+			break;
+		nDiag = 0;
+		for(i=1; i<=_nLen; i++)
+		{
+			nUp = pCol[i];
+			pCol[i] = nDiag + !_eq(pc[j], (unsigned char)_pPattern[i-1]);
+			if(nUp + 1 < pCol[i])
+				pCol[i] = nUp + 1;
+			if(pCol[i-1] + 1 < pCol[i])
+				pCol[i] = pCol[i-1] + 1;
+			nDiag = nUp;
+		}
+		nScore = pCol[_nLen];
+		if(nScore <= _nEdits && (nBest == -1 || nScore <= nBestScore))
+		{
+			if(nFirst == -1)
+				nFirst = j + 1;
+			nBest = j + 1;
+			nBestScore = nScore;
+		}
+	}
+	return nBest;
+}
+
+//----------------------------------------------------------------
+// pDist[n] = the edits from the pattern to the n bytes of text
+// starting at pText, for n = 0..nAvail; bBackwards for the n bytes
+// ending at pText, compared with the pattern read backwards.
+//----------------------------------------------------------------
+void grep_fuzzy::_distances( LPCSTR pText, long nAvail, bool bBackwards,
+							 long* pDist, long* pCol ) const
+{
+	const unsigned char* pc = (const unsigned char*)pText;
+	const ulonglong* pPeq;
+	ulonglong Pv, Mv, Ph, Mh, Xv, Xh, Eq, hb;
+	unsigned char c;
+	long nScore, nDiag, nUp, j, i;
+
+	pDist[0] = nScore = _nLen;
+	if(_pPeq)
+	{
+		// as in _findEnd, but the top cell is the text length: the
+		// match starts at pText
+		pPeq = _pPeq + (bBackwards ? 256 : 0);
+		Pv = ~(ulonglong)0;
+		Mv = 0;
+		hb = (ulonglong)1 << (_nLen - 1);
+		for(j=1; j<=nAvail; j++)
+		{
+			Eq = pPeq[bBackwards ? pc[-j] : pc[j-1]];
+			Xv = Eq | Mv;
+			Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+			Ph = Mv | ~(Xh | Pv);
+			Mh = Pv & Xh;
+			if(Ph & hb)
+				nScore++;
+			else if(Mh & hb)
+				nScore--;
+			Ph = (Ph << 1) | 1;
+			Mh <<= 1;
+			Pv = Mh | ~(Xv | Ph);
+			Mv = Ph & Xv;
+			pDist[j] = nScore;
+		}
+		return;
+	}
+
+	for(i=0; i<=_nLen; i++)
+		pCol[i] = i;
+	for(j=1; j<=nAvail; j++)
+	{
+		c = (bBackwards ? pc[-j] : pc[j-1]);
+		nDiag = j - 1;
+		pCol[0] = j;
+		for(i=1; i<=_nLen; i++)
+		{
+			nUp = pCol[i];
+			pCol[i] = nDiag + !_eq(c, (unsigned char)_pPattern[bBackwards ? _nLen - i : i - 1]);
+			if(nUp + 1 < pCol[i])
+				pCol[i] = nUp + 1;
+			if(pCol[i-1] + 1 < pCol[i])
+				pCol[i] = pCol[i-1] + 1;
+			nDiag = nUp;
+		}
+		pDist[j] = pCol[_nLen];
+	}
+}
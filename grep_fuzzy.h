@@ -0,0 +1,68 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_fuzzy.h - approximate search: a pattern matches text that
+// is within k edits of it (insertions, deletions and substitutions
+// of single bytes: the Levenshtein distance).
+//
+// Patterns of up to 64 bytes are matched with Myers' bit-parallel
+// algorithm: a column of the edit distance table is kept as two
+// 64-bit vectors of its +1/-1 differences, so each byte of the line
+// costs a dozen word operations, whatever k is. Longer patterns
+// fall back to the table itself, one column per byte.
+//
+// The line is scanned once for the end of a match; where the match
+// starts is found by scanning back from there with the pattern
+// reversed, over at most its length plus k bytes.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_fuzzy_inc_
+#define _grep_fuzzy_inc_
+
+#include "grep.h"
+#include "grep_scratch.h"
+#include "grep_arena.h"
+
+// Most edits --fuzzy allows
+const long FUZZY_MAX_EDITS	= 32;
+// Longest pattern the bit-parallel matcher takes
+const long FUZZY_WORD_BITS	= 64;
+
+class grep_fuzzy
+{
+public:
+	grep_fuzzy();
+	~grep_fuzzy();
+
+	void reset();
+	void init( LPCSTR pPattern, long nLen, long nEdits, bool caseSensitive,
+			   bool matchWholeWord, bool matchEntireLine );
+	// Returns true if some text of the line is within the edits of
+	// the pattern: the first such text to end, with the fewest edits
+	// among those ending near it. The scan state lives in pScratch.
+	bool match( LPCSTR pLine, long nLineLen, long* pMatchStart, long* pMatchLength,
+				grep_scratch* pScratch ) const;
+
+	void addStats(grep_alloc_stats* pStats) const	{ _mem.addStats(pStats); }
+
+private:
+	char*		_pPattern;		// ASCII lower case with -i
+	long		_nLen;
+	long		_nEdits;
+	bool		_bNoCase;
+	bool		_bWholeWord;	// -w
+	bool		_bEntireLine;	// -x
+	ulonglong*	_pPeq;			// per byte: the pattern positions it
+								// matches, forwards then backwards;
+								// NULL past FUZZY_WORD_BITS
+	grep_arena	_mem;
+
+private:
+	bool _eq(unsigned char c, unsigned char p) const
+	{
+		return (c == p) || (_bNoCase && c >= 'A' && c <= 'Z' && c + 'a' - 'A' == p);
+	}
+	long _findEnd(LPCSTR pLine, long nLineLen, long* pCol) const;
+	void _distances( LPCSTR pText, long nAvail, bool bBackwards,
+					 long* pDist, long* pCol ) const;
+};
+
+#endif	// _grep_fuzzy_inc_
@@ -0,0 +1,388 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_inflate.cpp - implementation of grep_inflater
+// Decoding follows RFC 1951 (and puff.c for the slow path); codes
+// up to INFLATE_FAST_BITS long are decoded with one table lookup.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_inflate.h"
+
+// Longest match, and the room kept free for it in the output
+static const long MAX_MATCH = 258;
+
+// Base lengths and extra bits of length symbols 257..285
+static const short s_lenBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const short s_lenExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+// Base distances and extra bits of distance symbols 0..29
+static const long s_distBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577 };
+static const short s_distExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+// Order of the code length code lengths in a dynamic block header
+static const unsigned char s_clOrder[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+grep_inflater::grep_inflater()
+{
+	init(NULL, 0);
+}
+
+void grep_inflater::init(const unsigned char* pIn, long nInLen)
+{
+	_pIn		= pIn;
+	_nInLen		= nInLen;
+	_nInPos		= 0;
+	_bitBuf		= 0;
+	_nBits		= 0;
+	_bFinal		= false;
+	_nBlockType	= -1;
+	_nStored	= 0;
+	_bDone		= false;
+	_bError		= false;
+	_nOutLen	= 0;
+	_nOutPos	= 0;
+}
+
+bool grep_inflater::initGzip(const unsigned char* pIn, long nInLen)
+{
+	long nPos = 10;
+	unsigned char flags;
+
+	init(NULL, 0);
+	if(nInLen < 18 || pIn[0] != 0x1F || pIn[1] != 0x8B || pIn[2] != 8)
+		return false;
+	flags = pIn[3];
+	if(flags & 4)		// FEXTRA
+		nPos += 2 + (pIn[10] | (pIn[11] << 8));
+	if(flags & 8)		// FNAME
+		while(nPos < nInLen && pIn[nPos++])
+			;
+	if(flags & 16)		// FCOMMENT
+		while(nPos < nInLen && pIn[nPos++])
+			;
+	if(flags & 2)		// FHCRC
+		nPos += 2;
+	if(nPos >= nInLen)
+		return false;
+	init(pIn + nPos, nInLen - nPos);
+	return true;
+}
+
+long grep_inflater::read(char* pOut, long nMax)
+{
+	long n;
+
+	while(_nOutPos == _nOutLen)
+	{
+		if(_bError)
+			return -1;
+		if(_bDone)
+			return 0;
+		// keep the last window for the back references
+		if(_nOutLen > OUT_WINDOW)
+		{
+			memmove(_out, _out + _nOutLen - OUT_WINDOW, OUT_WINDOW);
+			_nOutPos = _nOutLen = OUT_WINDOW;
+		}
+		if(!_inflate())
+		{
+			_bError = true;
+			return -1;
+		}
+	}
+
+	n = _nOutLen - _nOutPos;
+	if(n > nMax)
+		n = nMax;
+	memcpy(pOut, _out + _nOutPos, n);
+	_nOutPos += n;
+	return n;
+}
+
+//----------------------------------------------------------------
+// Bit input, least significant bit first
+//----------------------------------------------------------------
+bool grep_inflater::_need(int nBits)
+{
+	while(_nBits < nBits)
+	{
+		if(_nInPos == _nInLen)
+			return false;
+		_bitBuf |= (ulong)_pIn[_nInPos++] << _nBits;
+		_nBits += 8;
+	}
+	return true;
+}
+
+int grep_inflater::_bits(int nBits)
+{
+	int n;
+
+	if(!_need(nBits))
+	{
+		_bError = true;
+		return 0;
+	}
+	n = (int)(_bitBuf & ((1UL << nBits) - 1));
+	_bitBuf >>= nBits;
+	_nBits -= nBits;
+	return n;
+}
+
+// Returns the next symbol of the code, or -1
+int grep_inflater::_decode(const huffman& h)
+{
+	unsigned int e;
+	int code, first, index, count, len;
+
+	// as many bits as there are, up to the longest code
+	while(_nBits < 15 && _nInPos < _nInLen)
+	{
+		_bitBuf |= (ulong)_pIn[_nInPos++] << _nBits;
+		_nBits += 8;
+	}
+
+	e = h.fast[_bitBuf & ((1 << INFLATE_FAST_BITS) - 1)];
+	if(e && (int)(e >> 9) <= _nBits)
+	{
+		_bitBuf >>= (e >> 9);
+		_nBits -= (e >> 9);
+		return (int)(e & 511);
+	}
+
+	// longer codes: a bit at a time
+	code = first = index = 0;
+	for(len = 1; len < 16; len++)
+	{
+		if(_nBits == 0)
+			return -1;
+		code |= (int)(_bitBuf & 1);
+		_bitBuf >>= 1;
+		_nBits--;
+		count = h.count[len];
+		if(code - count < first)
+			return h.symbol[index + (code - first)];
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+//----------------------------------------------------------------
+// Builds the code from the code lengths of the symbols. Returns
+// false if there are too many codes of some length.
+//----------------------------------------------------------------
+bool grep_inflater::_build(huffman& h, const unsigned char* pLengths, int nSymbols)
+{
+	short offs[16];
+	int   sym, len, left, code, k, i, rev, j;
+
+	memset(h.count, 0, sizeof(h.count));
+	for(sym=0; sym<nSymbols; sym++)
+		h.count[pLengths[sym]]++;
+	h.count[0] = 0;
+
+	left = 1;
+	for(len=1; len<16; len++)
+	{
+		left = (left << 1) - h.count[len];
+		if(left < 0)
+			return false;
+	}
+
+	offs[1] = 0;
+	for(len=1; len<15; len++)
+		offs[len+1] = offs[len] + h.count[len];
+	for(sym=0; sym<nSymbols; sym++)
+		if(pLengths[sym])
+			h.symbol[offs[pLengths[sym]]++] = (short)sym;
+
+	// the lookup table: each short code, bit-reversed, fills every
+	// entry whose low bits it is
+	memset(h.fast, 0, sizeof(h.fast));
+	code = k = 0;
+	for(len=1; len<16; len++)
+	{
+		for(i=0; i<h.count[len]; i++, k++, code++)
+		{
+			if(len > INFLATE_FAST_BITS)
+				continue;
+			for(rev=0, j=0; j<len; j++)
+				rev |= ((code >> j) & 1) << (len - 1 - j);
+			for(j=rev; j < (1 << INFLATE_FAST_BITS); j += (1 << len))
+				h.fast[j] = (unsigned short)((len << 9) | h.symbol[k]);
+		}
+		code <<= 1;
+	}
+	return true;
+}
+
+void grep_inflater::_fixedTables()
+{
+	unsigned char lengths[288];
+	int i;
+
+	for(i=0; i<144; i++)	lengths[i] = 8;
+	for(; i<256; i++)		lengths[i] = 9;
+	for(; i<280; i++)		lengths[i] = 7;
+	for(; i<288; i++)		lengths[i] = 8;
+	_build(_lit, lengths, 288);
+	for(i=0; i<30; i++)		lengths[i] = 5;
+	_build(_dist, lengths, 30);
+}
+
+bool grep_inflater::_dynamicTables()
+{
+	unsigned char lengths[320];
+	int nLit, nDist, nCode, i, sym, len, nRepeat;
+
+	nLit  = _bits(5) + 257;
+	nDist = _bits(5) + 1;
+	nCode = _bits(4) + 4;
+	if(_bError || nLit > 286 || nDist > 30)
+		return false;
+
+	// the code for the code lengths; _dist is free to hold it
+	memset(lengths, 0, 19);
+	for(i=0; i<nCode; i++)
+		lengths[s_clOrder[i]] = (unsigned char)_bits(3);
+	if(_bError || !_build(_dist, lengths, 19))
+		return false;
+
+	for(i=0; i<nLit+nDist; )
+	{
+		sym = _decode(_dist);
+		if(sym < 0)
+			return false;
+		if(sym < 16)
+		{
+			lengths[i++] = (unsigned char)sym;
+			continue;
+		}
+		len = 0;
+		if(sym == 16)
+		{
+			if(i == 0)
+				return false;
+			len = lengths[i-1];
+			nRepeat = 3 + _bits(2);
+		}
+		else if(sym == 17)
+			nRepeat = 3 + _bits(3);
+		else
+			nRepeat = 11 + _bits(7);
+		if(_bError || i + nRepeat > nLit + nDist)
+			return false;
+		while(nRepeat--)
+			lengths[i++] = (unsigned char)len;
+	}
+	if(lengths[256] == 0)
+		return false;	// no end of block
+
+	return _build(_lit, lengths, nLit) && _build(_dist, lengths + nLit, nDist);
+}
+
+bool grep_inflater::_blockHeader()
+{
+	_bFinal = (_bits(1) != 0);
+	_nBlockType = _bits(2);
+	if(_bError)
+		return false;
+
+	switch(_nBlockType)
+	{
+	case 0:
+		// stored: byte aligned LEN and its complement
+		_bitBuf >>= (_nBits & 7);
+		_nBits -= (_nBits & 7);
+		_nStored = _bits(16);
+		if(_bError || (_bits(16) ^ 0xFFFF) != _nStored)
+			return false;
+		return !_bError;
+	case 1:
+		_fixedTables();
+		return true;
+	case 2:
+		return _dynamicTables();
+	default:
+		return false;
+	}
+}
+
+//----------------------------------------------------------------
+// Decodes until the output is nearly full or the data ends; the
+// output is left with room for the longest match
+//----------------------------------------------------------------
+bool grep_inflater::_inflate()
+{
+	long nLen, nDist, n;
+	int  sym;
+	unsigned char* pc;
+
+	while(!_bDone && _nOutLen < OUT_SIZE - MAX_MATCH)
+	{
+		if(_nBlockType == -1)
+		{
+			if(_bFinal)
+				_bDone = true;
+			else if(!_blockHeader())
+				return false;
+			continue;
+		}
+
+		if(_nBlockType == 0)
+		{
+			// the bit buffer is empty after the aligned LEN/NLEN
+			n = OUT_SIZE - MAX_MATCH - _nOutLen;
+			if(n > _nStored)
+				n = _nStored;
+			if(n > _nInLen - _nInPos)
+				return false;
+			memcpy(_out + _nOutLen, _pIn + _nInPos, n);
+			_nInPos += n;
+			_nOutLen += n;
+			if((_nStored -= n) == 0)
+				_nBlockType = -1;
+			continue;
+		}
+
+		sym = _decode(_lit);
+		if(sym < 0)
+			return false;
+		if(sym < 256)
+		{
+			_out[_nOutLen++] = (unsigned char)sym;
+			continue;
+		}
+		if(sym == 256)
+		{
+			_nBlockType = -1;
+			continue;
+		}
+
+		sym -= 257;
+		if(sym >= 29)
+			return false;
+		nLen = s_lenBase[sym] + _bits(s_lenExtra[sym]);
+		sym = _decode(_dist);
+		if(sym < 0 || sym >= 30)
+			return false;
+		nDist = s_distBase[sym] + _bits(s_distExtra[sym]);
+		if(_bError || nDist > _nOutLen)
+			return false;
+
+		// byte by byte: the copy may overlap itself
+		for(pc = _out + _nOutLen; nLen > 0; nLen--, pc++)
+			*pc = pc[-nDist];
+		_nOutLen = (long)(pc - _out);
+	}
+	return true;
+}
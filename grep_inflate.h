@@ -0,0 +1,75 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_inflate.h - DEFLATE (RFC 1951) decoder, for the members of
+// zip archives and gzip'ed tar files.
+//
+// The compressed data is all in memory (a mapped archive); the
+// output is handed out a piece at a time through read(), so a member
+// of any size is searched with a fixed 64K window.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_inflate_inc_
+#define _grep_inflate_inc_
+
+#include "grep.h"
+
+// Bits looked up at once when decoding a Huffman code
+const int INFLATE_FAST_BITS = 10;
+
+class grep_inflater
+{
+public:
+	grep_inflater();
+
+	// raw deflate data
+	void init(const unsigned char* pIn, long nInLen);
+	// gzip data (RFC 1952); false if the header is not valid
+	bool initGzip(const unsigned char* pIn, long nInLen);
+
+	// Returns the number of bytes decoded, 0 at the end of the data,
+	// -1 if the data is corrupt
+	long read(char* pOut, long nMax);
+
+private:
+	// canonical Huffman code
+	struct huffman
+	{
+		short			count[16];			// codes of each length
+		short			symbol[288];		// symbols in code order
+		unsigned short	fast[1 << INFLATE_FAST_BITS];	// (length << 9) | symbol, 0 if longer
+	};
+
+	enum { OUT_WINDOW = 32768, OUT_SIZE = 2 * 32768 + 512 };
+
+	const unsigned char* _pIn;
+	long			_nInLen;
+	long			_nInPos;
+	ulong			_bitBuf;
+	int				_nBits;
+
+	bool			_bFinal;		// the current block is the last one
+	int				_nBlockType;	// -1 between blocks
+	long			_nStored;		// bytes left in a stored block
+	bool			_bDone;
+	bool			_bError;
+
+	huffman			_lit;
+	huffman			_dist;
+
+	// decoded data; the last OUT_WINDOW bytes handed out are kept for
+	// the back references
+	unsigned char	_out[OUT_SIZE];
+	long			_nOutLen;
+	long			_nOutPos;		// handed out up to here
+
+private:
+	bool _need(int nBits);
+	int  _bits(int nBits);
+	int  _decode(const huffman& h);
+	bool _build(huffman& h, const unsigned char* pLengths, int nSymbols);
+	bool _blockHeader();
+	bool _dynamicTables();
+	void _fixedTables();
+	bool _inflate();
+};
+
+#endif	// _grep_inflate_inc_
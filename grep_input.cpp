@@ -0,0 +1,377 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_input.cpp - implementation of grep_input
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _WIN32
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		// O_DIRECT, readahead()
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "grep_input.h"
+
+// How far ahead of the reads the kernel is asked to prefetch
+static const long READ_AHEAD_BLOCKS = 4;
+
+grep_input::grep_input()
+{
+#ifdef _WIN32
+	_hFile		= INVALID_HANDLE_VALUE;
+#else
+	_fd			= -1;
+	_nAdvised	= 0;
+#endif
+	_bStdin		= false;
+	_bDirect	= false;
+	_nOffset	= 0;
+	_nReadSize	= 0;
+	_szName[0]	= _T('\0');
+	_pMem		= NULL;
+	_nMemLen	= 0;
+	_nMemPos	= 0;
+	_pfnRead	= NULL;
+	_pReadContext = NULL;
+	_pDirect	= NULL;
+	_nDirectSize = 0;
+	_nDirectPos	= 0;
+	_nDirectLen	= 0;
+}
+
+grep_input::~grep_input()
+{
+	close();
+	freeBuffer(_pDirect, _nDirectSize);
+}
+
+bool grep_input::open(LPCTSTR pszFileName, bool bDirect, long nReadSize)
+{
+	close();
+	lstrcpyn(_szName, pszFileName, sizeof(_szName)/sizeof(TCHAR));
+	_bStdin		= false;
+	_bDirect	= bDirect;
+	_nOffset	= 0;
+	_nReadSize	= nReadSize;
+
+	if(bDirect)
+	{
+		// direct reads go through an aligned buffer of read size;
+		// without one, the file is read the buffered way
+		long nSize = (nReadSize + IO_ALIGNMENT - 1) & ~(IO_ALIGNMENT - 1);
+		if(_nDirectSize != nSize)
+		{
+			freeBuffer(_pDirect, _nDirectSize);
+			_pDirect = allocBuffer(nSize);
+			_nDirectSize = (_pDirect ? nSize : 0);
+		}
+		if(_pDirect == NULL)
+			bDirect = _bDirect = false;
+		_nDirectPos = _nDirectLen = 0;
+	}
+
+#ifdef _WIN32
+	_hFile = CreateFile( pszFileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+						 NULL, OPEN_EXISTING,
+						 FILE_FLAG_SEQUENTIAL_SCAN | (bDirect ? FILE_FLAG_NO_BUFFERING : 0),
+						 NULL );
+	if(_hFile == INVALID_HANDLE_VALUE && bDirect)
+	{
+		_bDirect = false;
+		_hFile = CreateFile( pszFileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+							 NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	}
+	if(_hFile == INVALID_HANDLE_VALUE)
+		return false;
+#else
+	_fd = -1;
+#ifdef O_DIRECT
+	if(bDirect)
+		_fd = ::open(pszFileName, O_RDONLY | O_DIRECT);
+#endif
+	if(_fd == -1)
+	{
+		// no O_DIRECT, or the file system refused it (tmpfs does)
+		_bDirect = false;
+		_fd = ::open(pszFileName, O_RDONLY);
+	}
+	if(_fd == -1)
+		return false;
+#ifdef POSIX_FADV_SEQUENTIAL
+	if(!_bDirect)
+		posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	_nAdvised = 0;
+#endif
+	return true;
+}
+
+void grep_input::openStdin()
+{
+	close();
+	lstrcpy(_szName, _T("(standard input)"));
+	_bStdin		= true;
+	_bDirect	= false;
+	_nOffset	= 0;
+#ifdef _WIN32
+	_hFile = GetStdHandle(STD_INPUT_HANDLE);
+#else
+	_fd = 0;
+#endif
+}
+
+void grep_input::openMemory(LPCTSTR pszFileName, const char* pData, long nLen)
+{
+	close();
+	lstrcpyn(_szName, pszFileName, sizeof(_szName)/sizeof(TCHAR));
+	_bStdin		= false;
+	_bDirect	= false;
+	_nOffset	= 0;
+	_pMem		= pData;
+	_nMemLen	= nLen;
+	_nMemPos	= 0;
+}
+
+void grep_input::openStream(LPCTSTR pszFileName, PREADPROC pfnRead, void* pContext)
+{
+	close();
+	lstrcpyn(_szName, pszFileName, sizeof(_szName)/sizeof(TCHAR));
+	_bStdin		= false;
+	_bDirect	= false;
+	_nOffset	= 0;
+	_pfnRead	= pfnRead;
+	_pReadContext = pContext;
+}
+
+void grep_input::close()
+{
+#ifdef _WIN32
+	if(_hFile != INVALID_HANDLE_VALUE && !_bStdin)
+		CloseHandle(_hFile);
+	_hFile = INVALID_HANDLE_VALUE;
+#else
+	if(_fd != -1 && !_bStdin)
+		::close(_fd);
+	_fd = -1;
+#endif
+	_bStdin = false;
+	_pMem = NULL;
+	_pfnRead = NULL;
+}
+
+long grep_input::read(LPVOID pBuf, long nBytes)
+{
+	long n;
+
+	if(_pMem)
+	{
+		n = _nMemLen - _nMemPos;
+		if(n > nBytes)
+			n = nBytes;
+		memcpy(pBuf, _pMem + _nMemPos, n);
+		_nMemPos += n;
+		return n;
+	}
+	if(_pfnRead)
+		return _pfnRead(_pReadContext, pBuf, nBytes);
+	if(!_bDirect)
+		return _osRead(pBuf, nBytes);
+
+	// direct: refill the aligned buffer with whole blocks, then copy
+	if(_nDirectPos == _nDirectLen)
+	{
+		n = _osRead(_pDirect, _nDirectSize);
+		if(n <= 0)
+			return n;
+		_nDirectPos = 0;
+		_nDirectLen = n;
+	}
+	n = _nDirectLen - _nDirectPos;
+	if(n > nBytes)
+		n = nBytes;
+	memcpy(pBuf, _pDirect + _nDirectPos, n);
+	_nDirectPos += n;
+	return n;
+}
+
+bool grep_input::seek(ulonglong uOffset)
+{
+	char  buf[4096];
+	ulonglong uAt = 0;
+	long  n;
+
+	if(_pMem)
+	{
+		_nMemPos = (uOffset < (ulonglong)_nMemLen ? (long)uOffset : _nMemLen);
+		return true;
+	}
+
+	// direct reads can only start at an aligned offset
+	if(!_bStdin && !_pfnRead && _osSeek(_bDirect ? uOffset & ~(ulonglong)(IO_ALIGNMENT - 1) : uOffset))
+	{
+		uAt = _nOffset;
+		_nDirectPos = _nDirectLen = 0;
+	}
+	for(; uAt < uOffset; uAt += n)
+	{
+		n = (uOffset - uAt < sizeof(buf) ? (long)(uOffset - uAt) : (long)sizeof(buf));
+		n = read(buf, n);
+		if(n <= 0)
+			return (n == 0);
+	}
+	return true;
+}
+
+long grep_input::_osRead(LPVOID pBuf, long nBytes)
+{
+#ifdef _WIN32
+	DWORD dwRead;
+
+	if(!ReadFile(_hFile, pBuf, nBytes, &dwRead, NULL))
+		return (GetLastError() == ERROR_BROKEN_PIPE ? 0 : -1);
+	_nOffset += dwRead;
+	return (long)dwRead;
+#else
+	ssize_t n;
+
+	do
+		n = ::read(_fd, pBuf, nBytes);
+	while(n == -1 && errno == EINTR);
+	if(n <= 0)
+		return (long)n;
+	_nOffset += n;
+
+	// keep the kernel a few blocks ahead of us
+	if(!_bDirect && !_bStdin && _nOffset + _nReadSize > _nAdvised)
+	{
+#if defined(__linux__)
+		readahead(_fd, (off_t)_nOffset, (size_t)_nReadSize * READ_AHEAD_BLOCKS);
+#elif defined(POSIX_FADV_WILLNEED)
+		posix_fadvise(_fd, (off_t)_nOffset, (off_t)_nReadSize * READ_AHEAD_BLOCKS,
+					  POSIX_FADV_WILLNEED);
+#endif
+		_nAdvised = _nOffset + (ulonglong)_nReadSize * READ_AHEAD_BLOCKS;
+	}
+	return (long)n;
+#endif
+}
+
+bool grep_input::_osSeek(ulonglong uOffset)
+{
+#ifdef _WIN32
+	LONG  nHigh = (LONG)(uOffset >> 32);
+	DWORD dwLow;
+
+	if(GetFileType(_hFile) != FILE_TYPE_DISK)
+		return false;
+	dwLow = SetFilePointer(_hFile, (LONG)(DWORD)uOffset, &nHigh, FILE_BEGIN);
+	if(dwLow == 0xFFFFFFFF && GetLastError() != NO_ERROR)
+		return false;
+#else
+	if(lseek(_fd, (off_t)uOffset, SEEK_SET) == (off_t)-1)
+		return false;
+	_nAdvised = uOffset;
+#endif
+	_nOffset = uOffset;
+	return true;
+}
+
+char* grep_input::allocBuffer(long nSize)
+{
+#ifdef _WIN32
+	return (char*)VirtualAlloc(NULL, nSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	void* p = NULL;
+	if(posix_memalign(&p, IO_ALIGNMENT, nSize) != 0)
+		return NULL;
+	return (char*)p;
+#endif
+}
+
+void grep_input::freeBuffer(char* pBuf, long /* nSize */)
+{
+	if(pBuf == NULL)
+		return;
+#ifdef _WIN32
+	VirtualFree(pBuf, 0, MEM_RELEASE);
+#else
+	free(pBuf);
+#endif
+}
+
+bool grep_input::mapFile(LPCTSTR pszFileName, bool bCopyOnWrite, char** ppData, long* pnLen)
+{
+	*ppData = NULL;
+	*pnLen = 0;
+#ifdef _WIN32
+	HANDLE hFile, hMapping;
+	DWORD  dwSizeHigh, dwSize;
+
+	hFile = CreateFile( pszFileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+						NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if(hFile == INVALID_HANDLE_VALUE)
+		return false;
+	dwSize = GetFileSize(hFile, &dwSizeHigh);
+	if(dwSizeHigh || dwSize > 0x7fffffff)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+	if(dwSize == 0)
+	{
+		CloseHandle(hFile);
+		return true;
+	}
+	hMapping = CreateFileMapping( hFile, NULL, (bCopyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY),
+								  0, 0, NULL );
+	CloseHandle(hFile);
+	if(hMapping == NULL)
+		return false;
+	*ppData = (char*)MapViewOfFile(hMapping, (bCopyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ), 0, 0, 0);
+	CloseHandle(hMapping);	// the view keeps the mapping
+	if(*ppData == NULL)
+		return false;
+	*pnLen = (long)dwSize;
+	return true;
+#else
+	struct stat st;
+	void* p;
+	int fd = ::open(pszFileName, O_RDONLY);
+
+	if(fd == -1)
+		return false;
+	if(fstat(fd, &st) != 0 || st.st_size > 0x7fffffff)
+	{
+		::close(fd);
+		return false;
+	}
+	if(st.st_size == 0)
+	{
+		::close(fd);
+		return true;
+	}
+	p = mmap( NULL, (size_t)st.st_size, PROT_READ | (bCopyOnWrite ? PROT_WRITE : 0),
+			  MAP_PRIVATE, fd, 0 );
+	::close(fd);
+	if(p == MAP_FAILED)
+		return false;
+	madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+	*ppData = (char*)p;
+	*pnLen = (long)st.st_size;
+	return true;
+#endif
+}
+
+void grep_input::unmapFile(char* pData, long nLen)
+{
+	if(pData == NULL)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(pData);
+#else
+	munmap(pData, (size_t)nLen);
+#endif
+}
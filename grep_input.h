@@ -0,0 +1,86 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_input.h - input file for the searches.
+// Sequential block reads straight from the OS (Win32 or POSIX),
+// with read-ahead hints and an optional unbuffered (direct) mode
+// for big files that should not go through the cache.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_input_inc_
+#define _grep_input_inc_
+
+#include "grep.h"
+
+// Alignment of direct I/O buffers, offsets and sizes
+const long IO_ALIGNMENT = 4096;
+
+// Reads from a source that is not a file (see openStream); returns
+// the number of bytes read, 0 at the end, -1 on error
+typedef long (*PREADPROC)(void* pContext, LPVOID pBuf, long nBytes);
+
+class grep_input
+{
+public:
+	grep_input();
+	~grep_input();
+
+	// open a file; with bDirect the OS cache is bypassed if the
+	// file system allows it (falls back to normal reads if not)
+	bool open(LPCTSTR pszFileName, bool bDirect, long nReadSize);
+	void openStdin();
+	// serve a file that has already been read into memory
+	void openMemory(LPCTSTR pszFileName, const char* pData, long nLen);
+	// serve what pfnRead reads (an archive member, see grep_archive.h)
+	void openStream(LPCTSTR pszFileName, PREADPROC pfnRead, void* pContext);
+	void close();
+	// Returns the number of bytes read, 0 at EOF, -1 on error
+	long read(LPVOID pBuf, long nBytes);
+	// Goes to the offset before the first read. Input that can't
+	// seek (a pipe) is read up to it. Returns false on an error.
+	bool seek(ulonglong uOffset);
+
+	LPCTSTR getFileName()	{ return _szName; }
+	bool isStdin()			{ return _bStdin; }
+
+	// page-aligned buffers, as needed by direct I/O
+	static char* allocBuffer(long nSize);
+	static void  freeBuffer(char* pBuf, long nSize);
+
+	// Maps a whole file into memory. With bCopyOnWrite the pages
+	// can be written, privately. An empty file maps to NULL, 0.
+	static bool  mapFile(LPCTSTR pszFileName, bool bCopyOnWrite, char** ppData, long* pnLen);
+	static void  unmapFile(char* pData, long nLen);
+
+private:
+#ifdef _WIN32
+	HANDLE	_hFile;
+#else
+	int		_fd;
+	ulonglong _nAdvised;	// file offset up to which read-ahead was requested
+#endif
+	bool	_bStdin;
+	bool	_bDirect;
+	ulonglong _nOffset;		// current file offset
+	long	_nReadSize;
+	TCHAR	_szName[MAX_PATH*2];
+
+	// file contents already in memory (see openMemory)
+	const char* _pMem;
+	long	_nMemLen;
+	long	_nMemPos;
+
+	// or a stream (see openStream)
+	PREADPROC _pfnRead;
+	void*	_pReadContext;
+
+	// aligned bounce buffer for direct reads
+	char*	_pDirect;
+	long	_nDirectSize;
+	long	_nDirectPos;
+	long	_nDirectLen;
+
+private:
+	long _osRead(LPVOID pBuf, long nBytes);
+	bool _osSeek(ulonglong uOffset);
+};
+
+#endif	// _grep_input_inc_
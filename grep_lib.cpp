@@ -0,0 +1,139 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_lib.cpp - implementation of grep_compiled
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_lib.h"
+#include "grep_regex.h"
+
+grep_compiled::grep_compiled()
+{
+	_nFlags = 0;
+	_bCompiled = false;
+}
+
+grep_compiled::~grep_compiled()
+{
+}
+
+bool grep_compiled::compile( grep_search_type searchType,
+							 const LPCSTR* ppPatterns,
+							 int nPatterns,
+							 unsigned nFlags )
+{
+	grep_pattern_list patterns;
+	int i;
+
+	for(i=0; i<nPatterns; i++)
+		patterns.append(ppPatterns[i]);
+	return compile(searchType, &patterns, nFlags);
+}
+
+bool grep_compiled::compile( grep_search_type searchType,
+							 const grep_pattern_list* patterns,
+							 unsigned nFlags )
+{
+	LPCSTR pc;
+	int i;
+
+	_bCompiled = false;
+	if(patterns->length() == 0)
+		return false;
+
+	// phonetic patterns must be single words (see grep_options::_validate)
+	if(searchType == search_phonetic)
+	{
+		for(i=0; i<patterns->length(); i++)
+		{
+			for(pc = patterns->get(i); *pc; pc++)
+			{
+				if(!isalpha((unsigned char)*pc))
+					return false;
+			}
+		}
+	}
+	// and regular expressions must parse, as grep_options::_validate
+	// checks them; the matcher assumes they do
+	else if(searchType == search_regex || searchType == search_full_regex)
+	{
+		for(i=0; i<patterns->length(); i++)
+		{
+			if(grep_regex::check( patterns->get(i), patterns->lengthOf(i),
+								  searchType == search_full_regex ) != NULL)
+				return false;
+		}
+	}
+
+	_nFlags = nFlags;
+	_searcher.init( searchType, patterns, !(nFlags & GREP_IGNORE_CASE),
+					(nFlags & GREP_WORD) != 0, (nFlags & GREP_ENTIRE_LINE) != 0,
+					(long)((nFlags >> 8) & 0xFF) );
+	_bCompiled = true;
+	return true;
+}
+
+long grep_compiled::searchBuffer( grep_context& ctx,
+								  LPCSTR pBuf,
+								  long nLen,
+								  GREP_MATCH_CALLBACK pfnCallback,
+								  void* pUser ) const
+{
+	long nMatched;
+
+	// going through the reader decodes UTF-16 and NUL-terminates the lines
+	ctx.input.openMemory(_T(""), pBuf, nLen);
+	nMatched = searchInput(ctx, ctx.input, pfnCallback, pUser);
+	ctx.input.close();
+	return nMatched;
+}
+
+long grep_compiled::searchFile( grep_context& ctx,
+								LPCTSTR pszFileName,
+								GREP_MATCH_CALLBACK pfnCallback,
+								void* pUser ) const
+{
+	long nMatched;
+
+	if(!ctx.input.open(pszFileName, false, ctx.nReadSize))
+		return -1;
+	nMatched = searchInput(ctx, ctx.input, pfnCallback, pUser);
+	ctx.input.close();
+	return nMatched;
+}
+
+long grep_compiled::searchInput( grep_context& ctx,
+								 grep_input& input,
+								 GREP_MATCH_CALLBACK pfnCallback,
+								 void* pUser ) const
+{
+	grep_match m;
+	LPSTR pLine;
+	long nLineLen, nMatched;
+	bool bMatched, bInvert;
+
+	if(!_bCompiled)
+		return 0;
+
+	bInvert = (_nFlags & GREP_INVERT) != 0;
+	m.pszFileName = (*input.getFileName() ? input.getFileName() : NULL);
+	m.nLineNumber = 0;
+	nMatched = 0;
+
+	ctx.reader.attach(&input, ctx.nReadSize);
+	while( (nLineLen = ctx.reader.nextLine(&pLine)) != -1 )
+	{
+		m.nLineNumber++;
+		bMatched = _searcher.match( pLine, nLineLen, &m.nPattern,
+									&m.nMatchStart, &m.nMatchLength, &ctx.scratch );
+		if(bMatched == bInvert)
+			continue;
+
+		nMatched++;
+		if(bInvert)
+			m.nPattern = m.nMatchStart = m.nMatchLength = -1;
+		m.pLine = pLine;
+		m.nLineLen = nLineLen;
+		if(pfnCallback && !pfnCallback(pUser, &m))
+			break;
+	}
+	return nMatched;
+}
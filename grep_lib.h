@@ -0,0 +1,93 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_lib.h - the search engine as a library.
+//
+// A grep_compiled is a set of patterns compiled once; after
+// compile() it is never changed by the searches, so any number of
+// threads can search with it at the same time. All the working
+// memory of a search is in a grep_context, one per thread, which
+// is meant to be kept and reused from call to call. A program
+// built without grep.cpp defines grep_outOfMemory() (grep.h).
+//
+//	grep_compiled pats;
+//	grep_context  ctx;
+//	pats.compile(search_exact, ppPatterns, nPatterns, GREP_IGNORE_CASE);
+//	pats.searchFile(ctx, "app.log", OnMatch, pUserData);
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_lib_inc_
+#define _grep_lib_inc_
+
+#include "grep.h"
+#include "grep_search.h"
+#include "grep_input.h"
+#include "grep_reader.h"
+#include "grep_scratch.h"
+
+// Flags for grep_compiled::compile
+#define GREP_IGNORE_CASE	0x0001	// -i
+#define GREP_WORD			0x0002	// -w
+#define GREP_ENTIRE_LINE	0x0004	// -x
+#define GREP_INVERT			0x0008	// -v: report the lines that don't match
+// search_fuzzy: the edits a match may have, 0 to FUZZY_MAX_EDITS
+#define GREP_FUZZY_EDITS(n)	((unsigned)(n) << 8)
+
+// A matching line, as passed to the callback
+struct grep_match
+{
+	LPCTSTR	pszFileName;	// NULL when searching a buffer
+	LPCSTR	pLine;			// NUL-terminated, without the line break
+	long	nLineLen;
+	ulong	nLineNumber;	// first line is 1
+	long	nPattern;		// index of the pattern that matched, -1 with GREP_INVERT
+	long	nMatchStart;	// the match within the line, -1 with GREP_INVERT
+	long	nMatchLength;
+};
+
+// Called for each matching line; return false to stop the search
+typedef bool (*GREP_MATCH_CALLBACK)(void* pUser, const grep_match* pMatch);
+
+// Working memory of the searches of one thread
+class grep_context
+{
+public:
+	grep_context() : nReadSize(256 * 1024)	{}
+
+	long			nReadSize;	// size of the reads from files
+	grep_input		input;
+	grep_reader		reader;
+	grep_scratch	scratch;
+};
+
+class grep_compiled
+{
+public:
+	grep_compiled();
+	~grep_compiled();
+
+	// Compiles the patterns. Returns false if there are none, or if
+	// a pattern is not valid for the search type: a phonetic pattern
+	// that is not one word, or a regular expression that does not parse.
+	bool compile( grep_search_type searchType, const LPCSTR* ppPatterns,
+				  int nPatterns, unsigned nFlags );
+	bool compile( grep_search_type searchType, const grep_pattern_list* patterns,
+				  unsigned nFlags );
+
+	// Each search returns the number of matching lines (up to the
+	// point the callback stopped it), or -1 if the file can't be opened.
+	long searchBuffer( grep_context& ctx, LPCSTR pBuf, long nLen,
+					   GREP_MATCH_CALLBACK pfnCallback, void* pUser ) const;
+	long searchFile  ( grep_context& ctx, LPCTSTR pszFileName,
+					   GREP_MATCH_CALLBACK pfnCallback, void* pUser ) const;
+	// any opened grep_input: a file, stdin or memory
+	long searchInput ( grep_context& ctx, grep_input& input,
+					   GREP_MATCH_CALLBACK pfnCallback, void* pUser ) const;
+
+	const grep_search& searcher() const	{ return _searcher; }
+
+private:
+	grep_search	_searcher;
+	unsigned	_nFlags;
+	bool		_bCompiled;
+};
+
+#endif	// _grep_lib_inc_
@@ -0,0 +1,109 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_libbench.cpp - times grep_compiled against a grep per query.
+//
+//	grep_libbench GREP N PATTERN FILE
+//
+// Counts the lines of FILE that have PATTERN N times: with one
+// grep_compiled in this process, and with N runs of
+// 'GREP -c PATTERN FILE'. The difference is what a service that
+// embeds the engine saves on process start and compiling the
+// patterns. Needs fork; built for the bench target (bench.cmake).
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "grep_lib.h"
+
+static double _msSince(ulonglong uStart)
+{
+	return (double)(longlong)(grep_ticks() - uStart) * 1000.0 / (double)(longlong)grep_ticksPerSecond();
+}
+
+// The engine's arenas call this when the heap is exhausted
+void grep_outOfMemory()
+{
+	fprintf(stderr, "grep_libbench: out of memory\n");
+	exit(2);
+}
+
+// Runs 'pszGrep -c pszPattern pszFile' with its output thrown away;
+// false unless it ran and exited with 0 (found) or 1 (not found)
+static bool _runGrep(LPCSTR pszGrep, LPCSTR pszPattern, LPCSTR pszFile)
+{
+	pid_t pid;
+	int nStatus, fd;
+
+	pid = fork();
+	if(pid < 0)
+		return false;
+	if(pid == 0)
+	{
+		fd = open("/dev/null", O_WRONLY);
+		if(fd >= 0)
+			dup2(fd, 1);
+		execl(pszGrep, pszGrep, "-c", pszPattern, pszFile, (char*)NULL);
+		_exit(127);
+	}
+	if(waitpid(pid, &nStatus, 0) != pid)
+		return false;
+	return WIFEXITED(nStatus) && WEXITSTATUS(nStatus) <= 1;
+}
+
+int main(int argc, char* argv[])
+{
+	ulonglong uStart;
+	grep_compiled pats;
+	grep_context ctx;
+	LPCSTR ppPatterns[1];
+	long nQueries, nLines, i;
+	double dLib, dGrep;
+
+	if(argc != 5 || (nQueries = atol(argv[2])) < 1)
+	{
+		fprintf(stderr, "usage: grep_libbench GREP N PATTERN FILE\n");
+		return 2;
+	}
+
+	// in this process: the patterns are compiled once, as a
+	// service would keep them
+	uStart = grep_ticks();
+	ppPatterns[0] = argv[3];
+	if(!pats.compile(search_exact, ppPatterns, 1, 0))
+	{
+		fprintf(stderr, "grep_libbench: can't compile \"%s\"\n", argv[3]);
+		return 2;
+	}
+	nLines = 0;
+	for(i=0; i<nQueries; i++)
+	{
+		nLines = pats.searchFile(ctx, argv[4], NULL, NULL);
+		if(nLines < 0)
+		{
+			fprintf(stderr, "grep_libbench: can't open %s\n", argv[4]);
+			return 2;
+		}
+	}
+	dLib = _msSince(uStart);
+
+	// a grep for each query
+	uStart = grep_ticks();
+	for(i=0; i<nQueries; i++)
+	{
+		if(!_runGrep(argv[1], argv[3], argv[4]))
+		{
+			fprintf(stderr, "grep_libbench: %s failed\n", argv[1]);
+			return 2;
+		}
+	}
+	dGrep = _msSince(uStart);
+
+	printf("%ld queries, %ld matching lines each\n", nQueries, nLines);
+	printf("grep_compiled: %.0f ms, %.3f ms a query\n", dLib, dLib / nQueries);
+	printf("grep -c:       %.0f ms, %.3f ms a query\n", dGrep, dGrep / nQueries);
+	return 0;
+}
@@ -3,8 +3,41 @@
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #include "grep_options.h"
+#include "grep_input.h"
+#include "grep_reader.h"
+#include "grep_output.h"
+#include "grep_regex.h"
+
+// Default size of a single read from a file
+const long DEFAULT_READ_SIZE = 256 * 1024;
+// Default number of files read ahead in multi-file searches
+const long DEFAULT_ASYNC_READS = 32;
+// Default --multiline lookback: how far into the previous block a
+// match may start
+const long DEFAULT_LOOKBACK = 64 * 1024;
+// Most --threads
+const long MAX_THREADS = 256;
+// --top without a count
+const long DEFAULT_TOP_FILES = 10;
+// Most files --top and lines --sample keep
+const long MAX_AGGREGATE = 1000000;
 
 grep_options::grep_options()
+{
+	reset();
+}
+
+// destructor
+grep_options::~grep_options()
+{
+	_patterns.clear();
+	_fileSpecs.clear();
+}
+
+//----------------------------------------------------------------
+// Back to the defaults, for the next command line
+//----------------------------------------------------------------
+void grep_options::reset()
 {
 	bOneFile = true;
 	bJustCount = false;
@@ -19,12 +52,26 @@ grep_options::grep_options()
 	bMatchEntireLine = false;
 	bSearchSubDirs = false;
 	bShowSummary = false;
+	bDirectIO = false;
+	bJson = false;
+	bStats = false;
+	bStatsAll = false;
+	nMaxCount = 0;
+	nMultiline = 0;
+	bArchives = false;
+	nFuzzyEdits = 0;
+	nTopFiles = 0;
+	bByPattern = false;
+	nSample = 0;
+	uRangeStart = 0;
+	uRangeEnd = READER_NO_LIMIT;
+	nReadSize = DEFAULT_READ_SIZE;
+	nAsyncReads = DEFAULT_ASYNC_READS;
+	uMemoryBudget = 0;
+	nThreads = 1;
+	bUnordered = false;
+	szCacheDir[0] = 0;
 	_searchType = search_regex;
-}
-
-// destructor
-grep_options::~grep_options()
-{
 	_patterns.clear();
 	_fileSpecs.clear();
 }
@@ -45,7 +92,14 @@ bool grep_options::parseOptions(int argc, char* argv[])
 	{
 		if(argv[i][0] == '-')  // it's a switch
 		{
-			if(argv[i][1] == 'e')
+			if(argv[i][1] == '-' && argv[i][2])
+			{
+				// --name[=value]
+				if(!_parseLongOption(argv[i] + 2))
+					return false;
+				continue;
+			}
+			else if(argv[i][1] == 'e')
 			{
 				// for -e switches, add the string specified to the _patterns array
 				if( (i == argc-1) && (lstrlen(argv[i]) == 2) )
@@ -134,9 +188,9 @@ bool grep_options::parseOptions(int argc, char* argv[])
 				case 'm':
 					bShowSummary = true;
 					break;
-				//case 'E':
-				//	_searchType = search_full_regex;
-				//	break;
+				case 'E':
+					_searchType = search_full_regex;
+					break;
 				case 'F':
 					_searchType = search_exact;
 					break;
@@ -175,6 +229,7 @@ bool grep_options::parseOptions(int argc, char* argv[])
 	pfnstr = (bNoCase ? stristr : strstr);
 
 	_buildPatternList(&pat_files);
+	_patterns.removeDuplicates();
 	return _validate();
 }
 
@@ -198,14 +253,230 @@ LPCTSTR grep_options::getFileSpec(int index)
 	return _fileSpecs.get(index);
 }
 
+//----------------------------------------------------------------
+// Parse one --name[=value] option (without the leading --).
+// Return false on invalid option.
+//----------------------------------------------------------------
+bool grep_options::_parseLongOption(LPCTSTR pszOption)
+{
+	LPCTSTR pszValue = _tcschr(pszOption, _T('='));
+	int nNameLen = (pszValue ? (int)(pszValue - pszOption) : lstrlen(pszOption));
+
+	if(pszValue)
+		pszValue++;
+
+	if(nNameLen == 2 && !_tcsncmp(pszOption, _T("io"), 2) && pszValue)
+	{
+		if(streq(pszValue, _T("direct")))
+			bDirectIO = true;
+		else if(streq(pszValue, _T("buffered")))
+			bDirectIO = false;
+		else
+		{
+			g_stdout.writeFormatted("grep: Invalid I/O mode: %s\r\n", pszValue);
+			return false;
+		}
+	}
+	else if(nNameLen == 9 && !_tcsncmp(pszOption, _T("read-size"), 9) && pszValue)
+	{
+		if( !_parseSize(pszValue, &nReadSize) ||
+			nReadSize < IO_ALIGNMENT || nReadSize > 64*1024*1024 )
+		{
+			g_stdout.writeFormatted("grep: Invalid read size: %s (4K to 64M)\r\n", pszValue);
+			return false;
+		}
+		// whole pages, so that direct reads need no extra copy
+		nReadSize = (nReadSize + IO_ALIGNMENT - 1) & ~(IO_ALIGNMENT - 1);
+	}
+	else if(nNameLen == 5 && !_tcsncmp(pszOption, _T("async"), 5) && pszValue)
+	{
+		if(!_parseSize(pszValue, &nAsyncReads) || nAsyncReads > 4096)
+		{
+			g_stdout.writeFormatted("grep: Invalid number of reads ahead: %s (0 to 4096)\r\n", pszValue);
+			return false;
+		}
+	}
+	else if(nNameLen == 5 && !_tcsncmp(pszOption, _T("cache"), 5) && pszValue)
+	{
+		if(!*pszValue || lstrlen(pszValue) >= MAX_PATH - 64)
+		{
+			g_stdout.writeFormatted("grep: Invalid cache directory: %s\r\n", pszValue);
+			return false;
+		}
+		lstrcpyn(szCacheDir, pszValue, MAX_PATH);
+	}
+	else if(nNameLen == 9 && !_tcsncmp(pszOption, _T("max-count"), 9) && pszValue)
+	{
+		if(!_parseSize(pszValue, &nMaxCount) || nMaxCount < 1)
+		{
+			g_stdout.writeFormatted("grep: Invalid maximum count: %s\r\n", pszValue);
+			return false;
+		}
+	}
+	else if(nNameLen == 7 && !_tcsncmp(pszOption, _T("threads"), 7) && pszValue)
+	{
+		if(!_parseSize(pszValue, &nThreads) || nThreads < 1 || nThreads > MAX_THREADS)
+		{
+			g_stdout.writeFormatted("grep: Invalid thread count: %s (1 to %ld)\r\n", pszValue, MAX_THREADS);
+			return false;
+		}
+	}
+	else if(nNameLen == 9 && !_tcsncmp(pszOption, _T("unordered"), 9) && !pszValue)
+		bUnordered = true;
+	else if(nNameLen == 6 && !_tcsncmp(pszOption, _T("memory"), 6) && pszValue)
+	{
+		if(!_parseOffset(pszValue, pszValue + lstrlen(pszValue), &uMemoryBudget))
+		{
+			g_stdout.writeFormatted("grep: Invalid memory budget: %s\r\n", pszValue);
+			return false;
+		}
+	}
+	else if(nNameLen == 5 && !_tcsncmp(pszOption, _T("range"), 5) && pszValue)
+	{
+		if(!_parseRange(pszValue))
+		{
+			g_stdout.writeFormatted("grep: Invalid byte range: %s (START:END)\r\n", pszValue);
+			return false;
+		}
+	}
+	else if(nNameLen == 9 && !_tcsncmp(pszOption, _T("multiline"), 9))
+	{
+		nMultiline = DEFAULT_LOOKBACK;
+		if(pszValue && (!_parseSize(pszValue, &nMultiline) || nMultiline < 1))
+		{
+			g_stdout.writeFormatted("grep: Invalid lookback: %s\r\n", pszValue);
+			return false;
+		}
+	}
+	else if(nNameLen == 5 && !_tcsncmp(pszOption, _T("fuzzy"), 5))
+	{
+		_searchType = search_fuzzy;
+		nFuzzyEdits = 1;
+		if(pszValue && (!_parseSize(pszValue, &nFuzzyEdits) || nFuzzyEdits > FUZZY_MAX_EDITS))
+		{
+			g_stdout.writeFormatted("grep: Invalid number of edits: %s (0 to %ld)\r\n",
+									pszValue, FUZZY_MAX_EDITS);
+			return false;
+		}
+	}
+	else if(nNameLen == 3 && !_tcsncmp(pszOption, _T("top"), 3))
+	{
+		nTopFiles = DEFAULT_TOP_FILES;
+		if(pszValue && (!_parseSize(pszValue, &nTopFiles) || nTopFiles < 1 || nTopFiles > MAX_AGGREGATE))
+		{
+			g_stdout.writeFormatted("grep: Invalid number of files: %s (1 to %ld)\r\n", pszValue, MAX_AGGREGATE);
+			return false;
+		}
+	}
+	else if(nNameLen == 10 && !_tcsncmp(pszOption, _T("by-pattern"), 10) && !pszValue)
+		bByPattern = true;
+	else if(nNameLen == 6 && !_tcsncmp(pszOption, _T("sample"), 6) && pszValue)
+	{
+		if(!_parseSize(pszValue, &nSample) || nSample < 1 || nSample > MAX_AGGREGATE)
+		{
+			g_stdout.writeFormatted("grep: Invalid sample size: %s (1 to %ld)\r\n", pszValue, MAX_AGGREGATE);
+			return false;
+		}
+	}
+	else if(nNameLen == 4 && !_tcsncmp(pszOption, _T("json"), 4) && !pszValue)
+		bJson = true;
+	else if(nNameLen == 8 && !_tcsncmp(pszOption, _T("archives"), 8) && !pszValue)
+		bArchives = true;
+	else if(nNameLen == 5 && !_tcsncmp(pszOption, _T("stats"), 5))
+	{
+		if(pszValue && !streq(pszValue, _T("all")) && !streq(pszValue, _T("first")))
+		{
+			g_stdout.writeFormatted("grep: Invalid statistics mode: %s\r\n", pszValue);
+			return false;
+		}
+		bStats = true;
+		bStatsAll = (pszValue && streq(pszValue, _T("all")));
+	}
+	else
+	{
+		g_stdout.writeFormatted("grep: Invalid option: --%s\r\n", pszOption);
+		return false;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------
+// Parse a number with an optional K, M or G suffix
+//----------------------------------------------------------------
+bool grep_options::_parseSize(LPCTSTR pszValue, long* pSize)
+{
+	TCHAR* pEnd;
+	double dSize = _tcstod(pszValue, &pEnd);
+
+	if(pEnd == pszValue || dSize < 0)
+		return false;
+	switch(*pEnd)
+	{
+	case _T('k'): case _T('K'):	dSize *= 1024;					pEnd++; break;
+	case _T('m'): case _T('M'):	dSize *= 1024 * 1024;			pEnd++; break;
+	case _T('g'): case _T('G'):	dSize *= 1024 * 1024 * 1024;	pEnd++; break;
+	}
+	if(*pEnd || dSize > 2147483647.0)
+		return false;
+	*pSize = (long)dSize;
+	return true;
+}
+
+//----------------------------------------------------------------
+// Parse START:END; either one can be left out, for the start or
+// the end of the file
+//----------------------------------------------------------------
+bool grep_options::_parseRange(LPCTSTR pszValue)
+{
+	LPCTSTR pszColon = _tcschr(pszValue, _T(':'));
+
+	if(!pszColon)
+		return false;
+	uRangeStart = 0;
+	uRangeEnd = READER_NO_LIMIT;
+	if(pszColon > pszValue && !_parseOffset(pszValue, pszColon, &uRangeStart))
+		return false;
+	if(pszColon[1] && !_parseOffset(pszColon + 1, pszColon + lstrlen(pszColon), &uRangeEnd))
+		return false;
+	return (uRangeStart < uRangeEnd);
+}
+
+// A 64-bit offset with an optional K, M or G suffix, up to pszEnd
+bool grep_options::_parseOffset(LPCTSTR pszValue, LPCTSTR pszEnd, ulonglong* pOffset)
+{
+	ulonglong uValue = 0;
+	LPCTSTR pc;
+	int nShift = 0;
+
+	for(pc = pszValue; pc < pszEnd && *pc >= _T('0') && *pc <= _T('9'); pc++)
+	{
+		if(uValue > (READER_NO_LIMIT - 9) / 10)
+			return false;
+		uValue = uValue * 10 + (*pc - _T('0'));
+	}
+	if(pc == pszValue)
+		return false;
+	if(pc + 1 == pszEnd)
+	{
+		switch(*pc)
+		{
+		case _T('k'): case _T('K'):	nShift = 10;	pc++; break;
+		case _T('m'): case _T('M'):	nShift = 20;	pc++; break;
+		case _T('g'): case _T('G'):	nShift = 30;	pc++; break;
+		}
+	}
+	if(pc != pszEnd || (uValue << nShift) >> nShift != uValue)
+		return false;
+	*pOffset = uValue << nShift;
+	return true;
+}
+
 void grep_options::_buildPatternList(_string_array_* pPatFiles)
 {
 	// add each line in pPatFiles files as a pattern to this->_patterns
 	_file_finder_ ff;
-	_win32_file_ w32f;
 	TCHAR curfile[MAX_PATH];
 	bool bGoodSpec;		// is the current pattern filespec good?
-	LPSTR line = NULL;
 	int i;
 	
 	for(i=0; i<pPatFiles->length(); i++)
@@ -216,17 +487,9 @@ void grep_options::_buildPatternList(_string_array_* pPatFiles)
 		while(ff.getNextFile(curfile))
 		{
 			bGoodSpec = true;
-			w32f.reset(curfile);
-			if(!w32f.open(access_read))
-			{
+			// mapped and split in place, no copies
+			if(!_patterns.loadFile(curfile))
 				g_stdout.writeFormatted("grep: Can\'t open pattern file \'%s\'\r\n", curfile);
-				continue;
-			}
-			while(w32f.readLine(line) != -1)
-			{
-				_patterns.append(line);
-				free(line);
-			}
 		}
 		if(!bGoodSpec)
 			g_stdout.writeFormatted("grep: Can\'t find pattern file(s) \'%s\'\r\n", pPatFiles->get(i));
@@ -235,45 +498,65 @@ void grep_options::_buildPatternList(_string_array_* pPatFiles)
 
 bool grep_options::_validate()
 {
-	int i, j;
-
 	// check the patterns for validity
 	if(search_phonetic == _searchType)
 	{
 		// validate the patterns to conform to the soundex rules
-		for(i=0; i<_patterns.length(); i++)
-		{
-			for(j=0; j<lstrlen(_patterns[i]); j++)
-			{
-				if(!isalpha(_patterns[i][j]))
-				{
-					if(!bQuiet)
-						g_stdout.writeFormatted (
-							"grep: Pattern \"%s\" does not conform to the specified type of search:\r\n"
-							"For Phonetic search (-P), the pattern must contain a\r\n"
-							"single word consisting of all alphabetic characters.\r\n\r\n", _patterns[i] );
-					_patterns.removeAt(i--);
-					break; // next pattern
-				}
-			}
-		}
+		_patterns.removeIf(_dropBadPhonetic, this);
 	}
-	else if(search_regex == _searchType)
+	else if(search_regex == _searchType || search_full_regex == _searchType)
 	{
-		// validate the patterns to conform to basic regex rules
-		for(i=0; i<_patterns.length(); i++)
-		{
-		}
+		// validate the patterns to conform to basic or extended regex rules
+		_patterns.removeIf(_dropBadRegex, this);
 	}
-	else if(search_full_regex == _searchType)
+	
+	// exact and fuzzy searches do not require any pattern checks
+
+	if( nMultiline && (search_phonetic == _searchType || search_wildcard == _searchType ||
+					   search_fuzzy == _searchType) )
 	{
-		// validate the patterns to conform to extended regex rules
-		for(i=0; i<_patterns.length(); i++)
-		{
-		}
+		g_stdout.writeString("grep: --multiline works with exact and regular expression searches only\r\n");
+		return false;
+	}
+	if(nMultiline && (bShowNoMatch || bMatchEntireLine))
+	{
+		g_stdout.writeString("grep: --multiline can't be used with -v or -x\r\n");
+		return false;
+	}
+
+	// --top, --by-pattern and --sample count the lines as -c does,
+	// and write their summaries at the end instead
+	if(aggregates() && (bFileNameOnly || bQuiet))
+	{
+		g_stdout.writeString("grep: --top, --by-pattern and --sample can't be used with -l or -q\r\n");
+		return false;
+	}
+	if((bByPattern || nSample) && nMultiline)
+	{
+		g_stdout.writeString("grep: --by-pattern and --sample can't be used with --multiline\r\n");
+		return false;
+	}
+	if(bByPattern && bShowNoMatch)
+	{
+		g_stdout.writeString("grep: --by-pattern can't be used with -v: no pattern matches the lines\r\n");
+		return false;
+	}
+	if(aggregates())
+		bJustCount = true;
+
+	// the pattern counts of --stats and --by-pattern, and the sample,
+	// are kept by one thread
+	if(bStats || bByPattern || nSample)
+		nThreads = 1;
+
+	// the reader and the output are always there
+	if(uMemoryBudget && uMemoryBudget < (ulonglong)(grep_reader::footprint(nReadSize) + grep_output::bufferSize()))
+	{
+		g_stdout.writeFormatted("grep: --memory must be at least %ldK with a read size of %ldK\r\n",
+								(grep_reader::footprint(nReadSize) + grep_output::bufferSize()) / 1024,
+								nReadSize / 1024);
+		return false;
 	}
-	
-	// exact search does not require any pattern checks
 
 	if(_patterns.length()==0)
 	{
@@ -281,9 +564,41 @@ bool grep_options::_validate()
 			g_stdout.writeString("grep: No valid patterns were specified\r\n");
 		return false;
 	}
-	
-	// seed the search object with the patterns, search type, and options
-	g_searcher.init(_searchType, &_patterns, !bNoCase, bTreatAsWord, bMatchEntireLine);
+	return true;
+}
+
+// removeIf() filter for the phonetic patterns
+bool grep_options::_dropBadPhonetic(LPCSTR pPattern, long nLen, void* pThis)
+{
+	long i;
+
+	for(i=0; i<nLen; i++)
+	{
+		if(!isalpha((unsigned char)pPattern[i]))
+		{
+			if(!((grep_options*)pThis)->bQuiet)
+				g_stdout.writeFormatted (
+					"grep: Pattern \"%s\" does not conform to the specified type of search:\r\n"
+					"For Phonetic search (-P), the pattern must contain a\r\n"
+					"single word consisting of all alphabetic characters.\r\n\r\n", pPattern );
+			return true;
+		}
+	}
+	return false;
+}
+
+bool grep_options::_dropBadRegex(LPCSTR pPattern, long nLen, void* pThis)
+{
+	grep_options* pOptions = (grep_options*)pThis;
+	LPCSTR pError;
+
+	pError = grep_regex::check(pPattern, nLen, pOptions->_searchType == search_full_regex);
+	if(pError == NULL)
+		return false;
+	if(!pOptions->bQuiet)
+		g_stdout.writeFormatted( "grep: Pattern \"%s\" is not a valid %s regular expression: %s\r\n",
+								 pPattern, pOptions->_searchType == search_full_regex ? "full" : "basic",
+								 pError );
 	return true;
 }
 
@@ -7,6 +7,7 @@
 
 #include "grep.h"
 #include "grep_search.h"
+#include "grep_patterns.h"
 
 // command line options
 class grep_options
@@ -16,11 +17,14 @@ public:
 	~grep_options();
 
 	// operations
+	void reset();
 	bool parseOptions(int argc, char* argv[]);
 	int  patternCount();
 	LPCTSTR getPattern(int index);
 	int  fileSpecCount();
 	LPCTSTR getFileSpec(int index);
+	grep_search_type searchType()	{ return _searchType; }
+	grep_pattern_list* patterns()	{ return &_patterns; }
 
 public:
 	// Flag for quick checking whether there is just one file to be searched or many;
@@ -40,18 +44,52 @@ public:
 	bool bMatchEntireLine;	// -x
 	bool bSearchSubDirs;	// -R
 	bool bShowSummary;		// -m
+	bool bJson;				// --json: a JSON object per output line
+	bool bStats;			// --stats: hits and costs of each pattern
+	bool bStatsAll;			// --stats=all: count every pattern matching a line
+	long nMultiline;		// --multiline: lookback across blocks, 0 = off
+	bool bArchives;			// --archives: search the members of zip and tar files
+	long nFuzzyEdits;		// --fuzzy: edits a match may have
+
+	// Summaries written instead of the lines (grep_aggregate.h)
+	long nTopFiles;			// --top: files with the most matches, 0 = off
+	bool bByPattern;		// --by-pattern: matching lines per pattern
+	long nSample;			// --sample: matching lines picked at random, 0 = off
+	bool aggregates()		{ return nTopFiles || bByPattern || nSample; }
+
+	// Limits of the search in each file
+	long nMaxCount;			// --max-count: matching lines, 0 = no limit
+	ulonglong uRangeStart;	// --range: byte window, lines starting in it
+	ulonglong uRangeEnd;	// READER_NO_LIMIT if open-ended
+
+	// I/O settings
+	bool bDirectIO;			// --io=direct
+	long nReadSize;			// --read-size
+	long nAsyncReads;		// --async: files read ahead, 0 = off
+	ulonglong uMemoryBudget;	// --memory: bytes of buffers, 0 = no limit
+	long nThreads;			// --threads: files searched at once
+	bool bUnordered;		// --unordered: output in no particular file order
+
+	// Directory of the compiled pattern cache, empty if none (--cache)
+	TCHAR szCacheDir[MAX_PATH];
 
 private:
-	grep_search_type _searchType;  // default, -F, -W, -P, -E
+	grep_search_type _searchType;  // default, -F, -W, -P, -E, --fuzzy
 	// Regular expression(s) / patterns to be searched for
-	_string_array_   _patterns;
+	grep_pattern_list _patterns;
 	// File specifications to be searched
 	_string_array_   _fileSpecs;
 
 private:
 	// helpers
+	bool _parseLongOption(LPCTSTR pszOption);
+	bool _parseSize(LPCTSTR pszValue, long* pSize);
+	bool _parseRange(LPCTSTR pszValue);
+	static bool _parseOffset(LPCTSTR pszValue, LPCTSTR pszEnd, ulonglong* pOffset);
 	void _buildPatternList(_string_array_* pPatFiles);
 	bool _validate();
+	static bool _dropBadPhonetic(LPCSTR pPattern, long nLen, void* pThis);
+	static bool _dropBadRegex(LPCSTR pPattern, long nLen, void* pThis);
 	void _addFileSpec(LPCTSTR filespec);
 };
 
@@ -0,0 +1,200 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_output.cpp - implementation of grep_output
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <stdarg.h>
+#include <stdio.h>
+#ifdef _WIN32
+#include <io.h>
+#define isatty		_isatty
+#define vsnprintf	_vsnprintf
+#else
+#include <unistd.h>
+#endif
+
+#include "grep_output.h"
+#include "grep_server.h"
+#include "grep_utf8.h"
+
+// Size of the output buffer
+static const long OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+grep_output::grep_output() : _stdout(_win32_file_::ft_stdout)
+{
+	_buf		= (char*)malloc(OUTPUT_BUFFER_SIZE);
+	_len		= 0;
+	_bConsole	= (isatty(1) != 0);
+	_nSocket	= -1;
+	_pfnSink	= NULL;
+	_pSinkContext = NULL;
+}
+
+grep_output::~grep_output()
+{
+	flush();
+	free(_buf);
+}
+
+long grep_output::write(const void* pData, long nLen)
+{
+	if(_len + nLen > OUTPUT_BUFFER_SIZE)
+	{
+		flush();
+		if(nLen >= OUTPUT_BUFFER_SIZE)
+		{
+			// too big to be worth copying
+			_writeOut((const char*)pData, nLen);
+			return nLen;
+		}
+	}
+	memcpy(_buf + _len, pData, nLen);
+	_len += nLen;
+
+	if(_bConsole && _nSocket == -1 && !_pfnSink && nLen && ((const char*)pData)[nLen-1] == '\n')
+		flush();
+	return nLen;
+}
+
+long grep_output::writeString(LPCSTR psz)
+{
+	return write(psz, lstrlen(psz));
+}
+
+long grep_output::writeLine(LPCSTR psz)
+{
+	write(psz, lstrlen(psz));
+	return write("\r\n", 2);
+}
+
+long grep_output::writeFormatted(LPCSTR pszFormat, ...)
+{
+	char  szSmall[512];
+	char* pBuf = szSmall;
+	long  nSize = sizeof(szSmall);
+	long  n;
+	va_list args;
+
+	// grow until it fits; old vsnprintf's return -1 when it doesn't
+	for(;;)
+	{
+		va_start(args, pszFormat);
+		n = vsnprintf(pBuf, nSize, pszFormat, args);
+		va_end(args);
+		if(n >= 0 && n < nSize)
+			break;
+		nSize = (n >= nSize ? n + 1 : nSize * 2);
+		if(pBuf != szSmall)
+			free(pBuf);
+		pBuf = (char*)malloc(nSize);
+	}
+
+	write(pBuf, n);
+	if(pBuf != szSmall)
+		free(pBuf);
+	return n;
+}
+
+void grep_output::writeNumber(ulonglong uValue)
+{
+	char  szNum[24];
+	char* pc = szNum + sizeof(szNum);
+
+	do
+		*--pc = (char)('0' + (int)(uValue % 10));
+	while((uValue /= 10) != 0);
+	write(pc, (long)(szNum + sizeof(szNum) - pc));
+}
+
+void grep_output::writeJsonString(LPCSTR p, long nLen)
+{
+	static const char szHex[] = "0123456789abcdef";
+	LPCSTR pc   = p;
+	LPCSTR pRun = p;		// start of the run that needs no escaping
+	LPCSTR pEnd = p + nLen;
+	char   szEsc[6];
+	long   nSeq;
+	unsigned char c;
+
+	write("\"", 1);
+	while(pc < pEnd)
+	{
+		c = (unsigned char)*pc;
+		if(c >= 0x20 && c < 0x80 && c != '"' && c != '\\')
+		{
+			pc++;
+			continue;
+		}
+		if(c >= 0x80 && (nSeq = utf8_seqLength(pc, (long)(pEnd - pc))) != 0)
+		{
+			pc += nSeq;
+			continue;
+		}
+
+		if(pc > pRun)
+			write(pRun, (long)(pc - pRun));
+		switch(c)
+		{
+		case '"':	write("\\\"", 2);	break;
+		case '\\':	write("\\\\", 2);	break;
+		case '\t':	write("\\t", 2);	break;
+		case '\r':	write("\\r", 2);	break;
+		case '\n':	write("\\n", 2);	break;
+		default:
+			if(c >= 0x80)
+				write("\\ufffd", 6);
+			else
+			{
+				memcpy(szEsc, "\\u00", 4);
+				szEsc[4] = szHex[c >> 4];
+				szEsc[5] = szHex[c & 15];
+				write(szEsc, 6);
+			}
+			break;
+		}
+		pRun = ++pc;
+	}
+	if(pc > pRun)
+		write(pRun, (long)(pc - pRun));
+	write("\"", 1);
+}
+
+long grep_output::bufferSize()
+{
+	return OUTPUT_BUFFER_SIZE;
+}
+
+void grep_output::flush()
+{
+	if(_len)
+		_writeOut(_buf, _len);
+	_len = 0;
+}
+
+void grep_output::setSocket(int nSocket)
+{
+	flush();
+	_nSocket = nSocket;
+}
+
+void grep_output::setSink(POUTPUTPROC pfnSink, void* pContext)
+{
+	flush();
+	_pfnSink = pfnSink;
+	_pSinkContext = pContext;
+}
+
+void grep_output::_writeOut(const char* pData, long nLen)
+{
+	if(_pfnSink)
+	{
+		_pfnSink(_pSinkContext, pData, nLen);
+		return;
+	}
+	if(_nSocket == -1)
+	{
+		_stdout.write(pData, nLen);
+		return;
+	}
+
+	grep_send_frame(_nSocket, 'D', pData, nLen);
+}
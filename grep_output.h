@@ -0,0 +1,53 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_output.h - buffered output.
+// Collects the output in a buffer and writes it out in big chunks,
+// either to stdout or, in server mode, to a client's socket.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_output_inc_
+#define _grep_output_inc_
+
+#include "grep.h"
+
+// Where a grep_output with a sink sends what it collected
+typedef void (*POUTPUTPROC)(void* pContext, const char* pData, long nLen);
+
+class grep_output
+{
+public:
+	grep_output();
+	~grep_output();
+
+	long write(const void* pData, long nLen);
+	long writeString(LPCSTR psz);
+	long writeLine(LPCSTR psz);		// adds CR/LF
+	long writeFormatted(LPCSTR pszFormat, ...);
+	void writeNumber(ulonglong uValue);
+	// Writes the text as a quoted JSON string, escaping it on the
+	// way out; bytes that are not valid UTF-8 become U+FFFD
+	void writeJsonString(LPCSTR p, long nLen);
+	void flush();
+	// the memory the output is collected in
+	static long bufferSize();
+
+	// Sends the output to a server client as data frames (see
+	// grep_server.h) instead of stdout; -1 goes back to stdout.
+	void setSocket(int nSocket);
+	// Sends the output to pfnSink instead (a search thread's output
+	// goes to the reorder stage, see grep_parallel.h)
+	void setSink(POUTPUTPROC pfnSink, void* pContext);
+
+private:
+	_win32_file_	_stdout;
+	char*			_buf;
+	long			_len;
+	bool			_bConsole;	// stdout is a console: flush every line
+	int				_nSocket;
+	POUTPUTPROC		_pfnSink;
+	void*			_pSinkContext;
+
+private:
+	void _writeOut(const char* pData, long nLen);
+};
+
+#endif	// _grep_output_inc_
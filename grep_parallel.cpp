@@ -0,0 +1,303 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_parallel.cpp - implementation of grep_parallel
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_parallel.h"
+
+// Files handed out past the oldest unwritten one, per worker
+static const long WINDOW_PER_THREAD	= 4;
+// Smallest piece of pending output allocated
+static const long PENDING_MIN_SIZE	= 16 * 1024;
+
+grep_parallel::grep_parallel()
+{
+	_entries	= NULL;
+	_nWindow	= 0;
+	_workers	= NULL;
+	_threads	= NULL;
+	_nThreads	= 0;
+	_bOrdered	= true;
+	_pfnSearch	= NULL;
+	_pOut		= NULL;
+	_pBudget	= NULL;
+	_nWorkerSize = 0;
+	_nSubmitted	= _nTaken = _nNext = _nOldest = _nOwner = 0;
+	_bOwned		= false;
+	_bStop		= false;
+}
+
+grep_parallel::~grep_parallel()
+{
+	stop();
+}
+
+bool grep_parallel::start( int nThreads, bool bOrdered, PSEARCHFILEPROC pfnSearch,
+						   grep_output* pOut, long nReadSize, grep_memory_budget* pBudget )
+{
+	long i;
+
+	stop();
+	_nWorkerSize = grep_reader::footprint(nReadSize) + grep_output::bufferSize();
+	for(i=0; i<nThreads && pBudget && pBudget->tryReserve(_nWorkerSize); i++)
+		;
+	if(pBudget)
+		nThreads = i;
+	if(nThreads < 2)
+	{
+		for(; i > 0; i--)
+			pBudget->release(_nWorkerSize);
+		return false;
+	}
+
+	_nThreads	= nThreads;
+	_bOrdered	= bOrdered;
+	_pfnSearch	= pfnSearch;
+	_pOut		= pOut;
+	_pBudget	= pBudget;
+	_nSubmitted	= _nTaken = _nNext = _nOldest = _nOwner = 0;
+	_bOwned		= false;
+	_bStop		= false;
+
+	_nWindow = WINDOW_PER_THREAD * _nThreads;
+	_entries = new entry[(size_t)_nWindow];
+	for(i=0; i<_nWindow; i++)
+	{
+		_entries[i].nState	 = entry_free;
+		_entries[i].pPending = NULL;
+		_entries[i].nPending = 0;
+		_entries[i].nCap	 = 0;
+	}
+
+	_workers = new worker[(size_t)nThreads];
+	_threads = new grep_thread[(size_t)nThreads];
+	for(i=0; i<_nThreads; i++)
+	{
+		_workers[i].pPool = this;
+		_workers[i].nSeq = 0;
+		_workers[i].ctx.pOut = &_workers[i].out;
+		_workers[i].ctx.reader.setBudget(pBudget);
+		_workers[i].out.setSink(_sink, &_workers[i]);
+		if(!_threads[i].start(_workerProc, &_workers[i]))
+		{
+			for(; pBudget && nThreads > i; nThreads--)
+				pBudget->release(_nWorkerSize);
+			_nThreads = i;
+			break;
+		}
+	}
+	if(_nThreads < 2)
+	{
+		stop();
+		return false;
+	}
+	return true;
+}
+
+void grep_parallel::stop()
+{
+	long i;
+
+	if(_threads == NULL)
+		return;
+
+	wait();
+	_mutex.lock();
+	_bStop = true;
+	_changed.broadcast();
+	_mutex.unlock();
+	delete[] _threads;		// joins the threads
+	_threads = NULL;
+	delete[] _workers;
+	_workers = NULL;
+	if(_pBudget)
+	{
+		for(i=0; i<_nThreads; i++)
+			_pBudget->release(_nWorkerSize);
+	}
+	for(i=0; i<_nWindow; i++)
+		free(_entries[i].pPending);
+	delete[] _entries;
+	_entries = NULL;
+	_nThreads = 0;
+	_pBudget = NULL;
+}
+
+void grep_parallel::submit(LPCTSTR pszFileName)
+{
+	grep_lock lock(_mutex);
+	entry* pEntry = _entry(_nSubmitted);
+
+	while(pEntry->nState != entry_free)
+		_changed.wait(_mutex);
+	lstrcpyn(pEntry->szName, pszFileName, sizeof(pEntry->szName)/sizeof(TCHAR));
+	pEntry->nState = entry_queued;
+	_nSubmitted++;
+	_changed.broadcast();
+}
+
+void grep_parallel::wait()
+{
+	grep_lock lock(_mutex);
+
+	while(_nOldest != _nSubmitted)
+		_changed.wait(_mutex);
+}
+
+//----------------------------------------------------------------
+// Workers
+//----------------------------------------------------------------
+void grep_parallel::_workerProc(void* pWorker)
+{
+	((worker*)pWorker)->pPool->_work((worker*)pWorker);
+}
+
+void grep_parallel::_work(worker* pWorker)
+{
+	entry* pEntry;
+
+	_mutex.lock();
+	for(;;)
+	{
+		while(!_bStop && _nTaken == _nSubmitted)
+			_changed.wait(_mutex);
+		if(_bStop)
+			break;
+		pWorker->nSeq = _nTaken++;
+		pEntry = _entry(pWorker->nSeq);
+		pEntry->nState = entry_running;
+		_mutex.unlock();
+
+		_pfnSearch(pEntry->szName, pWorker->ctx);
+		pWorker->out.flush();
+
+		_mutex.lock();
+		_finish(pWorker->nSeq);
+	}
+	_mutex.unlock();
+}
+
+// grep_output sink of the workers
+void grep_parallel::_sink(void* pWorker, const char* pData, long nLen)
+{
+	((worker*)pWorker)->pPool->_write(((worker*)pWorker)->nSeq, pData, nLen);
+}
+
+//----------------------------------------------------------------
+// Output of file nSeq: straight out when it is the file's turn,
+// kept otherwise. When the budget or the memory can't take more,
+// waits for the turn; the file whose turn it is never waits, so
+// the output keeps going.
+//----------------------------------------------------------------
+void grep_parallel::_write(ulong nSeq, const char* pData, long nLen)
+{
+	grep_lock lock(_mutex);
+	entry* pEntry = _entry(nSeq);
+	long nCap;
+	char* pGrown;
+
+	for(;;)
+	{
+		if(_canWrite(nSeq))
+		{
+			if(!_bOrdered)
+			{
+				_bOwned = true;
+				_nOwner = nSeq;
+			}
+			_flushEntry(pEntry);
+			_pOut->write(pData, nLen);
+			return;
+		}
+
+		if(pEntry->nPending + nLen > pEntry->nCap)
+		{
+			nCap = 2 * pEntry->nCap;
+			if(nCap < pEntry->nPending + nLen)
+				nCap = pEntry->nPending + nLen;
+			if(nCap < PENDING_MIN_SIZE)
+				nCap = PENDING_MIN_SIZE;
+			if(_pBudget && !_pBudget->tryReserve(nCap - pEntry->nCap))
+			{
+				_changed.wait(_mutex);
+				continue;
+			}
+			pGrown = (char*)realloc(pEntry->pPending, nCap);
+			if(pGrown == NULL)
+			{
+				if(_pBudget)
+					_pBudget->release(nCap - pEntry->nCap);
+				_changed.wait(_mutex);
+				continue;
+			}
+			pEntry->pPending = pGrown;
+			pEntry->nCap = nCap;
+		}
+		memcpy(pEntry->pPending + pEntry->nPending, pData, nLen);
+		pEntry->nPending += nLen;
+		return;
+	}
+}
+
+//----------------------------------------------------------------
+// File nSeq is searched; writes out whatever output can go now.
+// Called with the lock held.
+//----------------------------------------------------------------
+void grep_parallel::_finish(ulong nSeq)
+{
+	ulong n;
+
+	_entry(nSeq)->nState = entry_done;
+
+	if(_bOrdered)
+	{
+		while(_nNext != _nTaken && _entry(_nNext)->nState == entry_done)
+		{
+			_flushEntry(_entry(_nNext));
+			_entry(_nNext)->nState = entry_free;
+			_nNext++;
+		}
+		// the file now in turn writes straight out from here on;
+		// what it kept so far goes first
+		if(_nNext != _nTaken)
+			_flushEntry(_entry(_nNext));
+	}
+	else
+	{
+		if(_bOwned && _nOwner == nSeq)
+			_bOwned = false;
+		if(!_bOwned)
+		{
+			for(n = _nOldest; n != _nTaken; n++)
+			{
+				if(_entry(n)->nState == entry_done)
+				{
+					_flushEntry(_entry(n));
+					_entry(n)->nState = entry_free;
+				}
+			}
+		}
+	}
+
+	while(_nOldest != _nSubmitted && _entry(_nOldest)->nState == entry_free)
+		_nOldest++;
+	_changed.broadcast();
+}
+
+void grep_parallel::_flushEntry(entry* pEntry)
+{
+	if(pEntry->nPending)
+		_pOut->write(pEntry->pPending, pEntry->nPending);
+	free(pEntry->pPending);
+	if(_pBudget && pEntry->nCap)
+		_pBudget->release(pEntry->nCap);
+	pEntry->pPending = NULL;
+	pEntry->nPending = 0;
+	pEntry->nCap = 0;
+}
+
+bool grep_parallel::_canWrite(ulong nSeq)
+{
+	if(_bOrdered)
+		return (nSeq == _nNext);
+	return (!_bOwned || _nOwner == nSeq);
+}
@@ -0,0 +1,120 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_parallel.h - searches files on several threads (--threads)
+// and puts their output back in order.
+//
+// Each file gets a sequence number as it is submitted. Between the
+// workers and the real output sits a reorder stage: the file that
+// is next in order writes straight through, the files after it
+// keep their output until it is their turn. Only a window of files
+// past the oldest unwritten one is handed out, so the output that
+// waits is a few files' worth, and within a memory budget a worker
+// that can't keep more waits for its turn. With --unordered the
+// order of the files is given up: a file writes straight through
+// unless another one is, and a finished file's output goes out as
+// soon as no file is writing. A file's lines are never interleaved
+// with another's.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_parallel_inc_
+#define _grep_parallel_inc_
+
+#include "grep.h"
+#include "grep_thread.h"
+#include "grep_input.h"
+#include "grep_reader.h"
+#include "grep_output.h"
+#include "grep_scratch.h"
+#include "grep_budget.h"
+
+// What the search of a file works with; the main thread has one,
+// and each worker its own
+struct grep_file_context
+{
+	grep_input		input;
+	grep_reader		reader;
+	grep_scratch	scratch;	// for the matchers
+	grep_output*	pOut;
+};
+
+// Searches a file the pool took from the queue
+typedef void (*PSEARCHFILEPROC)(LPCTSTR pszFileName, grep_file_context& ctx);
+
+class grep_parallel
+{
+public:
+	grep_parallel();
+	~grep_parallel();
+
+	// Up to nThreads workers, fewer if the budget can't take a reader
+	// for reads of nReadSize and an output buffer for each; false if
+	// that leaves fewer than two. The output goes to pOut.
+	bool start( int nThreads, bool bOrdered, PSEARCHFILEPROC pfnSearch,
+				grep_output* pOut, long nReadSize, grep_memory_budget* pBudget );
+	void stop();
+	bool isStarted()	{ return _threads != NULL; }
+
+	// queues a file; waits while the window is full
+	void submit(LPCTSTR pszFileName);
+	// waits until every file submitted is searched and its output written
+	void wait();
+
+private:
+	enum entry_state
+	{
+		entry_free,
+		entry_queued,
+		entry_running,
+		entry_done			// searched, output not all written yet
+	};
+
+	// A file in the window; entry seq % _nWindow
+	struct entry
+	{
+		TCHAR		szName[MAX_PATH*2];
+		entry_state	nState;
+		char*		pPending;	// output kept until the file's turn
+		long		nPending;
+		long		nCap;		// reserved in the budget
+	};
+
+	struct worker
+	{
+		grep_parallel*		pPool;
+		grep_file_context	ctx;
+		grep_output			out;	// goes to _sink
+		ulong				nSeq;	// the file being searched
+	};
+
+	entry*			_entries;
+	long			_nWindow;
+	worker*			_workers;
+	grep_thread*	_threads;
+	int				_nThreads;
+	bool			_bOrdered;
+	PSEARCHFILEPROC	_pfnSearch;
+	grep_output*	_pOut;
+	grep_memory_budget* _pBudget;
+	long			_nWorkerSize;	// reserved in the budget per worker
+
+	grep_mutex		_mutex;
+	grep_condition	_changed;		// any state change; everyone rechecks
+	ulong			_nSubmitted;	// sequence numbers
+	ulong			_nTaken;
+	ulong			_nNext;			// ordered: the file writing straight out
+	ulong			_nOldest;		// the oldest entry not free
+	ulong			_nOwner;		// unordered: the file writing straight out
+	bool			_bOwned;
+	bool			_bStop;
+
+private:
+	static void _workerProc(void* pWorker);
+	void _work(worker* pWorker);
+	static void _sink(void* pWorker, const char* pData, long nLen);
+	void _write(ulong nSeq, const char* pData, long nLen);
+	void _finish(ulong nSeq);
+	void _flushEntry(entry* pEntry);
+	bool _canWrite(ulong nSeq);
+	entry* _entry(ulong nSeq)	{ return &_entries[nSeq % _nWindow]; }
+};
+
+#endif	// _grep_parallel_inc_
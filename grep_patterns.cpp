@@ -0,0 +1,225 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_patterns.cpp - implementation of grep_pattern_list
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_patterns.h"
+#include "grep_input.h"
+
+grep_pattern_list::grep_pattern_list()
+{
+	_items	= NULL;
+	_nItems	= 0;
+	_nCap	= 0;
+	_uGrows	= 0;
+	_maps	= NULL;
+	_nMaps	= 0;
+}
+
+grep_pattern_list::~grep_pattern_list()
+{
+	_unmapAll();
+	free(_items);
+	free(_maps);
+}
+
+void grep_pattern_list::clear()
+{
+	_unmapAll();
+	_text.reset();
+	_nItems = 0;
+}
+
+void grep_pattern_list::append(LPCSTR pszPattern)
+{
+	append(pszPattern, lstrlen(pszPattern));
+}
+
+void grep_pattern_list::append(LPCSTR pPattern, long nLen)
+{
+	_appendItem(_text.copy(pPattern, nLen), nLen);
+}
+
+void grep_pattern_list::removeAt(int nIndex)
+{
+	// the text stays in the arena until clear()
+	memmove(_items + nIndex, _items + nIndex + 1, (_nItems - nIndex - 1) * sizeof(item));
+	_nItems--;
+}
+
+//----------------------------------------------------------------
+// Maps the file (privately, so it can be written) and turns the
+// line ends into NULs; the patterns are the lines where they lie.
+// Only a last line without a line end is copied, since there may
+// be no room after it for the NUL. What can't be mapped, or maps
+// as empty (a pipe, or a /proc file whose size is 0), is read.
+//----------------------------------------------------------------
+bool grep_pattern_list::loadFile(LPCTSTR pszFileName)
+{
+	char* pData;
+	long  nLen;
+
+	if(!grep_input::mapFile(pszFileName, true, &pData, &nLen) || pData == NULL)
+		return _readFile(pszFileName);
+
+	if(_nMaps % 16 == 0)
+	{
+		_maps = (mapping*)realloc(_maps, (_nMaps + 16) * sizeof(mapping));
+		if(_maps == NULL)
+			grep_outOfMemory();
+		_uGrows++;
+	}
+	_maps[_nMaps].pData = pData;
+	_maps[_nMaps].nLen  = nLen;
+	_nMaps++;
+
+	_splitLines(pData, nLen);
+	return true;
+}
+
+// Reads the file to its end into the text arena, and splits it there
+bool grep_pattern_list::_readFile(LPCTSTR pszFileName)
+{
+	grep_input input;
+	char* pBuf = NULL;
+	char* pGrown;
+	long  nLen = 0, nCap = 0, n;
+
+	if(!input.open(pszFileName, false, PATTERN_READ_SIZE))
+		return false;
+	for(;;)
+	{
+		if(nCap - nLen < PATTERN_READ_SIZE)
+		{
+			nCap = (nCap ? 2 * nCap : PATTERN_READ_SIZE);
+			pGrown = (char*)realloc(pBuf, nCap);
+			if(pGrown == NULL)
+			{
+				n = -1;
+				break;
+			}
+			pBuf = pGrown;
+		}
+		if((n = input.read(pBuf + nLen, PATTERN_READ_SIZE)) <= 0)
+			break;
+		nLen += n;
+	}
+	input.close();
+	if(n != 0)
+	{
+		free(pBuf);
+		return false;		// a read error, or out of memory
+	}
+	if(nLen)
+		_splitLines(_text.copy(pBuf, nLen), nLen);
+	free(pBuf);
+	return true;
+}
+
+void grep_pattern_list::_splitLines(char* pData, long nLen)
+{
+	char* pLine;
+	char* pEnd = pData + nLen;
+	char* pc;
+	long  nLineLen;
+
+	for(pLine = pData; pLine < pEnd; pLine = pc + 1)
+	{
+		pc = (char*)memchr(pLine, '\n', pEnd - pLine);
+		nLineLen = (long)((pc ? pc : pEnd) - pLine);
+		if(nLineLen && pLine[nLineLen-1] == '\r')
+			nLineLen--;
+		if(pc == NULL)
+		{
+			append(pLine, nLineLen);
+			break;
+		}
+		pLine[nLineLen] = '\0';
+		_appendItem(pLine, nLineLen);
+	}
+}
+
+void grep_pattern_list::removeIf(PPATTERNFILTER pfnDrop, void* pUser)
+{
+	int i, nKept = 0;
+
+	for(i=0; i<_nItems; i++)
+	{
+		if(!pfnDrop(_items[i].psz, _items[i].nLen, pUser))
+			_items[nKept++] = _items[i];
+	}
+	_nItems = nKept;
+}
+
+//----------------------------------------------------------------
+// One pass with an open-addressing hash table of item indexes
+//----------------------------------------------------------------
+void grep_pattern_list::removeDuplicates()
+{
+	int*  pTable;
+	ulong uHash, uMask, uSize;
+	long  j;
+	int   i, k, nKept = 0;
+
+	if(_nItems < 2)
+		return;
+	for(uSize = 64; uSize < 2 * (ulong)_nItems; uSize *= 2)
+		;
+	uMask = uSize - 1;
+	pTable = (int*)malloc(uSize * sizeof(int));
+	if(pTable == NULL)
+		return;		// the duplicates are only searched for again
+	memset(pTable, 0xff, uSize * sizeof(int));	// all -1
+
+	for(i=0; i<_nItems; i++)
+	{
+		// FNV-1a
+		uHash = 2166136261UL;
+		for(j=0; j<_items[i].nLen; j++)
+			uHash = (uHash ^ (unsigned char)_items[i].psz[j]) * 16777619UL;
+
+		for(uHash &= uMask; (k = pTable[uHash]) != -1; uHash = (uHash + 1) & uMask)
+		{
+			if( _items[k].nLen == _items[i].nLen &&
+				!memcmp(_items[k].psz, _items[i].psz, _items[i].nLen) )
+				break;
+		}
+		if(k == -1)
+		{
+			_items[nKept] = _items[i];
+			pTable[uHash] = nKept++;
+		}
+	}
+	_nItems = nKept;
+	free(pTable);
+}
+
+void grep_pattern_list::addStats(grep_alloc_stats* pStats) const
+{
+	_text.addStats(pStats);
+	pStats->uAllocs		+= _uGrows;
+	pStats->uHeapBlocks	+= _uGrows;
+}
+
+void grep_pattern_list::_appendItem(LPCSTR psz, long nLen)
+{
+	if(_nItems == _nCap)
+	{
+		_nCap = (_nCap ? 2 * _nCap : 64);
+		_items = (item*)realloc(_items, _nCap * sizeof(item));
+		if(_items == NULL)
+			grep_outOfMemory();
+		_uGrows++;
+	}
+	_items[_nItems].psz  = psz;
+	_items[_nItems].nLen = nLen;
+	_nItems++;
+}
+
+void grep_pattern_list::_unmapAll()
+{
+	while(_nMaps)
+	{
+		_nMaps--;
+		grep_input::unmapFile(_maps[_nMaps].pData, _maps[_nMaps].nLen);
+	}
+}
@@ -0,0 +1,76 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_patterns.h - list of search patterns.
+// The pattern texts live in an arena and the list keeps pointers
+// and lengths, so a list of 100,000 patterns costs a handful of
+// heap blocks instead of 100,000 allocations, and clear() keeps
+// the memory for the next list. Pattern files are mapped and split
+// in place; their patterns point straight into the mapping.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_patterns_inc_
+#define _grep_patterns_inc_
+
+#include "grep.h"
+#include "grep_arena.h"
+
+// Reads of a pattern file that can't be mapped
+const long PATTERN_READ_SIZE = 64 * 1024;
+
+// Pattern filter for removeIf(); true drops the pattern
+typedef bool (*PPATTERNFILTER)(LPCSTR pPattern, long nLen, void* pUser);
+
+class grep_pattern_list
+{
+public:
+	grep_pattern_list();
+	~grep_pattern_list();
+
+	void clear();
+	// Adds a copy of the pattern
+	void append(LPCSTR pszPattern);
+	void append(LPCSTR pPattern, long nLen);
+	void removeAt(int nIndex);
+	// Adds each line of the file (LF or CR/LF ended) as a pattern.
+	// Returns false if the file can't be read.
+	bool loadFile(LPCTSTR pszFileName);
+	// Drops the patterns the filter picks, keeping the order
+	void removeIf(PPATTERNFILTER pfnDrop, void* pUser);
+	// Drops repeated patterns, keeping the first of each
+	void removeDuplicates();
+
+	int    length() const					{ return _nItems; }
+	LPCSTR get(int nIndex) const			{ return _items[nIndex].psz; }
+	long   lengthOf(int nIndex) const		{ return _items[nIndex].nLen; }
+	LPCSTR operator[](int nIndex) const		{ return _items[nIndex].psz; }
+
+	void addStats(grep_alloc_stats* pStats) const;
+
+private:
+	struct item
+	{
+		LPCSTR	psz;		// NUL-terminated
+		long	nLen;
+	};
+
+	struct mapping
+	{
+		char*	pData;
+		long	nLen;
+	};
+
+	grep_arena	_text;
+	item*		_items;
+	int			_nItems;
+	int			_nCap;
+	ulong		_uGrows;	// times _items or _maps was reallocated
+	mapping*	_maps;		// pattern files the items point into
+	int			_nMaps;
+
+private:
+	void _appendItem(LPCSTR psz, long nLen);
+	bool _readFile(LPCTSTR pszFileName);
+	void _splitLines(char* pData, long nLen);
+	void _unmapAll();
+};
+
+#endif	// _grep_patterns_inc_
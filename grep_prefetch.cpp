@@ -0,0 +1,378 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_prefetch.cpp - implementation of grep_prefetcher
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_prefetch.h"
+#include "grep_input.h"
+
+#ifdef GREP_HAVE_LIBURING
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+// Most threads used by the thread pool; the calls are blocking
+// file system calls, so there are more threads than processors
+static const int MAX_PREFETCH_THREADS = 16;
+
+grep_prefetcher::grep_prefetcher()
+{
+	_slots			= NULL;
+	_nSlots			= 0;
+	_nBufferSize	= 0;
+	_pBudget		= NULL;
+	_nSubmitted		= 0;
+	_nConsumed		= 0;
+	_threads		= NULL;
+	_nThreads		= 0;
+	_nTaken			= 0;
+	_bStop			= false;
+#ifdef GREP_HAVE_LIBURING
+	_bRing			= false;
+	_nUnsubmitted	= 0;
+#endif
+}
+
+grep_prefetcher::~grep_prefetcher()
+{
+	stop();
+}
+
+bool grep_prefetcher::start(long nInFlight, long nBufferSize, bool bCpuBound, grep_memory_budget* pBudget)
+{
+	int nMaxThreads = MAX_PREFETCH_THREADS;
+	long i;
+
+	stop();
+	// fewer files in flight when the budget runs out
+	for(i=0; i<nInFlight && pBudget && pBudget->tryReserve(nBufferSize); i++)
+		;
+	if(pBudget)
+		nInFlight = i;
+	if(nInFlight <= 0)
+		return false;
+
+	_nSlots		 = nInFlight;
+	_nBufferSize = nBufferSize;
+	_pBudget	 = pBudget;
+	_nSubmitted	 = _nConsumed = _nTaken = 0;
+	_bStop		 = false;
+	_slots		 = new slot[_nSlots];
+	for(i=0; i<_nSlots; i++)
+	{
+		_slots[i].pData		= grep_input::allocBuffer(_nBufferSize);
+		_slots[i].nLen		= 0;
+		_slots[i].nStatus	= pf_pending;
+		_slots[i].pfnLoad	= NULL;
+	}
+	// stop() frees the buffers that were allocated and gives the
+	// budget back
+	for(i=0; i<_nSlots; i++)
+	{
+		if(_slots[i].pData == NULL)
+		{
+			stop();
+			return false;
+		}
+	}
+
+	// work that needs a processor gets a thread per processor
+	if(bCpuBound)
+	{
+		nMaxThreads = grep_thread::cpuCount();
+		if(nMaxThreads > MAX_PREFETCH_THREADS)
+			nMaxThreads = MAX_PREFETCH_THREADS;
+	}
+
+#ifdef GREP_HAVE_LIBURING
+	// four entries (statx, open, read, close) per file; the files
+	// are opened into the ring's own descriptor table, one per slot
+	if(!bCpuBound && io_uring_queue_init(4 * _nSlots, &_ring, 0) == 0)
+	{
+		if(io_uring_register_files_sparse(&_ring, _nSlots) == 0)
+			_bRing = true;
+		else
+			io_uring_queue_exit(&_ring);
+	}
+	if(_bRing)
+		return true;
+#endif
+
+	// no io_uring: blocking calls on a pool of threads
+	_nThreads = (nInFlight < nMaxThreads ? (int)nInFlight : nMaxThreads);
+	if(_nThreads < 1)
+		_nThreads = 1;
+	_threads = new grep_thread[(size_t)_nThreads];
+	for(i=0; i<_nThreads; i++)
+	{
+		if(!_threads[i].start(_workerProc, this))
+		{
+			_nThreads = i;
+			break;
+		}
+	}
+	if(_nThreads == 0)
+	{
+		stop();
+		return false;
+	}
+	return true;
+}
+
+void grep_prefetcher::stop()
+{
+	long i;
+
+	if(_slots == NULL)
+		return;
+
+	if(_threads)
+	{
+		_mutex.lock();
+		_bStop = true;
+		_workReady.broadcast();
+		_mutex.unlock();
+		delete[] _threads;	// joins the threads
+		_threads = NULL;
+		_nThreads = 0;
+	}
+#ifdef GREP_HAVE_LIBURING
+	if(_bRing)
+	{
+		// let the chains in flight finish before the buffers go
+		while(!isEmpty())
+			release(next());
+		io_uring_queue_exit(&_ring);
+		_bRing = false;
+	}
+#endif
+
+	for(i=0; i<_nSlots; i++)
+	{
+		grep_input::freeBuffer(_slots[i].pData, _nBufferSize);
+		if(_pBudget)
+			_pBudget->release(_nBufferSize);
+	}
+	_pBudget = NULL;
+	delete[] _slots;
+	_slots = NULL;
+	_nSlots = 0;
+}
+
+void grep_prefetcher::submit(LPCTSTR pszFileName, PPREFETCHPROC pfnLoad, void* pLoadContext)
+{
+	long nSlot = (long)(_nSubmitted % _nSlots);
+	slot* pSlot = &_slots[nSlot];
+
+	lstrcpyn(pSlot->szName, pszFileName, sizeof(pSlot->szName)/sizeof(TCHAR));
+	pSlot->nLen = 0;
+	pSlot->pfnLoad = pfnLoad;
+	pSlot->pLoadContext = pLoadContext;
+
+#ifdef GREP_HAVE_LIBURING
+	if(_bRing)
+	{
+		pSlot->nStatus = pf_pending;
+		_nSubmitted++;
+		_ringSubmit(nSlot);
+		return;
+	}
+#endif
+
+	_mutex.lock();
+	pSlot->nStatus = pf_pending;
+	_nSubmitted++;
+	_workReady.signal();
+	_mutex.unlock();
+}
+
+grep_prefetched* grep_prefetcher::next()
+{
+	slot* pSlot = &_slots[_nConsumed % _nSlots];
+
+#ifdef GREP_HAVE_LIBURING
+	if(_bRing)
+	{
+		while(pSlot->nStatus == pf_pending)
+			_ringReap();
+		return pSlot;
+	}
+#endif
+
+	_mutex.lock();
+	while(pSlot->nStatus == pf_pending)
+		_workDone.wait(_mutex);
+	_mutex.unlock();
+	return pSlot;
+}
+
+void grep_prefetcher::release(grep_prefetched* /* pItem */)
+{
+	// slots are used in order, so the oldest one is free now
+	_nConsumed++;
+}
+
+//----------------------------------------------------------------
+// Thread pool
+//----------------------------------------------------------------
+void grep_prefetcher::_workerProc(void* pThis)
+{
+	((grep_prefetcher*)pThis)->_work();
+}
+
+void grep_prefetcher::_work()
+{
+	slot* pSlot;
+
+	_mutex.lock();
+	for(;;)
+	{
+		while(!_bStop && _nTaken == _nSubmitted)
+			_workReady.wait(_mutex);
+		if(_bStop)
+			break;
+		pSlot = &_slots[_nTaken++ % _nSlots];
+		_mutex.unlock();
+
+		_readFile(pSlot);
+
+		_mutex.lock();
+		_workDone.broadcast();
+	}
+	_mutex.unlock();
+}
+
+//----------------------------------------------------------------
+// Reads the whole file into the slot's buffer, or finds out that
+// it does not fit. Sets nStatus last, under the lock.
+//----------------------------------------------------------------
+void grep_prefetcher::_readFile(slot* pSlot)
+{
+	grep_input input;
+	grep_prefetch_status nStatus;
+	long nLen, n;
+	char c;
+
+	nLen = n = 0;
+	if(pSlot->pfnLoad)
+		nStatus = pSlot->pfnLoad(pSlot->pLoadContext, pSlot->pData, _nBufferSize, &nLen);
+	else if(!input.open(pSlot->szName, false, _nBufferSize))
+		nStatus = pf_open_failed;
+	else
+	{
+		while( nLen < _nBufferSize &&
+			   (n = input.read(pSlot->pData + nLen, _nBufferSize - nLen)) > 0 )
+			nLen += n;
+		if(n < 0)
+			nStatus = pf_read_failed;
+		else if(nLen == _nBufferSize && input.read(&c, 1) != 0)
+			nStatus = pf_too_big;
+		else
+			nStatus = pf_ok;
+	}
+
+	_mutex.lock();
+	pSlot->nLen = nLen;
+	pSlot->nStatus = nStatus;
+	_mutex.unlock();
+}
+
+#ifdef GREP_HAVE_LIBURING
+//----------------------------------------------------------------
+// io_uring: one linked statx/open/read/close chain per file. The
+// user_data of each entry is (slot << 2) | step.
+//----------------------------------------------------------------
+void grep_prefetcher::_ringSubmit(long nSlot)
+{
+	slot* pSlot = &_slots[nSlot];
+	struct io_uring_sqe* sqe;
+
+	pSlot->nStatRes = pSlot->nOpenRes = pSlot->nReadRes = 0;
+
+	// there is always room for a chain: the ring has 4 entries a slot.
+	// The size tells a whole file from a short read; a failed statx
+	// must not cancel the open, which reports the error
+	sqe = io_uring_get_sqe(&_ring);
+	io_uring_prep_statx(sqe, AT_FDCWD, pSlot->szName, 0, STATX_TYPE | STATX_SIZE, &pSlot->stx);
+	sqe->flags |= IOSQE_IO_HARDLINK;
+	io_uring_sqe_set_data64(sqe, ((__u64)nSlot << 2) | 0);
+
+	sqe = io_uring_get_sqe(&_ring);
+	io_uring_prep_openat_direct(sqe, AT_FDCWD, pSlot->szName, O_RDONLY, 0, nSlot);
+	sqe->flags |= IOSQE_IO_LINK;
+	io_uring_sqe_set_data64(sqe, ((__u64)nSlot << 2) | 1);
+
+	sqe = io_uring_get_sqe(&_ring);
+	io_uring_prep_read(sqe, nSlot, pSlot->pData, _nBufferSize, 0);
+	// hard link: a short read must not cancel the close
+	sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+	io_uring_sqe_set_data64(sqe, ((__u64)nSlot << 2) | 2);
+
+	sqe = io_uring_get_sqe(&_ring);
+	io_uring_prep_close_direct(sqe, nSlot);
+	io_uring_sqe_set_data64(sqe, ((__u64)nSlot << 2) | 3);
+
+	// batch the submissions; next() flushes them before waiting
+	if(++_nUnsubmitted >= _nSlots / 4)
+	{
+		io_uring_submit(&_ring);
+		_nUnsubmitted = 0;
+	}
+}
+
+// Waits for at least one completion and handles all that are ready
+void grep_prefetcher::_ringReap()
+{
+	struct io_uring_cqe* cqe;
+	unsigned head, nSeen;
+	slot* pSlot;
+
+	if(_nUnsubmitted)
+	{
+		io_uring_submit(&_ring);
+		_nUnsubmitted = 0;
+	}
+	if(io_uring_wait_cqe(&_ring, &cqe) != 0)
+		return;
+
+	nSeen = 0;
+	io_uring_for_each_cqe(&_ring, head, cqe)
+	{
+		pSlot = &_slots[io_uring_cqe_get_data64(cqe) >> 2];
+		switch(io_uring_cqe_get_data64(cqe) & 3)
+		{
+		case 0:
+			pSlot->nStatRes = cqe->res;
+			break;
+		case 1:
+			pSlot->nOpenRes = cqe->res;
+			break;
+		case 2:
+			pSlot->nReadRes = cqe->res;
+			break;
+		case 3:
+			// the close is last in the chain, even if it was cancelled
+			if(pSlot->nOpenRes < 0)
+				pSlot->nStatus = pf_open_failed;
+			else if(pSlot->nReadRes < 0)
+				pSlot->nStatus = pf_read_failed;
+			else if(pSlot->nReadRes == _nBufferSize)
+				pSlot->nStatus = pf_too_big;	// may be exactly full; reread
+			else if( pSlot->nStatRes < 0 || !S_ISREG(pSlot->stx.stx_mode) ||
+					 pSlot->stx.stx_size != (__u64)pSlot->nReadRes )
+			{
+				// one read is not the whole of a pipe, a /proc file or
+				// a file that was cut short; read it to the end here
+				_readFile(pSlot);
+			}
+			else
+			{
+				pSlot->nLen = pSlot->nReadRes;
+				pSlot->nStatus = pf_ok;
+			}
+			break;
+		}
+		nSeen++;
+	}
+	io_uring_cq_advance(&_ring, nSeen);
+}
+#endif
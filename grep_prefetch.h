@@ -0,0 +1,114 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_prefetch.h - reads many (small) files ahead of the search.
+//
+// Files are submitted in the order they are found and come back in
+// the same order, read into buffers from a fixed pool of slots, while
+// up to a slot count of opens and reads are in flight. On Linux built
+// with liburing each file is one linked statx/open/read/close chain in
+// an io_uring; otherwise a pool of threads does the blocking calls.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_prefetch_inc_
+#define _grep_prefetch_inc_
+
+#include "grep.h"
+#include "grep_thread.h"
+#include "grep_budget.h"
+
+#ifdef GREP_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+// Status of a prefetched file
+enum grep_prefetch_status
+{
+	pf_pending,			// still being read
+	pf_ok,				// the whole file is in the buffer
+	pf_too_big,			// did not fit; read it the usual way
+	pf_open_failed,
+	pf_read_failed
+};
+
+// Fills pBuf with up to nBufSize bytes of something other than a
+// file (an archive member); called on the prefetcher's threads
+typedef grep_prefetch_status (*PPREFETCHPROC)(void* pContext, char* pBuf, long nBufSize, long* pnLen);
+
+// A file read ahead of the search
+struct grep_prefetched
+{
+	TCHAR	szName[MAX_PATH*2];
+	char*	pData;
+	long	nLen;
+	grep_prefetch_status nStatus;
+};
+
+class grep_prefetcher
+{
+public:
+	grep_prefetcher();
+	~grep_prefetcher();
+
+	// nInFlight files of up to nBufferSize bytes are read ahead;
+	// bCpuBound when the loaders compute rather than wait on I/O.
+	// With a budget, only as many buffers as it has room for; false
+	// if there is not room for one.
+	bool start( long nInFlight, long nBufferSize, bool bCpuBound = false,
+				grep_memory_budget* pBudget = NULL );
+	void stop();
+	bool isStarted()	{ return _slots != NULL; }
+	long slotCount()	{ return _nSlots; }
+	bool isFull()		{ return _nSubmitted - _nConsumed == (ulong)_nSlots; }
+	bool isEmpty()		{ return _nSubmitted == _nConsumed; }
+
+	// queue a file, or with pfnLoad what it loads into the buffer;
+	// the caller must not submit when isFull()
+	void submit(LPCTSTR pszFileName, PPREFETCHPROC pfnLoad = NULL, void* pLoadContext = NULL);
+	// waits for the oldest submitted file; never call when isEmpty()
+	grep_prefetched* next();
+	// hands the oldest file's buffer back to the pool
+	void release(grep_prefetched* pItem);
+
+private:
+	struct slot : grep_prefetched
+	{
+		int		nStatRes;		// io_uring results of the chain
+		int		nOpenRes;
+		int		nReadRes;
+#ifdef GREP_HAVE_LIBURING
+		struct statx stx;		// the file's size, from the chain
+#endif
+		PPREFETCHPROC pfnLoad;	// NULL to read the file
+		void*	pLoadContext;
+	};
+
+	slot*			_slots;
+	long			_nSlots;
+	long			_nBufferSize;
+	grep_memory_budget* _pBudget;	// the slot buffers are reserved in it
+	ulong			_nSubmitted;	// sequence numbers; slot = seq % _nSlots
+	ulong			_nConsumed;
+
+	// thread pool
+	grep_mutex		_mutex;
+	grep_condition	_workReady;
+	grep_condition	_workDone;
+	grep_thread*	_threads;
+	int				_nThreads;
+	ulong			_nTaken;		// next sequence number for a worker
+	bool			_bStop;
+
+#ifdef GREP_HAVE_LIBURING
+	struct io_uring	_ring;
+	bool			_bRing;
+	long			_nUnsubmitted;
+	void _ringSubmit(long nSlot);
+	void _ringReap();
+#endif
+
+private:
+	static void _workerProc(void* pThis);
+	void _work();
+	void _readFile(slot* pSlot);
+};
+
+#endif	// _grep_prefetch_inc_
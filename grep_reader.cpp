@@ -0,0 +1,425 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_reader.cpp - implementation of grep_reader
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_reader.h"
+#include "grep_utf8.h"
+
+// Smallest size of the line buffer
+static const long READER_INITIAL_SIZE	= 128 * 1024;
+// Lines longer than this are split (unless reads are even bigger)
+static const long READER_MAX_LINE		= 1024 * 1024;
+// Number of leading bytes looked at by the UTF-16 heuristic
+static const long READER_SNIFF_SIZE		= 1024;
+
+grep_reader::grep_reader()
+{
+	_pInput		= NULL;
+	_nReadSize	= 0;
+	_encoding	= enc_bytes;
+	_bDetected	= false;
+	_bEof		= true;
+	_bAscii		= true;
+	_buf		= NULL;
+	_cap		= 0;
+	_pos		= 0;
+	_scan		= 0;
+	_end		= 0;
+	_raw		= NULL;
+	_rawSize	= 0;
+	_rawLen		= 0;
+	_pBudget	= NULL;
+	_nGrown		= 0;
+}
+
+grep_reader::~grep_reader()
+{
+	grep_input::freeBuffer(_buf, _cap);
+	grep_input::freeBuffer((char*)_raw, _rawSize);
+}
+
+void grep_reader::attach(grep_input* pInput, long nReadSize, ulonglong uStart, ulonglong uEnd)
+{
+	long nSize = (2 * nReadSize > READER_INITIAL_SIZE ? 2 * nReadSize : READER_INITIAL_SIZE);
+	char* pc;
+
+	_pInput		= pInput;
+	_nReadSize	= nReadSize;
+	_encoding	= enc_bytes;
+	_bDetected	= false;
+	_bEof		= false;
+	_bAscii		= true;
+	_pos		= 0;
+	_scan		= 0;
+	_end		= 0;
+	_base		= 0;
+	_limit		= uEnd;
+	_rawLen		= 0;
+
+	if(_cap < nSize || (_pBudget && _cap > nSize))
+	{
+		if(_pBudget)
+			_pBudget->release(_nGrown);
+		_nGrown = 0;
+		_grow(nSize);
+	}
+	if(_rawSize != nReadSize)
+	{
+		grep_input::freeBuffer((char*)_raw, _rawSize);
+		_raw = NULL;
+		_rawSize = nReadSize;
+	}
+
+	// A window starts at the first line that starts in it: from the
+	// byte before it, skip to the first line break
+	if(uStart > 0)
+	{
+		if(!_pInput->seek(uStart - 1))
+		{
+			_bEof = true;
+			return;
+		}
+		_base = uStart - 1;
+		for(;;)
+		{
+			pc = (char*)memchr(_buf + _pos, '\n', _end - _pos);
+			if(pc)
+			{
+				_pos = _scan = (long)(pc - _buf) + 1;
+				break;
+			}
+			_pos = _scan = _end;
+			if(_bEof || !_fill())
+				break;
+		}
+	}
+}
+
+long grep_reader::nextLine(LPSTR* ppLine)
+{
+	char* pc;
+	long  nLen;
+
+	if(_base + _pos >= _limit)
+		return -1;
+
+	for(;;)
+	{
+		if(_scan < _end)
+		{
+			pc = (char*)memchr(_buf + _scan, '\n', _end - _scan);
+			if(pc)
+			{
+				*ppLine = _buf + _pos;
+				nLen = (long)(pc - *ppLine);
+				_pos = _scan = (long)(pc - _buf) + 1;
+				break;
+			}
+			_scan = _end;
+		}
+
+		if(_bEof)
+		{
+			if(_pos == _end)
+				return -1;
+			// last line without a line break
+			*ppLine = _buf + _pos;
+			nLen = _end - _pos;
+			_pos = _scan = _end;
+			break;
+		}
+
+		if(!_fill())
+		{
+			// the line does not fit into the largest buffer; split it
+			*ppLine = _buf + _pos;
+			nLen = _end - _pos;
+			_pos = _scan = _end;
+			break;
+		}
+	}
+
+	if(nLen > 0 && (*ppLine)[nLen-1] == '\r')
+		nLen--;
+	(*ppLine)[nLen] = '\0';
+	return nLen;
+}
+
+long grep_reader::nextBlock(LPSTR* ppBlock, long nKeep)
+{
+	char* pc;
+	long  nLen;
+
+	if(_base + _pos >= _limit)
+		return -1;
+	_pos -= nKeep;
+
+	for(;;)
+	{
+		if(_scan < _end)
+		{
+			// up to the last line break buffered
+			for(pc = _buf + _end; pc > _buf + _scan && pc[-1] != '\n'; pc--)
+				;
+			if(pc > _buf + _scan)
+			{
+				*ppBlock = _buf + _pos;
+				nLen = (long)(pc - *ppBlock);
+				break;
+			}
+			_scan = _end;
+		}
+
+		if(_bEof || !_fill())
+		{
+			// the end of the file, or a line too long for the buffer
+			if(_end - _pos == nKeep)
+			{
+				_pos = _end;
+				return -1;
+			}
+			*ppBlock = _buf + _pos;
+			nLen = _end - _pos;
+			break;
+		}
+	}
+
+	// up to the line break of the last line that starts in the window
+	if(_limit - (_base + _pos) < (ulonglong)nLen)
+	{
+		pc = (char*)memchr( *ppBlock + (long)(_limit - (_base + _pos)) - 1, '\n',
+							nLen - (long)(_limit - (_base + _pos)) + 1 );
+		if(pc)
+			nLen = (long)(pc - *ppBlock) + 1;
+	}
+	_pos = _scan = (long)(*ppBlock - _buf) + nLen;
+	return nLen;
+}
+
+//----------------------------------------------------------------
+// Counts the line breaks 16 bytes at a time where SSE2 is there
+//----------------------------------------------------------------
+GREP_TARGET_CLONES
+long grep_reader::countNewlines(LPCSTR p, long nLen)
+{
+	long nCount = 0;
+	long i = 0;
+
+#ifdef GREP_USE_SSE2
+	const __m128i nl = _mm_set1_epi8('\n');
+	__m128i sum, acc;
+	long nBlock;
+
+	while(nLen - i >= 16)
+	{
+		// byte counters can take 255 rounds before they overflow
+		nBlock = (nLen - i) / 16;
+		if(nBlock > 255)
+			nBlock = 255;
+		acc = _mm_setzero_si128();
+		for(; nBlock > 0; nBlock--, i += 16)
+			acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i)), nl));
+		sum = _mm_sad_epu8(acc, _mm_setzero_si128());
+		nCount += _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+	}
+#endif
+	for(; i < nLen; i++)
+		nCount += (p[i] == '\n');
+	return nCount;
+}
+
+//----------------------------------------------------------------
+// Reads more input into the line buffer. Returns false only if
+// the buffer is full and cannot grow any more.
+//----------------------------------------------------------------
+bool grep_reader::_fill()
+{
+	long n;
+
+	// move the unread tail to the front
+	if(_pos > 0)
+	{
+		memmove(_buf, _buf + _pos, _end - _pos);
+		_base += _pos;
+		_end  -= _pos;
+		_scan -= _pos;
+		_pos   = 0;
+	}
+	if(_end == 0)
+		_bAscii = true;
+
+	// grow when a long line leaves too little room to read into;
+	// one byte is always kept for the terminating NUL, and at least
+	// 6 bytes are needed to decode two UTF-16 units, which is a whole
+	// surrogate pair or a lone surrogate's U+FFFD and the next unit
+	if( (_cap - _end - 1) < _cap / 4 )
+	{
+		if( (_cap >= READER_MAX_LINE && _cap >= 2 * _nReadSize) ||
+			(_pBudget && !_pBudget->tryReserve(_cap)) )
+		{
+			if(_cap - _end - 1 < 6)
+				return false;
+		}
+		else
+		{
+			if(_pBudget)
+				_nGrown += _cap;
+			_grow(_cap * 2);
+		}
+	}
+
+	// read at most one read size at a time
+	do
+		n = _readDecoded( _buf + _end, (_cap - _end - 1 < _nReadSize) ?
+										_cap - _end - 1 : _nReadSize );
+	while(n == 0);
+
+	if(n < 0)
+		_bEof = true;
+	else
+	{
+		if(_bAscii)
+			_bAscii = utf8_isAscii(_buf + _end, n);
+		_end += n;
+	}
+	return true;
+}
+
+long grep_reader::footprint(long nReadSize)
+{
+	// the line buffer, and the undecoded UTF-16 input
+	return (2 * nReadSize > READER_INITIAL_SIZE ? 2 * nReadSize : READER_INITIAL_SIZE) + nReadSize;
+}
+
+// Moves the buffered text into a new aligned buffer of nSize bytes
+void grep_reader::_grow(long nSize)
+{
+	char* pNew = grep_input::allocBuffer(nSize);
+
+	if(_buf)
+	{
+		memcpy(pNew, _buf, _end);
+		grep_input::freeBuffer(_buf, _cap);
+	}
+	_buf = pNew;
+	_cap = nSize;
+}
+
+//----------------------------------------------------------------
+// Looks at the first block (already in _raw) and sets _encoding.
+// Strips the BOM, if any.
+//----------------------------------------------------------------
+void grep_reader::_detect()
+{
+	const unsigned char* p = _raw;
+	long nSniff, nPairs, nZeroEven, nZeroOdd, i;
+
+	_bDetected = true;
+
+	if(_rawLen >= 3 && p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF)
+	{
+		_encoding = enc_utf8;
+		memmove(_raw, _raw + 3, _rawLen -= 3);
+		_base += 3;		// offsets count the BOM
+		return;
+	}
+	if(_rawLen >= 2 && p[0] == 0xFF && p[1] == 0xFE)
+	{
+		_encoding = enc_utf16le;
+		memmove(_raw, _raw + 2, _rawLen -= 2);
+		return;
+	}
+	if(_rawLen >= 2 && p[0] == 0xFE && p[1] == 0xFF)
+	{
+		_encoding = enc_utf16be;
+		memmove(_raw, _raw + 2, _rawLen -= 2);
+		return;
+	}
+
+	// No BOM. Text in UTF-16 that is mostly Latin has a zero in
+	// every other byte, which no sane 8-bit text file has.
+	nSniff = (_rawLen < READER_SNIFF_SIZE ? _rawLen : READER_SNIFF_SIZE);
+	nPairs = nSniff / 2;
+	nZeroEven = nZeroOdd = 0;
+	for(i=0; i+1<nSniff; i+=2)
+	{
+		if(p[i] == 0)	nZeroEven++;
+		if(p[i+1] == 0)	nZeroOdd++;
+	}
+	if(nPairs >= 2)
+	{
+		if(nZeroOdd * 10 >= nPairs * 7 && nZeroEven * 10 <= nPairs)
+			_encoding = enc_utf16le;
+		else if(nZeroEven * 10 >= nPairs * 7 && nZeroOdd * 10 <= nPairs)
+			_encoding = enc_utf16be;
+	}
+}
+
+//----------------------------------------------------------------
+// Reads and decodes up to nRoom bytes into pDst.
+// Returns the number of bytes stored (may be 0), or -1 at EOF.
+//----------------------------------------------------------------
+long grep_reader::_readDecoded(char* pDst, long nRoom)
+{
+	long n, nSrc, nConsumed, nOut;
+	bool bEof;
+
+	if(!_bDetected)
+	{
+		// the first block goes through the raw buffer, so that
+		// the BOM can be stripped and the encoding sniffed
+		if(_raw == NULL)
+			_raw = (unsigned char*)grep_input::allocBuffer(_rawSize);
+		n = _pInput->read(_raw, _rawSize);
+		if(n <= 0)
+			return -1;
+		_rawLen = n;
+		_detect();
+
+		if(_encoding == enc_bytes || _encoding == enc_utf8)
+		{
+			// fast path from now on: read straight into the line buffer
+			n = (_rawLen < nRoom ? _rawLen : nRoom);
+			memcpy(pDst, _raw, n);
+			memmove(_raw, _raw + n, _rawLen -= n);
+			return n;
+		}
+	}
+
+	if(_encoding == enc_bytes || _encoding == enc_utf8)
+	{
+		// leftovers of the first block, if the line buffer was too small
+		if(_rawLen > 0)
+		{
+			n = (_rawLen < nRoom ? _rawLen : nRoom);
+			memcpy(pDst, _raw, n);
+			memmove(_raw, _raw + n, _rawLen -= n);
+			return n;
+		}
+		n = _pInput->read(pDst, nRoom);
+		return (n <= 0 ? -1 : n);
+	}
+
+	// UTF-16: top up the raw buffer, then convert as much as fits
+	bEof = false;
+	if(_rawLen < _rawSize)
+	{
+		n = _pInput->read(_raw + _rawLen, _rawSize - _rawLen);
+		if(n > 0)
+			_rawLen += n;
+		else
+			bEof = true;
+	}
+
+	// every 2 source bytes produce at most 3 bytes of UTF-8; _fill
+	// leaves room for 6, so a surrogate pair is never cut in two
+	nSrc = (nRoom / 3) * 2;
+	if(nSrc > _rawLen)
+		nSrc = _rawLen;
+	nOut = utf16_toUtf8(_raw, nSrc, _encoding == enc_utf16be, pDst, &nConsumed);
+	memmove(_raw, _raw + nConsumed, _rawLen -= nConsumed);
+
+	if(nOut == 0 && bEof)
+		return -1;	// end of file; a stray odd byte or lone surrogate is dropped
+	return nOut;
+}
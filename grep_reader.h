@@ -0,0 +1,101 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_reader.h - block-buffered line reader.
+// Detects the encoding of the input (BOM or content heuristic),
+// converts UTF-16 to UTF-8 on the fly, and hands out the lines
+// in place, without copying them.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_reader_inc_
+#define _grep_reader_inc_
+
+#include "grep.h"
+#include "grep_input.h"
+#include "grep_budget.h"
+
+// No end to the window of attach()
+const ulonglong READER_NO_LIMIT = ~(ulonglong)0;
+
+// Input encodings recognized by the reader
+enum grep_encoding
+{
+	enc_bytes,		// no BOM, not UTF-16: ASCII, UTF-8 or some 8-bit code page
+	enc_utf8,		// UTF-8 with BOM
+	enc_utf16le,	// UTF-16, little endian (BOM or heuristic)
+	enc_utf16be		// UTF-16, big endian (BOM or heuristic)
+};
+
+class grep_reader
+{
+public:
+	grep_reader();
+	~grep_reader();
+
+	// start reading a new file; the buffers are kept between files
+	// and are at least twice the size of a single read. Only the
+	// lines that start in the window [uStart, uEnd) are handed out.
+	void attach( grep_input* pInput, long nReadSize,
+				 ulonglong uStart = 0, ulonglong uEnd = READER_NO_LIMIT );
+	// Returns the length of the next line (w/o the line break), or -1
+	// at the end of file. *ppLine points into the reader's buffer, is
+	// NUL-terminated, and stays valid until the next call.
+	long nextLine(LPSTR* ppLine);
+	// Returns the length of the next block of whole lines, with their
+	// line breaks, or -1 at the end of file. Only a line too long for
+	// the buffer, or the last one, can end without a break. The block
+	// is not NUL-terminated and stays valid until the next call.
+	// The last nKeep bytes of the previous block are handed out
+	// again at the start of this one; there is a block only if
+	// there is something new after them.
+	long nextBlock(LPSTR* ppBlock, long nKeep = 0);
+
+	// Growing the buffer for a long line is charged to the budget,
+	// and a line that doesn't fit is split as if it were too long.
+	// Under a budget the buffer goes back to its usual size for
+	// each file.
+	void setBudget(grep_memory_budget* pBudget)	{ _pBudget = pBudget; _nGrown = 0; }
+	// the memory the reader takes for reads of nReadSize bytes
+	static long footprint(long nReadSize);
+
+	// Number of '\n' in the text
+	static long countNewlines(LPCSTR p, long nLen);
+
+	// Offset in the input of a char of the last line or block handed
+	// out. For UTF-16 files the offset is in the UTF-8 text.
+	ulonglong offsetOf(LPCSTR p)	{ return _base + (ulonglong)(p - _buf); }
+
+	grep_encoding encoding()	{ return _encoding; }
+	// true if every byte currently buffered is 7-bit ASCII
+	bool isAscii()				{ return _bAscii; }
+
+private:
+	grep_input*		_pInput;
+	long			_nReadSize;
+	grep_encoding	_encoding;
+	bool			_bDetected;
+	bool			_bEof;
+	bool			_bAscii;
+
+	// decoded (UTF-8 or raw byte) text; lines are served from here
+	char*			_buf;
+	long			_cap;
+	long			_pos;		// start of the next line
+	long			_scan;		// how far the line break search got
+	long			_end;		// end of valid data
+	ulonglong		_base;		// input offset of _buf[0]
+	ulonglong		_limit;		// no lines start at or after this offset
+	grep_memory_budget* _pBudget;
+	long			_nGrown;	// reserved in the budget for long lines
+
+	// undecoded UTF-16 input
+	unsigned char*	_raw;
+	long			_rawSize;
+	long			_rawLen;
+
+private:
+	bool _fill();
+	void _grow(long nSize);
+	void _detect();
+	long _readDecoded(char* pDst, long nRoom);
+};
+
+#endif	// _grep_reader_inc_
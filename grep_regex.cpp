@@ -0,0 +1,1687 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_regex.cpp - implementation of grep_regex
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_regex.h"
+#include "grep_utf8.h"
+
+// Program instructions
+enum
+{
+	// consume text
+	op_char,		// the byte c
+	op_any,			// any char but a NEWLINE
+	op_class,		// a char of class x
+	op_backref,		// the text group n captured (backtracker only)
+	op_match,
+	// don't
+	op_split,		// go on at x, and at y
+	op_jmp,			// go on at x
+	op_save,		// remember the position in capture slot n
+	op_mark,		// remember the position in empty-loop slot n
+	op_progress,	// leave the loop for x if nothing was consumed
+					// since op_mark n
+	op_bol,			// ^
+	op_eol,			// $
+	op_wordb,		// \b
+	op_nwordb,		// \B
+	op_wbeg,		// \<
+	op_wend,		// \>
+	op_nwbefore,	// -w: no word char before
+	op_nwafter		// -w: no word char after
+};
+
+// Groups that can be referred back to, and their capture slots
+const int RE_MAX_BACKREF	= 9;
+const int RE_CAPTURE_SLOTS	= 2 * (RE_MAX_BACKREF + 1);
+// Nesting depth of parentheses the parser recurses through
+const int RE_MAX_DEPTH		= 256;
+// Largest failure memo of the backtracker, in bits
+const long RE_MAX_MEMO_BITS	= 64L * 1024 * 1024;
+// Most failed states remembered with their captures, per line
+const long RE_MAX_STATES	= 64L * 1024;
+// Cap on the shortest match length, which nested counts multiply
+const long RE_MAX_LENGTH	= 0x100000;
+
+// Error messages
+static LPCSTR RE_ERR_BRACKET	= "Unmatched [";
+static LPCSTR RE_ERR_PAREN		= "Unmatched ( or \\(";
+static LPCSTR RE_ERR_RPAREN		= "Unmatched ) or \\)";
+static LPCSTR RE_ERR_BRACE		= "Unmatched \\{";
+static LPCSTR RE_ERR_INTERVAL	= "Invalid content of \\{\\}";
+static LPCSTR RE_ERR_PRECEDING	= "Invalid preceding regular expression";
+static LPCSTR RE_ERR_BACKREF	= "Invalid back reference";
+static LPCSTR RE_ERR_RANGE		= "Invalid range end";
+static LPCSTR RE_ERR_CLASS		= "Invalid character class name";
+static LPCSTR RE_ERR_COLLATE	= "Invalid collation character";
+static LPCSTR RE_ERR_ESCAPE		= "Trailing backslash";
+static LPCSTR RE_ERR_SIZE		= "Regular expression too big";
+
+inline unsigned char _foldByte(unsigned char c)
+{
+	return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + 'a' - 'A') : c;
+}
+
+// The code point of the valid nLen-byte sequence at p
+static unsigned long _decode(const unsigned char* p, long nLen)
+{
+	unsigned long cp;
+	long i;
+
+	if(nLen == 1)
+		return p[0];
+	cp = p[0] & (0x7F >> nLen);
+	for(i=1; i<nLen; i++)
+		cp = (cp << 6) | (p[i] & 0x3F);
+	return cp;
+}
+
+//----------------------------------------------------------------
+// The parse tree. Concatenations and alternations keep their
+// operands as a list (nFirst, then each one's nNext), so the tree
+// is only as deep as the parentheses are nested.
+//----------------------------------------------------------------
+enum
+{
+	node_char,		// a byte
+	node_any,
+	node_class,		// a bracket expression, \w or \W
+	node_backref,
+	node_assert,	// an op_ assertion with no operand
+	node_empty,
+	node_cat,
+	node_alt,
+	node_repeat,	// nFirst, nMin to nMax (-1: no limit) times
+	node_group
+};
+
+struct re_node
+{
+	int		type;
+	long	n;			// byte, class, op, group
+	long	nMin, nMax;
+	long	nFirst;		// operand(s)
+	long	nNext;		// next operand of the parent
+};
+
+struct re_parser
+{
+	LPCSTR	p, pEnd;
+	bool	bExtended;
+	bool	bNoCase;
+	LPCSTR	pError;
+
+	re_node*	nodes;
+	long		nNodes, nMaxNodes;
+	grep_regex::charclass* classes;
+	long		nClasses, nMaxClasses;
+	grep_regex::range* ranges;
+	long		nRanges, nMaxRanges;
+
+	int			nGroups;		// opened so far
+	ulong		uClosed;		// bit n: group n has been closed
+	int			nDepth;
+	bool		bBackrefs;
+
+	re_parser(LPCSTR pPattern, long nLen, bool bExt, bool noCase)
+	{
+		p = pPattern;
+		pEnd = pPattern + nLen;
+		bExtended = bExt;
+		bNoCase = noCase;
+		pError = NULL;
+		nodes = NULL;	nNodes = nMaxNodes = 0;
+		classes = NULL;	nClasses = nMaxClasses = 0;
+		ranges = NULL;	nRanges = nMaxRanges = 0;
+		nGroups = 0;
+		uClosed = 0;
+		nDepth = 0;
+		bBackrefs = false;
+	}
+	~re_parser()
+	{
+		free(nodes);
+		free(classes);
+		free(ranges);
+	}
+
+	long	node(int type, long n = 0);
+	void	append(long nList, long nNode);
+	long	parseAlt();
+	long	parseCat();
+	long	parseAtom(bool bFirst);
+	long	parseGroup();
+	long	parsePostfix(long nAtom);
+	long	parseBracket();
+	long	literal(LPCSTR pAt, long nAvail, long* pUsed);
+	bool	parseInterval(long* pMin, long* pMax);
+	long	newClass(bool bNegate);
+	void	addToClass(long nClass, unsigned long lo, unsigned long hi);
+	bool	addNamedClass(long nClass, LPCSTR pName, long nNameLen);
+
+	bool	at(LPCSTR s) const
+	{
+		long n = lstrlen(s);
+		return (pEnd - p >= n && !memcmp(p, s, n));
+	}
+	// BRE operators are escaped, ERE ones are not
+	bool	atOp(char c) const
+	{
+		if(bExtended)
+			return (p < pEnd && *p == c);
+		return (pEnd - p >= 2 && p[0] == '\\' && p[1] == c);
+	}
+	long	opLen() const	{ return bExtended ? 1 : 2; }
+};
+
+long re_parser::node(int type, long n)
+{
+	if(nNodes == nMaxNodes)
+	{
+		nMaxNodes = (nMaxNodes ? 2 * nMaxNodes : 64);
+		nodes = (re_node*)realloc(nodes, nMaxNodes * sizeof(re_node));
+	}
+	nodes[nNodes].type		= type;
+	nodes[nNodes].n			= n;
+	nodes[nNodes].nMin		= 0;
+	nodes[nNodes].nMax		= 0;
+	nodes[nNodes].nFirst	= -1;
+	nodes[nNodes].nNext		= -1;
+	return nNodes++;
+}
+
+void re_parser::append(long nList, long nNode)
+{
+	long i = nodes[nList].nFirst;
+
+	if(i == -1)
+	{
+		nodes[nList].nFirst = nNode;
+		return;
+	}
+	while(nodes[i].nNext != -1)
+		i = nodes[i].nNext;
+	nodes[i].nNext = nNode;
+}
+
+// alternatives separated by | (\| in a BRE)
+long re_parser::parseAlt()
+{
+	long nAlt, nCat;
+
+	if(++nDepth > RE_MAX_DEPTH)
+	{
+		pError = RE_ERR_SIZE;
+		return -1;
+	}
+	nCat = parseCat();
+	if(pError || !atOp('|'))
+	{
+		nDepth--;
+		return nCat;
+	}
+	nAlt = node(node_alt);
+	append(nAlt, nCat);
+	while(!pError && atOp('|'))
+	{
+		p += opLen();
+		nCat = parseCat();
+		append(nAlt, nCat);
+	}
+	nDepth--;
+	return nAlt;
+}
+
+// a concatenation, up to the end, a | or a closing parenthesis.
+// In an ERE, a ) with no ( is an ordinary char.
+long re_parser::parseCat()
+{
+	long nCat = node(node_cat), nLast = -1, nAtom;
+	bool bFirst = true;
+
+	while( !pError && p < pEnd && !atOp('|') &&
+		   !(atOp(')') && (!bExtended || nDepth > 1)) )
+	{
+		nAtom = parseAtom(bFirst);
+		if(pError)
+			break;
+		// in a BRE, a * right after a leading ^ is still literal
+		bFirst = (!bExtended && bFirst && nodes[nAtom].type == node_assert &&
+				  nodes[nAtom].n == op_bol);
+		if(!bFirst)
+			nAtom = parsePostfix(nAtom);
+		// chained as they come, rather than appended
+		if(nLast == -1)
+			nodes[nCat].nFirst = nAtom;
+		else
+			nodes[nLast].nNext = nAtom;
+		nLast = nAtom;
+	}
+	return nCat;
+}
+
+// One char, or the chars of one UTF-8 sequence, as a literal
+long re_parser::literal(LPCSTR pAt, long nAvail, long* pUsed)
+{
+	long nLen = utf8_seqLength(pAt, nAvail), nCat, i;
+
+	if(nLen <= 1)
+	{
+		*pUsed = 1;
+		return node(node_char, (unsigned char)*pAt);
+	}
+	// a multi-byte char repeats as a whole
+	nCat = node(node_cat);
+	for(i=0; i<nLen; i++)
+		append(nCat, node(node_char, (unsigned char)pAt[i]));
+	*pUsed = nLen;
+	return nCat;
+}
+
+long re_parser::parseAtom(bool bFirst)
+{
+	long nAtom, nUsed;
+	char c;
+
+	c = *p;
+	if(c == '\\')
+	{
+		if(p + 1 == pEnd)
+		{
+			pError = RE_ERR_ESCAPE;
+			return -1;
+		}
+		c = p[1];
+		p += 2;
+		if(c >= '1' && c <= '9')
+		{
+			if(!(uClosed & (1UL << (c - '0'))))
+			{
+				pError = RE_ERR_BACKREF;
+				return -1;
+			}
+			bBackrefs = true;
+			return node(node_backref, c - '0');
+		}
+		switch(c)
+		{
+		case '<':	return node(node_assert, op_wbeg);
+		case '>':	return node(node_assert, op_wend);
+		case 'b':	return node(node_assert, op_wordb);
+		case 'B':	return node(node_assert, op_nwordb);
+		case 'w':
+		case 'W':
+			nAtom = node(node_class, newClass(c == 'W'));
+			addNamedClass(nodes[nAtom].n, "alnum", 5);
+			addToClass(nodes[nAtom].n, '_', '_');
+			addToClass(nodes[nAtom].n, 0x80, 0x10FFFF);
+			return nAtom;
+		}
+		if(!bExtended && c == '(')
+			return parseGroup();
+		if(!bExtended && c == '{')
+		{
+			pError = RE_ERR_PRECEDING;
+			return -1;
+		}
+		nAtom = literal(p - 1, (long)(pEnd - p) + 1, &nUsed);
+		p += nUsed - 1;
+		return nAtom;
+	}
+
+	if(bExtended && c == '(')
+	{
+		p++;
+		return parseGroup();
+	}
+
+	p++;
+	switch(c)
+	{
+	case '.':
+		return node(node_any);
+	case '[':
+		return parseBracket();
+	case '^':
+		// a BRE anchors only at the start
+		if(bExtended || bFirst)
+			return node(node_assert, op_bol);
+		break;
+	case '$':
+		// ... and only at the end
+		if(bExtended || p == pEnd || atOp(')') || atOp('|'))
+			return node(node_assert, op_eol);
+		break;
+	case '*':
+		// a leading * is an ordinary char
+		break;
+	case '+':
+	case '?':
+		if(bExtended && !bFirst)
+		{
+			pError = RE_ERR_PRECEDING;
+			return -1;
+		}
+		break;
+	case '{':
+		if(bExtended && !bFirst && p < pEnd && (isdigit((unsigned char)*p) || *p == ','))
+		{
+			pError = RE_ERR_PRECEDING;
+			return -1;
+		}
+		break;
+	}
+	nAtom = literal(p - 1, (long)(pEnd - p) + 1, &nUsed);
+	p += nUsed - 1;
+	return nAtom;
+}
+
+// *, intervals, and in an ERE (or as GNU escapes in a BRE) + and ?
+// after the opening parenthesis
+long re_parser::parseGroup()
+{
+	long nGroup, nFirst;
+
+	// only 1 to 9 can be referred back to; past 31 none is counted
+	nGroup = node(node_group, nGroups < 31 ? ++nGroups : 0);
+	nFirst = parseAlt();
+	nodes[nGroup].nFirst = nFirst;
+	if(pError)
+		return -1;
+	if(!atOp(')'))
+	{
+		pError = RE_ERR_PAREN;
+		return -1;
+	}
+	p += opLen();
+	if(nodes[nGroup].n)
+		uClosed |= (1UL << nodes[nGroup].n);
+	return nGroup;
+}
+
+long re_parser::parsePostfix(long nAtom)
+{
+	long nRep, nMin, nMax;
+
+	for(;;)
+	{
+		if(p < pEnd && *p == '*')
+		{
+			p++;
+			nMin = 0;
+			nMax = -1;
+		}
+		else if(atOp('+'))
+		{
+			p += opLen();
+			nMin = 1;
+			nMax = -1;
+		}
+		else if(atOp('?'))
+		{
+			p += opLen();
+			nMin = 0;
+			nMax = 1;
+		}
+		else if(atOp('{') && (!bExtended ||
+				 (p + 1 < pEnd && (isdigit((unsigned char)p[1]) || p[1] == ','))))
+		{
+			p += opLen();
+			if(!parseInterval(&nMin, &nMax))
+				return nAtom;
+		}
+		else
+			return nAtom;
+
+		nRep = node(node_repeat);
+		nodes[nRep].nFirst	= nAtom;
+		nodes[nRep].nMin	= nMin;
+		nodes[nRep].nMax	= nMax;
+		nAtom = nRep;
+	}
+}
+
+// m}, m,}, m,n} or ,n}, with \} in a BRE
+bool re_parser::parseInterval(long* pMin, long* pMax)
+{
+	long nMin = 0, nMax;
+	bool bDigits = false;
+
+	while(p < pEnd && isdigit((unsigned char)*p))
+	{
+		nMin = 10 * nMin + (*p++ - '0');
+		if(nMin > RE_MAX_COUNT)
+			break;
+		bDigits = true;
+	}
+	nMax = nMin;
+	if(p < pEnd && *p == ',')
+	{
+		p++;
+		if(p < pEnd && isdigit((unsigned char)*p))
+		{
+			nMax = 0;
+			while(p < pEnd && isdigit((unsigned char)*p))
+			{
+				nMax = 10 * nMax + (*p++ - '0');
+				if(nMax > RE_MAX_COUNT)
+					break;
+			}
+		}
+		else
+			nMax = -1;
+		bDigits = true;
+	}
+	if(!bDigits || nMin > RE_MAX_COUNT || nMax > RE_MAX_COUNT || (nMax != -1 && nMax < nMin))
+	{
+		pError = RE_ERR_INTERVAL;
+		return false;
+	}
+	if(!atOp('}'))
+	{
+		pError = (p < pEnd ? RE_ERR_INTERVAL : RE_ERR_BRACE);
+		return false;
+	}
+	p += opLen();
+	*pMin = nMin;
+	*pMax = nMax;
+	return true;
+}
+
+long re_parser::newClass(bool bNegate)
+{
+	if(nClasses == nMaxClasses)
+	{
+		nMaxClasses = (nMaxClasses ? 2 * nMaxClasses : 8);
+		classes = (grep_regex::charclass*)realloc(classes, nMaxClasses * sizeof(grep_regex::charclass));
+	}
+	memset(&classes[nClasses], 0, sizeof(grep_regex::charclass));
+	classes[nClasses].bNegate = bNegate;
+	classes[nClasses].nFirstRange = nRanges;
+	return nClasses++;
+}
+
+// Ranges are added to the last class only
+void re_parser::addToClass(long nClass, unsigned long lo, unsigned long hi)
+{
+	grep_regex::charclass& cls = classes[nClass];
+	unsigned long c;
+
+	for(c = lo; c <= hi && c < 0x80; c++)
+	{
+		cls.bits[c >> 3] |= (1 << (c & 7));
+		if(bNoCase && isalpha((int)c))
+		{
+			cls.bits[(c ^ 0x20) >> 3] |= (1 << ((c ^ 0x20) & 7));
+		}
+	}
+	if(hi >= 0x80)
+	{
+		if(nRanges == nMaxRanges)
+		{
+			nMaxRanges = (nMaxRanges ? 2 * nMaxRanges : 16);
+			ranges = (grep_regex::range*)realloc(ranges, nMaxRanges * sizeof(grep_regex::range));
+		}
+		ranges[nRanges].lo = (lo < 0x80 ? 0x80 : lo);
+		ranges[nRanges].hi = hi;
+		nRanges++;
+		cls.nRanges++;
+	}
+}
+
+bool re_parser::addNamedClass(long nClass, LPCSTR pName, long nNameLen)
+{
+	static const struct { LPCSTR pName; int (*pfnIs)(int); } s_names[] =
+	{
+		{ "alpha", isalpha }, { "digit", isdigit }, { "alnum", isalnum },
+		{ "upper", isupper }, { "lower", islower }, { "space", isspace },
+		{ "punct", ispunct }, { "print", isprint }, { "graph", isgraph },
+		{ "cntrl", iscntrl }, { "xdigit", isxdigit }, { "blank", NULL }
+	};
+	int (*pfnIs)(int);
+	int i, c;
+
+	for(i=0; i<(int)(sizeof(s_names) / sizeof(s_names[0])); i++)
+	{
+		if(lstrlen(s_names[i].pName) == nNameLen && !memcmp(s_names[i].pName, pName, nNameLen))
+			break;
+	}
+	if(i == (int)(sizeof(s_names) / sizeof(s_names[0])))
+		return false;
+
+	pfnIs = s_names[i].pfnIs;
+	// with -i, upper and lower are both letters
+	if(bNoCase && (pfnIs == isupper || pfnIs == islower))
+		pfnIs = isalpha;
+	for(c=0; c<0x80; c++)
+	{
+		if(pfnIs ? pfnIs(c) : (c == ' ' || c == '\t'))
+			addToClass(nClass, c, c);
+	}
+	return true;
+}
+
+long re_parser::parseBracket()
+{
+	long nClass, nUsed, nNameLen;
+	unsigned long lo, hi;
+	LPCSTR pName;
+	bool bFirst = true, bRange;
+
+	nClass = newClass(p < pEnd && *p == '^');
+	if(classes[nClass].bNegate)
+		p++;
+
+	for(;;)
+	{
+		if(p >= pEnd)
+		{
+			pError = RE_ERR_BRACKET;
+			return -1;
+		}
+		if(*p == ']' && !bFirst)
+		{
+			p++;
+			break;
+		}
+		bFirst = false;
+
+		if(at("[:"))
+		{
+			pName = p + 2;
+			for(p = pName; p + 1 < pEnd && !(p[0] == ':' && p[1] == ']'); p++)
+				;
+			if(p + 1 >= pEnd)
+			{
+				pError = RE_ERR_BRACKET;
+				return -1;
+			}
+			nNameLen = (long)(p - pName);
+			p += 2;
+			if(!addNamedClass(nClass, pName, nNameLen))
+			{
+				pError = RE_ERR_CLASS;
+				return -1;
+			}
+			continue;
+		}
+
+		// a char, a [.c.] or an [=c=] (one char each here)
+		bRange = false;
+		for(;;)
+		{
+			if(at("[.") || at("[="))
+			{
+				char cEnd = p[1];
+				p += 2;
+				nUsed = utf8_seqLength(p, (long)(pEnd - p));
+				if(nUsed == 0)
+					nUsed = 1;
+				if(pEnd - p < nUsed + 2 || p[nUsed] != cEnd || p[nUsed + 1] != ']')
+				{
+					pError = RE_ERR_COLLATE;
+					return -1;
+				}
+				hi = (nUsed > 1 ? _decode((const unsigned char*)p, nUsed) : (unsigned char)*p);
+				p += nUsed + 2;
+			}
+			else
+			{
+				nUsed = utf8_seqLength(p, (long)(pEnd - p));
+				if(nUsed == 0)
+					nUsed = 1;
+				hi = (nUsed > 1 ? _decode((const unsigned char*)p, nUsed) : (unsigned char)*p);
+				p += nUsed;
+			}
+			if(!bRange)
+				lo = hi;
+			// a - that is not last makes a range
+			if(bRange || !(pEnd - p >= 2 && p[0] == '-' && p[1] != ']'))
+				break;
+			p++;
+			bRange = true;
+		}
+		if(lo > hi)
+		{
+			pError = RE_ERR_RANGE;
+			return -1;
+		}
+		addToClass(nClass, lo, hi);
+	}
+	return node(node_class, nClass);
+}
+
+//----------------------------------------------------------------
+// Compiling the tree
+//----------------------------------------------------------------
+struct re_compiler
+{
+	re_parser&		parse;
+	grep_regex::inst* prog;
+	long			nProg;
+	long			nSlots;
+	bool			bCaptures;
+	bool			bNoCase;
+	bool			bTooBig;
+
+	re_compiler(re_parser& p) : parse(p)
+	{
+		prog = (grep_regex::inst*)malloc(RE_MAX_PROGRAM * sizeof(grep_regex::inst));
+		nProg = nSlots = 0;
+		bCaptures = p.bBackrefs;
+		bNoCase = p.bNoCase;
+		bTooBig = false;
+	}
+	~re_compiler()	{ free(prog); }
+
+	long emit(int op, long x = 0, long n = 0)
+	{
+		if(nProg == RE_MAX_PROGRAM)
+		{
+			bTooBig = true;
+			return RE_MAX_PROGRAM - 1;	// written over, never used
+		}
+		prog[nProg].op	= (unsigned char)op;
+		prog[nProg].c	= 0;
+		prog[nProg].n	= (unsigned short)n;
+		prog[nProg].x	= x;
+		prog[nProg].y	= 0;
+		return nProg++;
+	}
+	bool nullable(long nNode) const;
+	long minLength(long nNode) const;
+	void compile(long nNode);
+};
+
+// Can the node match the empty string?
+bool re_compiler::nullable(long nNode) const
+{
+	const re_node& nd = parse.nodes[nNode];
+	long i;
+
+	switch(nd.type)
+	{
+	case node_char:
+	case node_any:
+	case node_class:
+		return false;
+	case node_cat:
+		for(i = nd.nFirst; i != -1; i = parse.nodes[i].nNext)
+			if(!nullable(i))
+				return false;
+		return true;
+	case node_alt:
+		for(i = nd.nFirst; i != -1; i = parse.nodes[i].nNext)
+			if(nullable(i))
+				return true;
+		return false;
+	case node_repeat:
+		return (nd.nMin == 0 || nullable(nd.nFirst));
+	case node_group:
+		return nullable(nd.nFirst);
+	default:
+		// assertions, empty, and back references to empty groups
+		return true;
+	}
+}
+
+// The fewest bytes the node can match; no more than RE_MAX_LENGTH
+long re_compiler::minLength(long nNode) const
+{
+	const re_node& nd = parse.nodes[nNode];
+	long nMin = 0, nLen, i;
+
+	switch(nd.type)
+	{
+	case node_char:
+	case node_any:
+	case node_class:
+		return 1;
+	case node_cat:
+		for(i = nd.nFirst; i != -1; i = parse.nodes[i].nNext)
+			nMin += minLength(i);
+		break;
+	case node_alt:
+		for(i = nd.nFirst; i != -1; i = parse.nodes[i].nNext)
+		{
+			nLen = minLength(i);
+			if(i == nd.nFirst || nLen < nMin)
+				nMin = nLen;
+		}
+		break;
+	case node_repeat:
+		nMin = nd.nMin * minLength(nd.nFirst);
+		break;
+	case node_group:
+		nMin = minLength(nd.nFirst);
+		break;
+	default:
+		// assertions, empty, and back references (to empty groups)
+		break;
+	}
+	return (nMin < RE_MAX_LENGTH ? nMin : RE_MAX_LENGTH);
+}
+
+void re_compiler::compile(long nNode)
+{
+	const re_node& nd = parse.nodes[nNode];
+	long nSplit, nJmp, nBefore, nLoop, i, k;
+	long* pPatch;
+	int  nSlot;
+
+	if(bTooBig)
+		return;
+
+	switch(nd.type)
+	{
+	case node_char:
+		k = emit(op_char);
+		prog[k].c = (unsigned char)(bNoCase ? _foldByte((unsigned char)nd.n) : nd.n);
+		break;
+	case node_any:
+		emit(op_any);
+		break;
+	case node_class:
+		emit(op_class, nd.n);
+		break;
+	case node_backref:
+		emit(op_backref, 0, nd.n);
+		break;
+	case node_assert:
+		emit(nd.n);
+		break;
+	case node_empty:
+		break;
+	case node_cat:
+		for(i = nd.nFirst; i != -1; i = parse.nodes[i].nNext)
+			compile(i);
+		break;
+	case node_alt:
+		// split to each alternative but the last, jump past the rest
+		pPatch = NULL;
+		k = 0;
+		for(i = nd.nFirst; i != -1 && !bTooBig; i = parse.nodes[i].nNext)
+		{
+			if(parse.nodes[i].nNext == -1)
+			{
+				compile(i);
+				break;
+			}
+			nSplit = emit(op_split, nProg + 1);
+			compile(i);
+			nJmp = emit(op_jmp);
+			pPatch = (long*)realloc(pPatch, (k + 1) * sizeof(long));
+			pPatch[k++] = nJmp;
+			prog[nSplit].y = nProg;
+		}
+		while(k--)
+			prog[pPatch[k]].x = nProg;
+		free(pPatch);
+		break;
+	case node_group:
+		if(bCaptures && nd.n >= 1 && nd.n <= RE_MAX_BACKREF)
+			emit(op_save, 0, 2 * nd.n);
+		compile(nd.nFirst);
+		if(bCaptures && nd.n >= 1 && nd.n <= RE_MAX_BACKREF)
+			emit(op_save, 0, 2 * nd.n + 1);
+		break;
+	case node_repeat:
+		// the required copies; a body that compiles to nothing
+		// (only empty groups) needs no more copies
+		for(i=0; i<nd.nMin && !bTooBig; i++)
+		{
+			nBefore = nProg;
+			compile(nd.nFirst);
+			if(nProg == nBefore)
+				return;
+		}
+		if(nd.nMax == -1)
+		{
+			// loop; a body that can match empty leaves the loop
+			// after a pass that consumed nothing (for the
+			// backtracker), keeping what that pass captured
+			nSlot = (nullable(nd.nFirst) ? (int)nSlots++ : -1);
+			nLoop = emit(op_split, nProg + 1);
+			if(nSlot != -1)
+				emit(op_mark, 0, nSlot);
+			compile(nd.nFirst);
+			if(nSlot != -1)
+				nJmp = emit(op_progress, 0, nSlot);
+			emit(op_jmp, nLoop);
+			prog[nLoop].y = nProg;
+			if(nSlot != -1)
+				prog[nJmp].x = nProg;
+		}
+		else if(nd.nMax > nd.nMin)
+		{
+			// optional copies, each one skipping to the end
+			pPatch = (long*)malloc((nd.nMax - nd.nMin) * sizeof(long));
+			for(k=0; k < nd.nMax - nd.nMin && !bTooBig; k++)
+			{
+				pPatch[k] = emit(op_split, nProg + 1);
+				nBefore = nProg;
+				compile(nd.nFirst);
+				if(nProg == nBefore)
+				{
+					k++;
+					break;
+				}
+			}
+			while(k--)
+				prog[pPatch[k]].y = nProg;
+			free(pPatch);
+		}
+		break;
+	}
+}
+
+//----------------------------------------------------------------
+// grep_regex
+//----------------------------------------------------------------
+grep_regex::grep_regex()
+{
+	_prog		= NULL;
+	_nProg		= 0;
+	_classes	= NULL;
+	_ranges		= NULL;
+	_nSlots		= 0;
+	_bNoCase	= false;
+	_bBackrefs	= false;
+	_pLive		= NULL;
+	_nLiveMax	= 0;
+	_nFirstByte	= -1;
+	_nStartOp	= -1;
+	_nMinLen	= 0;
+	_pMust		= NULL;
+	_nGiveUps	= 0;
+}
+
+grep_regex::~grep_regex()
+{
+	reset();
+}
+
+void grep_regex::reset()
+{
+	_mem.reset();
+	_prog		= NULL;
+	_nProg		= 0;
+	_classes	= NULL;
+	_ranges		= NULL;
+	_nSlots		= 0;
+	_bBackrefs	= false;
+	_pLive		= NULL;
+	_nLiveMax	= 0;
+	_nFirstByte	= -1;
+	_nStartOp	= -1;
+	_nMinLen	= 0;
+	delete _pMust;
+	_pMust		= NULL;
+	_nGiveUps	= 0;
+}
+
+LPCSTR grep_regex::check(LPCSTR pPattern, long nLen, bool bExtended)
+{
+	grep_regex re;
+	LPCSTR pError = NULL;
+
+	re.init(pPattern, nLen, bExtended, true, false, false, &pError);
+	return pError;
+}
+
+bool grep_regex::init( LPCSTR pPattern, long nLen, bool bExtended,
+					   bool caseSensitive, bool matchWholeWord, bool matchEntireLine,
+					   LPCSTR* ppError )
+{
+	char* pCopy;
+	long nRoot, nTop, nWrap, nRun, nBest, nBestStart, i, k;
+	ulong uLive;
+	bool bChanged;
+
+	reset();
+	_bNoCase = !caseSensitive;
+
+	// With -i, grep_search folds the non-ASCII lines; fold the
+	// non-ASCII chars of the pattern the same way. The ASCII ones
+	// are left alone, for the escapes (\w and \W differ by case).
+	pCopy = _mem.copy(pPattern, nLen);
+	if(_bNoCase)
+	{
+		for(i=0; i<nLen; i += k)
+		{
+			k = utf8_seqLength(pCopy + i, nLen - i);
+			if(k > 1)
+				utf8_foldCase(pCopy + i, k);
+			if(k == 0)
+				k = 1;
+		}
+	}
+
+	re_parser parse(pCopy, nLen, bExtended, _bNoCase);
+	nRoot = parse.parseAlt();
+	if(!parse.pError && parse.p < parse.pEnd)
+		parse.pError = RE_ERR_RPAREN;
+	if(parse.pError)
+	{
+		if(ppError)
+			*ppError = parse.pError;
+		reset();
+		return false;
+	}
+	nTop = nRoot;
+
+	// -x: ^(re)$; -w: no word chars on either side
+	if(matchEntireLine || matchWholeWord)
+	{
+		nWrap = parse.node(node_cat);
+		parse.append(nWrap, parse.node(node_assert, matchEntireLine ? op_bol : op_nwbefore));
+		nTop = parse.node(node_group, 0);
+		parse.nodes[nTop].nFirst = nRoot;
+		parse.append(nWrap, nTop);
+		parse.append(nWrap, parse.node(node_assert, matchEntireLine ? op_eol : op_nwafter));
+		nRoot = nWrap;
+	}
+
+	re_compiler comp(parse);
+	_nMinLen = comp.minLength(nRoot);
+	comp.compile(nRoot);
+	comp.emit(op_match);
+	if(comp.bTooBig)
+	{
+		if(ppError)
+			*ppError = RE_ERR_SIZE;
+		reset();
+		return false;
+	}
+
+	_nProg = comp.nProg;
+	_prog = (inst*)_mem.alloc(_nProg * sizeof(inst));
+	memcpy(_prog, comp.prog, _nProg * sizeof(inst));
+	_classes = (charclass*)_mem.alloc((parse.nClasses + 1) * sizeof(charclass));
+	memcpy(_classes, parse.classes, parse.nClasses * sizeof(charclass));
+	_ranges = (range*)_mem.alloc((parse.nRanges + 1) * sizeof(range));
+	memcpy(_ranges, parse.ranges, parse.nRanges * sizeof(range));
+	_nSlots = comp.nSlots;
+	_bBackrefs = parse.bBackrefs;
+
+	// The backtracker remembers the failures of the instructions
+	// from which no back reference can be reached: their outcome
+	// does not depend on what the groups captured.
+	// The backtracker remembers failed states. What a state must
+	// hold besides the instruction and the position are the capture
+	// slots that a back reference ahead may still read: the slots
+	// live at the instruction.
+	if(_bBackrefs)
+	{
+		_pLive = (ulong*)_mem.alloc(_nProg * sizeof(ulong));
+		memset(_pLive, 0, _nProg * sizeof(ulong));
+		do
+		{
+			bChanged = false;
+			for(i=_nProg-1; i>=0; i--)
+			{
+				switch(_prog[i].op)
+				{
+				case op_match:
+					uLive = 0;
+					break;
+				case op_jmp:
+					uLive = _pLive[_prog[i].x];
+					break;
+				case op_split:
+					uLive = _pLive[_prog[i].x] | _pLive[_prog[i].y];
+					break;
+				case op_progress:
+					uLive = _pLive[_prog[i].x] | _pLive[i + 1];
+					break;
+				case op_save:
+					uLive = _pLive[i + 1] & ~(1UL << _prog[i].n);
+					break;
+				case op_backref:
+					uLive = _pLive[i + 1] | (3UL << (2 * _prog[i].n));
+					break;
+				default:
+					uLive = _pLive[i + 1];
+					break;
+				}
+				if(uLive != _pLive[i])
+				{
+					_pLive[i] = uLive;
+					bChanged = true;
+				}
+			}
+		}
+		while(bChanged);
+
+		for(i=0; i<_nProg; i++)
+		{
+			for(k=0, uLive=_pLive[i]; uLive; uLive &= uLive - 1)
+				k++;
+			if(k > _nLiveMax)
+				_nLiveMax = k;
+		}
+	}
+
+	// The byte all matches start with, if there is one, and what
+	// must hold before it (^, or no word char for -w and \<), let
+	// the search skip to the places where a match can start
+	for(i=0; i<_nProg; )
+	{
+		if(_prog[i].op == op_jmp)
+			i = _prog[i].x;
+		else if(_prog[i].op >= op_save && _prog[i].op != op_split)
+		{
+			if( _nStartOp == -1 &&
+				(_prog[i].op == op_bol || _prog[i].op == op_nwbefore || _prog[i].op == op_wbeg) )
+				_nStartOp = _prog[i].op;
+			i++;
+		}
+		else
+			break;
+	}
+	if(_prog[i].op == op_char && !(_bNoCase && isalpha(_prog[i].c)))
+		_nFirstByte = _prog[i].c;
+
+	// The longest run of literal chars the top level concatenation
+	// must match: lines without it are passed over at once
+	while(parse.nodes[nTop].type == node_group)
+		nTop = parse.nodes[nTop].nFirst;
+	if(parse.nodes[nTop].type == node_cat)
+	{
+		nRun = nBest = nBestStart = 0;
+		k = -1;
+		for(i = parse.nodes[nTop].nFirst; ; i = parse.nodes[i].nNext)
+		{
+			if(i != -1 && parse.nodes[i].type == node_char && parse.nodes[i].n != 0)
+			{
+				if(nRun++ == 0)
+					k = i;
+				continue;
+			}
+			if(nRun > nBest)
+			{
+				nBest = nRun;
+				nBestStart = k;
+			}
+			nRun = 0;
+			if(i == -1)
+				break;
+		}
+		if(nBest >= 2)
+		{
+			pCopy = (char*)_mem.alloc(nBest + 1);
+			for(i = nBestStart, k = 0; k < nBest; i = parse.nodes[i].nNext)
+				pCopy[k++] = (char)parse.nodes[i].n;
+			pCopy[k] = '\0';
+			_pMust = new _boyer_moore_;
+			_pMust->initPattern(pCopy, caseSensitive, false, false);
+		}
+	}
+	return true;
+}
+
+//----------------------------------------------------------------
+// Matching
+//----------------------------------------------------------------
+
+// Bytes the consuming instruction takes at nPos, 0 if it fails
+long grep_regex::_consume(const inst& in, LPCSTR pLine, long nLen, long nPos) const
+{
+	unsigned char c;
+	unsigned long cp;
+	const charclass* pClass;
+	const range* pRange;
+	long nSeq, i;
+	bool bIn;
+
+	if(nPos >= nLen)
+		return 0;
+	c = (unsigned char)pLine[nPos];
+
+	switch(in.op)
+	{
+	case op_char:
+		return ((_bNoCase ? _foldByte(c) : c) == in.c) ? 1 : 0;
+	case op_any:
+		if(c == '\n')
+			return 0;
+		if(c < 0x80)
+			return 1;
+		nSeq = utf8_seqLength(pLine + nPos, nLen - nPos);
+		return (nSeq ? nSeq : 1);
+	case op_class:
+		pClass = &_classes[in.x];
+		if(c < 0x80)
+		{
+			if(c == '\n' && pClass->bNegate)
+				return 0;
+			bIn = ((pClass->bits[c >> 3] & (1 << (c & 7))) != 0);
+			return (bIn != pClass->bNegate) ? 1 : 0;
+		}
+		// a byte that starts no valid sequence stands for itself
+		nSeq = utf8_seqLength(pLine + nPos, nLen - nPos);
+		if(nSeq == 0)
+		{
+			nSeq = 1;
+			cp = c;
+		}
+		else
+			cp = _decode((const unsigned char*)pLine + nPos, nSeq);
+		bIn = false;
+		pRange = _ranges + pClass->nFirstRange;
+		for(i=0; i<pClass->nRanges && !bIn; i++)
+			bIn = (cp >= pRange[i].lo && cp <= pRange[i].hi);
+		return (bIn != pClass->bNegate) ? nSeq : 0;
+	}
+	return 0;
+}
+
+// Does the zero-width instruction hold at nPos?
+bool grep_regex::_assert(const inst& in, LPCSTR pLine, long nLen, long nPos) const
+{
+	bool bBefore, bAfter;
+
+	switch(in.op)
+	{
+	case op_bol:
+		return (nPos == 0 || pLine[nPos-1] == '\n');
+	case op_eol:
+		return (nPos == nLen || pLine[nPos] == '\n' ||
+				(pLine[nPos] == '\r' && nPos + 1 < nLen && pLine[nPos+1] == '\n'));
+	}
+	bBefore	= (nPos > 0 && utf8_isWordByte((unsigned char)pLine[nPos-1]));
+	bAfter	= (nPos < nLen && utf8_isWordByte((unsigned char)pLine[nPos]));
+	switch(in.op)
+	{
+	case op_wordb:		return (bBefore != bAfter);
+	case op_nwordb:		return (bBefore == bAfter);
+	case op_wbeg:		return (!bBefore && bAfter);
+	case op_wend:		return (bBefore && !bAfter);
+	case op_nwbefore:	return !bBefore;
+	case op_nwafter:	return !bAfter;
+	}
+	return true;
+}
+
+bool grep_regex::match( LPCSTR pLine, long nLineLen, long* pMatchStart,
+						long* pMatchLength, grep_scratch* pScratch ) const
+{
+	long nStart, nEnd;
+	bool bMatched;
+
+	if(_nProg == 0 || nLineLen < _nMinLen)
+		return false;
+	if(_pMust && !_pMust->match(pLine, nLineLen, &nStart, &nEnd))
+		return false;
+
+	if(_bBackrefs)
+		bMatched = _backtrack(pLine, nLineLen, &nStart, &nEnd, pScratch);
+	else
+		bMatched = _pike(pLine, nLineLen, &nStart, &nEnd, pScratch);
+	if(bMatched)
+	{
+		if(pMatchStart)		*pMatchStart	= nStart;
+		if(pMatchLength)	*pMatchLength	= nEnd - nStart;
+	}
+	return bMatched;
+}
+
+//----------------------------------------------------------------
+// The first position at or after nPos where a match can start, or
+// -1: one with the first byte, where the start assertion holds.
+// Past a word char, -w and \< can't start again before the end of
+// the word; the rest of it is passed over without a memchr per
+// occurrence of the first byte.
+//----------------------------------------------------------------
+long grep_regex::_nextStart(LPCSTR pLine, long nLen, long nPos) const
+{
+	const char* pFound;
+
+	while(nPos <= nLen)
+	{
+		if(_nFirstByte >= 0)
+		{
+			if(nPos >= nLen)
+				return -1;
+			pFound = (const char*)memchr(pLine + nPos, _nFirstByte, nLen - nPos);
+			if(pFound == NULL)
+				return -1;
+			nPos = (long)(pFound - pLine);
+		}
+		if(nPos == 0 || _nStartOp == -1)
+			return nPos;
+
+		if(_nStartOp == op_bol)
+		{
+			if(pLine[nPos-1] == '\n')
+				return nPos;
+			pFound = (const char*)memchr(pLine + nPos, '\n', nLen - nPos);
+			if(pFound == NULL)
+				return -1;
+			nPos = (long)(pFound - pLine) + 1;
+		}
+		else
+		{
+			if(!utf8_isWordByte((unsigned char)pLine[nPos-1]))
+				return nPos;
+			nPos += utf8_wordLength(pLine + nPos, nLen - nPos) + 1;
+		}
+	}
+	return -1;
+}
+
+//----------------------------------------------------------------
+// The Pike VM. A thread is an instruction and the position its
+// match started at. Each of the next positions a thread can get to
+// (a char is 1 to 4 bytes) has a list of the threads that reach it;
+// a list holds an instruction once, with the leftmost start that
+// reached it, and is a sparse set, so it needs no clearing.
+//----------------------------------------------------------------
+const long PIKE_LISTS = 5;
+
+struct grep_regex::pike_list
+{
+	long*	pDense;		// instructions, in the order added
+	long*	pSparse;	// where each instruction is in pDense
+	long*	pStart;		// start of each one in pDense
+	long	nCount;
+};
+
+bool grep_regex::_pike( LPCSTR pLine, long nLen, long* pStart, long* pEnd,
+						grep_scratch* pScratch ) const
+{
+	pike_list lists[PIKE_LISTS];
+	pike_list* pCur;
+	long* pMem;
+	long* pStack;
+	long nPos, nPc, nStart, nBestStart = 0, nBestEnd = 0, i, j;
+	bool bMatched = false, bAlive;
+
+	pMem = (long*)pScratch->buffer(scratch_regex,
+						(PIKE_LISTS * 3 * _nProg + 2 * _nProg + 2) * sizeof(long));
+	for(i=0; i<PIKE_LISTS; i++)
+	{
+		lists[i].pDense		= pMem;		pMem += _nProg;
+		lists[i].pSparse	= pMem;		pMem += _nProg;
+		lists[i].pStart		= pMem;		pMem += _nProg;
+		lists[i].nCount		= 0;
+	}
+	pStack = pMem;
+
+	for(nPos = 0; ; nPos++)
+	{
+		bAlive = false;
+		for(i=0; i<PIKE_LISTS; i++)
+			bAlive = bAlive || (lists[i].nCount != 0);
+		if(!bAlive)
+		{
+			if(bMatched)
+				break;
+			// no thread left: skip to where a match can start
+			nPos = _nextStart(pLine, nLen, nPos);
+			if(nPos == -1)
+				break;
+		}
+
+		// a new thread starts here, unless a match has been found
+		// (it started earlier); then the threads at nPos advance.
+		// The list does not grow while it is walked: every thread
+		// that moves on lands further along.
+		pCur = &lists[nPos % PIKE_LISTS];
+		if(!bMatched)
+			_addThread(pCur, pStack, 0, nPos, pLine, nLen, nPos);
+		for(i=0; i<pCur->nCount; i++)
+		{
+			nPc		= pCur->pDense[i];
+			nStart	= pCur->pStart[i];
+			if(bMatched && nStart > nBestStart)
+				continue;
+			switch(_prog[nPc].op)
+			{
+			case op_match:
+				if(!bMatched || nStart < nBestStart || (nStart == nBestStart && nPos > nBestEnd))
+				{
+					bMatched	= true;
+					nBestStart	= nStart;
+					nBestEnd	= nPos;
+				}
+				break;
+			case op_char:
+			case op_any:
+			case op_class:
+				j = _consume(_prog[nPc], pLine, nLen, nPos);
+				if(j)
+					_addThread(&lists[(nPos + j) % PIKE_LISTS], pStack, nPc + 1, nStart,
+							   pLine, nLen, nPos + j);
+				break;
+			}
+		}
+		pCur->nCount = 0;
+		if(nPos >= nLen)
+			break;
+	}
+
+	if(bMatched)
+	{
+		*pStart	= nBestStart;
+		*pEnd	= nBestEnd;
+	}
+	return bMatched;
+}
+
+// Adds the thread at nPc, and everything it reaches without
+// consuming, to the list for position nAt. An instruction already
+// in the list is taken over by a thread with an earlier start.
+void grep_regex::_addThread( pike_list* pList, long* pStack, long nPc, long nStart,
+							 LPCSTR pLine, long nLen, long nAt ) const
+{
+	long nSp = 0, i;
+
+	pStack[nSp++] = nPc;
+	while(nSp)
+	{
+		nPc = pStack[--nSp];
+		i = pList->pSparse[nPc];
+		if(i >= 0 && i < pList->nCount && pList->pDense[i] == nPc)
+		{
+			if(pList->pStart[i] <= nStart)
+				continue;
+			pList->pStart[i] = nStart;
+		}
+		else
+		{
+			i = pList->nCount++;
+			pList->pSparse[nPc]	= i;
+			pList->pDense[i]	= nPc;
+			pList->pStart[i]	= nStart;
+		}
+		switch(_prog[nPc].op)
+		{
+		case op_jmp:
+			pStack[nSp++] = _prog[nPc].x;
+			break;
+		case op_split:
+			pStack[nSp++] = _prog[nPc].y;
+			pStack[nSp++] = _prog[nPc].x;
+			break;
+		case op_save:
+		case op_mark:
+		case op_progress:
+			pStack[nSp++] = nPc + 1;
+			break;
+		case op_bol:
+		case op_eol:
+		case op_wordb:
+		case op_nwordb:
+		case op_wbeg:
+		case op_wend:
+		case op_nwbefore:
+		case op_nwafter:
+			if(_assert(_prog[nPc], pLine, nLen, nAt))
+				pStack[nSp++] = nPc + 1;
+			break;
+		}
+	}
+}
+
+//----------------------------------------------------------------
+// The backtracker, for patterns with back references. Alternatives
+// are tried in order, longest repetition first. What a thread
+// changes (captures, empty-loop marks) is pushed to be put back
+// when it fails.
+//
+// A state that has failed fails again whenever it comes back, so
+// failures are remembered for the whole line. Where no capture is
+// live (see _pLive) the instruction and position are the state,
+// kept in a bitmap. Elsewhere the state also holds the live slots;
+// those are kept in a hash set, at the splits only (every repeated
+// path goes through one), for as long as the set has room.
+//----------------------------------------------------------------
+struct bt_entry
+{
+	long	nPc;	// >= 0: try nPc at nVal; < 0: put nVal back in slot -nPc-1
+	long	nVal;
+};
+
+struct bt_states
+{
+	grep_scratch* pScratch;
+	long*	pTable;		// nWidth longs per entry: pc, pos, live captures
+	long	nWidth;
+	long	nMask;		// entries - 1
+	long	nUsed;
+
+	void init(grep_scratch* pS, long nLiveMax)
+	{
+		pScratch = pS;
+		pTable	= NULL;
+		nWidth	= 2 + nLiveMax;
+		nMask	= 0;
+		nUsed	= 0;
+	}
+
+	// Returns true if the state was already in the set; else adds it
+	bool seen(long nPc, long nPos, const long* pSlots, ulong uLive)
+	{
+		long key[2 + RE_CAPTURE_SLOTS];
+		long nKey = 2, n;
+
+		// the live slots, packed: they are the same for every
+		// state of one instruction
+		key[0] = nPc;
+		key[1] = nPos;
+		for(n=0; n<RE_CAPTURE_SLOTS; n++)
+		{
+			if(uLive & (1UL << n))
+				key[nKey++] = pSlots[n];
+		}
+		while(nKey < nWidth)
+			key[nKey++] = 0;
+		// set up on first use: most lines never get here
+		if(pTable == NULL)
+			_resize(1024);
+		if(_find(key, true))
+			return true;
+		if(nUsed >= (nMask + 1) / 2 && nMask + 1 < RE_MAX_STATES)
+			_resize(2 * (nMask + 1));
+		return false;
+	}
+
+	bool _find(const long* pKey, bool bAdd)
+	{
+		ulong uHash = 0;
+		long* pEntry;
+		long  i;
+
+		for(i=0; i<nWidth; i++)
+			uHash = (uHash ^ (ulong)pKey[i]) * 16777619UL;
+		for(i = (long)(uHash & nMask); ; i = (i + 1) & nMask)
+		{
+			pEntry = pTable + i * nWidth;
+			if(pEntry[0] == -1)
+				break;
+			if(!memcmp(pEntry, pKey, nWidth * sizeof(long)))
+				return true;
+		}
+		// a full set (three quarters, so the probes stay short)
+		// only stops learning
+		if(bAdd && nUsed < (nMask + 1) - (nMask + 1) / 4)
+		{
+			memcpy(pEntry, pKey, nWidth * sizeof(long));
+			nUsed++;
+		}
+		return false;
+	}
+
+	void _resize(long nEntries)
+	{
+		long* pOld = NULL;
+		long  nOld = (pTable ? nMask + 1 : 0), i;
+
+		if(nOld)
+		{
+			pOld = (long*)malloc(nOld * nWidth * sizeof(long));
+			memcpy(pOld, pTable, nOld * nWidth * sizeof(long));
+		}
+		pTable = (long*)pScratch->buffer(scratch_states, nEntries * nWidth * sizeof(long));
+		memset(pTable, 0xFF, nEntries * nWidth * sizeof(long));
+		nMask = nEntries - 1;
+		nUsed = 0;
+		for(i=0; i<nOld; i++)
+		{
+			if(pOld[i * nWidth] != -1)
+				_find(pOld + i * nWidth, true);
+		}
+		free(pOld);
+	}
+};
+
+bool grep_regex::_backtrack( LPCSTR pLine, long nLen, long* pStart, long* pEnd,
+							 grep_scratch* pScratch ) const
+{
+	long* pSlots;
+	unsigned char* pMemo = NULL;
+	bt_states states;
+	bt_entry* pStack;
+	long nMaxStack, nSp, nPc, nPos, nFrom, nSteps = 0, nRef, nRefLen, i;
+	ulonglong uBit, uMemoBits;
+	bool bFail;
+
+	pSlots = (long*)pScratch->buffer(scratch_regex,
+						(RE_CAPTURE_SLOTS + _nSlots) * sizeof(long));
+
+	states.init(pScratch, _nLiveMax);
+
+	uMemoBits = (ulonglong)_nProg * (nLen + 1);
+	if(uMemoBits <= (ulonglong)RE_MAX_MEMO_BITS)
+	{
+		pMemo = (unsigned char*)pScratch->buffer(scratch_memo, (long)(uMemoBits / 8 + 1));
+		memset(pMemo, 0, (size_t)(uMemoBits / 8 + 1));
+	}
+	nMaxStack = 256;
+	pStack = (bt_entry*)pScratch->grow(scratch_stack, nMaxStack * sizeof(bt_entry));
+
+	for(nFrom = 0; nFrom <= nLen; nFrom++)
+	{
+		nFrom = _nextStart(pLine, nLen, nFrom);
+		if(nFrom == -1)
+			break;
+		for(i=0; i<RE_CAPTURE_SLOTS + _nSlots; i++)
+			pSlots[i] = -1;
+
+		nSp = 0;
+		pStack[nSp].nPc = 0;
+		pStack[nSp].nVal = nFrom;
+		nSp++;
+		while(nSp)
+		{
+			nSp--;
+			if(pStack[nSp].nPc < 0)
+			{
+				pSlots[-pStack[nSp].nPc - 1] = pStack[nSp].nVal;
+				continue;
+			}
+			nPc	 = pStack[nSp].nPc;
+			nPos = pStack[nSp].nVal;
+
+			for(bFail = false; !bFail; )
+			{
+				if(++nSteps > RE_STEP_BUDGET)
+				{
+					_giveUpLock.lock();
+					_nGiveUps++;
+					_giveUpLock.unlock();
+					return false;
+				}
+				if(pMemo && !_pLive[nPc])
+				{
+					uBit = (ulonglong)nPc * (nLen + 1) + nPos;
+					if(pMemo[uBit >> 3] & (1 << (uBit & 7)))
+						break;
+					pMemo[uBit >> 3] |= (unsigned char)(1 << (uBit & 7));
+				}
+				// room for the two entries an instruction may push
+				if(nSp + 2 > nMaxStack)
+				{
+					nMaxStack *= 2;
+					pStack = (bt_entry*)pScratch->grow(scratch_stack, nMaxStack * sizeof(bt_entry));
+				}
+
+				const inst& in = _prog[nPc];
+				switch(in.op)
+				{
+				case op_char:
+				case op_any:
+				case op_class:
+					i = _consume(in, pLine, nLen, nPos);
+					if(i == 0)
+						bFail = true;
+					nPos += i;
+					nPc++;
+					break;
+				case op_backref:
+					nRef = pSlots[2 * in.n];
+					nRefLen = pSlots[2 * in.n + 1] - nRef;
+					if(nRef < 0 || nRefLen < 0 || nRefLen > nLen - nPos)
+					{
+						bFail = true;
+						break;
+					}
+					if(_bNoCase)
+					{
+						for(i=0; i<nRefLen; i++)
+						{
+							if(_foldByte((unsigned char)pLine[nRef + i]) !=
+							   _foldByte((unsigned char)pLine[nPos + i]))
+								break;
+						}
+						bFail = (i < nRefLen);
+					}
+					else
+						bFail = (memcmp(pLine + nRef, pLine + nPos, nRefLen) != 0);
+					nPos += nRefLen;
+					nPc++;
+					break;
+				case op_match:
+					*pStart	= nFrom;
+					*pEnd	= nPos;
+					return true;
+				case op_jmp:
+					nPc = in.x;
+					break;
+				case op_split:
+					if(_pLive[nPc] && states.seen(nPc, nPos, pSlots, _pLive[nPc]))
+					{
+						bFail = true;
+						break;
+					}
+					pStack[nSp].nPc = in.y;
+					pStack[nSp].nVal = nPos;
+					nSp++;
+					nPc = in.x;
+					break;
+				case op_save:
+				case op_mark:
+					i = (in.op == op_save ? in.n : RE_CAPTURE_SLOTS + in.n);
+					pStack[nSp].nPc = -i - 1;
+					pStack[nSp].nVal = pSlots[i];
+					nSp++;
+					pSlots[i] = nPos;
+					nPc++;
+					break;
+				case op_progress:
+					if(pSlots[RE_CAPTURE_SLOTS + in.n] == nPos)
+						nPc = in.x;
+					else
+						nPc++;
+					break;
+				default:
+					bFail = !_assert(in, pLine, nLen, nPos);
+					nPc++;
+					break;
+				}
+			}
+		}
+	}
+	return false;
+}
@@ -0,0 +1,119 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_regex.h - basic and extended regular expressions (re.txt).
+//
+// A pattern is parsed into a tree and compiled into a small program
+// of match instructions. Counted repetition (\{m,n\}, {m,n}) is
+// unrolled into the program, which therefore grows linearly with
+// the counts and never with their product of choices.
+//
+// Patterns without back references run on a Pike VM: all the
+// threads of the program advance through the line together, one
+// per instruction at most, so a line costs O(length * program size)
+// whatever the pattern. The match is the leftmost-longest one.
+//
+// Back references can't be matched that way, since the text a
+// thread must match depends on what it captured. Those patterns
+// run on a backtracker that remembers the states that have failed,
+// with what the referenced groups captured where that matters, so
+// no state is tried twice; a line also gets a fixed budget of steps.
+// A line that runs out of steps is taken as not matching, and
+// counted (giveUps()).
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_regex_inc_
+#define _grep_regex_inc_
+
+#include "grep.h"
+#include "grep_scratch.h"
+#include "grep_arena.h"
+#include "grep_thread.h"
+
+// Largest count allowed in an interval
+const long RE_MAX_COUNT			= 255;
+// Largest compiled program, in instructions
+const long RE_MAX_PROGRAM		= 32768;
+// Backtracking steps a line may take before it is given up on
+const long RE_STEP_BUDGET		= 4 * 1024 * 1024;
+
+class grep_regex
+{
+public:
+	grep_regex();
+	~grep_regex();
+
+	void reset();
+	// Compiles the pattern; bExtended for -E syntax. Returns false,
+	// with a message in *ppError, if the pattern is not valid.
+	bool init( LPCSTR pPattern, long nLen, bool bExtended, bool caseSensitive,
+			   bool matchWholeWord, bool matchEntireLine, LPCSTR* ppError = NULL );
+	// Returns true if the pattern matches the line. The match state
+	// lives in pScratch.
+	bool match( LPCSTR pLine, long nLineLen, long* pMatchStart, long* pMatchLength,
+				grep_scratch* pScratch ) const;
+
+	// Checks the syntax of a pattern; NULL if it is valid, else
+	// the reason it is not
+	static LPCSTR check(LPCSTR pPattern, long nLen, bool bExtended);
+
+	// Lines given up on for running out of backtracking steps
+	long giveUps() const	{ return _nGiveUps; }
+
+	void addStats(grep_alloc_stats* pStats) const	{ _mem.addStats(pStats); }
+
+public:
+	// one program instruction
+	struct inst
+	{
+		unsigned char	op;
+		unsigned char	c;		// the byte of a char instruction
+		unsigned short	n;		// group, or empty-loop slot
+		long			x;		// jump target, or class index
+		long			y;		// second split target
+	};
+	// one bracket expression
+	struct charclass
+	{
+		unsigned char	bits[32];	// bytes below 0x80 it matches
+		long			nFirstRange;
+		long			nRanges;	// non-ASCII code point ranges
+		bool			bNegate;
+	};
+	struct range
+	{
+		unsigned long	lo, hi;
+	};
+
+private:
+	inst*		_prog;
+	long		_nProg;
+	charclass*	_classes;
+	range*		_ranges;
+	long		_nSlots;		// empty-loop slots (backtracker)
+	bool		_bNoCase;
+	bool		_bBackrefs;
+	ulong*		_pLive;			// per instruction: capture slots a back
+								// reference ahead may read (backtracker)
+	long		_nLiveMax;		// most slots live at one instruction
+	int			_nFirstByte;	// byte every match starts with, or -1
+	int			_nStartOp;		// assertion every match starts with, or -1
+	long		_nMinLen;		// fewest bytes a match can have
+	_boyer_moore_* _pMust;		// a literal every match contains, or NULL
+	grep_arena	_mem;
+
+	mutable grep_mutex	_giveUpLock;
+	mutable long		_nGiveUps;
+
+private:
+	struct pike_list;
+	long _consume(const inst& in, LPCSTR pLine, long nLen, long nPos) const;
+	bool _assert(const inst& in, LPCSTR pLine, long nLen, long nPos) const;
+	long _nextStart(LPCSTR pLine, long nLen, long nPos) const;
+	bool _pike( LPCSTR pLine, long nLen, long* pStart, long* pEnd,
+				grep_scratch* pScratch ) const;
+	void _addThread( pike_list* pList, long* pStack, long nPc, long nStart,
+					 LPCSTR pLine, long nLen, long nAt ) const;
+	bool _backtrack( LPCSTR pLine, long nLen, long* pStart, long* pEnd,
+					 grep_scratch* pScratch ) const;
+};
+
+#endif	// _grep_regex_inc_
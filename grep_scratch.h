@@ -0,0 +1,73 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_scratch.h - per-thread working memory for the matchers.
+// The compiled patterns are only read while matching; everything
+// a match writes goes into a grep_scratch, so one compiled set
+// can serve several threads, each with its own scratch.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_scratch_inc_
+#define _grep_scratch_inc_
+
+#include "grep.h"
+
+// Scratch buffers, one per user
+enum grep_scratch_slot
+{
+	scratch_fold,		// case-folded copy of the line
+	scratch_wildcard,	// wildcard scan state
+	scratch_block,		// next match of each pattern in a block
+	scratch_regex,		// regex threads, or captures
+	scratch_memo,		// failed states of the regex backtracker
+	scratch_states,		// ... and those that depend on the captures
+	scratch_stack,		// regex backtracking stack
+	scratch_fuzzy,		// edit distances of the fuzzy search
+	SCRATCH_SLOTS
+};
+
+class grep_scratch
+{
+public:
+	grep_scratch()
+	{
+		for(int i=0; i<SCRATCH_SLOTS; i++)
+		{
+			_bufs[i] = NULL;
+			_sizes[i] = 0;
+		}
+	}
+	~grep_scratch()
+	{
+		for(int i=0; i<SCRATCH_SLOTS; i++)
+			free(_bufs[i]);
+	}
+
+	// Returns a buffer of at least nBytes; it only grows, and its
+	// contents are not kept when it does
+	void* buffer(grep_scratch_slot slot, long nBytes)
+	{
+		if(_sizes[slot] < nBytes)
+		{
+			free(_bufs[slot]);
+			_sizes[slot] = (nBytes > 2 * _sizes[slot] ? nBytes : 2 * _sizes[slot]);
+			_bufs[slot] = malloc(_sizes[slot]);
+		}
+		return _bufs[slot];
+	}
+
+	// buffer() that keeps the contents when it grows
+	void* grow(grep_scratch_slot slot, long nBytes)
+	{
+		if(_sizes[slot] < nBytes)
+		{
+			_sizes[slot] = (nBytes > 2 * _sizes[slot] ? nBytes : 2 * _sizes[slot]);
+			_bufs[slot] = realloc(_bufs[slot], _sizes[slot]);
+		}
+		return _bufs[slot];
+	}
+
+private:
+	void*	_bufs[SCRATCH_SLOTS];
+	long	_sizes[SCRATCH_SLOTS];
+};
+
+#endif	// _grep_scratch_inc_
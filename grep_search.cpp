@@ -3,16 +3,23 @@
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
 #include "grep_search.h"
+#include "grep_utf8.h"
+#include "grep_input.h"
+#include "grep_cache.h"
 
 grep_search::grep_search()
 {
 	_searchType		= search_regex;
 	_patternCount	= 0;
 	_arExact		= NULL;
-	_arWild			= NULL;
-	_arPhonetic		= NULL;
+	_pExactLen		= NULL;
 	_arRegex		= NULL;
-	_arFullRegex	= NULL;
+	_arFuzzy		= NULL;
+	_bFoldUtf8		= false;
+	_bWholeWord		= false;
+	_bEntireLine	= false;
+	_pCacheMap		= NULL;
+	_nCacheMapLen	= 0;
 }
 
 grep_search::~grep_search()
@@ -23,67 +30,325 @@ grep_search::~grep_search()
 void grep_search::reset()
 {
 	delete[] _arExact;
-	delete[] _arWild;
-	delete[] _arPhonetic;
+	delete[] _pExactLen;
+	_wild.reset();
+	_phonetic.reset();
 	delete[] _arRegex;
-	delete[] _arFullRegex;
+	delete[] _arFuzzy;
 
 	_arExact		= NULL;
-	_arWild			= NULL;
-	_arPhonetic		= NULL;
+	_pExactLen		= NULL;
 	_arRegex		= NULL;
-	_arFullRegex	= NULL;
+	_arFuzzy		= NULL;
 	_searchType		= search_regex;
 	_patternCount	= 0;
+	_bFoldUtf8		= false;
+	_bWholeWord		= false;
+	_bEntireLine	= false;
+	_foldedPatterns.clear();
+
+	grep_input::unmapFile(_pCacheMap, _nCacheMapLen);
+	_pCacheMap		= NULL;
+	_nCacheMapLen	= 0;
 }
 
 void grep_search::init( grep_search_type searchType,
-						_string_array_* patterns,
+						const grep_pattern_list* patterns,
 						bool caseSensitive,
 						bool matchWholeWord,
-						bool matchEntireLine )
+						bool matchEntireLine,
+						long nFuzzyEdits )
 {
-	int i;
+	int   i;
+	char* pFolded;
 
 	reset();
 	
 	_searchType = searchType;
 	_patternCount = patterns->length();
+	_bWholeWord = matchWholeWord;
+	_bEntireLine = matchEntireLine;
+
+	// The engines only know ASCII case rules. For case-insensitive
+	// searches with non-ASCII patterns, fold the patterns here and
+	// the non-ASCII lines in match(). Phonetic patterns are ASCII.
+	// Regexes fold their own patterns: folding the escapes would
+	// change them (\W to \w).
+	if(!caseSensitive && searchType != search_phonetic)
+	{
+		for(i=0; i<_patternCount; i++)
+		{
+			if(!utf8_isAscii(patterns->get(i), patterns->lengthOf(i)))
+				_bFoldUtf8 = true;
+		}
+	}
+	if(_bFoldUtf8 && searchType != search_regex && searchType != search_full_regex)
+	{
+		for(i=0; i<_patternCount; i++)
+		{
+			// folding keeps the length: fold the list's own copy
+			_foldedPatterns.append(patterns->get(i), patterns->lengthOf(i));
+			pFolded = (char*)_foldedPatterns.get(i);
+			utf8_foldCase(pFolded, patterns->lengthOf(i));
+		}
+		patterns = &_foldedPatterns;
+	}
 
 	switch(_searchType)
 	{
 	case search_exact:
+		// -w and -x are checked here (see _findExact), the engine
+		// only finds the pattern
 		_arExact = new _boyer_moore_[_patternCount];
+		_pExactLen = new long[_patternCount];
 		for(i=0; i<_patternCount; i++)
-			_arExact[i].initPattern( patterns->get(i), caseSensitive,
-									 matchWholeWord, matchEntireLine );
+		{
+			_arExact[i].initPattern( patterns->get(i), caseSensitive, false, false );
+			_pExactLen[i] = patterns->lengthOf(i);
+		}
 		break;
 	case search_wildcard:
-		_arWild = new _wildcard_search_[_patternCount];
-		for(i=0; i<_patternCount; i++)
-			_arWild[i].initPattern( patterns->get(i), caseSensitive,
-									matchWholeWord, matchEntireLine );
+		// -w does not apply to wildcard searches
+		_wild.init( patterns, caseSensitive, matchEntireLine );
 		break;
 	case search_phonetic:
-		_arPhonetic = new _soundex_[_patternCount];
-		for(i=0; i<_patternCount; i++)
-			_arPhonetic[i].initPattern( patterns->get(i), matchEntireLine );
+		_phonetic.init( patterns, matchEntireLine );
 		break;
 	case search_regex:
-		_arRegex = new _regex_[_patternCount];
+	case search_full_regex:
+		// the options have dropped the patterns that don't compile
+		if(_patternCount <= 0)
+			break;
+		_arRegex = new grep_regex[(size_t)_patternCount];
 		for(i=0; i<_patternCount; i++)
-			_arRegex[i].initPattern( patterns->get(i), false,
-									 caseSensitive, matchEntireLine );
+			_arRegex[i].init( patterns->get(i), patterns->lengthOf(i),
+							  _searchType == search_full_regex, caseSensitive,
+							  matchWholeWord, matchEntireLine );
 		break;
-	case search_full_regex:
-		_arFullRegex = new _regex_[_patternCount];
+	case search_fuzzy:
+		if(_patternCount <= 0)
+			break;
+		_arFuzzy = new grep_fuzzy[(size_t)_patternCount];
 		for(i=0; i<_patternCount; i++)
-			_arFullRegex[i].initPattern( patterns->get(i), true,
-										 caseSensitive, matchEntireLine );
+			_arFuzzy[i].init( patterns->get(i), patterns->lengthOf(i), nFuzzyEdits,
+							  caseSensitive, matchWholeWord, matchEntireLine );
 		break;
 	}
 }
 
+long grep_search::regexGiveUps() const
+{
+	long nGiveUps = 0;
+	int  i;
+
+	if(_arRegex)
+	{
+		for(i=0; i<_patternCount; i++)
+			nGiveUps += _arRegex[i].giveUps();
+	}
+	return nGiveUps;
+}
+
+void grep_search::addStats(grep_alloc_stats* pStats) const
+{
+	_foldedPatterns.addStats(pStats);
+	_wild.addStats(pStats);
+	_phonetic.addStats(pStats);
+	// the exact, regex and fuzzy objects are one array each, and
+	// the exact pattern lengths another
+	if(_arExact || _arRegex || _arFuzzy)
+	{
+		pStats->uAllocs++;
+		pStats->uHeapBlocks++;
+	}
+	if(_pExactLen)
+	{
+		pStats->uAllocs++;
+		pStats->uHeapBlocks++;
+	}
+	if(_arRegex)
+	{
+		for(int i=0; i<_patternCount; i++)
+			_arRegex[i].addStats(pStats);
+	}
+	if(_arFuzzy)
+	{
+		for(int i=0; i<_patternCount; i++)
+			_arFuzzy[i].addStats(pStats);
+	}
+}
+
+bool grep_search::canSearchBlocks() const
+{
+	return (_searchType == search_exact && !_bEntireLine && !_bFoldUtf8);
+}
+
+//----------------------------------------------------------------
+// Each pattern is searched for through the rest of the block once;
+// where its next match is stays in the scratch until the search
+// passes it, so patterns that don't occur cost one scan per block.
+//----------------------------------------------------------------
+long grep_search::findInBlock( LPCSTR pBlock, long nLen, long nFrom,
+							   grep_scratch* pScratch ) const
+{
+	long* pNext;		// per pattern: next match, -1 none, -2 not searched
+	long  nStart, nMatchLen, nFirst = -1;
+	int   i;
+
+	if(pScratch == NULL)
+		pScratch = &_scratch;
+	pNext = (long*)pScratch->buffer(scratch_block, _patternCount * sizeof(long));
+
+	for(i=0; i<_patternCount; i++)
+	{
+		if(nFrom == 0 || (pNext[i] != -1 && pNext[i] < nFrom))
+		{
+			if(_findExact(i, pBlock + nFrom, nLen - nFrom, &nStart, &nMatchLen))
+				pNext[i] = nFrom + nStart;
+			else
+				pNext[i] = -1;
+		}
+		if(pNext[i] != -1 && (nFirst == -1 || pNext[i] < nFirst))
+			nFirst = pNext[i];
+	}
+	return nFirst;
+}
+
+//----------------------------------------------------------------
+// match() returns the first pattern, in pattern order, that matches
+// anywhere in the text; a match of another pattern before it would
+// be passed over. Here each pattern's next match is kept in the
+// scratch as in findInBlock, and the one that starts first wins;
+// of those starting at the same place, the longest. With -i and
+// non-ASCII text, the whole block is folded once, on nFrom 0.
+//----------------------------------------------------------------
+bool grep_search::matchInBlock( LPCSTR pBlock, long nLen, long nFrom, long* pMatchPatIndex,
+								long* pMatchStart, long* pMatchLength,
+								grep_scratch* pScratch ) const
+{
+	long* pNext;		// per pattern: start and length of the next match,
+						// start -1 none; then whether the block is folded
+	long  nStart, nLength;
+	int   i, nBest = -1;
+
+	if(pScratch == NULL)
+		pScratch = &_scratch;
+	pNext = (long*)pScratch->buffer(scratch_block, (2 * _patternCount + 1) * sizeof(long));
+
+	if(nFrom == 0)
+		pNext[2 * _patternCount] = ( _bFoldUtf8 && !utf8_isAscii(pBlock, nLen) );
+	if(pNext[2 * _patternCount])
+	{
+		// the fold buffer still holds the block folded on nFrom 0
+		if(nFrom == 0)
+			pBlock = _foldLine(pBlock, nLen, pScratch);
+		else
+			pBlock = (LPCSTR)pScratch->buffer(scratch_fold, nLen + 1);
+	}
+
+	for(i=0; i<_patternCount; i++)
+	{
+		if(nFrom == 0 || (pNext[2*i] != -1 && pNext[2*i] < nFrom))
+		{
+			if(_matchOne(i, pBlock + nFrom, nLen - nFrom, &nStart, &nLength, pScratch))
+			{
+				pNext[2*i]	 = nFrom + nStart;
+				pNext[2*i+1] = nLength;
+			}
+			else
+				pNext[2*i] = -1;
+		}
+		if( pNext[2*i] != -1 &&
+			(nBest == -1 || pNext[2*i] < pNext[2*nBest] ||
+			 (pNext[2*i] == pNext[2*nBest] && pNext[2*i+1] > pNext[2*nBest+1])) )
+			nBest = i;
+	}
+	if(nBest == -1)
+		return false;
+	if(pMatchPatIndex)	*pMatchPatIndex	= nBest;
+	if(pMatchStart)		*pMatchStart	= pNext[2*nBest];
+	if(pMatchLength)	*pMatchLength	= pNext[2*nBest+1];
+	return true;
+}
+
+//----------------------------------------------------------------
+// Flat block: a header, then the engine's own block
+//----------------------------------------------------------------
+struct search_block
+{
+	long	nSearchType;
+	long	nPatternCount;
+	long	bFoldUtf8;
+	long	nReserved;
+};
+
+bool grep_search::canSave(grep_search_type searchType)
+{
+	return (searchType == search_wildcard || searchType == search_phonetic);
+}
+
+long grep_search::saveSize() const
+{
+	long nSize = cache_align(sizeof(search_block));
+
+	switch(_searchType)
+	{
+	case search_wildcard:	nSize += _wild.saveSize();		break;
+	case search_phonetic:	nSize += _phonetic.saveSize();	break;
+	default:				break;
+	}
+	return nSize;
+}
+
+void grep_search::save(char* pOut) const
+{
+	search_block* pBlock = (search_block*)pOut;
+
+	memset(pBlock, 0, sizeof(search_block));
+	pBlock->nSearchType		= _searchType;
+	pBlock->nPatternCount	= _patternCount;
+	pBlock->bFoldUtf8		= _bFoldUtf8;
+
+	pOut += cache_align(sizeof(search_block));
+	switch(_searchType)
+	{
+	case search_wildcard:	_wild.save(pOut);		break;
+	case search_phonetic:	_phonetic.save(pOut);	break;
+	default:				break;
+	}
+}
+
+bool grep_search::load(const char* pData, long nLen, char* pMap, long nMapLen)
+{
+	const search_block* pBlock = (const search_block*)pData;
+	bool bLoaded = false;
+
+	reset();
+	if(nLen < cache_align(sizeof(search_block)))
+		return false;
+
+	_searchType		= (grep_search_type)pBlock->nSearchType;
+	_patternCount	= pBlock->nPatternCount;
+	_bFoldUtf8		= (pBlock->bFoldUtf8 != 0);
+	pData += cache_align(sizeof(search_block));
+	nLen  -= cache_align(sizeof(search_block));
+
+	switch(_searchType)
+	{
+	case search_wildcard:	bLoaded = _wild.load(pData, nLen);		break;
+	case search_phonetic:	bLoaded = _phonetic.load(pData, nLen);	break;
+	default:				break;
+	}
+	if(!bLoaded)
+	{
+		reset();
+		return false;
+	}
+	_pCacheMap		= pMap;
+	_nCacheMapLen	= nMapLen;
+	return true;
+}
+
 //----------------------------------------------------------------
 // Attempt to match the line against any of the supplied patterns.
 // Return true if found a match, false if not.
@@ -91,21 +356,28 @@ void grep_search::init( grep_search_type searchType,
 // pMatchPatIndex	- the index of the pattern that matched
 // pMatchStart		- the starting index of match in the line
 // pMatchLength		- the length of the matching substring (chars)
+// pScratch			- working memory of the calling thread (optional)
 //----------------------------------------------------------------
 bool grep_search::match( /* in */ LPCSTR pLine,
 						 /* in */  long  nLineLen,
 						 /* out */ long* pMatchPatIndex,
 						 /* out */ long* pMatchStart,
-						 /* out */ long* pMatchLength )
+						 /* out */ long* pMatchLength,
+						 /* in */  grep_scratch* pScratch ) const
 {
 	int i;
 
+	if(pScratch == NULL)
+		pScratch = &_scratch;
+	if(_bFoldUtf8 && !utf8_isAscii(pLine, nLineLen))
+		pLine = _foldLine(pLine, nLineLen, pScratch);
+
 	switch(_searchType)
 	{
 	case search_exact:
 		for(i=0; i<_patternCount; i++)
 		{
-			if( _arExact[i].match(pLine, nLineLen, pMatchStart, pMatchLength) )
+			if( _findExact(i, pLine, nLineLen, pMatchStart, pMatchLength) )
 			{
 				if(pMatchPatIndex) *pMatchPatIndex = i;
 				return true;
@@ -113,47 +385,173 @@ bool grep_search::match( /* in */ LPCSTR pLine,
 		}
 		break;
 	case search_wildcard:
+		// all the patterns are matched in one pass
+		return _wild.match(pLine, nLineLen, pMatchPatIndex, pMatchStart, pMatchLength, pScratch);
+	case search_phonetic:
+		// one code lookup per word, whatever the number of patterns
+		return _phonetic.match(pLine, nLineLen, pMatchPatIndex, pMatchStart, pMatchLength);
+	case search_regex:
+	case search_full_regex:
 		for(i=0; i<_patternCount; i++)
 		{
-			if( _arWild[i].match(pLine, nLineLen, pMatchStart, pMatchLength) )
+			if( _arRegex[i].match(pLine, nLineLen, pMatchStart, pMatchLength, pScratch) )
 			{
 				if(pMatchPatIndex) *pMatchPatIndex = i;
 				return true;
 			}
 		}
 		break;
-	case search_phonetic:
+	case search_fuzzy:
 		for(i=0; i<_patternCount; i++)
 		{
-			if( _arPhonetic[i].match(pLine, nLineLen, pMatchStart, pMatchLength) )
+			if( _arFuzzy[i].match(pLine, nLineLen, pMatchStart, pMatchLength, pScratch) )
 			{
 				if(pMatchPatIndex) *pMatchPatIndex = i;
 				return true;
 			}
 		}
 		break;
-	case search_regex:
-		for(i=0; i<_patternCount; i++)
+	
+	} // switch(_searchType)
+	
+	return false;
+}
+
+//----------------------------------------------------------------
+// match() with the statistics of --stats. The wildcard and phonetic
+// sets match all their patterns in one pass: their time is the
+// set's, and only the pattern they report is counted.
+//----------------------------------------------------------------
+bool grep_search::matchStats( /* in */ LPCSTR pLine,
+							  /* in */  long  nLineLen,
+							  /* in */  bool  bAll,
+							  /* in */  grep_pattern_stats* pStats,
+							  /* out */ long* pMatchPatIndex,
+							  /* out */ long* pMatchStart,
+							  /* out */ long* pMatchLength,
+							  /* in */  grep_scratch* pScratch ) const
+{
+	ulonglong uStart;
+	long nPat, nStart, nLength;
+	bool bMatched = false;
+	int  i;
+
+	if(_searchType == search_wildcard || _searchType == search_phonetic)
+	{
+		uStart = grep_ticks();
+		bMatched = match(pLine, nLineLen, &nPat, pMatchStart, pMatchLength, pScratch);
+		pStats->addRun(0, nLineLen, grep_ticks() - uStart);
+		if(bMatched)
+		{
+			pStats->addHit(nPat);
+			if(pMatchPatIndex) *pMatchPatIndex = nPat;
+		}
+		return bMatched;
+	}
+
+	if(pScratch == NULL)
+		pScratch = &_scratch;
+	if(_bFoldUtf8 && !utf8_isAscii(pLine, nLineLen))
+		pLine = _foldLine(pLine, nLineLen, pScratch);
+
+	for(i=0; i<_patternCount; i++)
+	{
+		uStart = grep_ticks();
+		if( _matchOne(i, pLine, nLineLen, &nStart, &nLength, pScratch) )
 		{
-			if( _arRegex[i].match(pLine, nLineLen, pMatchStart, pMatchLength) )
+			pStats->addRun(i, nLineLen, grep_ticks() - uStart);
+			pStats->addHit(i);
+			if(!bMatched)
 			{
-				if(pMatchPatIndex) *pMatchPatIndex = i;
-				return true;
+				if(pMatchPatIndex)	*pMatchPatIndex	= i;
+				if(pMatchStart)		*pMatchStart	= nStart;
+				if(pMatchLength)	*pMatchLength	= nLength;
+				bMatched = true;
 			}
+			if(!bAll)
+				break;
 		}
-		break;
+		else
+			pStats->addRun(i, nLineLen, grep_ticks() - uStart);
+	}
+	return bMatched;
+}
+
+long grep_search::engineCount() const
+{
+	if(_searchType == search_wildcard || _searchType == search_phonetic)
+		return 1;
+	return _patternCount;
+}
+
+// Pattern i's own engine object; exact, regex and fuzzy searches only
+bool grep_search::_matchOne( int i, LPCSTR pLine, long nLineLen,
+							 long* pMatchStart, long* pMatchLength,
+							 grep_scratch* pScratch ) const
+{
+	switch(_searchType)
+	{
+	case search_exact:
+		return _findExact(i, pLine, nLineLen, pMatchStart, pMatchLength);
+	case search_regex:
 	case search_full_regex:
-		for(i=0; i<_patternCount; i++)
+		return _arRegex[i].match(pLine, nLineLen, pMatchStart, pMatchLength, pScratch);
+	case search_fuzzy:
+		return _arFuzzy[i].match(pLine, nLineLen, pMatchStart, pMatchLength, pScratch);
+	default:
+		return false;
+	}
+}
+
+//----------------------------------------------------------------
+// Exact pattern i in the text, with -x or -w. With -x only a line
+// of the pattern's length can match, and only from its start. With
+// -w a find that is part of a longer word is passed over, and the
+// search goes on after the end of the word it is in: a match can
+// only start after a char that is not a word char.
+//----------------------------------------------------------------
+bool grep_search::_findExact( int i, LPCSTR pText, long nLen,
+							  long* pMatchStart, long* pMatchLength ) const
+{
+	long nFrom, nStart, nMatchLen, nEnd;
+
+	if(_bEntireLine)
+	{
+		if(nLen != _pExactLen[i])
+			return false;
+		return _arExact[i].match(pText, nLen, pMatchStart, pMatchLength);
+	}
+	if(!_bWholeWord)
+		return _arExact[i].match(pText, nLen, pMatchStart, pMatchLength);
+
+	for(nFrom = 0; nFrom <= nLen; )
+	{
+		if(!_arExact[i].match(pText + nFrom, nLen - nFrom, &nStart, &nMatchLen))
+			return false;
+		nStart += nFrom;
+		nEnd = nStart + nMatchLen;
+		if( (nStart == 0 || !utf8_isWordByte((unsigned char)pText[nStart-1])) &&
+			(nEnd == nLen || !utf8_isWordByte((unsigned char)pText[nEnd])) )
 		{
-			if( _arFullRegex[i].match(pLine, nLineLen, pMatchStart, pMatchLength) )
-			{
-				if(pMatchPatIndex) *pMatchPatIndex = i;
-				return true;
-			}
+			if(pMatchStart)		*pMatchStart	= nStart;
+			if(pMatchLength)	*pMatchLength	= nMatchLen;
+			return true;
 		}
-		break;
-	
-	} // switch(_searchType)
-	
+		nFrom = nStart + utf8_wordLength(pText + nStart, nLen - nStart) + 1;
+	}
 	return false;
 }
+
+//----------------------------------------------------------------
+// Returns a case-folded copy of the line; see utf8_foldCase().
+// The copy has the same length, so match offsets carry over.
+//----------------------------------------------------------------
+LPCSTR grep_search::_foldLine(LPCSTR pLine, long nLineLen, grep_scratch* pScratch) const
+{
+	char* pFolded = (char*)pScratch->buffer(scratch_fold, nLineLen + 1);
+
+	memcpy(pFolded, pLine, nLineLen);
+	pFolded[nLineLen] = '\0';
+	utf8_foldCase(pFolded, nLineLen);
+	return pFolded;
+}
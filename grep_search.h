@@ -9,13 +9,20 @@
 
 #include "grep.h"
 #include "grep_options.h"
+#include "grep_wildcard.h"
+#include "grep_soundex.h"
+#include "grep_scratch.h"
+#include "grep_patterns.h"
+#include "grep_stats.h"
+#include "grep_regex.h"
+#include "grep_fuzzy.h"
 
 // The classes used in the five supported search types:
 // _boyer_moore_	 - exact searches
-// _wildcard_search_ - simple wildcard (* and ?) searches
-// _soundex_		 - soundex (phonetic) searches
-// _regex_			 - basic regular expression searches
-// _full_regex_		 - full (extended) regular expression searches
+// grep_wildcard_set - simple wildcard (* and ?) searches
+// grep_soundex_set - soundex (phonetic) searches
+// grep_regex		 - basic and full (extended) regular expression searches
+// grep_fuzzy		 - approximate searches
 
 
 // Command line options that apply to exact search:
@@ -23,15 +30,28 @@
 // -x: options.bMatchEntireLine
 // -w: options.bTreatAsWord
 
+// Command line options that apply to wildcard search:
+// -i: options.bNoCase
+// -x: options.bMatchEntireLine
+
 // Command line options that apply to soundex search:
 // -x: options.bMatchEntireLine
 
-// Command line options that apply to basic regex search:
-//
+// Command line options that apply to basic and full regex search:
+// -i: options.bNoCase
+// -x: options.bMatchEntireLine
+// -w: options.bTreatAsWord
 
-// Command line options that apply to full regex search:
-//
+// Command line options that apply to fuzzy search:
+// --fuzzy=K: options.nFuzzyEdits
+// -i: options.bNoCase
+// -x: options.bMatchEntireLine
+// -w: options.bTreatAsWord
 
+// Once init() has returned, match() only reads the search objects;
+// what it writes goes into the scratch it is given. Threads sharing
+// one grep_search need a grep_scratch each. Without one, match()
+// uses the object's own scratch and is not reentrant.
 class grep_search
 {
 public:
@@ -39,23 +59,90 @@ public:
 	~grep_search();
 
 	void reset();
-	void init ( grep_search_type searchType, _string_array_* patterns,
-				bool caseSensitive, bool matchWholeWord, bool matchEntireLine );
+	// nFuzzyEdits: the edits a fuzzy match may have
+	void init ( grep_search_type searchType, const grep_pattern_list* patterns,
+				bool caseSensitive, bool matchWholeWord, bool matchEntireLine,
+				long nFuzzyEdits = 0 );
 	// matches the line against any of the specified patterns
 	bool match( LPCSTR pLine, long nLineLen, long* pMatchPatIndex,
-				long* pMatchStart, long* pMatchLength );
+				long* pMatchStart, long* pMatchLength,
+				grep_scratch* pScratch = NULL ) const;
+
+	// match() for --stats: times each engine object run on the line
+	// and counts the pattern that matched, or with bAll every one.
+	// The match reported is the first, as match() would report it.
+	bool matchStats( LPCSTR pLine, long nLineLen, bool bAll, grep_pattern_stats* pStats,
+					 long* pMatchPatIndex, long* pMatchStart, long* pMatchLength,
+					 grep_scratch* pScratch = NULL ) const;
+	// Number of engine objects: one per pattern, or one for the set
+	long engineCount() const;
+
+	// Searches that can look for matches in many lines at once
+	// (exact, without -x or non-ASCII folding) can use findInBlock:
+	// it returns the offset of the first match at or after nFrom in
+	// a block of whole lines, or -1. nFrom 0 starts a new block;
+	// after that nFrom must only grow.
+	bool canSearchBlocks() const;
+	long findInBlock( LPCSTR pBlock, long nLen, long nFrom,
+					  grep_scratch* pScratch = NULL ) const;
+	// For --multiline: the leftmost match of any pattern at or after
+	// nFrom in a block of whole lines, with the same calling rules as
+	// findInBlock. pMatchStart is from the start of the block.
+	// Exact, regex and fuzzy searches only.
+	bool matchInBlock( LPCSTR pBlock, long nLen, long nFrom, long* pMatchPatIndex,
+					   long* pMatchStart, long* pMatchLength,
+					   grep_scratch* pScratch = NULL ) const;
+
+	grep_search_type searchType() const	{ return _searchType; }
+	int patternCount() const			{ return _patternCount; }
+	// allocations made compiling the patterns
+	void addStats(grep_alloc_stats* pStats) const;
+	// lines the regex backtracker gave up on (see grep_regex.h)
+	long regexGiveUps() const;
+
+	// The compiled searcher as one flat block, for the compile cache
+	// (grep_cache.h). Only the wildcard and phonetic sets are saved;
+	// a regex (grep_regex) is compiled again, as its required literal
+	// is a _boyer_moore_, which has no flat form. load() takes over
+	// the file mapping the block is in.
+	static bool canSave(grep_search_type searchType);
+	long saveSize() const;
+	void save(char* pOut) const;
+	bool load(const char* pData, long nLen, char* pMap, long nMapLen);
 
 private:
 	grep_search_type	_searchType;
 	int					_patternCount;
 
+	// With -i and non-ASCII patterns, the patterns are case-folded
+	// once here, and non-ASCII lines are folded into the scratch
+	bool				_bFoldUtf8;
+	bool				_bWholeWord;	// -w
+	bool				_bEntireLine;	// -x
+	grep_pattern_list	_foldedPatterns;
+
+	mutable grep_scratch _scratch;	// for callers without a scratch
+
+	// cache file mapping the engines use (see load)
+	char*				_pCacheMap;
+	long				_nCacheMapLen;
+
 	// Search objects arrays
 	// which one of them is used depends on the search type
 	_boyer_moore_*		_arExact;
-	_wildcard_search_*	_arWild;
-	_soundex_*			_arPhonetic;
-	_regex_*			_arRegex;
-	_regex_*			_arFullRegex;
+	long*				_pExactLen;	// length of each exact pattern
+	grep_wildcard_set	_wild;		// all the wildcard patterns in one object
+	grep_soundex_set	_phonetic;	// all the phonetic patterns in one object
+	grep_regex*			_arRegex;	// basic or full, one per pattern
+	grep_fuzzy*			_arFuzzy;
+
+private:
+	LPCSTR _foldLine(LPCSTR pLine, long nLineLen, grep_scratch* pScratch) const;
+	bool _findExact( int i, LPCSTR pText, long nLen,
+					 long* pMatchStart, long* pMatchLength ) const;
+	bool _matchOne( int i, LPCSTR pLine, long nLineLen,
+					long* pMatchStart, long* pMatchLength,
+					grep_scratch* pScratch ) const;
 };
 
 #endif	// _grep_search_inc_
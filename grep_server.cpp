@@ -0,0 +1,617 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_server.cpp - implementation of grep_server and the client
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#define GREP_HAVE_INOTIFY
+#endif
+#endif
+
+#include "grep_server.h"
+#include "grep_options.h"
+#include "grep_output.h"
+#include "grep_dirlist.h"
+
+// Request header sent by the client
+static const char SERVER_MAGIC[] = "GREP1";
+// Biggest request accepted
+static const long SERVER_MAX_REQUEST = 1024 * 1024;
+// Most arguments in a request
+static const int  SERVER_MAX_ARGS = 4096;
+
+grep_server* g_pServer = NULL;
+
+
+#ifdef _WIN32
+
+grep_server::grep_server()	{ _nSearchers = _nListings = 0; _nNotify = -1; _uClock = 0; }
+grep_server::~grep_server()	{}
+int grep_server::serve(LPCTSTR)	{ return RTN_ERROR; }
+grep_search* grep_server::searcher(grep_options&)	{ return &g_searcher; }
+bool grep_server::listFiles(LPCTSTR, bool, _string_array_*)	{ return false; }
+void grep_server::_handle(int)			{}
+void grep_server::_checkChanges()		{}
+void grep_server::_dropListing(int)		{}
+bool grep_send_frame(int, char, const void*, long)	{ return false; }
+
+int GrepServe(LPCTSTR)
+{
+	g_stdout.writeString("grep: The server mode needs Unix domain sockets; not available on Windows\r\n");
+	return RTN_ERROR;
+}
+
+int GrepClient(LPCTSTR, int, char**)
+{
+	g_stdout.writeString("grep: The server mode needs Unix domain sockets; not available on Windows\r\n");
+	return RTN_ERROR;
+}
+
+#else	// !_WIN32
+
+//----------------------------------------------------------------
+// Socket helpers
+//----------------------------------------------------------------
+static bool _sendAll(int nSocket, const void* pData, long nLen)
+{
+	const char* pc = (const char*)pData;
+	long n;
+
+	while(nLen > 0)
+	{
+		n = (long)send(nSocket, pc, nLen, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return false;
+		pc += n;
+		nLen -= n;
+	}
+	return true;
+}
+
+// Reads exactly nLen bytes; false on end of stream or error
+static bool _recvAll(int nSocket, void* pData, long nLen)
+{
+	char* pc = (char*)pData;
+	long n;
+
+	while(nLen > 0)
+	{
+		n = (long)recv(nSocket, pc, nLen, 0);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return false;
+		pc += n;
+		nLen -= n;
+	}
+	return true;
+}
+
+static bool _socketAddress(LPCTSTR pszSocket, struct sockaddr_un* pAddr)
+{
+	memset(pAddr, 0, sizeof(*pAddr));
+	pAddr->sun_family = AF_UNIX;
+	if(lstrlen(pszSocket) >= (int)sizeof(pAddr->sun_path))
+	{
+		g_stdout.writeFormatted("grep: Socket path too long: %s\r\n", pszSocket);
+		return false;
+	}
+	lstrcpy(pAddr->sun_path, pszSocket);
+	return true;
+}
+
+bool grep_send_frame(int nSocket, char cType, const void* pData, long nLen)
+{
+	unsigned char hdr[5];
+	int i;
+
+	hdr[0] = (unsigned char)cType;
+	for(i=0; i<4; i++)
+		hdr[i+1] = (unsigned char)(nLen >> (8*i));
+	return _sendAll(nSocket, hdr, sizeof(hdr)) && _sendAll(nSocket, pData, nLen);
+}
+
+
+//----------------------------------------------------------------
+// grep_server
+//----------------------------------------------------------------
+grep_server::grep_server()
+{
+	_nSearchers	= 0;
+	_nListings	= 0;
+	_uClock		= 0;
+#ifdef GREP_HAVE_INOTIFY
+	_nNotify	= inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+	_nNotify	= -1;
+#endif
+}
+
+grep_server::~grep_server()
+{
+	int i;
+
+	for(i=0; i<_nSearchers; i++)
+	{
+		delete _searchers[i].pSearch;
+		free(_searchers[i].pKey);
+	}
+	while(_nListings)
+		_dropListing(_nListings - 1);
+	if(_nNotify != -1)
+		close(_nNotify);
+}
+
+int grep_server::serve(LPCTSTR pszSocket)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int nListen, nClient;
+	mode_t oldMask;
+
+	if(!_socketAddress(pszSocket, &addr))
+		return RTN_ERROR;
+
+	// a stale socket from an earlier server is replaced; anything else isn't
+	if(lstat(pszSocket, &st) == 0)
+	{
+		if(!S_ISSOCK(st.st_mode))
+		{
+			g_stdout.writeFormatted("grep: \'%s\' exists and is not a socket\r\n", pszSocket);
+			return RTN_ERROR;
+		}
+		unlink(pszSocket);
+	}
+
+	nListen = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(nListen == -1)
+	{
+		g_stdout.writeString("grep: Can\'t create the server socket\r\n");
+		return RTN_ERROR;
+	}
+	// the server reads files with our rights: only we may connect
+	oldMask = umask(077);
+	if(bind(nListen, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(nListen, 64) != 0)
+	{
+		umask(oldMask);
+		g_stdout.writeFormatted("grep: Can\'t listen on \'%s\'\r\n", pszSocket);
+		close(nListen);
+		return RTN_ERROR;
+	}
+	umask(oldMask);
+	g_stdout.flush();
+
+	// one request at a time: the search itself uses the global state
+	for(;;)
+	{
+		nClient = accept(nListen, NULL, NULL);
+		if(nClient == -1)
+		{
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+		_handle(nClient);
+		close(nClient);
+	}
+
+	close(nListen);
+	unlink(pszSocket);
+	g_stdout.writeString("grep: The server stopped: accept failed\r\n");
+	return RTN_ERROR;
+}
+
+//----------------------------------------------------------------
+// Reads a request, runs it with the output going to the client,
+// and sends the exit code.
+//----------------------------------------------------------------
+void grep_server::_handle(int nClient)
+{
+	char* pRequest = (char*)malloc(SERVER_MAX_REQUEST + 1);
+	char* argv[SERVER_MAX_ARGS + 1];
+	char* pc;
+	char* pEnd;
+	long  nLen = 0, n;
+	int   argc, nRtn;
+
+	if(pRequest == NULL)
+	{
+		g_stdout.setSocket(nClient);
+		g_stdout.writeString("grep: The server is out of memory\r\n");
+		_reply(nClient, RTN_ERROR);
+		return;
+	}
+
+	// the request is complete when the client shuts down its side
+	while(nLen < SERVER_MAX_REQUEST)
+	{
+		n = (long)recv(nClient, pRequest + nLen, SERVER_MAX_REQUEST - nLen, 0);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			break;
+		nLen += n;
+	}
+	pRequest[nLen] = 0;
+	pEnd = pRequest + nLen;
+
+	if(nLen < (long)sizeof(SERVER_MAGIC) || memcmp(pRequest, SERVER_MAGIC, sizeof(SERVER_MAGIC)) ||
+	   nLen == SERVER_MAX_REQUEST || pEnd[-1] != 0)
+	{
+		free(pRequest);
+		return;		// not one of ours, or cut short
+	}
+
+	// working directory, then the arguments
+	pc = pRequest + sizeof(SERVER_MAGIC);
+	if(pc >= pEnd || chdir(pc) != 0)
+	{
+		g_stdout.setSocket(nClient);
+		g_stdout.writeFormatted("grep: The server can\'t change to \'%s\'\r\n", (pc < pEnd ? pc : ""));
+		nRtn = RTN_ERROR;
+	}
+	else
+	{
+		pc += lstrlen(pc) + 1;
+		argv[0] = (char*)"grep";
+		for(argc=1; pc < pEnd && argc < SERVER_MAX_ARGS; argc++)
+		{
+			argv[argc] = pc;
+			pc += lstrlen(pc) + 1;
+		}
+		argv[argc] = NULL;
+
+		_uClock++;
+		_checkChanges();
+		g_stdout.setSocket(nClient);
+		nRtn = GrepMain(argc, argv);
+	}
+	_reply(nClient, nRtn);
+	free(pRequest);
+}
+
+// Ends the output of a request and sends its exit code
+void grep_server::_reply(int nClient, int nRtn)
+{
+	unsigned char code[4];
+
+	g_stdout.flush();
+	g_stdout.setSocket(-1);
+
+	code[0] = (unsigned char)nRtn;
+	code[1] = code[2] = code[3] = 0;
+	grep_send_frame(nClient, 'X', code, sizeof(code));
+}
+
+//----------------------------------------------------------------
+// The searcher for the patterns and the options that affect
+// compiling them. Kept for later requests; the least recently
+// used one goes when the cache is full.
+//----------------------------------------------------------------
+grep_search* grep_server::searcher(grep_options& options)
+{
+	grep_pattern_list* pPatterns = options.patterns();
+	searcher_entry* pEntry;
+	char* pKey;
+	long  nKeyLen, nLen;
+	int   i, nOldest;
+
+	nKeyLen = 5;
+	for(i=0; i<pPatterns->length(); i++)
+		nKeyLen += pPatterns->lengthOf(i) + 1;
+	pKey = (char*)malloc(nKeyLen);
+	if(pKey == NULL)
+		return NULL;
+	pKey[0] = (char)options.searchType();
+	pKey[1] = (char)options.bNoCase;
+	pKey[2] = (char)options.bTreatAsWord;
+	pKey[3] = (char)options.bMatchEntireLine;
+	pKey[4] = (char)options.nFuzzyEdits;
+	nLen = 5;
+	for(i=0; i<pPatterns->length(); i++)
+	{
+		memcpy(pKey + nLen, pPatterns->get(i), pPatterns->lengthOf(i) + 1);
+		nLen += pPatterns->lengthOf(i) + 1;
+	}
+
+	for(i=0; i<_nSearchers; i++)
+	{
+		pEntry = &_searchers[i];
+		if(pEntry->nKeyLen == nKeyLen && !memcmp(pEntry->pKey, pKey, nKeyLen))
+		{
+			free(pKey);
+			pEntry->uLastUse = _uClock;
+			return pEntry->pSearch;
+		}
+	}
+
+	if(_nSearchers < SERVER_MAX_SEARCHERS)
+		pEntry = &_searchers[_nSearchers++];
+	else
+	{
+		nOldest = 0;
+		for(i=1; i<_nSearchers; i++)
+		{
+			if(_searchers[i].uLastUse < _searchers[nOldest].uLastUse)
+				nOldest = i;
+		}
+		pEntry = &_searchers[nOldest];
+		delete pEntry->pSearch;
+		free(pEntry->pKey);
+	}
+
+	pEntry->pKey	 = pKey;
+	pEntry->nKeyLen	 = nKeyLen;
+	pEntry->uLastUse = _uClock;
+	pEntry->pSearch	 = new grep_search;
+	pEntry->pSearch->init( options.searchType(), pPatterns, !options.bNoCase,
+						   options.bTreatAsWord, options.bMatchEntireLine,
+						   options.nFuzzyEdits );
+	return pEntry->pSearch;
+}
+
+//----------------------------------------------------------------
+// Lists the files of a spec, from the cache if no directory it
+// read has changed since. Listings whose directories can't be
+// watched aren't kept.
+//----------------------------------------------------------------
+bool grep_server::listFiles(LPCTSTR pszSpec, bool bRecursive, _string_array_* pFiles)
+{
+	_string_array_ dirs;
+	listing_entry* pEntry;
+	char  szCwd[MAX_PATH*2];
+	char* pszKey;
+	int   i, nOldest, nWatch;
+
+	if(_snapshot.wastedBytes() > SERVER_SNAPSHOT_WASTE)
+		_snapshot.reset();
+	if(_nNotify == -1 || !getcwd(szCwd, sizeof(szCwd)))
+		return grep_dir_list::list(pszSpec, bRecursive, pFiles, NULL, &_snapshot) && pFiles->length();
+
+	// without memory for the key, the listing isn't kept
+	pszKey = (char*)malloc(lstrlen(szCwd) + lstrlen(pszSpec) + 4);
+	if(pszKey == NULL)
+		return grep_dir_list::list(pszSpec, bRecursive, pFiles, NULL, &_snapshot) && pFiles->length();
+	sprintf(pszKey, "%s\n%c\n%s", szCwd, (bRecursive ? 'R' : '-'), pszSpec);
+
+	for(i=0; i<_nListings; i++)
+	{
+		pEntry = &_listings[i];
+		if(streq(pEntry->pszKey, pszKey))
+		{
+			free(pszKey);
+			pEntry->uLastUse = _uClock;
+			for(i=0; i<pEntry->pFiles->length(); i++)
+				pFiles->append(pEntry->pFiles->get(i));
+			return pFiles->length() > 0;
+		}
+	}
+
+	if(!grep_dir_list::list(pszSpec, bRecursive, pFiles, &dirs, &_snapshot) || dirs.length() == 0)
+	{
+		free(pszKey);
+		return pFiles->length() > 0;
+	}
+
+	if(_nListings == SERVER_MAX_LISTINGS)
+	{
+		nOldest = 0;
+		for(i=1; i<_nListings; i++)
+		{
+			if(_listings[i].uLastUse < _listings[nOldest].uLastUse)
+				nOldest = i;
+		}
+		_dropListing(nOldest);
+	}
+
+	pEntry = &_listings[_nListings];
+	pEntry->pszKey	 = pszKey;
+	pEntry->uLastUse = _uClock;
+	pEntry->pFiles	 = new _string_array_;
+	pEntry->pWatches = new int[dirs.length()];
+	pEntry->nWatches = 0;
+	for(i=0; i<dirs.length(); i++)
+	{
+#ifdef GREP_HAVE_INOTIFY
+		nWatch = inotify_add_watch( _nNotify, dirs[i],
+									IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+									IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR );
+#else
+		nWatch = -1;
+#endif
+		if(nWatch == -1)
+			break;		// out of watches: can't tell when it changes
+		pEntry->pWatches[pEntry->nWatches++] = nWatch;
+	}
+	_nListings++;
+	if(pEntry->nWatches < dirs.length())
+	{
+		_dropListing(_nListings - 1);
+		return pFiles->length() > 0;
+	}
+
+	for(i=0; i<pFiles->length(); i++)
+		pEntry->pFiles->append(pFiles->get(i));
+	return pFiles->length() > 0;
+}
+
+//----------------------------------------------------------------
+// Drops the listings with a directory that changed
+//----------------------------------------------------------------
+void grep_server::_checkChanges()
+{
+#ifdef GREP_HAVE_INOTIFY
+	char buf[16 * 1024];
+	const struct inotify_event* pEvent;
+	long nLen, nPos;
+	int  i, j;
+	bool bChanged;
+
+	if(_nNotify == -1)
+		return;
+	while( (nLen = (long)read(_nNotify, buf, sizeof(buf))) > 0 )
+	{
+		for(nPos=0; nPos < nLen; nPos += sizeof(struct inotify_event) + pEvent->len)
+		{
+			pEvent = (const struct inotify_event*)(buf + nPos);
+			for(i=_nListings-1; i>=0; i--)
+			{
+				// an overflow means events were lost: drop everything
+				bChanged = ((pEvent->mask & IN_Q_OVERFLOW) != 0);
+				for(j=0; j<_listings[i].nWatches && !bChanged; j++)
+					bChanged = (_listings[i].pWatches[j] == pEvent->wd);
+				if(bChanged)
+					_dropListing(i);
+			}
+		}
+	}
+#endif
+}
+
+void grep_server::_dropListing(int nIndex)
+{
+	listing_entry* pEntry = &_listings[nIndex];
+	int i, j, k;
+	bool bShared;
+
+	// remove the watches no other listing uses
+	for(j=0; j<pEntry->nWatches; j++)
+	{
+		bShared = false;
+		for(i=0; i<_nListings && !bShared; i++)
+		{
+			for(k=0; i != nIndex && k<_listings[i].nWatches && !bShared; k++)
+				bShared = (_listings[i].pWatches[k] == pEntry->pWatches[j]);
+		}
+#ifdef GREP_HAVE_INOTIFY
+		if(!bShared)
+			inotify_rm_watch(_nNotify, pEntry->pWatches[j]);
+#endif
+	}
+
+	free(pEntry->pszKey);
+	delete pEntry->pFiles;
+	delete[] pEntry->pWatches;
+	_listings[nIndex] = _listings[--_nListings];
+}
+
+
+//----------------------------------------------------------------
+// --server=SOCKET
+//----------------------------------------------------------------
+int GrepServe(LPCTSTR pszSocket)
+{
+	grep_server server;
+	int nRtn;
+
+	g_pServer = &server;
+	nRtn = server.serve(pszSocket);
+	g_pServer = NULL;
+	return nRtn;
+}
+
+//----------------------------------------------------------------
+// --client=SOCKET: sends the rest of the command line to the
+// server and writes out what comes back
+//----------------------------------------------------------------
+int GrepClient(LPCTSTR pszSocket, int argc, char* argv[])
+{
+	struct sockaddr_un addr;
+	_win32_file_ out(_win32_file_::ft_stdout);
+	char  szCwd[MAX_PATH*2];
+	char* pRequest;
+	char* pData = NULL;
+	long  nLen, nFrameLen, nDataSize = 0;
+	unsigned char hdr[5];
+	int   nSocket, i, nRtn = RTN_ERROR;
+	bool  bDone = false;
+
+	if(!_socketAddress(pszSocket, &addr))
+		return RTN_ERROR;
+	if(!getcwd(szCwd, sizeof(szCwd)))
+	{
+		g_stdout.writeString("grep: Can\'t get the current directory\r\n");
+		return RTN_ERROR;
+	}
+
+	nSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(nSocket == -1 || connect(nSocket, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		g_stdout.writeFormatted("grep: Can\'t connect to the server at \'%s\'\r\n", pszSocket);
+		if(nSocket != -1)
+			close(nSocket);
+		return RTN_ERROR;
+	}
+
+	// build and send the request
+	nLen = sizeof(SERVER_MAGIC) + lstrlen(szCwd) + 1;
+	for(i=0; i<argc; i++)
+		nLen += lstrlen(argv[i]) + 1;
+	pRequest = (char*)malloc(nLen);
+	if(pRequest == NULL)
+	{
+		g_stdout.writeString("grep: Out of memory\r\n");
+		close(nSocket);
+		return RTN_ERROR;
+	}
+	memcpy(pRequest, SERVER_MAGIC, sizeof(SERVER_MAGIC));
+	nLen = sizeof(SERVER_MAGIC);
+	memcpy(pRequest + nLen, szCwd, lstrlen(szCwd) + 1);
+	nLen += lstrlen(szCwd) + 1;
+	for(i=0; i<argc; i++)
+	{
+		memcpy(pRequest + nLen, argv[i], lstrlen(argv[i]) + 1);
+		nLen += lstrlen(argv[i]) + 1;
+	}
+	if(!_sendAll(nSocket, pRequest, nLen))
+		nLen = -1;
+	free(pRequest);
+	shutdown(nSocket, SHUT_WR);
+
+	// copy the output until the exit code comes
+	while(nLen != -1 && _recvAll(nSocket, hdr, sizeof(hdr)))
+	{
+		nFrameLen = (long)hdr[1] | ((long)hdr[2] << 8) | ((long)hdr[3] << 16) | ((long)hdr[4] << 24);
+		if(nFrameLen < 0 || nFrameLen > 64*1024*1024)
+			break;
+		if(nFrameLen > nDataSize)
+		{
+			free(pData);
+			pData = (char*)malloc(nDataSize = nFrameLen);
+			if(pData == NULL)
+			{
+				g_stdout.writeString("grep: Out of memory\r\n");
+				bDone = true;
+				break;
+			}
+		}
+		if(!_recvAll(nSocket, pData, nFrameLen))
+			break;
+		if(hdr[0] == 'D')
+			out.write(pData, nFrameLen);
+		else if(hdr[0] == 'X' && nFrameLen == 4)
+		{
+			nRtn = (unsigned char)pData[0];
+			bDone = true;
+			break;
+		}
+	}
+
+	if(!bDone)
+		g_stdout.writeString("grep: Lost the connection to the server\r\n");
+	free(pData);
+	close(nSocket);
+	return nRtn;
+}
+
+#endif	// !_WIN32
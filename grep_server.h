@@ -0,0 +1,94 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_server.h - resident server mode.
+// 'grep --server=SOCKET' stays up on a local socket; each
+// 'grep --client=SOCKET options pattern files...' hands it a
+// command line and prints what comes back. Between requests the
+// server keeps the compiled pattern sets and the directory
+// listings of the file specs, the latter checked for changes
+// with inotify. A listing that changed is made again from a
+// snapshot of the directories (grep_snapshot.h), reading only
+// those that changed. Needs Unix domain sockets; not on Windows.
+//
+// The client sends "GREP1", its working directory and its
+// arguments, each NUL-terminated, and shuts down its side. The
+// server answers with frames of a type byte, a 4-byte little
+// endian length and the data: 'D' for output, then one 'X'
+// holding the exit code.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_server_inc_
+#define _grep_server_inc_
+
+#include "grep.h"
+#include "grep_search.h"
+#include "grep_snapshot.h"
+
+class grep_options;
+
+// Pattern sets and listings kept at most
+const int SERVER_MAX_SEARCHERS	= 16;
+const int SERVER_MAX_LISTINGS	= 64;
+// Replaced directory listings the snapshot may hold before it is
+// started over
+const long SERVER_SNAPSHOT_WASTE	= 64 * 1024 * 1024;
+
+class grep_server
+{
+public:
+	grep_server();
+	~grep_server();
+
+	// Serves requests until an error; returns RTN_ERROR then
+	int serve(LPCTSTR pszSocket);
+
+	// The searcher for the options' patterns, compiled on first use;
+	// NULL if there is no memory for it
+	grep_search* searcher(grep_options& options);
+	// The files of a file spec; false if there are none
+	bool listFiles(LPCTSTR pszSpec, bool bRecursive, _string_array_* pFiles);
+
+private:
+	struct searcher_entry
+	{
+		char*			pKey;		// search type, flags and the patterns
+		long			nKeyLen;
+		grep_search*	pSearch;
+		ulong			uLastUse;
+	};
+	struct listing_entry
+	{
+		char*			pszKey;		// directory, recursion flag and spec
+		_string_array_*	pFiles;
+		int*			pWatches;	// inotify watches of the directories read
+		int				nWatches;
+		ulong			uLastUse;
+	};
+
+	searcher_entry	_searchers[SERVER_MAX_SEARCHERS];
+	int				_nSearchers;
+	listing_entry	_listings[SERVER_MAX_LISTINGS];
+	int				_nListings;
+	grep_dir_snapshot _snapshot;	// every directory the listings read
+	int				_nNotify;		// inotify descriptor, -1 if none
+	ulong			_uClock;		// request counter, for LRU
+
+private:
+	void _handle(int nClient);
+	void _reply(int nClient, int nRtn);
+	void _checkChanges();
+	void _dropListing(int nIndex);
+};
+
+// The running server, NULL in a normal run
+extern grep_server* g_pServer;
+
+// Entry points for --server= and --client=
+int GrepServe(LPCTSTR pszSocket);
+int GrepClient(LPCTSTR pszSocket, int argc, char* argv[]);
+// One command line; in grep.cpp
+int GrepMain(int argc, char* argv[]);
+
+// Writes a frame to the socket; false if the peer went away
+bool grep_send_frame(int nSocket, char cType, const void* pData, long nLen);
+
+#endif	// _grep_server_inc_
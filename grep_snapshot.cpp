@@ -0,0 +1,454 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_snapshot.cpp - implementation of grep_dir_snapshot
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include <stdio.h>
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+#include "grep_snapshot.h"
+#include "grep_cache.h"
+#include "grep_input.h"
+
+// Bumped whenever the file changes
+static const long SNAPSHOT_VERSION = 1;
+static const char SNAPSHOT_MAGIC[8] = { 'G', 'R', 'E', 'P', 'D', 'S', '\r', '\n' };
+static const ulonglong SNAPSHOT_BYTE_ORDER = ULL(0x0102030405060708);
+
+// Ticks of the stamps' clock
+#ifdef _WIN32
+static const ulonglong SNAPSHOT_TICKS_PER_SECOND = 10000000;
+#else
+static const ulonglong SNAPSHOT_TICKS_PER_SECOND = 1000000000;
+#endif
+
+struct snapshot_header
+{
+	char		szMagic[8];
+	long		nVersion;
+	long		nLongSize;		// sizeof(long) of the writer
+	ulonglong	uByteOrder;		// SNAPSHOT_BYTE_ORDER as the writer stored it
+	long		nCharSize;		// sizeof(TCHAR) of the writer
+	long		nEntries;
+};
+
+// Each directory: this, then its key and its listing, padded to
+// CACHE_ALIGNMENT
+struct snapshot_record
+{
+	grep_dir_stamp	stamp;
+	long			nKeyLen;
+	long			nListingLen;
+	ulong			uUsed;
+	long			nReserved;
+};
+
+grep_dir_snapshot::grep_dir_snapshot()
+{
+	_entries		= NULL;
+	_nEntries		= 0;
+	_nMaxEntries	= 0;
+	_table			= NULL;
+	_nTableSize		= 0;
+	_pMap			= NULL;
+	_nMapLen		= 0;
+	_bChanged		= false;
+	_nWasted		= 0;
+	_szCwd[0]		= 0;
+	_uRacyTime		= 0;
+	_uToday			= 0;
+}
+
+grep_dir_snapshot::~grep_dir_snapshot()
+{
+	reset();
+}
+
+void grep_dir_snapshot::reset()
+{
+	free(_entries);
+	delete[] _table;
+	_entries		= NULL;
+	_table			= NULL;
+	_nEntries		= 0;
+	_nMaxEntries	= 0;
+	_nTableSize		= 0;
+	_mem.reset();
+	grep_input::unmapFile(_pMap, _nMapLen);
+	_pMap			= NULL;
+	_nMapLen		= 0;
+	_bChanged		= false;
+	_nWasted		= 0;
+}
+
+//----------------------------------------------------------------
+// The listings point into the mapped file; nothing is copied.
+// Directories not walked for SNAPSHOT_KEEP_DAYS are left out.
+//----------------------------------------------------------------
+void grep_dir_snapshot::load(LPCTSTR pszCacheDir)
+{
+	TCHAR szFile[MAX_PATH*2];
+	const snapshot_header* pHeader;
+	const snapshot_record* pRecord;
+	entry e;
+	long nPos, nLen, i;
+
+	reset();
+	_uToday = (ulong)(_now() / (SNAPSHOT_TICKS_PER_SECOND * 86400));
+	_fileName(szFile, pszCacheDir, _T(".snapshot"));
+	if(!grep_input::mapFile(szFile, false, &_pMap, &_nMapLen))
+		return;
+
+	pHeader = (const snapshot_header*)_pMap;
+	nPos = cache_align(sizeof(snapshot_header));
+	if( _nMapLen < nPos ||
+		memcmp(pHeader->szMagic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) ||
+		pHeader->nVersion != SNAPSHOT_VERSION ||
+		pHeader->nLongSize != (long)sizeof(long) ||
+		pHeader->uByteOrder != SNAPSHOT_BYTE_ORDER ||
+		pHeader->nCharSize != (long)sizeof(TCHAR) )
+	{
+		reset();
+		return;
+	}
+
+	for(i=0; i<pHeader->nEntries; i++)
+	{
+		// a record that runs past the end, or a key or listing that
+		// isn't terminated, means the file is damaged
+		pRecord = (const snapshot_record*)(_pMap + nPos);
+		if( _nMapLen - nPos < (long)sizeof(snapshot_record) ||
+			pRecord->nKeyLen < 1 || pRecord->nListingLen < 1 )
+			break;
+		nLen = (pRecord->nKeyLen + pRecord->nListingLen) * (long)sizeof(TCHAR);
+		if( nLen < 0 || _nMapLen - nPos - (long)sizeof(snapshot_record) < nLen )
+			break;
+		e.pszKey		= (LPCTSTR)(pRecord + 1);
+		e.nKeyLen		= pRecord->nKeyLen;
+		e.pListing		= e.pszKey + e.nKeyLen;
+		e.nListingLen	= pRecord->nListingLen;
+		e.stamp			= pRecord->stamp;
+		e.uUsed			= pRecord->uUsed;
+		if(e.pszKey[e.nKeyLen-1] || e.pListing[e.nListingLen-1])
+			break;
+		nPos += cache_align(sizeof(snapshot_record) + nLen);
+
+		if(e.uUsed + SNAPSHOT_KEEP_DAYS < _uToday)
+			_bChanged = true;
+		else if(_lookup(e.pszKey, e.nKeyLen) == -1)
+			_add(e);
+	}
+	if(i < pHeader->nEntries)
+		reset();
+}
+
+//----------------------------------------------------------------
+// Written to a temporary file first and renamed, as the compiled
+// pattern sets are
+//----------------------------------------------------------------
+bool grep_dir_snapshot::save(LPCTSTR pszCacheDir)
+{
+	static const char zeros[CACHE_ALIGNMENT] = { 0 };
+	TCHAR szFile[MAX_PATH*2];
+	TCHAR szTemp[MAX_PATH*2];
+	TCHAR szExt[32];
+	snapshot_header header;
+	snapshot_record record;
+	FILE* pFile;
+	long  nLen, i;
+	bool  bOk;
+
+	if(!_bChanged)
+		return true;
+	// Windows can't replace a file that is mapped
+	_unmap();
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.szMagic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	header.nVersion		= SNAPSHOT_VERSION;
+	header.nLongSize	= sizeof(long);
+	header.uByteOrder	= SNAPSHOT_BYTE_ORDER;
+	header.nCharSize	= sizeof(TCHAR);
+	header.nEntries		= _nEntries;
+
+#ifdef _WIN32
+	wsprintf(szExt, _T(".%lu.tmp"), GetCurrentProcessId());
+#else
+	sprintf(szExt, ".%lu.tmp", (ulong)getpid());
+#endif
+	_fileName(szFile, pszCacheDir, _T(".snapshot"));
+	_fileName(szTemp, pszCacheDir, szExt);
+
+	pFile = fopen(szTemp, "wb");
+	bOk = (pFile != NULL);
+	if(bOk)
+	{
+		bOk = (fwrite(&header, sizeof(header), 1, pFile) == 1) &&
+			  (fwrite(zeros, 1, cache_align(sizeof(header)) - sizeof(header), pFile) ==
+			   (size_t)(cache_align(sizeof(header)) - sizeof(header)));
+		for(i=0; i<_nEntries && bOk; i++)
+		{
+			memset(&record, 0, sizeof(record));
+			record.stamp		= _entries[i].stamp;
+			record.nKeyLen		= _entries[i].nKeyLen;
+			record.nListingLen	= _entries[i].nListingLen;
+			record.uUsed		= _entries[i].uUsed;
+			nLen = sizeof(record) + (record.nKeyLen + record.nListingLen) * (long)sizeof(TCHAR);
+			bOk = (fwrite(&record, sizeof(record), 1, pFile) == 1) &&
+				  (fwrite(_entries[i].pszKey, sizeof(TCHAR), record.nKeyLen, pFile) ==
+				   (size_t)record.nKeyLen) &&
+				  (fwrite(_entries[i].pListing, sizeof(TCHAR), record.nListingLen, pFile) ==
+				   (size_t)record.nListingLen) &&
+				  (fwrite(zeros, 1, cache_align(nLen) - nLen, pFile) == (size_t)(cache_align(nLen) - nLen));
+		}
+		bOk = (fclose(pFile) == 0) && bOk;
+	}
+
+#ifdef _WIN32
+	bOk = bOk && MoveFileEx(szTemp, szFile, MOVEFILE_REPLACE_EXISTING);
+	if(!bOk)
+		DeleteFile(szTemp);
+#else
+	bOk = bOk && (rename(szTemp, szFile) == 0);
+	if(!bOk)
+		unlink(szTemp);
+#endif
+	if(bOk)
+		_bChanged = false;
+	return bOk;
+}
+
+//----------------------------------------------------------------
+// Copies the keys and listings that point into the loaded file to
+// the arena, and unmaps the file
+//----------------------------------------------------------------
+void grep_dir_snapshot::_unmap()
+{
+	entry* pEntry;
+	long i;
+
+	if(_pMap == NULL)
+		return;
+	for(i=0; i<_nEntries; i++)
+	{
+		pEntry = &_entries[i];
+		if((const char*)pEntry->pszKey >= _pMap && (const char*)pEntry->pszKey < _pMap + _nMapLen)
+			pEntry->pszKey = (LPCTSTR)memcpy( _mem.alloc(pEntry->nKeyLen * sizeof(TCHAR)),
+											  pEntry->pszKey, pEntry->nKeyLen * sizeof(TCHAR) );
+		if((const char*)pEntry->pListing >= _pMap && (const char*)pEntry->pListing < _pMap + _nMapLen)
+			pEntry->pListing = (LPCTSTR)memcpy( _mem.alloc(pEntry->nListingLen * sizeof(TCHAR)),
+												pEntry->pListing, pEntry->nListingLen * sizeof(TCHAR) );
+	}
+	grep_input::unmapFile(_pMap, _nMapLen);
+	_pMap		= NULL;
+	_nMapLen	= 0;
+}
+
+void grep_dir_snapshot::begin()
+{
+	ulonglong uNow = _now();
+
+#ifdef _WIN32
+	if(!GetCurrentDirectory(MAX_PATH*2, _szCwd))
+		_szCwd[0] = 0;
+#else
+	if(!getcwd(_szCwd, MAX_PATH*2))
+		_szCwd[0] = 0;
+#endif
+	_uRacyTime	= uNow - SNAPSHOT_RACY_SECONDS * SNAPSHOT_TICKS_PER_SECOND;
+	_uToday		= (ulong)(uNow / (SNAPSHOT_TICKS_PER_SECOND * 86400));
+}
+
+bool grep_dir_snapshot::stampOf(LPCTSTR pszDir, grep_dir_stamp* pStamp) const
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+
+	if( !GetFileAttributesEx(pszDir, GetFileExInfoStandard, &fad) ||
+		!(fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) )
+		return false;
+	pStamp->uId		= 0;
+	pStamp->uTime	= ((ulonglong)fad.ftLastWriteTime.dwHighDateTime << 32) |
+					  fad.ftLastWriteTime.dwLowDateTime;
+	pStamp->uSize	= 0;
+#else
+	struct stat st;
+
+	if(stat(pszDir, &st) != 0 || !S_ISDIR(st.st_mode))
+		return false;
+	pStamp->uId		= (ulonglong)st.st_ino;
+	pStamp->uTime	= (ulonglong)st.st_mtime * SNAPSHOT_TICKS_PER_SECOND;
+#if defined(__APPLE__)
+	pStamp->uTime	+= st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+	pStamp->uTime	+= st.st_mtim.tv_nsec;
+#endif
+	pStamp->uSize	= (ulonglong)st.st_size;
+#endif
+	return (_szCwd[0] && pStamp->uTime < _uRacyTime);
+}
+
+LPCTSTR grep_dir_snapshot::find(LPCTSTR pszDir, const grep_dir_stamp& stamp)
+{
+	TCHAR szKey[MAX_PATH*4];
+	entry* pEntry;
+	long i;
+
+	i = _lookup(szKey, _keyOf(pszDir, szKey));
+	if(i == -1)
+		return NULL;
+	pEntry = &_entries[i];
+	if( pEntry->stamp.uId != stamp.uId || pEntry->stamp.uTime != stamp.uTime ||
+		pEntry->stamp.uSize != stamp.uSize )
+		return NULL;
+	// the day of the last use is written at most once a day
+	if(pEntry->uUsed != _uToday)
+	{
+		pEntry->uUsed = _uToday;
+		_bChanged = true;
+	}
+	return pEntry->pListing;
+}
+
+void grep_dir_snapshot::store(LPCTSTR pszDir, const grep_dir_stamp& stamp, LPCTSTR pListing, long nLen)
+{
+	TCHAR szKey[MAX_PATH*4];
+	entry e;
+	long i;
+
+	e.nKeyLen		= _keyOf(pszDir, szKey);
+	e.nListingLen	= nLen;
+	e.stamp			= stamp;
+	e.uUsed			= _uToday;
+	e.pListing		= (LPCTSTR)memcpy(_mem.alloc(nLen * sizeof(TCHAR)), pListing, nLen * sizeof(TCHAR));
+	_bChanged		= true;
+
+	i = _lookup(szKey, e.nKeyLen);
+	if(i != -1)
+	{
+		// the old listing stays where it is until the next reset
+		_nWasted += _entries[i].nListingLen * (long)sizeof(TCHAR);
+		e.pszKey = _entries[i].pszKey;
+		_entries[i] = e;
+		return;
+	}
+	e.pszKey = (LPCTSTR)memcpy(_mem.alloc(e.nKeyLen * sizeof(TCHAR)), szKey, e.nKeyLen * sizeof(TCHAR));
+	_add(e);
+}
+
+//----------------------------------------------------------------
+// The absolute path of a directory, the key of its entry; returns
+// its length with the NUL
+//----------------------------------------------------------------
+long grep_dir_snapshot::_keyOf(LPCTSTR pszDir, LPTSTR pszKey) const
+{
+	int nLen;
+
+#ifdef _WIN32
+	if( pszDir[0] == _T('\\') || pszDir[0] == _T('/') || (pszDir[0] && pszDir[1] == _T(':')) )
+#else
+	if( pszDir[0] == _T('/') )
+#endif
+	{
+		lstrcpyn(pszKey, pszDir, MAX_PATH*4);
+		return lstrlen(pszKey) + 1;
+	}
+	lstrcpyn(pszKey, _szCwd, MAX_PATH*2);
+	nLen = lstrlen(pszKey);
+	if(nLen && pszKey[nLen-1] != _T('/') && pszKey[nLen-1] != _T('\\'))
+		pszKey[nLen++] = _T('/');
+	lstrcpyn(pszKey + nLen, pszDir, MAX_PATH*4 - nLen);
+	return lstrlen(pszKey) + 1;
+}
+
+long grep_dir_snapshot::_lookup(LPCTSTR pszKey, long nKeyLen) const
+{
+	long i;
+
+	if(!_nTableSize)
+		return -1;
+	for(i = _hash(pszKey, nKeyLen) & (_nTableSize - 1); _table[i] != -1; i = (i + 1) & (_nTableSize - 1))
+	{
+		if( _entries[_table[i]].nKeyLen == nKeyLen &&
+			!memcmp(_entries[_table[i]].pszKey, pszKey, nKeyLen * sizeof(TCHAR)) )
+			return _table[i];
+	}
+	return -1;
+}
+
+void grep_dir_snapshot::_add(const entry& e)
+{
+	long i;
+
+	if(_nEntries == _nMaxEntries)
+	{
+		_nMaxEntries = (_nMaxEntries ? 2 * _nMaxEntries : 256);
+		_entries = (entry*)realloc(_entries, _nMaxEntries * sizeof(entry));
+	}
+	// the table is kept at most half full
+	if(2 * (_nEntries + 1) > _nTableSize)
+		_grow();
+	_entries[_nEntries] = e;
+	for(i = _hash(e.pszKey, e.nKeyLen) & (_nTableSize - 1); _table[i] != -1; i = (i + 1) & (_nTableSize - 1))
+		;
+	_table[i] = _nEntries++;
+}
+
+void grep_dir_snapshot::_grow()
+{
+	long i, j;
+
+	delete[] _table;
+	_nTableSize = (_nTableSize ? 2 * _nTableSize : 512);
+	_table = new long[_nTableSize];
+	for(i=0; i<_nTableSize; i++)
+		_table[i] = -1;
+	for(j=0; j<_nEntries; j++)
+	{
+		for(i = _hash(_entries[j].pszKey, _entries[j].nKeyLen) & (_nTableSize - 1);
+			_table[i] != -1; i = (i + 1) & (_nTableSize - 1))
+			;
+		_table[i] = j;
+	}
+}
+
+// Now, in the ticks of the stamps
+ulonglong grep_dir_snapshot::_now()
+{
+#ifdef _WIN32
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	return ((ulonglong)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (ulonglong)ts.tv_sec * SNAPSHOT_TICKS_PER_SECOND + ts.tv_nsec;
+#endif
+}
+
+// FNV-1a of the key's chars
+ulong grep_dir_snapshot::_hash(LPCTSTR pszKey, long nKeyLen)
+{
+	ulong uHash = 2166136261u;
+	long i;
+
+	for(i=0; i<nKeyLen; i++)
+		uHash = (uHash ^ (ulong)pszKey[i]) * 16777619u;
+	return uHash;
+}
+
+void grep_dir_snapshot::_fileName(LPTSTR pszOut, LPCTSTR pszDir, LPCTSTR pszExt)
+{
+	int nLen = lstrlen(pszDir);
+
+	if(nLen > MAX_PATH)
+		nLen = MAX_PATH;
+	lstrcpyn(pszOut, pszDir, nLen + 1);
+	if(nLen && pszDir[nLen-1] != _T('/') && pszDir[nLen-1] != _T('\\'))
+		pszOut[nLen++] = _T('/');
+	lstrcpyn(pszOut + nLen, _T("grep-dirs"), 10);
+	lstrcpyn(pszOut + nLen + 9, pszExt, 32);
+}
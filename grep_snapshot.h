@@ -0,0 +1,111 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_snapshot.h - snapshot of the directories -R walked.
+// Keeps, for each directory read, the names of its files and
+// subdirectories with the directory's inode, modification time and
+// size when it was read. Adding, removing or renaming an entry
+// changes the directory's modification time, so a directory whose
+// stamp is the same has the same entries, and grep_dir_list uses
+// them instead of reading it again: a walk of a tree that hasn't
+// changed costs a stat per directory instead of a readdir and, on
+// file systems that don't give the entry types, a stat per entry.
+// A subdirectory has its own stamp; a change deep in the tree
+// doesn't make its parents be read again.
+//
+// A directory modified within SNAPSHOT_RACY_SECONDS of the walk is
+// not kept: it could change again within the same tick of its
+// clock without its time changing.
+//
+// With --cache=DIR, the snapshot is kept in DIR between runs, in
+// the machine's own format like the compiled pattern sets (see
+// grep_cache.h). The server keeps one in memory.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_snapshot_inc_
+#define _grep_snapshot_inc_
+
+#include "grep.h"
+#include "grep_arena.h"
+
+// How close to the walk a directory may have changed and be kept
+const long SNAPSHOT_RACY_SECONDS	= 2;
+// Directories not walked for this long are dropped when saving
+const long SNAPSHOT_KEEP_DAYS		= 30;
+
+// The kinds of entries, the first char of each name in a listing
+const TCHAR DIR_ENTRY_FILE	= _T('f');
+const TCHAR DIR_ENTRY_DIR	= _T('d');
+
+// How a directory looked when it was read
+struct grep_dir_stamp
+{
+	ulonglong	uId;		// inode; 0 on Windows
+	ulonglong	uTime;		// modification time, ns (100 ns on Windows)
+	ulonglong	uSize;
+};
+
+class grep_dir_snapshot
+{
+public:
+	grep_dir_snapshot();
+	~grep_dir_snapshot();
+
+	// Forgets every directory
+	void reset();
+	// Reads the snapshot kept in pszCacheDir. A missing file or one
+	// written by another version or machine is an empty snapshot.
+	void load(LPCTSTR pszCacheDir);
+	// Writes it back if anything changed; false if it couldn't be
+	bool save(LPCTSTR pszCacheDir);
+
+	// Called before each walk: relative paths are taken from the
+	// current directory, and the racy window from now
+	void begin();
+	// The stamp of a directory; false if it is not a directory or
+	// is too recent to be kept
+	bool stampOf(LPCTSTR pszDir, grep_dir_stamp* pStamp) const;
+	// A listing kept for the directory with this stamp, or NULL.
+	// A listing is kind-and-name strings ended by an empty one.
+	LPCTSTR find(LPCTSTR pszDir, const grep_dir_stamp& stamp);
+	void store(LPCTSTR pszDir, const grep_dir_stamp& stamp, LPCTSTR pListing, long nLen);
+
+	// Bytes of listings that were replaced and still take memory
+	long wastedBytes() const		{ return _nWasted; }
+
+private:
+	struct entry
+	{
+		LPCTSTR			pszKey;		// absolute path
+		LPCTSTR			pListing;
+		long			nKeyLen;	// chars, with the NUL
+		long			nListingLen;
+		grep_dir_stamp	stamp;
+		ulong			uUsed;		// day it was last walked
+	};
+
+	entry*		_entries;
+	long		_nEntries;
+	long		_nMaxEntries;
+	long*		_table;			// hash of the key -> entry, -1 if free
+	long		_nTableSize;	// a power of 2
+	grep_arena	_mem;			// keys and listings stored since load
+	char*		_pMap;			// the file loaded; loaded keys and
+	long		_nMapLen;		// listings point into it
+	bool		_bChanged;
+	long		_nWasted;
+
+	TCHAR		_szCwd[MAX_PATH*2];
+	ulonglong	_uRacyTime;		// directories changed after this aren't kept
+	ulong		_uToday;
+
+private:
+	long _keyOf(LPCTSTR pszDir, LPTSTR pszKey) const;
+	long _lookup(LPCTSTR pszKey, long nKeyLen) const;
+	void _add(const entry& e);
+	void _grow();
+	void _unmap();
+	static ulonglong _now();
+	static ulong _hash(LPCTSTR pszKey, long nKeyLen);
+	static void _fileName(LPTSTR pszOut, LPCTSTR pszDir, LPCTSTR pszExt);
+};
+
+#endif	// _grep_snapshot_inc_
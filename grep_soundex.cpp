@@ -0,0 +1,178 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_soundex.cpp - implementation of grep_soundex_set
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_soundex.h"
+#include "grep_cache.h"
+
+// Char classes: the Soundex digit of a letter, SX_SEP for vowels
+// (which separate equal digits), SX_SKIP for H and W (which don't),
+// and SX_NONE for everything that is not a letter.
+#define SX_SEP		0
+#define SX_SKIP		7
+#define SX_NONE		8
+
+static unsigned char g_sxClass[256];
+static bool g_sxClassReady = false;
+
+static void _initClassTable()
+{
+	static const char* letters = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	static const char* digits  = "01230127022455012623017202";
+	int c;
+
+	if(g_sxClassReady)
+		return;
+	for(c=0; c<256; c++)
+		g_sxClass[c] = SX_NONE;
+	for(c=0; c<26; c++)
+	{
+		g_sxClass[(unsigned char)letters[c]] =
+		g_sxClass[(unsigned char)tolower(letters[c])] = (unsigned char)(digits[c] - '0');
+	}
+	g_sxClassReady = true;
+}
+
+// Packs the first letter and three digits into 0..SOUNDEX_CODES-1
+inline long _packCode(unsigned char first, const long* digits)
+{
+	return ((toupper(first) - 'A') * 7 + digits[0]) * 49 + digits[1] * 7 + digits[2];
+}
+
+grep_soundex_set::grep_soundex_set()
+{
+	_bEntireLine = false;
+	_table = NULL;
+}
+
+grep_soundex_set::~grep_soundex_set()
+{
+	reset();
+}
+
+void grep_soundex_set::reset()
+{
+	_mem.reset();
+	_table = NULL;
+}
+
+void grep_soundex_set::init(const grep_pattern_list* patterns, bool matchEntireLine)
+{
+	long code, i;
+
+	reset();
+	_initClassTable();
+
+	_bEntireLine = matchEntireLine;
+	_table = (long*)_mem.alloc(SOUNDEX_CODES * sizeof(long));
+	for(i=0; i<SOUNDEX_CODES; i++)
+		_table[i] = -1;
+
+	// patterns have been checked to be single alphabetic words
+	for(i=patterns->length()-1; i>=0; i--)
+	{
+		code = codeOf(patterns->get(i), patterns->lengthOf(i));
+		if(code >= 0)
+			_table[code] = i;	// going backwards leaves the first one
+	}
+}
+
+// Flat block: the -x flag, then the code table
+long grep_soundex_set::saveSize() const
+{
+	return CACHE_ALIGNMENT + SOUNDEX_CODES * sizeof(long);
+}
+
+void grep_soundex_set::save(char* pOut) const
+{
+	memset(pOut, 0, CACHE_ALIGNMENT);
+	*(long*)pOut = _bEntireLine;
+	memcpy(pOut + CACHE_ALIGNMENT, _table, SOUNDEX_CODES * sizeof(long));
+}
+
+bool grep_soundex_set::load(const char* pData, long nLen)
+{
+	reset();
+	if(nLen != saveSize())
+		return false;
+	_initClassTable();
+	_bEntireLine = (*(const long*)pData != 0);
+	_table = (long*)(pData + CACHE_ALIGNMENT);
+	return true;
+}
+
+long grep_soundex_set::codeOf(LPCSTR pWord, long nLen)
+{
+	const unsigned char* pc = (const unsigned char*)pWord;
+	long digits[3] = {0, 0, 0};
+	long nDigits = 0;
+	long last, cls, i;
+
+	_initClassTable();
+	if(nLen == 0 || g_sxClass[pc[0]] == SX_NONE)
+		return -1;
+
+	last = (g_sxClass[pc[0]] == SX_SKIP ? SX_SEP : g_sxClass[pc[0]]);
+	for(i=1; i<nLen && nDigits<3; i++)
+	{
+		cls = g_sxClass[pc[i]];
+		if(cls == SX_SKIP)
+			continue;
+		if(cls != SX_SEP && cls != last)
+			digits[nDigits++] = cls;
+		last = cls;
+	}
+	return _packCode(pc[0], digits);
+}
+
+//----------------------------------------------------------------
+// Attempt to match the words of the line against the patterns.
+// Params are the same as in grep_search::match.
+//----------------------------------------------------------------
+bool grep_soundex_set::match( /* in */ LPCSTR pLine,
+							  /* in */  long  nLineLen,
+							  /* out */ long* pMatchPatIndex,
+							  /* out */ long* pMatchStart,
+							  /* out */ long* pMatchLength ) const
+{
+	const unsigned char* pc = (const unsigned char*)pLine;
+	long digits[3];
+	long nDigits, nWord, last, cls, pat, i;
+
+	i = 0;
+	while(i < nLineLen)
+	{
+		// skip to the next word
+		while(i < nLineLen && g_sxClass[pc[i]] == SX_NONE)
+			i++;
+		if(i == nLineLen)
+			break;
+
+		// code the word while walking over it
+		nWord = i;
+		digits[0] = digits[1] = digits[2] = 0;
+		nDigits = 0;
+		last = (g_sxClass[pc[i]] == SX_SKIP ? SX_SEP : g_sxClass[pc[i]]);
+		for(i++; i < nLineLen && (cls = g_sxClass[pc[i]]) != SX_NONE; i++)
+		{
+			if(cls == SX_SKIP || nDigits == 3)
+				continue;
+			if(cls != SX_SEP && cls != last)
+				digits[nDigits++] = cls;
+			last = cls;
+		}
+
+		if(_bEntireLine && (nWord != 0 || i != nLineLen))
+			return false;	// the line is not a single word
+
+		pat = _table[_packCode(pc[nWord], digits)];
+		if(pat != -1)
+		{
+			if(pMatchPatIndex)	*pMatchPatIndex	= pat;
+			if(pMatchStart)		*pMatchStart	= nWord;
+			if(pMatchLength)	*pMatchLength	= i - nWord;
+			return true;
+		}
+	}
+	return false;
+}
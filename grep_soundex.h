@@ -0,0 +1,52 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_soundex.h - compiled set of phonetic (Soundex) patterns.
+//
+// A Soundex code is a letter and three digits 0..6, so there are
+// only 26*7*7*7 of them; the set is a table indexed by the code
+// that holds the first pattern with that code. Each line is split
+// into words once, the codes of the words are computed in the same
+// pass with a char class table, and each word costs one lookup no
+// matter how many patterns there are.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_soundex_inc_
+#define _grep_soundex_inc_
+
+#include "grep.h"
+#include "grep_patterns.h"
+
+// Number of distinct Soundex codes
+const long SOUNDEX_CODES = 26 * 7 * 7 * 7;
+
+class grep_soundex_set
+{
+public:
+	grep_soundex_set();
+	~grep_soundex_set();
+
+	void reset();
+	void init( const grep_pattern_list* patterns, bool matchEntireLine );
+	// Returns true if any word in the line sounds like any pattern.
+	// Reports the leftmost such word and the first pattern it matches.
+	bool match( LPCSTR pLine, long nLineLen, long* pMatchPatIndex,
+				long* pMatchStart, long* pMatchLength ) const;
+
+	// The compiled set as one flat block, for the compile cache.
+	// load() uses the block in place: it must outlive the set.
+	long saveSize() const;
+	void save(char* pOut) const;
+	bool load(const char* pData, long nLen);
+
+	// Soundex code of the word (letters only), 0..SOUNDEX_CODES-1
+	static long codeOf(LPCSTR pWord, long nLen);
+
+private:
+	bool	_bEntireLine;
+	long*	_table;		// code -> index of the first pattern, or -1
+	grep_arena	_mem;	// holds _table
+
+public:
+	void addStats(grep_alloc_stats* pStats) const	{ _mem.addStats(pStats); }
+};
+
+#endif	// _grep_soundex_inc_
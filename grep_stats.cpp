@@ -0,0 +1,158 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_stats.cpp - implementation of grep_pattern_stats
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_stats.h"
+#include "grep_output.h"
+
+// The stats being sorted; qsort gives the compare function no context
+static const grep_pattern_stats* s_pSorting = NULL;
+
+grep_pattern_stats::grep_pattern_stats()
+{
+	_nPatterns	= 0;
+	_nEngines	= 0;
+	_bAll		= false;
+	_hits		= NULL;
+	_bytes		= NULL;
+	_ticks		= NULL;
+}
+
+grep_pattern_stats::~grep_pattern_stats()
+{
+	release();
+}
+
+void grep_pattern_stats::init(long nPatterns, long nEngines, bool bAllPatterns)
+{
+	release();
+	_nPatterns	= nPatterns;
+	_nEngines	= nEngines;
+	_bAll		= bAllPatterns;
+	_hits		= new ulonglong[nPatterns + 1];
+	_bytes		= new ulonglong[nEngines + 1];
+	_ticks		= new ulonglong[nEngines + 1];
+	memset(_hits, 0, (nPatterns + 1) * sizeof(ulonglong));
+	memset(_bytes, 0, (nEngines + 1) * sizeof(ulonglong));
+	memset(_ticks, 0, (nEngines + 1) * sizeof(ulonglong));
+}
+
+void grep_pattern_stats::release()
+{
+	delete[] _hits;
+	delete[] _bytes;
+	delete[] _ticks;
+	_hits = _bytes = _ticks = NULL;
+	_nPatterns = _nEngines = 0;
+}
+
+//----------------------------------------------------------------
+// One row per pattern. With an engine per pattern, the most time
+// first; with one engine for the set, its total comes first and
+// the patterns are in the order of their hits, the fewest first.
+//----------------------------------------------------------------
+void grep_pattern_stats::write(const grep_pattern_list* pPatterns, bool bJson) const
+{
+	bool   bPerPattern = (_nEngines == _nPatterns);
+	long*  order = new long[_nPatterns + 1];
+	long   i, p;
+
+	for(i=0; i<_nPatterns; i++)
+		order[i] = i;
+	s_pSorting = this;
+	qsort(order, _nPatterns, sizeof(long), _compare);
+	s_pSorting = NULL;
+
+	if(bJson)
+	{
+		if(!bPerPattern && _nEngines > 0)
+		{
+			g_stdout.writeFormatted( "{\"type\":\"engine\",\"patterns\":%ld,\"bytes\":", _nPatterns );
+			g_stdout.writeNumber( _bytes[0] );
+			g_stdout.writeFormatted( ",\"time_ms\":%.3f}\r\n", _ms(_ticks[0]) );
+		}
+		for(i=0; i<_nPatterns; i++)
+		{
+			p = order[i];
+			g_stdout.writeFormatted( "{\"type\":\"pattern\",\"index\":%ld,\"pattern\":", p );
+			g_stdout.writeJsonString( pPatterns->get(p), pPatterns->lengthOf(p) );
+			g_stdout.writeString( ",\"hits\":" );
+			g_stdout.writeNumber( _hits[p] );
+			if(bPerPattern)
+			{
+				g_stdout.writeString( ",\"bytes\":" );
+				g_stdout.writeNumber( _bytes[p] );
+				g_stdout.writeFormatted( ",\"time_ms\":%.3f", _ms(_ticks[p]) );
+			}
+			g_stdout.writeString( "}\r\n" );
+		}
+		delete[] order;
+		return;
+	}
+
+	g_stdout.writeString( _bAll ? "\r\nLines matched, counting every pattern that matched:\r\n"
+								: "\r\nLines matched, counting the first pattern that matched:\r\n" );
+	if(bPerPattern)
+		g_stdout.writeString( "        Hits         Bytes      Time(ms)  Pattern\r\n" );
+	else
+	{
+		if(_nEngines > 0)
+		{
+			g_stdout.writeFormatted( "All %ld pattern(s) in one pass: ", _nPatterns );
+			g_stdout.writeNumber( _bytes[0] );
+			g_stdout.writeFormatted( " byte(s), %.3f ms\r\n", _ms(_ticks[0]) );
+		}
+		g_stdout.writeString( "        Hits  Pattern\r\n" );
+	}
+
+	for(i=0; i<_nPatterns; i++)
+	{
+		p = order[i];
+		_writeColumn( _hits[p], 12 );
+		if(bPerPattern)
+		{
+			_writeColumn( _bytes[p], 14 );
+			g_stdout.writeFormatted( "%14.3f", _ms(_ticks[p]) );
+		}
+		g_stdout.writeString( "  " );
+		g_stdout.write( pPatterns->get(p), pPatterns->lengthOf(p) );
+		g_stdout.writeString( "\r\n" );
+	}
+	delete[] order;
+}
+
+// Ticks to milliseconds; old compilers only convert signed 64-bit
+// numbers to double
+double grep_pattern_stats::_ms(ulonglong uTicks)
+{
+	return (double)(longlong)uTicks * 1000.0 / (double)(longlong)grep_ticksPerSecond();
+}
+
+// The most time first, then the fewest hits, then the pattern order
+int grep_pattern_stats::_compare(const void* p1, const void* p2)
+{
+	const grep_pattern_stats* pThis = s_pSorting;
+	long i1 = *(const long*)p1;
+	long i2 = *(const long*)p2;
+
+	if(pThis->_nEngines == pThis->_nPatterns && pThis->_ticks[i1] != pThis->_ticks[i2])
+		return (pThis->_ticks[i1] > pThis->_ticks[i2] ? -1 : 1);
+	if(pThis->_hits[i1] != pThis->_hits[i2])
+		return (pThis->_hits[i1] < pThis->_hits[i2] ? -1 : 1);
+	return (i1 < i2 ? -1 : 1);
+}
+
+// A number right-aligned in nWidth chars; printf can't do 64-bit
+// numbers the same way everywhere
+void grep_pattern_stats::_writeColumn(ulonglong uValue, int nWidth)
+{
+	char  szNum[32];
+	char* pc = szNum + sizeof(szNum);
+
+	do
+		*--pc = (char)('0' + (int)(uValue % 10));
+	while((uValue /= 10) != 0);
+	while(pc > szNum && szNum + sizeof(szNum) - pc < nWidth)
+		*--pc = ' ';
+	g_stdout.write(pc, (long)(szNum + sizeof(szNum) - pc));
+}
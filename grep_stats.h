@@ -0,0 +1,50 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_stats.h - per-pattern statistics (--stats).
+// Counts the lines each pattern matched, and the bytes and the time
+// each engine object spent on, so that the few patterns of a big
+// set that never match or cost the most can be found.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_stats_inc_
+#define _grep_stats_inc_
+
+#include "grep.h"
+#include "grep_patterns.h"
+#include "grep_thread.h"	// grep_ticks
+
+class grep_pattern_stats
+{
+public:
+	grep_pattern_stats();
+	~grep_pattern_stats();
+
+	// Zeroes the counts. With as many engines as patterns, engine i
+	// searches for pattern i; a single engine searches for them all.
+	void init(long nPatterns, long nEngines, bool bAllPatterns);
+	void release();
+
+	void addHit(long nPattern)			{ _hits[nPattern]++; }
+	void addRun(long nEngine, long nBytes, ulonglong uTicks)
+	{
+		_bytes[nEngine] += nBytes;
+		_ticks[nEngine] += uTicks;
+	}
+
+	// Writes the table, the costliest patterns first
+	void write(const grep_pattern_list* pPatterns, bool bJson) const;
+
+private:
+	long		_nPatterns;
+	long		_nEngines;
+	bool		_bAll;		// every matching pattern counted, not just the first
+	ulonglong*	_hits;		// lines matched, per pattern
+	ulonglong*	_bytes;		// bytes searched, per engine
+	ulonglong*	_ticks;		// time spent, per engine
+
+private:
+	static int _compare(const void* p1, const void* p2);
+	static void _writeColumn(ulonglong uValue, int nWidth);
+	static double _ms(ulonglong uTicks);
+};
+
+#endif	// _grep_stats_inc_
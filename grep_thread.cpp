@@ -0,0 +1,189 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_thread.cpp - implementation of the thread wrappers
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_thread.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <time.h>
+#endif
+
+//----------------------------------------------------------------
+// grep_mutex
+//----------------------------------------------------------------
+grep_mutex::grep_mutex()
+{
+#ifdef _WIN32
+	InitializeCriticalSection(&_cs);
+#else
+	pthread_mutex_init(&_m, NULL);
+#endif
+}
+
+grep_mutex::~grep_mutex()
+{
+#ifdef _WIN32
+	DeleteCriticalSection(&_cs);
+#else
+	pthread_mutex_destroy(&_m);
+#endif
+}
+
+void grep_mutex::lock()
+{
+#ifdef _WIN32
+	EnterCriticalSection(&_cs);
+#else
+	pthread_mutex_lock(&_m);
+#endif
+}
+
+void grep_mutex::unlock()
+{
+#ifdef _WIN32
+	LeaveCriticalSection(&_cs);
+#else
+	pthread_mutex_unlock(&_m);
+#endif
+}
+
+//----------------------------------------------------------------
+// grep_condition
+//----------------------------------------------------------------
+grep_condition::grep_condition()
+{
+#ifdef _WIN32
+	InitializeConditionVariable(&_cv);
+#else
+	pthread_cond_init(&_cv, NULL);
+#endif
+}
+
+grep_condition::~grep_condition()
+{
+#ifndef _WIN32
+	pthread_cond_destroy(&_cv);
+#endif
+}
+
+void grep_condition::wait(grep_mutex& m)
+{
+#ifdef _WIN32
+	SleepConditionVariableCS(&_cv, &m._cs, INFINITE);
+#else
+	pthread_cond_wait(&_cv, &m._m);
+#endif
+}
+
+void grep_condition::signal()
+{
+#ifdef _WIN32
+	WakeConditionVariable(&_cv);
+#else
+	pthread_cond_signal(&_cv);
+#endif
+}
+
+void grep_condition::broadcast()
+{
+#ifdef _WIN32
+	WakeAllConditionVariable(&_cv);
+#else
+	pthread_cond_broadcast(&_cv);
+#endif
+}
+
+//----------------------------------------------------------------
+// grep_thread
+//----------------------------------------------------------------
+grep_thread::grep_thread()
+{
+	_pfnProc	= NULL;
+	_pArg		= NULL;
+	_bRunning	= false;
+}
+
+grep_thread::~grep_thread()
+{
+	join();
+}
+
+bool grep_thread::start(GREP_THREAD_PROC pfnProc, void* pArg)
+{
+	_pfnProc = pfnProc;
+	_pArg = pArg;
+#ifdef _WIN32
+	_hThread = CreateThread(NULL, 0, _threadProc, this, 0, NULL);
+	_bRunning = (_hThread != NULL);
+#else
+	_bRunning = (pthread_create(&_thread, NULL, _threadProc, this) == 0);
+#endif
+	return _bRunning;
+}
+
+void grep_thread::join()
+{
+	if(!_bRunning)
+		return;
+#ifdef _WIN32
+	WaitForSingleObject(_hThread, INFINITE);
+	CloseHandle(_hThread);
+#else
+	pthread_join(_thread, NULL);
+#endif
+	_bRunning = false;
+}
+
+#ifdef _WIN32
+DWORD WINAPI grep_thread::_threadProc(LPVOID pThis)
+{
+	((grep_thread*)pThis)->_pfnProc(((grep_thread*)pThis)->_pArg);
+	return 0;
+}
+#else
+void* grep_thread::_threadProc(void* pThis)
+{
+	((grep_thread*)pThis)->_pfnProc(((grep_thread*)pThis)->_pArg);
+	return NULL;
+}
+#endif
+
+int grep_thread::cpuCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return (int)si.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0 ? (int)n : 1);
+#endif
+}
+
+//----------------------------------------------------------------
+// Clock
+//----------------------------------------------------------------
+ulonglong grep_ticks()
+{
+#ifdef _WIN32
+	LARGE_INTEGER li;
+	QueryPerformanceCounter(&li);
+	return (ulonglong)li.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ulonglong)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+ulonglong grep_ticksPerSecond()
+{
+#ifdef _WIN32
+	LARGE_INTEGER li;
+	QueryPerformanceFrequency(&li);
+	return (ulonglong)li.QuadPart;
+#else
+	return 1000000000;
+#endif
+}
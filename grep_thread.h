@@ -0,0 +1,90 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_thread.h - minimal thread, mutex and condition variable
+// wrappers over Win32 and POSIX threads, and a monotonic clock.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_thread_inc_
+#define _grep_thread_inc_
+
+#include "grep.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// Monotonic clock, in ticks of grep_ticksPerSecond()
+ulonglong grep_ticks();
+ulonglong grep_ticksPerSecond();
+
+class grep_mutex
+{
+public:
+	grep_mutex();
+	~grep_mutex();
+	void lock();
+	void unlock();
+
+private:
+	friend class grep_condition;
+#ifdef _WIN32
+	CRITICAL_SECTION	_cs;
+#else
+	pthread_mutex_t		_m;
+#endif
+};
+
+// Locks a mutex for the lifetime of the object
+class grep_lock
+{
+public:
+	grep_lock(grep_mutex& m) : _m(m)	{ _m.lock(); }
+	~grep_lock()						{ _m.unlock(); }
+private:
+	grep_mutex& _m;
+};
+
+class grep_condition
+{
+public:
+	grep_condition();
+	~grep_condition();
+	// the mutex must be locked by the caller
+	void wait(grep_mutex& m);
+	void signal();
+	void broadcast();
+
+private:
+#ifdef _WIN32
+	CONDITION_VARIABLE	_cv;
+#else
+	pthread_cond_t		_cv;
+#endif
+};
+
+typedef void (*GREP_THREAD_PROC)(void* pArg);
+
+class grep_thread
+{
+public:
+	grep_thread();
+	~grep_thread();
+	bool start(GREP_THREAD_PROC pfnProc, void* pArg);
+	void join();
+
+	// number of processors, for sizing thread pools
+	static int cpuCount();
+
+private:
+	GREP_THREAD_PROC	_pfnProc;
+	void*				_pArg;
+	bool				_bRunning;
+#ifdef _WIN32
+	HANDLE				_hThread;
+	static DWORD WINAPI	_threadProc(LPVOID pThis);
+#else
+	pthread_t			_thread;
+	static void*		_threadProc(void* pThis);
+#endif
+};
+
+#endif	// _grep_thread_inc_
@@ -0,0 +1,220 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_utf8.cpp - implementation of the UTF-8 helpers
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_utf8.h"
+
+GREP_TARGET_CLONES
+bool utf8_isAscii(LPCSTR p, long nLen)
+{
+	const unsigned char* pc = (const unsigned char*)p;
+	const unsigned char* pEnd = pc + nLen;
+
+#ifdef GREP_USE_SSE2
+	// OR 64 bytes at a time together and test the high bits once
+	while(pEnd - pc >= 64)
+	{
+		__m128i v = _mm_or_si128(
+			_mm_or_si128( _mm_loadu_si128((const __m128i*)pc),
+						  _mm_loadu_si128((const __m128i*)(pc + 16)) ),
+			_mm_or_si128( _mm_loadu_si128((const __m128i*)(pc + 32)),
+						  _mm_loadu_si128((const __m128i*)(pc + 48)) ) );
+		if(_mm_movemask_epi8(v))
+			return false;
+		pc += 64;
+	}
+	while(pEnd - pc >= 16)
+	{
+		if(_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)pc)))
+			return false;
+		pc += 16;
+	}
+#endif
+	while(pc < pEnd)
+	{
+		if(*pc++ & 0x80)
+			return false;
+	}
+	return true;
+}
+
+GREP_TARGET_CLONES
+long utf8_wordLength(LPCSTR p, long nLen)
+{
+	const unsigned char* pc = (const unsigned char*)p;
+	const unsigned char* pEnd = pc + nLen;
+
+#ifdef GREP_USE_SSE2
+	// 16 bytes at a time: a byte is a word char if it is negative
+	// (non-ASCII), a digit, '_', or a letter once 0x20 is or-ed in
+	const __m128i zero	= _mm_setzero_si128();
+	const __m128i lower	= _mm_set1_epi8(0x20);
+	const __m128i under	= _mm_set1_epi8('_');
+	__m128i v, l, word;
+
+	while(pEnd - pc >= 16)
+	{
+		v = _mm_loadu_si128((const __m128i*)pc);
+		l = _mm_or_si128(v, lower);
+		word = _mm_or_si128(
+			_mm_or_si128( _mm_cmplt_epi8(v, zero), _mm_cmpeq_epi8(v, under) ),
+			_mm_or_si128( _mm_and_si128( _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+										 _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)) ),
+						  _mm_and_si128( _mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)),
+										 _mm_cmplt_epi8(l, _mm_set1_epi8('z' + 1)) ) ) );
+		if(_mm_movemask_epi8(word) != 0xFFFF)
+			break;		// the bytes below find which one
+		pc += 16;
+	}
+#endif
+	while(pc < pEnd && utf8_isWordByte(*pc))
+		pc++;
+	return (long)(pc - (const unsigned char*)p);
+}
+
+long utf8_seqLength(LPCSTR p, long nAvail)
+{
+	const unsigned char* pc = (const unsigned char*)p;
+	unsigned long cp;
+	long n, i;
+
+	if(nAvail <= 0)
+		return 0;
+	if(pc[0] < 0x80)
+		return 1;
+	else if(pc[0] >= 0xC2 && pc[0] <= 0xDF)
+		n = 2, cp = pc[0] & 0x1F;
+	else if(pc[0] >= 0xE0 && pc[0] <= 0xEF)
+		n = 3, cp = pc[0] & 0x0F;
+	else if(pc[0] >= 0xF0 && pc[0] <= 0xF4)
+		n = 4, cp = pc[0] & 0x07;
+	else
+		return 0;	// continuation byte, overlong C0/C1, or F5..FF
+
+	if(nAvail < n)
+		return 0;
+	for(i=1; i<n; i++)
+	{
+		if((pc[i] & 0xC0) != 0x80)
+			return 0;
+		cp = (cp << 6) | (pc[i] & 0x3F);
+	}
+	// reject overlong forms, surrogates, and code points past U+10FFFF
+	if( (n == 3 && cp < 0x800) || (n == 4 && cp < 0x10000) ||
+		(cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF )
+		return 0;
+	return n;
+}
+
+// Simple case mapping for the two-byte range (U+0080..U+07FF)
+static unsigned long _foldCodePoint(unsigned long cp)
+{
+	if(cp >= 0xC0 && cp <= 0xDE && cp != 0xD7)			// Latin-1
+		return cp + 0x20;
+	if(cp >= 0x100 && cp <= 0x17F)						// Latin Extended-A
+	{
+		// the dotted capital I and the dotless small i are not a pair:
+		// their cases are the one-byte i and I, so they are left alone
+		if(cp == 0x130 || cp == 0x131)
+			return cp;
+		if( (cp <= 0x137) || (cp >= 0x14A && cp <= 0x177) )
+			return (cp & 1) ? cp : cp + 1;
+		if( (cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E) )
+			return (cp & 1) ? cp + 1 : cp;
+		return cp;
+	}
+	if(cp >= 0x391 && cp <= 0x3A9 && cp != 0x3A2)		// Greek
+		return cp + 0x20;
+	if(cp >= 0x410 && cp <= 0x42F)						// Cyrillic
+		return cp + 0x20;
+	if(cp >= 0x400 && cp <= 0x40F)
+		return cp + 0x50;
+	return cp;
+}
+
+void utf8_foldCase(char* p, long nLen)
+{
+	unsigned char* pc = (unsigned char*)p;
+	unsigned char* pEnd = pc + nLen;
+	unsigned long cp;
+
+	while(pc < pEnd)
+	{
+		if(*pc < 0x80)
+		{
+			if(*pc >= 'A' && *pc <= 'Z')
+				*pc += 'a' - 'A';
+			pc++;
+		}
+		else if( *pc >= 0xC2 && *pc <= 0xDF &&
+				 pc + 1 < pEnd && (pc[1] & 0xC0) == 0x80 )
+		{
+			cp = _foldCodePoint( ((unsigned long)(pc[0] & 0x1F) << 6) | (pc[1] & 0x3F) );
+			pc[0] = (unsigned char)(0xC0 | (cp >> 6));
+			pc[1] = (unsigned char)(0x80 | (cp & 0x3F));
+			pc += 2;
+		}
+		else
+			pc++;	// longer sequences and stray bytes are left alone
+	}
+}
+
+long utf16_toUtf8( const unsigned char* src, long nSrcLen, bool bBigEndian,
+				   char* dst, long* pConsumed )
+{
+	unsigned char* pd = (unsigned char*)dst;
+	unsigned long cp, lo;
+	long i = 0;
+
+	while(i + 1 < nSrcLen)
+	{
+		cp = bBigEndian ? ((src[i] << 8) | src[i+1]) : ((src[i+1] << 8) | src[i]);
+
+		if(cp < 0x80)
+		{
+			// runs of ASCII are by far the most common case
+			*pd++ = (unsigned char)cp;
+			i += 2;
+			continue;
+		}
+
+		if(cp >= 0xD800 && cp <= 0xDBFF)
+		{
+			if(i + 3 >= nSrcLen)
+				break;	// wait for the low surrogate
+			lo = bBigEndian ? ((src[i+2] << 8) | src[i+3]) : ((src[i+3] << 8) | src[i+2]);
+			if(lo >= 0xDC00 && lo <= 0xDFFF)
+			{
+				cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+				i += 2;
+			}
+			else
+				cp = 0xFFFD;
+		}
+		else if(cp >= 0xDC00 && cp <= 0xDFFF)
+			cp = 0xFFFD;	// unpaired low surrogate
+		i += 2;
+
+		if(cp < 0x800)
+		{
+			*pd++ = (unsigned char)(0xC0 | (cp >> 6));
+			*pd++ = (unsigned char)(0x80 | (cp & 0x3F));
+		}
+		else if(cp < 0x10000)
+		{
+			*pd++ = (unsigned char)(0xE0 | (cp >> 12));
+			*pd++ = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+			*pd++ = (unsigned char)(0x80 | (cp & 0x3F));
+		}
+		else
+		{
+			*pd++ = (unsigned char)(0xF0 | (cp >> 18));
+			*pd++ = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+			*pd++ = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+			*pd++ = (unsigned char)(0x80 | (cp & 0x3F));
+		}
+	}
+
+	*pConsumed = i;
+	return (long)(pd - (unsigned char*)dst);
+}
@@ -0,0 +1,43 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_utf8.h - UTF-8 helpers: ASCII detection, sequence
+// validation, case folding and UTF-16 to UTF-8 transcoding.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_utf8_inc_
+#define _grep_utf8_inc_
+
+#include "grep.h"
+
+// Returns true if none of the bytes has the high bit set
+bool utf8_isAscii(LPCSTR p, long nLen);
+
+// Word chars, for -w and the regex word assertions: ASCII letters,
+// digits and '_', and every non-ASCII byte (taken as a letter)
+inline bool utf8_isWordByte(unsigned char c)
+{
+	return ( c >= 0x80 || (c >= '0' && c <= '9') || c == '_' ||
+			 ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') );
+}
+
+// Returns the number of word chars p starts with
+long utf8_wordLength(LPCSTR p, long nLen);
+
+// Returns the length of the valid UTF-8 sequence starting at p,
+// or 0 if the bytes at p do not form a valid sequence
+long utf8_seqLength(LPCSTR p, long nAvail);
+
+// Lower-cases ASCII letters and the two-byte upper case letters
+// of Latin-1, Latin Extended-A, Greek and Cyrillic in place.
+// Folding never changes the length of the text, so match offsets
+// found in the folded copy are valid in the original.
+void utf8_foldCase(char* p, long nLen);
+
+// Converts UTF-16 text to UTF-8. Stops at an odd trailing byte or
+// at a high surrogate whose pair is not in the buffer yet; the
+// number of source bytes consumed is returned in *pConsumed.
+// dst must have room for 3 bytes per 2 source bytes.
+// Returns the number of bytes written to dst.
+long utf16_toUtf8( const unsigned char* src, long nSrcLen, bool bBigEndian,
+				   char* dst, long* pConsumed );
+
+#endif	// _grep_utf8_inc_
@@ -0,0 +1,650 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_wildcard.cpp - implementation of grep_wildcard_set
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#include "grep_wildcard.h"
+#include "grep_cache.h"
+
+// Bits per shift-and state word
+static const long WORD_BITS = 64;
+
+inline long _wordsFor(long nLen)
+{
+	return (nLen + WORD_BITS - 1) / WORD_BITS;
+}
+
+grep_wildcard_set::grep_wildcard_set()
+{
+	_bCaseSensitive	= true;
+	_bEntireLine	= false;
+	_pats			= NULL;
+	_nPats			= 0;
+	_segs			= NULL;
+	_nSegs			= 0;
+	_masks			= NULL;
+	_text			= NULL;
+	_nTextLen		= 0;
+	_nMaskWords		= 0;
+	_nStateWords	= 0;
+	_grams			= NULL;
+	_nGramMask		= 0;
+	_gramNext		= NULL;
+	_always			= NULL;
+	_nAlways		= 0;
+	_gramPairs		= NULL;
+	_nGramLens		= 0;
+}
+
+grep_wildcard_set::~grep_wildcard_set()
+{
+	reset();
+}
+
+void grep_wildcard_set::reset()
+{
+	_mem.reset();
+
+	_pats	= NULL;
+	_segs	= NULL;
+	_masks	= NULL;
+	_text	= NULL;
+	_nPats	= 0;
+	_nSegs	= 0;
+	_nTextLen = 0;
+	_nMaskWords = 0;
+	_nStateWords = 0;
+	_grams		= NULL;
+	_gramNext	= NULL;
+	_always		= NULL;
+	_gramPairs	= NULL;
+	_nAlways	= 0;
+	_nGramLens	= 0;
+}
+
+void grep_wildcard_set::init( const grep_pattern_list* patterns,
+							  bool caseSensitive,
+							  bool matchEntireLine )
+{
+	LPCSTR pc, pSeg;
+	long nMaxSegs, nTextLen, nMaskWords, nStateWords, nPatWords, nMasks, i, k;
+
+	reset();
+
+	_bCaseSensitive	= caseSensitive;
+	_bEntireLine	= matchEntireLine;
+	_nPats			= patterns->length();
+
+	// Upper bounds for the segment count and the text size, and the
+	// exact number of mask and state words. A pattern needs as many
+	// state words as its longest segment.
+	nMaxSegs = nTextLen = nMaskWords = nStateWords = 0;
+	for(i=0; i<_nPats; i++)
+	{
+		nPatWords = 0;
+		for(pSeg = pc = patterns->get(i); ; pc++)
+		{
+			if(*pc == '*' || *pc == '\0')
+			{
+				nMaskWords += 256 * _wordsFor((long)(pc - pSeg));
+				if(_wordsFor((long)(pc - pSeg)) > nPatWords)
+					nPatWords = _wordsFor((long)(pc - pSeg));
+				nMaxSegs++;
+				if(*pc == '\0')
+					break;
+				pSeg = pc + 1;
+			}
+			else
+				nTextLen++;
+		}
+		nStateWords += nPatWords;
+	}
+
+	_pats	= (pattern*)_mem.alloc(_nPats * sizeof(pattern));
+	_segs	= (segment*)_mem.alloc(nMaxSegs * sizeof(segment));
+	_masks	= (ulonglong*)_mem.alloc(nMaskWords * sizeof(ulonglong));
+	_text	= (char*)_mem.alloc(nTextLen + 1);
+	_nMaskWords  = nMaskWords;
+	_nStateWords = nStateWords;
+
+	memset(_masks, 0, nMaskWords * sizeof(ulonglong));
+	nMasks = nStateWords = 0;
+
+	for(i=0; i<_nPats; i++)
+	{
+		pc = patterns->get(i);
+		_pats[i].nFirstSeg		= _nSegs;
+		_pats[i].nState			= nStateWords;
+		_pats[i].bAnchorStart	= matchEntireLine && (*pc != '*');
+		_pats[i].bAnchorEnd		= matchEntireLine &&
+								  (*pc == '\0' || pc[patterns->lengthOf(i)-1] != '*');
+
+		// split at the *'s; runs of *'s are the same as one
+		nPatWords = 0;
+		for(pSeg = pc; ; pc++)
+		{
+			if(*pc == '*' || *pc == '\0')
+			{
+				if(pc > pSeg)
+				{
+					_addSegment(pSeg, (long)(pc - pSeg), nMasks);
+					nMasks += 256 * _segs[_nSegs-1].nWords;
+					if(_segs[_nSegs-1].nWords > nPatWords)
+						nPatWords = _segs[_nSegs-1].nWords;
+				}
+				if(*pc == '\0')
+					break;
+				pSeg = pc + 1;
+			}
+		}
+		_pats[i].nSegs = _nSegs - _pats[i].nFirstSeg;
+		_pats[i].nMinLen = 0;
+		for(k=_pats[i].nFirstSeg; k<_nSegs; k++)
+			_pats[i].nMinLen += _segs[k].nLen;
+		nStateWords += nPatWords;
+	}
+	_buildFilter();
+}
+
+//----------------------------------------------------------------
+// Flat block: the header, then the pattern, segment, mask and text
+// arrays, each starting on a CACHE_ALIGNMENT boundary
+//----------------------------------------------------------------
+struct wildcard_block
+{
+	long	nPats;
+	long	nSegs;
+	long	nMaskWords;
+	long	nTextLen;
+	long	nStateWords;
+	long	bCaseSensitive;
+	long	bEntireLine;
+};
+
+long grep_wildcard_set::saveSize() const
+{
+	return cache_align(sizeof(wildcard_block)) +
+		   cache_align(_nPats * sizeof(pattern)) +
+		   cache_align(_nSegs * sizeof(segment)) +
+		   cache_align(_nMaskWords * sizeof(ulonglong)) +
+		   cache_align(_nTextLen + 1);
+}
+
+void grep_wildcard_set::save(char* pOut) const
+{
+	wildcard_block* pBlock = (wildcard_block*)pOut;
+
+	memset(pOut, 0, saveSize());
+	pBlock->nPats			= _nPats;
+	pBlock->nSegs			= _nSegs;
+	pBlock->nMaskWords		= _nMaskWords;
+	pBlock->nTextLen		= _nTextLen;
+	pBlock->nStateWords		= _nStateWords;
+	pBlock->bCaseSensitive	= _bCaseSensitive;
+	pBlock->bEntireLine		= _bEntireLine;
+
+	pOut += cache_align(sizeof(wildcard_block));
+	memcpy(pOut, _pats, _nPats * sizeof(pattern));
+	pOut += cache_align(_nPats * sizeof(pattern));
+	memcpy(pOut, _segs, _nSegs * sizeof(segment));
+	pOut += cache_align(_nSegs * sizeof(segment));
+	memcpy(pOut, _masks, _nMaskWords * sizeof(ulonglong));
+	pOut += cache_align(_nMaskWords * sizeof(ulonglong));
+	memcpy(pOut, _text, _nTextLen);
+}
+
+bool grep_wildcard_set::load(const char* pData, long nLen)
+{
+	const wildcard_block* pBlock = (const wildcard_block*)pData;
+
+	reset();
+	if(nLen < (long)sizeof(wildcard_block))
+		return false;
+
+	_nPats			= pBlock->nPats;
+	_nSegs			= pBlock->nSegs;
+	_nMaskWords		= pBlock->nMaskWords;
+	_nTextLen		= pBlock->nTextLen;
+	_nStateWords	= pBlock->nStateWords;
+	_bCaseSensitive	= (pBlock->bCaseSensitive != 0);
+	_bEntireLine	= (pBlock->bEntireLine != 0);
+	// every item takes a byte at least, so no count is above nLen
+	// and the sizes can't overflow; a pattern's state words are at
+	// most its segments' mask words / 256
+	if( _nPats < 0 || _nSegs < 0 || _nMaskWords < 0 || _nTextLen < 0 ||
+		_nPats > nLen || _nSegs > nLen || _nMaskWords > nLen || _nTextLen > nLen ||
+		_nStateWords < 0 || _nStateWords > _nMaskWords / 256 ||
+		saveSize() != nLen )
+	{
+		reset();
+		return false;
+	}
+
+	pData += cache_align(sizeof(wildcard_block));
+	_pats  = (pattern*)pData;
+	pData += cache_align(_nPats * sizeof(pattern));
+	_segs  = (segment*)pData;
+	pData += cache_align(_nSegs * sizeof(segment));
+	_masks = (ulonglong*)pData;
+	pData += cache_align(_nMaskWords * sizeof(ulonglong));
+	_text  = (char*)pData;
+	if(!_checkLoaded())
+	{
+		reset();
+		return false;
+	}
+	_buildFilter();
+	return true;
+}
+
+//----------------------------------------------------------------
+// Checks that the patterns and segments of a loaded block stay
+// within its arrays; match() follows their offsets unchecked
+//----------------------------------------------------------------
+bool grep_wildcard_set::_checkLoaded() const
+{
+	const segment* seg;
+	const pattern* pat;
+	long nMinLen, p, k;
+
+	for(k=0; k<_nSegs; k++)
+	{
+		seg = &_segs[k];
+		if( seg->nLen < 1 || seg->nText < 0 || seg->nText > _nTextLen ||
+			seg->nLen > _nTextLen - seg->nText ||
+			seg->nWords != _wordsFor(seg->nLen) ||
+			seg->nMasks < 0 || seg->nMasks > _nMaskWords ||
+			seg->nWords > (_nMaskWords - seg->nMasks) / 256 )
+			return false;
+	}
+	for(p=0; p<_nPats; p++)
+	{
+		pat = &_pats[p];
+		if( pat->nFirstSeg < 0 || pat->nFirstSeg > _nSegs ||
+			pat->nSegs < 0 || pat->nSegs > _nSegs - pat->nFirstSeg ||
+			pat->nState < 0 || pat->nState > _nStateWords )
+			return false;
+		nMinLen = 0;
+		for(k=pat->nFirstSeg; k<pat->nFirstSeg + pat->nSegs; k++)
+		{
+			if(_segs[k].nWords > _nStateWords - pat->nState)
+				return false;
+			nMinLen += _segs[k].nLen;
+		}
+		if(pat->nMinLen != nMinLen)
+			return false;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------
+// Picks the gram of each pattern: the first GRAM_MAX chars of the
+// longest run of its segments without ?'s. A pattern with no such
+// run ("*", "?*?") has no gram and is a candidate on every line.
+//----------------------------------------------------------------
+void grep_wildcard_set::_buildFilter()
+{
+	const segment* seg;
+	LPCSTR pText;
+	LPCSTR pRun;
+	ulonglong uKey;
+	unsigned c0, c1;
+	long nSlots, nRun, nBest, p, k, i, j;
+	gram_slot* pSlot;
+
+	_nGramLens = 0;
+	memset(_gramBytes, 0, sizeof(_gramBytes));
+	for(i=0; i<256; i++)
+		_fold[i] = (unsigned char)(_bCaseSensitive ? i : tolower(i));
+
+	for(nSlots = 16; nSlots < 2 * _nPats; nSlots *= 2)
+		;
+	_grams		= (gram_slot*)_mem.alloc(nSlots * sizeof(gram_slot));
+	_nGramMask	= nSlots - 1;
+	_gramNext	= (long*)_mem.alloc(_nPats * sizeof(long));
+	_always		= (long*)_mem.alloc(_nPats * sizeof(long));
+	_gramPairs	= (ulonglong*)_mem.alloc(65536 / 64 * sizeof(ulonglong));
+	_nAlways	= 0;
+	memset(_grams, 0, nSlots * sizeof(gram_slot));
+	memset(_gramPairs, 0, 65536 / 64 * sizeof(ulonglong));
+
+	for(p=0; p<_nPats; p++)
+	{
+		pRun = NULL;
+		nBest = 0;
+		for(k=_pats[p].nFirstSeg; k<_pats[p].nFirstSeg + _pats[p].nSegs; k++)
+		{
+			seg = &_segs[k];
+			pText = _text + seg->nText;
+			for(i=0; i<seg->nLen; i=j+1)
+			{
+				for(j=i; j<seg->nLen && pText[j] != '?'; j++)
+					;
+				if(j - i > nBest)
+				{
+					nBest = j - i;
+					pRun = pText + i;
+				}
+			}
+		}
+		if(nBest == 0)
+		{
+			_always[_nAlways++] = p;
+			continue;
+		}
+
+		nRun = (nBest < GRAM_MAX ? nBest : GRAM_MAX);
+		uKey = 0;
+		for(i=0; i<nRun; i++)
+			uKey |= (ulonglong)_fold[(unsigned char)pRun[i]] << (8 * i);
+		uKey |= (ulonglong)nRun << 32;
+
+		for(i = _gramHash(uKey) & _nGramMask; ; i = (i + 1) & _nGramMask)
+		{
+			pSlot = &_grams[i];
+			if(pSlot->uKey == 0 || pSlot->uKey == uKey)
+				break;
+		}
+		_gramNext[p] = (pSlot->uKey ? pSlot->nFirst : -1);
+		pSlot->uKey	  = uKey;
+		pSlot->nFirst = p;
+
+		c0 = _fold[(unsigned char)pRun[0]];
+		if(nRun == 1)
+			_gramBytes[c0 >> 6] |= (ulonglong)1 << (c0 & 63);
+		else
+		{
+			c1 = _fold[(unsigned char)pRun[1]];
+			_gramPairs[(c0 << 8 | c1) >> 6] |= (ulonglong)1 << ((c0 << 8 | c1) & 63);
+			_nGramLens |= 1 << nRun;
+		}
+	}
+}
+
+long grep_wildcard_set::_gramHash(ulonglong uKey)
+{
+	return (long)((uKey * ULL(0x9E3779B97F4A7C15)) >> 40);
+}
+
+//----------------------------------------------------------------
+// Sets pCand[p] for each pattern whose gram is in the line, and
+// for those without one. Returns how many were set.
+//----------------------------------------------------------------
+long grep_wildcard_set::_findCandidates(const unsigned char* pc, long nLineLen, char* pCand) const
+{
+	ulonglong uKey;
+	unsigned c0, c1;
+	long i, k, nCand = 0;
+
+	memset(pCand, 0, _nPats);
+	for(i=0; i<_nAlways; i++)
+		pCand[_always[i]] = 1;
+	nCand = _nAlways;
+
+	for(i=0; i<nLineLen; i++)
+	{
+		c0 = _fold[pc[i]];
+		if(_gramBytes[c0 >> 6] & ((ulonglong)1 << (c0 & 63)))
+			nCand += _markGram(((ulonglong)1 << 32) | c0, pCand);
+		if(i + 1 == nLineLen)
+			break;
+		c1 = _fold[pc[i+1]];
+		if(!(_gramPairs[(c0 << 8 | c1) >> 6] & ((ulonglong)1 << ((c0 << 8 | c1) & 63))))
+			continue;
+
+		uKey = c0 | (c1 << 8);
+		for(k=2; k<=GRAM_MAX && i + k <= nLineLen; k++)
+		{
+			if(k > 2)
+				uKey |= (ulonglong)_fold[pc[i+k-1]] << (8 * (k-1));
+			if(_nGramLens & (1 << k))
+				nCand += _markGram(((ulonglong)k << 32) | uKey, pCand);
+		}
+	}
+	return nCand;
+}
+
+// Marks the patterns with the gram; returns how many weren't yet
+long grep_wildcard_set::_markGram(ulonglong uKey, char* pCand) const
+{
+	const gram_slot* pSlot;
+	long i, p, nNew = 0;
+
+	for(i = _gramHash(uKey) & _nGramMask; ; i = (i + 1) & _nGramMask)
+	{
+		pSlot = &_grams[i];
+		if(pSlot->uKey == 0)
+			return 0;
+		if(pSlot->uKey == uKey)
+			break;
+	}
+	for(p = pSlot->nFirst; p != -1; p = _gramNext[p])
+	{
+		if(!pCand[p])
+		{
+			pCand[p] = 1;
+			nNew++;
+		}
+	}
+	return nNew;
+}
+
+//----------------------------------------------------------------
+// Stores the segment text and builds its shift-and masks: bit i of
+// mask[c] is set if the segment's char i matches c.
+//----------------------------------------------------------------
+void grep_wildcard_set::_addSegment(LPCSTR pText, long nLen, long nMasks)
+{
+	segment& seg = _segs[_nSegs];
+	ulonglong* masks = _masks + nMasks;
+	ulonglong bit;
+	unsigned char c;
+	long i, j, w;
+
+	seg.nLen	= nLen;
+	seg.nText	= _nTextLen;
+	seg.nWords	= _wordsFor(nLen);
+	seg.nMasks	= nMasks;
+	memcpy(_text + _nTextLen, pText, nLen);
+	_nTextLen += nLen;
+
+	for(i=0; i<nLen; i++)
+	{
+		w   = i / WORD_BITS;
+		bit = (ulonglong)1 << (i % WORD_BITS);
+		c = (unsigned char)pText[i];
+		if(c == '?')
+		{
+			for(j=0; j<256; j++)
+				masks[j * seg.nWords + w] |= bit;
+		}
+		else if(!_bCaseSensitive && isalpha(c))
+		{
+			masks[tolower(c) * seg.nWords + w] |= bit;
+			masks[toupper(c) * seg.nWords + w] |= bit;
+		}
+		else
+			masks[c * seg.nWords + w] |= bit;
+	}
+	_nSegs++;
+}
+
+inline bool grep_wildcard_set::_charEq(char c, char p) const
+{
+	return (p == '?') || (c == p) ||
+		   (!_bCaseSensitive && tolower((unsigned char)c) == tolower((unsigned char)p));
+}
+
+// Compares the segment text from position nFrom on with pAt
+bool grep_wildcard_set::_segEq(const segment& seg, LPCSTR pAt, long nFrom) const
+{
+	LPCSTR pText = _text + seg.nText;
+	long i;
+
+	for(i=nFrom; i<seg.nLen; i++)
+	{
+		if(!_charEq(pAt[i - nFrom], pText[i]))
+			return false;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------
+// Attempt to match the line against all the patterns at once.
+// Params are the same as in grep_search::match.
+//----------------------------------------------------------------
+bool grep_wildcard_set::match( /* in */ LPCSTR pLine,
+							   /* in */  long  nLineLen,
+							   /* out */ long* pMatchPatIndex,
+							   /* out */ long* pMatchStart,
+							   /* out */ long* pMatchLength,
+							   /* in */  grep_scratch* pScratch ) const
+{
+	const unsigned char* pc = (const unsigned char*)pLine;
+	long nActive, nLate, nBeg, nEnd, pos, k, p, w, last;
+	ulonglong *st, word, carry, live, inject;
+	const ulonglong* mask;
+	const pattern* pat;
+	const segment* seg;
+
+	// per-line scan state, one entry per pattern
+	ulonglong*	state;	// shift-and state of the segment being looked for
+	long*		curSeg;	// segment being looked for
+	long*		start;	// where the first segment matched
+	long*		skipTo;	// don't feed chars before this position
+	long*		active;	// indexes of the patterns still in the race
+	char*		cand;	// the patterns the prefilter let through
+
+	state  = (ulonglong*)pScratch->buffer( scratch_wildcard,
+										   _nStateWords * sizeof(ulonglong) +
+										   4 * _nPats * sizeof(long) + _nPats );
+	curSeg = (long*)(state + _nStateWords);
+	start  = curSeg + _nPats;
+	skipTo = start + _nPats;
+	active = skipTo + _nPats;
+	cand   = (char*)(active + _nPats);
+
+	if(_findCandidates(pc, nLineLen, cand) == 0)
+		return false;
+
+	// Patterns that need no scanning are settled first. A match that
+	// can only end at the end of the line is remembered in nLate and
+	// reported if no other pattern's match ends sooner.
+	nActive = 0;
+	nLate = -1;
+	for(p=0; p<_nPats; p++)
+	{
+		if(!cand[p])
+			continue;
+		pat = &_pats[p];
+		if(pat->nSegs == 0)
+		{
+			// "", "*", "**"...: every line, or only empty ones with -x
+			if( (pat->bAnchorStart || pat->bAnchorEnd) && nLineLen != 0 )
+				continue;
+			if(pMatchPatIndex)	*pMatchPatIndex	= p;
+			if(pMatchStart)		*pMatchStart	= 0;
+			if(pMatchLength)	*pMatchLength	= (_bEntireLine ? nLineLen : 0);
+			return true;
+		}
+
+		// a line shorter than the pattern's chars needs no scan
+		if(nLineLen < pat->nMinLen)
+			continue;
+
+		seg = &_segs[pat->nFirstSeg];
+		if(pat->nSegs == 1 && pat->bAnchorEnd)
+		{
+			// a lone segment anchored at the end: compare the tail
+			if( nLineLen >= seg->nLen &&
+				(!pat->bAnchorStart || nLineLen == seg->nLen) &&
+				nLate == -1 &&
+				_segEq(*seg, pLine + nLineLen - seg->nLen, 0) )
+				nLate = p;
+			continue;
+		}
+
+		curSeg[p]	= pat->nFirstSeg;
+		memset(state + pat->nState, 0, seg->nWords * sizeof(ulonglong));
+		start[p]	= -1;
+		skipTo[p]	= 0;
+		active[nActive++] = p;
+	}
+
+	// One pass over the line; every pattern still in the race takes
+	// one shift-and step per char for the segment it is looking for
+	for(pos=0; pos<nLineLen && nActive>0; pos++)
+	{
+		for(k=0; k<nActive; k++)
+		{
+			p = active[k];
+			if(pos < skipTo[p])
+				continue;
+
+			pat = &_pats[p];
+			seg = &_segs[curSeg[p]];
+			inject = 1;
+			if(pat->bAnchorStart && curSeg[p] == pat->nFirstSeg)
+				inject = (pos == 0);
+
+			// one shift-and step: st = ((st << 1) | inject) & mask[c]
+			st    = state + pat->nState;
+			mask  = _masks + seg->nMasks + pc[pos] * seg->nWords;
+			carry = inject;
+			live  = 0;
+			for(w=0; w<seg->nWords; w++)
+			{
+				word	= st[w];
+				st[w]	= ((word << 1) | carry) & mask[w];
+				carry	= word >> (WORD_BITS - 1);
+				live   |= st[w];
+			}
+
+			if(st[seg->nWords - 1] & ((ulonglong)1 << ((seg->nLen - 1) % WORD_BITS)))
+			{
+				nBeg = pos + 1 - seg->nLen;
+				nEnd = pos + 1;
+
+				// the segment is found; look for the next one after it
+				if(curSeg[p] == pat->nFirstSeg)
+					start[p] = nBeg;
+				curSeg[p]++;
+				skipTo[p]	= nEnd;
+
+				last = pat->nFirstSeg + pat->nSegs - 1;
+				if(curSeg[p] > last)
+				{
+					if(pMatchPatIndex)	*pMatchPatIndex	= p;
+					if(pMatchStart)		*pMatchStart	= (_bEntireLine ? 0 : start[p]);
+					if(pMatchLength)	*pMatchLength	= (_bEntireLine ? nLineLen : nEnd) -
+														  (_bEntireLine ? 0 : start[p]);
+					return true;
+				}
+				if(pat->bAnchorEnd && curSeg[p] == last)
+				{
+					// the last segment has to be the tail of the line
+					seg = &_segs[last];
+					if( nLate == -1 && nLineLen - seg->nLen >= nEnd &&
+						_segEq(*seg, pLine + nLineLen - seg->nLen, 0) )
+						nLate = p;
+					active[k--] = active[--nActive];
+				}
+				else
+					memset(st, 0, _segs[curSeg[p]].nWords * sizeof(ulonglong));
+			}
+			else if(live == 0 && pat->bAnchorStart && curSeg[p] == pat->nFirstSeg)
+			{
+				// anchored first segment fell off: no match possible
+				active[k--] = active[--nActive];
+			}
+		}
+	}
+
+	if(nLate != -1)
+	{
+		if(pMatchPatIndex)	*pMatchPatIndex	= nLate;
+		if(pMatchStart)		*pMatchStart	= 0;
+		if(pMatchLength)	*pMatchLength	= nLineLen;
+		return true;
+	}
+	return false;
+}
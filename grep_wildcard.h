@@ -0,0 +1,115 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// grep_wildcard.h - compiled set of simple wildcard (* and ?)
+// patterns, matched in one left-to-right pass over the line.
+//
+// Each pattern is split at the *'s into literal segments (in which
+// ? matches any one char). The segments are found greedily, left
+// to right, each one with a bit-parallel shift-and automaton (one
+// 64-bit word per 64 chars of segment), so there is no backtracking:
+// a line is scanned once no matter how many *'s the patterns have,
+// and all patterns advance together.
+//
+// The automata only run for the patterns a line can match. Each
+// pattern has a gram: up to GRAM_MAX chars of its longest run
+// without ?'s, which every line it matches contains. One pass over
+// the line looks up the grams of all the patterns in a hash table,
+// behind a bitmap of their first two chars, so a line none of them
+// is in costs that pass whatever the number of patterns.
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+#ifndef _grep_wildcard_inc_
+#define _grep_wildcard_inc_
+
+#include "grep.h"
+#include "grep_scratch.h"
+#include "grep_patterns.h"
+
+// Longest gram the prefilter looks up
+const long GRAM_MAX = 4;
+
+class grep_wildcard_set
+{
+public:
+	grep_wildcard_set();
+	~grep_wildcard_set();
+
+	void reset();
+	void init( const grep_pattern_list* patterns, bool caseSensitive, bool matchEntireLine );
+	// Returns true if any pattern matches the line. The reported
+	// pattern is the one whose match ends first. The scan state
+	// lives in pScratch.
+	bool match( LPCSTR pLine, long nLineLen, long* pMatchPatIndex,
+				long* pMatchStart, long* pMatchLength, grep_scratch* pScratch ) const;
+
+	// The compiled set as one flat block, for the compile cache.
+	// load() uses the block in place: it must outlive the set.
+	long saveSize() const;
+	void save(char* pOut) const;
+	bool load(const char* pData, long nLen);
+
+private:
+	// one literal segment (the text between *'s)
+	struct segment
+	{
+		long		nLen;		// length of the segment
+		long		nText;		// offset of the segment text in _text
+		long		nWords;		// 64-bit words per shift-and mask
+		long		nMasks;		// offset of its 256 masks in _masks
+	};
+	// one pattern
+	struct pattern
+	{
+		long		nFirstSeg;	// index of the first segment in _segs
+		long		nSegs;		// number of segments (0 for "", "*", "**"...)
+		long		nState;		// offset of its shift-and state in _state
+		long		nMinLen;	// sum of the segment lengths: no shorter
+								// line can match
+		bool		bAnchorStart;	// -x and no leading *
+		bool		bAnchorEnd;		// -x and no trailing *
+	};
+
+	bool		_bCaseSensitive;
+	bool		_bEntireLine;
+
+	pattern*	_pats;
+	long		_nPats;
+	segment*	_segs;
+	long		_nSegs;
+	ulonglong*	_masks;		// 256 masks per segment; mask[c*nWords + w]
+	char*		_text;		// segment texts, back to back
+	long		_nTextLen;
+	long		_nMaskWords;
+	long		_nStateWords;	// shift-and state words of all patterns
+	grep_arena	_mem;		// all of the above arrays
+
+	// the prefilter, built from the segments by init and load
+	struct gram_slot
+	{
+		ulonglong	uKey;		// length << 32 | the folded chars; 0 free
+		long		nFirst;		// the first pattern with the gram
+	};
+	gram_slot*	_grams;
+	long		_nGramMask;		// slots - 1, a power of 2 less 1
+	long*		_gramNext;		// per pattern: the next one with its gram
+	long*		_always;		// patterns with no gram, run on every line
+	long		_nAlways;
+	ulonglong*	_gramPairs;		// a bit per first two chars of grams of 2+
+	ulonglong	_gramBytes[4];	// a bit per char of grams of 1
+	long		_nGramLens;		// bit n set: there are grams of n chars
+	unsigned char _fold[256];	// chars as the grams have them
+
+private:
+	bool _charEq(char c, char p) const;
+	bool _segEq(const segment& seg, LPCSTR pAt, long nFrom) const;
+	void _addSegment(LPCSTR pText, long nLen, long nMasks);
+	void _buildFilter();
+	bool _checkLoaded() const;
+	long _findCandidates(const unsigned char* pc, long nLineLen, char* pCand) const;
+	long _markGram(ulonglong uKey, char* pCand) const;
+	static long _gramHash(ulonglong uKey);
+
+public:
+	void addStats(grep_alloc_stats* pStats) const	{ _mem.addStats(pStats); }
+};
+
+#endif	// _grep_wildcard_inc_
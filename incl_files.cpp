@@ -10,5 +10,4 @@
 #include <_boyer_moore_.cpp>
 #include <_wildcard_search_.cpp>
 #include <_soundex_.cpp>
-#include <_regex_.cpp>
 
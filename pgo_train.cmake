@@ -0,0 +1,49 @@
+#~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+# pgo_train.cmake - the pgo-train target (see CMakeLists.txt).
+# Runs the profiling build of grep over the corpus with the kinds
+# of searches it is used for, so the profiles weigh each engine and
+# the reading and output paths about as real use does. A search
+# finding nothing is not an error here.
+#~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+if(NOT CORPUS OR NOT IS_DIRECTORY "${CORPUS}")
+	message(FATAL_ERROR "GREP_PGO_CORPUS is not a directory: '${CORPUS}'")
+endif()
+
+set(sFiles "${CORPUS}/*")
+
+# one search per line: the options, then the pattern
+set(searches
+	"-R -c -F error"
+	"-R -c -F -i warning"
+	"-R -c -F -w id"
+	"-R -c -F -x }"
+	"-R -l -F TODO"
+	"-R -n -F return"
+	"-R -c -v -F e"
+	"-R -c ^[[:space:]]*#include"
+	"-R -c -E [0-9]{4}-[0-9]{2}-[0-9]{2}"
+	"-R -c -E -i (get|set)_[a-z]+"
+	"-R -c -E -w [A-Z][a-z]+[A-Z][a-z]+"
+	"-R -c -W *.h*"
+	"-R -c -P Robert"
+	"-R -c --fuzzy=1 recieve"
+	"-R -c --fuzzy=2 -w seperate"
+	"-R -c --threads=4 -F static"
+	"-R --stats -c -F -e for -e while -e if")
+
+foreach(sSearch IN LISTS searches)
+	message(STATUS "grep ${sSearch}")
+	separate_arguments(args UNIX_COMMAND "${sSearch}")
+	execute_process(COMMAND "${GREP}" ${args} "${sFiles}"
+					OUTPUT_QUIET ERROR_QUIET)
+endforeach()
+
+# Clang writes raw profiles that have to be merged
+if(NOT COMPILER STREQUAL "GNU")
+	if(NOT PROFDATA)
+		message(FATAL_ERROR "llvm-profdata is needed to merge the profiles")
+	endif()
+	file(GLOB raw "${PGO_DIR}/*.profraw")
+	execute_process(COMMAND "${PROFDATA}" merge -o "${PGO_DIR}/grep.profdata" ${raw})
+endif()